@@ -0,0 +1,35 @@
+#ifndef CANBITTIMING_H
+#define CANBITTIMING_H
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @brief Time a CAN or CAN FD frame occupies the bus.
+ *
+ * Counts every bit from start of frame through interframe space, with
+ * worst-case bit stuffing for classic frames and the fixed stuff bits of
+ * the FD CRC field. FD frames with bit rate switch send control, data and
+ * CRC at dataBitrate. Used both to generate load of a given bus utilization
+ * and to measure it.
+ *
+ * Deliberately free of Qt so the standalone tools can share it.
+ */
+inline double canFrameTimeUs(std::uint8_t length, bool extendedId, bool flexibleDataRate, bool bitrateSwitch,
+                             double bitrate, double dataBitrate)
+{
+    const double dataBits = 8.0 * length;
+    if (!flexibleDataRate) {
+        const double stuffable = (extendedId ? 54.0 : 34.0) + dataBits;
+        const double bits = stuffable + 13.0 + std::floor((stuffable - 1) / 4);
+        return bits * 1e6 / bitrate;
+    }
+
+    // Arbitration and end of frame at the nominal rate; control, data and
+    // CRC at the data rate if the bit rate is switched.
+    const double nominalBits = (extendedId ? 41.0 : 21.0) + 10.0;
+    const double dataPhaseBits = (8.0 + dataBits + (length > 16 ? 26.0 : 22.0) + 2.0) * 1.2;
+    return nominalBits * 1e6 / bitrate + dataPhaseBits * 1e6 / (bitrateSwitch ? dataBitrate : bitrate);
+}
+
+#endif // CANBITTIMING_H
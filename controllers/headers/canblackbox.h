@@ -0,0 +1,84 @@
+#ifndef CANBLACKBOX_H
+#define CANBLACKBOX_H
+
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "canblackboxring.h"
+#include "canframe.h"
+
+class QThread;
+
+/**
+ * @brief Always-on flight recorder for CAN traffic.
+ *
+ * Appends every frame it is given to a fixed-size, memory-mapped circular
+ * file (see CanBlackBoxRing for the layout). Recording is a store into the
+ * mapping, with no syscall and no allocation, so it can stay on in production.
+ * A background thread msync()s the mapping every FlushIntervalMs, which
+ * bounds what a power loss can take; a process crash loses nothing because
+ * the data already lives in the page cache.
+ *
+ * Records carry wall-clock time, so captures stay meaningful across reboots
+ * and can be exported with tools/canbb2candump.
+ *
+ * record() must only be called from one thread.
+ */
+class CanBlackBox
+{
+public:
+    static constexpr qint64 DefaultFileSize = 64 * 1024 * 1024;
+    static constexpr qint64 MinimumFileSize = 64 * 1024;
+    static constexpr int FlushIntervalMs = 1000;
+
+    CanBlackBox();
+    ~CanBlackBox();
+
+    CanBlackBox(const CanBlackBox &) = delete;
+    CanBlackBox &operator=(const CanBlackBox &) = delete;
+
+    // Opens or creates the recorder file. An existing recording of the same
+    // size is continued; anything else is reformatted.
+    bool open(const QString &path, qint64 fileSize = DefaultFileSize);
+    void close();
+    bool isOpen() const;
+    QString path() const;
+    QString errorString() const;
+    quint32 recordCount() const;
+
+    void record(const CanFrame &frame)
+    {
+        m_ring.append(frame.timestampUs + m_realtimeOffsetUs, frame.frameId, frame.flags, frame.bus,
+                      frame.payload, frame.length);
+    }
+
+    void record(const QVector<CanFrame> &frames)
+    {
+        for (const CanFrame &frame : frames) {
+            record(frame);
+        }
+    }
+
+    // Synchronously writes the mapping back to disk.
+    void flush();
+
+private:
+    void flushLoop();
+
+    QFile m_file;
+    uchar *m_mapping;
+    qint64 m_mappingSize;
+    CanBlackBoxRing m_ring;
+    qint64 m_realtimeOffsetUs; // monotonic frame time -> Unix time
+    QString m_errorString;
+
+    QThread *m_flushThread;
+    QMutex m_flushMutex;
+    QWaitCondition m_flushWake;
+    bool m_stopFlushing;
+};
+
+#endif // CANBLACKBOX_H
@@ -0,0 +1,254 @@
+#ifndef CANBLACKBOXRING_H
+#define CANBLACKBOXRING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief On-disk layout of the CAN black-box recorder.
+ *
+ * A recorder file is one FileHeader page followed by a circular data area of
+ * variable-size records, each a RecordHeader plus the payload rounded up to
+ * 8 bytes (32 bytes for a classic frame, 88 for a 64-byte FD frame). A record
+ * that does not fit before the end of the area leaves a wrap marker and
+ * starts again at offset 0; the oldest records are evicted as the head runs
+ * into them.
+ *
+ * Head, tail and sequence numbers live in the header itself and are updated
+ * after every record, so a process crash loses nothing: the page cache holds
+ * a consistent ring. Every record carries a sequence number, letting
+ * attach() cut the ring back to the last intact record after a power loss
+ * tore pages that had not been flushed. Only what was flushed is
+ * guaranteed; later records are best effort.
+ *
+ * Deliberately free of Qt so the offline export tool can share it.
+ */
+namespace CanBlackBoxFormat {
+
+constexpr char Magic[8] = {'V', 'S', 'C', 'A', 'N', 'B', 'B', '1'};
+constexpr std::uint32_t Version = 1;
+constexpr std::uint64_t HeaderSize = 4096;
+constexpr std::uint8_t WrapMarker = 0xFF;
+constexpr std::uint8_t MaxPayloadSize = 64;
+
+struct FileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t dataSize;      // bytes in the circular area after the header page
+    std::uint64_t head;          // offset where the next record goes
+    std::uint64_t tail;          // offset of the oldest record
+    std::uint32_t headSequence;  // sequence number the next record gets
+    std::uint32_t tailSequence;  // sequence number of the record at tail
+};
+
+struct RecordHeader
+{
+    std::int64_t unixTimeUs;
+    std::uint32_t sequence;
+    std::uint32_t frameId;
+    std::uint8_t flags;          // CanFrame::Flag
+    std::uint8_t length;         // payload bytes, or WrapMarker
+    std::uint8_t bus;
+    std::uint8_t reserved[5];
+};
+
+static_assert(sizeof(RecordHeader) == 24, "record header layout changed");
+
+inline std::uint64_t recordSize(std::uint8_t length)
+{
+    return sizeof(RecordHeader) + ((length + 7u) & ~std::uint64_t(7));
+}
+
+} // namespace CanBlackBoxFormat
+
+class CanBlackBoxRing
+{
+public:
+    using FileHeader = CanBlackBoxFormat::FileHeader;
+    using RecordHeader = CanBlackBoxFormat::RecordHeader;
+
+    CanBlackBoxRing()
+        : m_header(nullptr)
+        , m_data(nullptr)
+    {
+    }
+
+    // Initialises an empty ring over a mapping of fileSize bytes.
+    void format(void *base, std::uint64_t fileSize)
+    {
+        m_header = static_cast<FileHeader *>(base);
+        m_data = static_cast<std::uint8_t *>(base) + CanBlackBoxFormat::HeaderSize;
+        std::memset(m_header, 0, sizeof(FileHeader));
+        std::memcpy(m_header->magic, CanBlackBoxFormat::Magic, sizeof(m_header->magic));
+        m_header->version = CanBlackBoxFormat::Version;
+        m_header->dataSize = (fileSize - CanBlackBoxFormat::HeaderSize) & ~std::uint64_t(7);
+    }
+
+    // Attaches to an existing ring, trimming it to its last intact record.
+    // Returns false when the mapping does not hold a ring of this size.
+    bool attach(void *base, std::uint64_t fileSize)
+    {
+        m_header = static_cast<FileHeader *>(base);
+        m_data = static_cast<std::uint8_t *>(base) + CanBlackBoxFormat::HeaderSize;
+
+        FileHeader &h = *m_header;
+        if (std::memcmp(h.magic, CanBlackBoxFormat::Magic, sizeof(h.magic)) != 0
+            || h.version != CanBlackBoxFormat::Version
+            || h.dataSize != ((fileSize - CanBlackBoxFormat::HeaderSize) & ~std::uint64_t(7))
+            || h.head > h.dataSize || h.tail > h.dataSize) {
+            m_header = nullptr;
+            m_data = nullptr;
+            return false;
+        }
+
+        std::uint64_t end;
+        std::uint32_t endSequence;
+        walk(h.tail, h.tailSequence, end, endSequence);
+        if (end != h.head || endSequence != h.headSequence) {
+            // Torn by a power loss. If nothing survives from the tail on,
+            // fall back to the newest lap, which always starts at offset 0.
+            if (endSequence == h.tailSequence && h.headSequence != h.tailSequence) {
+                const RecordHeader *first = recordAt(0);
+                if (first && first->length <= CanBlackBoxFormat::MaxPayloadSize) {
+                    h.tail = 0;
+                    h.tailSequence = first->sequence;
+                    walk(0, first->sequence, end, endSequence);
+                }
+            }
+            h.head = end;
+            h.headSequence = endSequence;
+        }
+        return true;
+    }
+
+    bool isAttached() const
+    {
+        return m_header != nullptr;
+    }
+
+    // The recording hot path: one header store and one payload memcpy, plus
+    // occasional tail eviction.
+    void append(std::int64_t unixTimeUs, std::uint32_t frameId, std::uint8_t flags, std::uint8_t bus,
+                const std::uint8_t *payload, std::uint8_t length)
+    {
+        FileHeader &h = *m_header;
+        if (length > CanBlackBoxFormat::MaxPayloadSize) {
+            length = CanBlackBoxFormat::MaxPayloadSize;
+        }
+
+        const std::uint64_t size = CanBlackBoxFormat::recordSize(length);
+        std::uint64_t head = h.head;
+        if (head + size > h.dataSize) {
+            evict(head, h.dataSize);
+            if (h.dataSize - head >= sizeof(RecordHeader)) {
+                RecordHeader *marker = reinterpret_cast<RecordHeader *>(m_data + head);
+                marker->length = CanBlackBoxFormat::WrapMarker;
+            }
+            head = 0;
+        }
+        evict(head, head + size);
+
+        RecordHeader *record = reinterpret_cast<RecordHeader *>(m_data + head);
+        record->unixTimeUs = unixTimeUs;
+        record->sequence = h.headSequence;
+        record->frameId = frameId;
+        record->flags = flags;
+        record->length = length;
+        record->bus = bus;
+        std::memcpy(m_data + head + sizeof(RecordHeader), payload, length);
+
+        h.head = head + size;
+        ++h.headSequence;
+    }
+
+    std::uint32_t recordCount() const
+    {
+        return m_header ? m_header->headSequence - m_header->tailSequence : 0;
+    }
+
+    // Calls visit(const RecordHeader &, const std::uint8_t *payload) for every
+    // record from oldest to newest.
+    template <typename Visitor>
+    void forEach(Visitor &&visit) const
+    {
+        if (!m_header) {
+            return;
+        }
+        std::uint64_t offset = m_header->tail;
+        for (std::uint32_t remaining = recordCount(); remaining > 0;) {
+            const RecordHeader *record = recordAt(offset);
+            if (!record) {
+                offset = 0;
+                continue;
+            }
+            visit(*record, m_data + offset + sizeof(RecordHeader));
+            offset += CanBlackBoxFormat::recordSize(record->length);
+            --remaining;
+        }
+    }
+
+private:
+    // Record at offset, or nullptr where the writer wrapped to offset 0.
+    const RecordHeader *recordAt(std::uint64_t offset) const
+    {
+        if (m_header->dataSize - offset < sizeof(RecordHeader)) {
+            return nullptr;
+        }
+        const RecordHeader *record = reinterpret_cast<const RecordHeader *>(m_data + offset);
+        return record->length == CanBlackBoxFormat::WrapMarker ? nullptr : record;
+    }
+
+    // Drops the oldest records until none starts inside [begin, end).
+    void evict(std::uint64_t begin, std::uint64_t end)
+    {
+        FileHeader &h = *m_header;
+        while (h.tailSequence != h.headSequence && h.tail >= begin && h.tail < end) {
+            const RecordHeader *record = recordAt(h.tail);
+            if (!record) {
+                h.tail = 0;
+                continue;
+            }
+            h.tail += CanBlackBoxFormat::recordSize(record->length);
+            ++h.tailSequence;
+            // Keep the tail on a real record so the next window sees it.
+            if (h.tailSequence != h.headSequence && !recordAt(h.tail)) {
+                h.tail = 0;
+            }
+        }
+    }
+
+    // Follows the record chain from offset while sequence numbers and sizes
+    // stay consistent; stops at the header's head or the first bad record.
+    void walk(std::uint64_t offset, std::uint32_t sequence, std::uint64_t &end, std::uint32_t &endSequence) const
+    {
+        const FileHeader &h = *m_header;
+        std::uint64_t budget = h.dataSize / sizeof(RecordHeader) + 2;
+        while (budget-- > 0 && !(offset == h.head && sequence == h.headSequence)) {
+            const RecordHeader *record = recordAt(offset);
+            if (!record) {
+                if (offset == 0) {
+                    break;
+                }
+                offset = 0;
+                continue;
+            }
+            const std::uint64_t size = CanBlackBoxFormat::recordSize(record->length);
+            if (record->sequence != sequence || record->length > CanBlackBoxFormat::MaxPayloadSize
+                || offset + size > h.dataSize) {
+                break;
+            }
+            offset += size;
+            ++sequence;
+        }
+        end = offset;
+        endSequence = sequence;
+    }
+
+    FileHeader *m_header;
+    std::uint8_t *m_data;
+};
+
+#endif // CANBLACKBOXRING_H
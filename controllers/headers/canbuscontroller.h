@@ -1,20 +1,45 @@
 #ifndef CANBUSCONTROLLER_H
 #define CANBUSCONTROLLER_H
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QTimer>
 #include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QVariantList>
+#include <QVector>
+
+#include "canblackbox.h"
+#include "canframe.h"
+#include "cantrafficstats.h"
+#include "realtimeprofile.h"
 
 #ifdef HAVE_QT_SERIALBUS
 #include <QCanBusDevice>
 #include <QCanBusFrame>
 #endif
 
+class CanBusMerger;
+class CanReceiveWorker;
+
 class CanBusController : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(bool connected READ connected NOTIFY connectedChanged)
     Q_PROPERTY(QString status READ status NOTIFY statusChanged)
+    Q_PROPERTY(QString backend READ backend WRITE setBackend NOTIFY backendChanged)
+    Q_PROPERTY(QStringList interfaces READ interfaces WRITE setInterfaces NOTIFY interfacesChanged)
+    Q_PROPERTY(QString replayFile READ replayFile WRITE setReplayFile NOTIFY replayFileChanged)
+    Q_PROPERTY(double replaySpeed READ replaySpeed WRITE setReplaySpeed NOTIFY replaySpeedChanged)
+    Q_PROPERTY(QString generatorProfile READ generatorProfile WRITE setGeneratorProfile NOTIFY generatorProfileChanged)
+    Q_PROPERTY(int ringHighWaterMark READ ringHighWaterMark NOTIFY ingestStatsChanged)
+    Q_PROPERTY(qint64 droppedFrames READ droppedFrames NOTIFY ingestStatsChanged)
+    Q_PROPERTY(bool recording READ recording NOTIFY recordingChanged)
+    Q_PROPERTY(QVariantList trafficStatistics READ trafficStatistics NOTIFY trafficStatisticsChanged)
+    Q_PROPERTY(double busUtilization READ busUtilization NOTIFY trafficStatisticsChanged)
+    Q_PROPERTY(qint64 errorFrames READ errorFrames NOTIFY trafficStatisticsChanged)
+    Q_PROPERTY(qint64 unknownFrames READ unknownFrames NOTIFY trafficStatisticsChanged)
 
 public:
     explicit CanBusController(QObject *parent = nullptr);
@@ -22,36 +47,140 @@ public:
 
     bool connected() const;
     QString status() const;
+    QString backend() const;
+    QStringList interfaces() const;
+    QString replayFile() const;
+    double replaySpeed() const;
+    QString generatorProfile() const;
+    int ringHighWaterMark() const;
+    qint64 droppedFrames() const;
+    bool recording() const;
+
+    // One entry per interface, in bus order: interface, connected, frames,
+    // dropped, ringHighWaterMark, errorFrames, frameRate and utilization.
+    Q_INVOKABLE QVariantList busStatistics() const;
+
+    // Traffic statistics, refreshed every StatisticsIntervalMs. The QML list
+    // has one entry per ID: bus, frameId, extended, fd, unknown, frames,
+    // frameRate, minGapUs, avgGapUs, maxGapUs, length, lastPayload (hex) and
+    // dlcHistogram.
+    static constexpr int StatisticsIntervalMs = 1000;
+    QVariantList trafficStatistics() const;
+    // Highest utilization of any bus over the last interval, 0..1.
+    double busUtilization() const;
+    qint64 errorFrames() const;
+    qint64 unknownFrames() const;
+    const CanTrafficStats::Snapshot &trafficSnapshot() const;
+    // Live table, for the decoder to count unknown IDs in. Decode thread only.
+    CanTrafficStats *trafficStats();
+    // Bit rates used to compute bus utilization; 500 kbit/s and 2 Mbit/s
+    // FD data phase unless set.
+    Q_INVOKABLE void setBusBitrate(int bus, double bitrate, double dataBitrate = CanTrafficStats::DefaultDataBitrate);
+
+    // Black-box recorder. Frames are recorded as they are published and
+    // sent; replayed captures are not recorded again.
+    bool startRecorder(const QString &path, qint64 fileSize = CanBlackBox::DefaultFileSize);
+    void stopRecorder();
+    static QString defaultRecorderPath();
+
+    // Real-time profile of the CAN path: the ingest threads get its
+    // priority, the merge thread and the thread this controller lives on,
+    // which decodes, one below. Applied and reported on each thread from its
+    // own event loop, to ingest threads created later as well.
+    void setRealtimeProfile(const RealtimeProfile &profile);
+
+    // Receive backends selectable through the backend property. Takes effect
+    // on the next connect.
+    static const QString QtSerialBusBackend;   // QtSerialBus "socketcan" plugin
+    static const QString NativeSocketCanBackend; // raw AF_CAN socket, recvmmsg + kernel timestamps
+    static const QString ReplayBackend;          // candump .log / Vector .asc capture from replayFile
+    static const QString GeneratorBackend;       // synthetic load described by generatorProfile
 
 public slots:
+    void setBackend(const QString &backend);
+    // Interfaces opened on the next connect. Frames are tagged with the
+    // index of the interface they arrived on (CanFrame::bus).
+    void setInterfaces(const QStringList &interfaces);
+    void setReplayFile(const QString &path);
+    // 1.0 = real time, N = N times faster, 0 = as fast as frames can be
+    // decoded. Paces the generator backend too.
+    void setReplaySpeed(double speed);
+    // CanLoadProfile spec, e.g. "messages=4000,fd=0.25,load=0.8,seed=7";
+    // rejected if it does not parse.
+    void setGeneratorProfile(const QString &profile);
     void connectToSimulator();
     void disconnectFromSimulator();
-    void sendFrame(quint32 frameId, const QByteArray &data);
+    // IDs above 0x7FF are always sent extended
+    void sendFrame(quint32 frameId, const QByteArray &data, int bus = 0, bool extended = false);
+    // One tick of the built-in simulation, as its timer runs it
+    void simulateVehicleData();
 
 signals:
     void connectedChanged(bool connected);
     void statusChanged(const QString &status);
+    void backendChanged(const QString &backend);
+    void interfacesChanged(const QStringList &interfaces);
+    void replayFileChanged(const QString &path);
+    void replaySpeedChanged(double speed);
+    void generatorProfileChanged(const QString &profile);
+    // Legacy per-frame signal; allocates a QByteArray per frame and is only
+    // emitted while something is connected to it.
     void frameReceived(quint32 frameId, const QByteArray &data);
+    // Allocation-free batch path used by VehicleDataController.
+    void frameBatchReceived(const QVector<CanFrame> &frames);
+    void ingestStatsChanged();
+    void recordingChanged(bool recording);
+    void trafficStatisticsChanged();
     void errorOccurred(const QString &error);
 
 private slots:
-#ifdef HAVE_QT_SERIALBUS
-    void handleFramesReceived();
-    void handleErrorOccurred(QCanBusDevice::CanBusError error);
-    void handleStateChanged(QCanBusDevice::CanBusDeviceState state);
-#endif
-    void simulateVehicleData();
+    void drainReceivedFrames();
+    void handleErrorOccurred(const QString &error);
+    void handleReplayFinished(qint64 frames, qint64 malformedLines);
+    void updateTrafficStatistics();
 
 private:
     void setupSimulatedData();
-    void connectToBus(const QString &interface);
-    
+    void connectToBuses();
+    void closeDevice();
+    void ensureReceiveWorkers(int count);
+    void applyRealtimeProfile(QObject *threadContext, int priorityOffset) const;
+    void updateBusStatus();
 #ifdef HAVE_QT_SERIALBUS
-    QCanBusDevice *m_canDevice;
+    void handleStateChanged(int bus, QCanBusDevice::CanBusDeviceState state);
 #endif
+    void publishFrames(const QVector<CanFrame> &frames);
+
+    // One reader per bus, each on its own ingest thread, merged by
+    // timestamp on the merge thread. m_busOpen/m_busConnected are indexed
+    // like m_receiveWorkers.
+    QVector<QThread *> m_ingestThreads;
+    QVector<CanReceiveWorker *> m_receiveWorkers;
+    QVector<bool> m_busOpen;
+    QVector<bool> m_busConnected;
+    QThread m_mergeThread;
+    CanBusMerger *m_merger;
+    QStringList m_interfaces;
+    RealtimeProfile m_realtimeProfile;
+    bool m_deviceOpen;
+    QVector<CanFrame> m_frameBatch;
+    QVector<CanFrame> m_simulatedFrames;
+    int m_ringHighWaterMark;
+    qint64 m_droppedFrames;
     QTimer *m_simulationTimer;
     bool m_connected;
     QString m_status;
+    QString m_backend;
+    QString m_replayFile;
+    double m_replaySpeed;
+    QString m_generatorProfile;
+    QElapsedTimer m_replayClock;
+    bool m_replaying;
+    CanBlackBox m_blackBox;
+    CanTrafficStats m_trafficStats;
+    CanTrafficStats::Snapshot m_trafficSnapshot;
+    QTimer *m_statisticsTimer;
+    qint64 m_errorFrames;
     
     // Simulated vehicle data counters
     int m_speed;
@@ -0,0 +1,80 @@
+#ifndef CANBUSMERGER_H
+#define CANBUSMERGER_H
+
+#include <QObject>
+#include <QVector>
+
+#include <atomic>
+
+#include "canframe.h"
+#include "spscringbuffer.h"
+
+class CanReceiveWorker;
+class QTimer;
+
+/**
+ * @brief Merges the ingest rings of several CAN buses into one stream
+ * ordered by timestamp.
+ *
+ * Runs on its own thread between the per-bus CanReceiveWorkers and the
+ * consumer. Every bus is already in timestamp order, so the merge is a
+ * k-way pick of the oldest head frame. A frame is released once every
+ * other bus has delivered something at least as new, which proves nothing
+ * older can still arrive from it. Otherwise it is released once it is
+ * MergeWindowUs old, so an idle bus only delays the others by that window.
+ * With a single source frames pass straight through.
+ *
+ * A frame that still arrives older than one already released goes out
+ * immediately and is counted in lateFrames().
+ */
+class CanBusMerger : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr std::size_t RingCapacity = 8192;
+    static constexpr qint64 MergeWindowUs = 2000;
+    using FrameRing = SpscRingBuffer<CanFrame, RingCapacity>;
+
+    explicit CanBusMerger(QObject *parent = nullptr);
+
+    // Consumer side, callable from any single consumer thread.
+    std::size_t drain(CanFrame *out, std::size_t maxFrames);
+    std::size_t ringHighWaterMark() const;
+    std::size_t droppedFrames() const;
+    qint64 lateFrames() const;
+    // Frames collected from the sources but not released yet. Merge
+    // thread only.
+    int queuedFrames() const;
+
+public slots:
+    // Must run on the merge thread. Frames still queued from the previous
+    // sources are discarded.
+    void setSources(const QVector<CanReceiveWorker *> &sources);
+    void mergePending();
+
+signals:
+    void framesPending();
+
+private:
+    struct BusQueue
+    {
+        CanReceiveWorker *source;
+        QVector<CanFrame> frames;
+        int head;
+        qint64 newestTimestampUs;
+    };
+
+    // Returns false when the queue filled up before the source ran dry.
+    bool collect(BusQueue &queue);
+    void notifyConsumer();
+
+    QVector<BusQueue> m_queues;
+    QTimer *m_releaseTimer;
+    qint64 m_lastReleasedUs;
+    std::atomic<qint64> m_lateFrames;
+    FrameRing m_ring;
+    std::atomic<bool> m_drainPending;
+};
+
+#endif // CANBUSMERGER_H
@@ -0,0 +1,88 @@
+#ifndef CANFRAME_H
+#define CANFRAME_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QVector>
+
+#include <chrono>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief Fixed-size, allocation-free CAN / CAN FD frame.
+ *
+ * This is the frame type carried end-to-end from the receive backends
+ * through the ingest ring into VehicleDataController. The payload lives
+ * inline, so frames can be copied, queued and batched without touching the
+ * heap.
+ *
+ * Timestamps are microseconds on the monotonic clock returned by
+ * canMonotonicMicros(), so frames from every source can be ordered and
+ * differenced regardless of wall-clock adjustments. timestampUs is when
+ * the frame arrived, or for a replay when it was released; replayed
+ * frames also carry the capture's own time in sourceTimestampUs.
+ */
+struct CanFrame
+{
+    enum Flag : quint8 {
+        ExtendedId = 0x01,
+        FlexibleDataRate = 0x02,
+        BitrateSwitch = 0x04,
+        Transmitted = 0x08
+    };
+
+    static constexpr int MaxPayloadSize = 64;
+
+    quint32 frameId;
+    quint8 flags;
+    quint8 length;      // payload length in bytes (0..8 classic, 0..64 FD)
+    quint8 bus;         // index of the interface the frame was seen on
+    quint8 reserved;
+    qint64 timestampUs;
+    qint64 sourceTimestampUs;   // capture time rebased onto replay start, 0 if the same as timestampUs
+    quint8 payload[MaxPayloadSize];
+
+    static CanFrame make(quint32 frameId, int length, qint64 timestampUs)
+    {
+        CanFrame frame;
+        std::memset(&frame, 0, sizeof(frame));
+        frame.frameId = frameId;
+        frame.length = static_cast<quint8>(length > MaxPayloadSize ? MaxPayloadSize : length);
+        frame.timestampUs = timestampUs;
+        if (frame.length > 8) {
+            frame.flags |= FlexibleDataRate;
+        }
+        return frame;
+    }
+
+    static CanFrame fromBytes(quint32 frameId, const char *data, int size, qint64 timestampUs)
+    {
+        CanFrame frame = make(frameId, size, timestampUs);
+        std::memcpy(frame.payload, data, frame.length);
+        return frame;
+    }
+
+    // Time the vehicle saw the frame at, for integrating over it
+    qint64 sourceTimeUs() const { return sourceTimestampUs ? sourceTimestampUs : timestampUs; }
+
+    // Compatibility helper for QByteArray-based consumers; allocates.
+    QByteArray payloadBytes() const
+    {
+        return QByteArray(reinterpret_cast<const char *>(payload), length);
+    }
+};
+
+static_assert(std::is_trivially_copyable<CanFrame>::value, "CanFrame must stay POD");
+static_assert(sizeof(CanFrame) == 88, "CanFrame layout changed");
+
+Q_DECLARE_TYPEINFO(CanFrame, Q_PRIMITIVE_TYPE);
+Q_DECLARE_METATYPE(CanFrame)
+
+inline qint64 canMonotonicMicros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // CANFRAME_H
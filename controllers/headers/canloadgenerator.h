@@ -0,0 +1,322 @@
+#ifndef CANLOADGENERATOR_H
+#define CANLOADGENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "canbittiming.h"
+
+/**
+ * @brief Configuration of a synthetic CAN load.
+ *
+ * Written as a comma-separated key=value list, e.g.
+ * "messages=4000,fd=0.25,load=0.8,seed=7":
+ *
+ *   messages        distinct IDs, allocated upwards from first-id; IDs past
+ *                   0x7FF are sent as extended IDs (default 2000)
+ *   first-id        first ID, decimal or 0x hex (default 0x100, so the IDs of
+ *                   the built-in vehicle DBC are part of the load)
+ *   min-period-ms   shortest per-ID period (default 1)
+ *   max-period-ms   longest per-ID period; periods are drawn log-uniformly
+ *                   between the two (default 1000)
+ *   fd              fraction of IDs sent as CAN FD with 12..64 byte
+ *                   payloads and bit rate switch (default 0)
+ *   load            if > 0, periods are scaled so the estimated bus load at
+ *                   bitrate/data-bitrate is this fraction (1 = saturated)
+ *   bitrate         nominal bit rate in bit/s (default 500000)
+ *   data-bitrate    CAN FD data phase bit rate in bit/s (default 2000000)
+ *   seed            seeds IDs' periods, lengths, phases and payloads; the
+ *                   same profile always yields the same frame sequence
+ *                   (default 1)
+ *   duration-s      stop after this much generated time; 0 runs forever
+ */
+struct CanLoadProfile
+{
+    int messageCount = 2000;
+    std::uint32_t firstId = 0x100;
+    double minPeriodMs = 1.0;
+    double maxPeriodMs = 1000.0;
+    double fdRatio = 0.0;
+    double busLoad = 0.0;
+    double bitrate = 500000.0;
+    double dataBitrate = 2000000.0;
+    std::uint64_t seed = 1;
+    double durationS = 0.0;
+
+    // Parses spec on top of the defaults. On failure returns false and
+    // names the offending entry in error.
+    bool parse(const std::string &spec, std::string *error = nullptr)
+    {
+        std::size_t start = 0;
+        while (start < spec.size()) {
+            std::size_t end = spec.find(',', start);
+            if (end == std::string::npos) {
+                end = spec.size();
+            }
+            const std::string entry = spec.substr(start, end - start);
+            start = end + 1;
+            if (entry.empty()) {
+                continue;
+            }
+            if (!parseEntry(entry)) {
+                if (error) {
+                    *error = "bad load profile entry '" + entry + "'";
+                }
+                return false;
+            }
+        }
+        if (messageCount < 1 || minPeriodMs <= 0 || maxPeriodMs < minPeriodMs || fdRatio < 0 || fdRatio > 1
+            || busLoad < 0 || bitrate <= 0 || dataBitrate <= 0 || durationS < 0
+            || firstId + static_cast<std::uint64_t>(messageCount) - 1 > 0x1FFFFFFFu) {
+            if (error) {
+                *error = "load profile out of range";
+            }
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool parseEntry(const std::string &entry)
+    {
+        const std::size_t separator = entry.find('=');
+        if (separator == std::string::npos) {
+            return false;
+        }
+        const std::string key = entry.substr(0, separator);
+        const char *value = entry.c_str() + separator + 1;
+        char *end = nullptr;
+
+        if (key == "messages") {
+            messageCount = static_cast<int>(std::strtol(value, &end, 10));
+        } else if (key == "first-id") {
+            firstId = static_cast<std::uint32_t>(std::strtoul(value, &end, 0));
+        } else if (key == "seed") {
+            seed = std::strtoull(value, &end, 0);
+        } else {
+            const double number = std::strtod(value, &end);
+            if (key == "min-period-ms") {
+                minPeriodMs = number;
+            } else if (key == "max-period-ms") {
+                maxPeriodMs = number;
+            } else if (key == "fd") {
+                fdRatio = number;
+            } else if (key == "load") {
+                busLoad = number;
+            } else if (key == "bitrate") {
+                bitrate = number;
+            } else if (key == "data-bitrate") {
+                dataBitrate = number;
+            } else if (key == "duration-s") {
+                durationS = number;
+            } else {
+                return false;
+            }
+        }
+        return end != value && *end == '\0';
+    }
+};
+
+/**
+ * @brief Deterministic periodic CAN traffic for stress tests.
+ *
+ * Models a bus with CanLoadProfile::messageCount periodic messages, each
+ * with its own period, phase, length and frame type, and yields their frames
+ * in transmission order. Timestamps are microseconds from the start of the
+ * schedule; the caller decides whether to pace them in real time or run
+ * flat out. A min-heap keyed on the next due time keeps next() at
+ * O(log messages) and allocation-free.
+ *
+ * Payloads start with a little-endian sequence counter and are otherwise
+ * pseudo-random, so every frame differs from its predecessor and decoded
+ * signals keep changing.
+ *
+ * Deliberately free of Qt so the standalone tools/canloadgen can share it.
+ */
+class CanLoadGenerator
+{
+public:
+    // Mirrors CanFrame::Flag.
+    static constexpr std::uint8_t ExtendedIdFlag = 0x01;
+    static constexpr std::uint8_t FlexibleDataRateFlag = 0x02;
+    static constexpr std::uint8_t BitrateSwitchFlag = 0x04;
+
+    explicit CanLoadGenerator(const CanLoadProfile &profile = CanLoadProfile())
+        : m_profile(profile)
+        , m_frames(0)
+        , m_estimatedLoad(0)
+    {
+        reset();
+    }
+
+    const CanLoadProfile &profile() const { return m_profile; }
+    std::uint64_t generatedFrames() const { return m_frames; }
+    // Bus load the schedule produces at the profile's bit rates (1 = saturated).
+    double estimatedBusLoad() const { return m_estimatedLoad; }
+    double framesPerSecond() const
+    {
+        double rate = 0;
+        for (const Message &message : m_messages) {
+            rate += 1e6 / static_cast<double>(message.periodUs);
+        }
+        return rate;
+    }
+
+    // Restarts the schedule; the frame sequence repeats exactly.
+    void reset()
+    {
+        std::uint64_t state = m_profile.seed;
+        const double logMin = std::log(m_profile.minPeriodMs * 1000.0);
+        const double logMax = std::log(m_profile.maxPeriodMs * 1000.0);
+        static const std::uint8_t fdLengths[] = {12, 16, 20, 24, 32, 48, 64};
+
+        m_messages.assign(static_cast<std::size_t>(m_profile.messageCount), Message());
+        double busyUsPerSecond = 0;
+        for (std::size_t i = 0; i < m_messages.size(); ++i) {
+            Message &message = m_messages[i];
+            message.frameId = m_profile.firstId + static_cast<std::uint32_t>(i);
+            message.flags = message.frameId > 0x7FF ? ExtendedIdFlag : 0;
+            if (unitInterval(state) < m_profile.fdRatio) {
+                message.flags |= FlexibleDataRateFlag | BitrateSwitchFlag;
+                message.length = fdLengths[splitMix(state) % (sizeof(fdLengths) / sizeof(fdLengths[0]))];
+            } else {
+                message.length = static_cast<std::uint8_t>(1 + splitMix(state) % 8);
+            }
+            message.periodUs = static_cast<std::int64_t>(std::exp(logMin + (logMax - logMin) * unitInterval(state)));
+            message.periodUs = std::max<std::int64_t>(message.periodUs, 1);
+            message.sequence = 0;
+            message.payloadState = splitMix(state) | 1;
+            busyUsPerSecond += frameTimeUs(message) * 1e6 / static_cast<double>(message.periodUs);
+        }
+
+        m_estimatedLoad = busyUsPerSecond / 1e6;
+        if (m_profile.busLoad > 0 && m_estimatedLoad > 0) {
+            const double scale = m_estimatedLoad / m_profile.busLoad;
+            for (Message &message : m_messages) {
+                message.periodUs = std::max<std::int64_t>(
+                    1, static_cast<std::int64_t>(std::llround(static_cast<double>(message.periodUs) * scale)));
+            }
+            m_estimatedLoad = 0;
+            for (const Message &message : m_messages) {
+                m_estimatedLoad += frameTimeUs(message) / static_cast<double>(message.periodUs);
+            }
+        }
+
+        // Random phases spread each ID's first frame over its period.
+        m_schedule.clear();
+        m_schedule.reserve(m_messages.size());
+        for (std::size_t i = 0; i < m_messages.size(); ++i) {
+            const std::int64_t phaseUs = static_cast<std::int64_t>(splitMix(state) % static_cast<std::uint64_t>(m_messages[i].periodUs));
+            m_schedule.push_back(Due{phaseUs, static_cast<std::uint32_t>(i)});
+        }
+        std::make_heap(m_schedule.begin(), m_schedule.end(), Later());
+        m_frames = 0;
+    }
+
+    // Fills the next frame in transmission order. Frame needs frameId,
+    // flags, length, timestampUs and a payload of at least 64 bytes, as
+    // CanFrame has. Returns false once the profile's duration has passed.
+    template<typename Frame>
+    bool next(Frame &frame)
+    {
+        std::pop_heap(m_schedule.begin(), m_schedule.end(), Later());
+        Due &due = m_schedule.back();
+        if (m_profile.durationS > 0 && due.timeUs >= static_cast<std::int64_t>(m_profile.durationS * 1e6)) {
+            std::push_heap(m_schedule.begin(), m_schedule.end(), Later());
+            return false;
+        }
+
+        Message &message = m_messages[due.message];
+        frame.frameId = message.frameId;
+        frame.flags = message.flags;
+        frame.length = message.length;
+        frame.timestampUs = due.timeUs;
+        fillPayload(message, frame.payload);
+
+        due.timeUs += message.periodUs;
+        std::push_heap(m_schedule.begin(), m_schedule.end(), Later());
+        ++m_frames;
+        return true;
+    }
+
+private:
+    struct Message
+    {
+        std::uint32_t frameId;
+        std::uint8_t flags;
+        std::uint8_t length;
+        std::int64_t periodUs;
+        std::uint32_t sequence;
+        std::uint64_t payloadState;
+    };
+
+    struct Due
+    {
+        std::int64_t timeUs;
+        std::uint32_t message;
+    };
+
+    // Heap order: earliest first, ties broken by message index so the
+    // sequence never depends on the heap implementation.
+    struct Later
+    {
+        bool operator()(const Due &a, const Due &b) const
+        {
+            return a.timeUs != b.timeUs ? a.timeUs > b.timeUs : a.message > b.message;
+        }
+    };
+
+    static std::uint64_t splitMix(std::uint64_t &state)
+    {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    static double unitInterval(std::uint64_t &state)
+    {
+        return static_cast<double>(splitMix(state) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    static void fillPayload(Message &message, std::uint8_t *payload)
+    {
+        const std::uint32_t sequence = message.sequence++;
+        std::uint8_t bytes[64];
+        for (int i = 0; i < 64; i += 8) {
+            // xorshift64: cheap, and a full 64-bit period per message
+            std::uint64_t x = message.payloadState;
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            message.payloadState = x;
+            std::memcpy(bytes + i, &x, 8);
+            if (i + 8 >= message.length) {
+                break;
+            }
+        }
+        for (int i = 0; i < 4 && i < message.length; ++i) {
+            bytes[i] = static_cast<std::uint8_t>(sequence >> (8 * i));
+        }
+        std::memcpy(payload, bytes, message.length);
+    }
+
+    double frameTimeUs(const Message &message) const
+    {
+        return canFrameTimeUs(message.length, message.flags & ExtendedIdFlag, message.flags & FlexibleDataRateFlag,
+                              message.flags & BitrateSwitchFlag, m_profile.bitrate, m_profile.dataBitrate);
+    }
+
+    CanLoadProfile m_profile;
+    std::vector<Message> m_messages;
+    std::vector<Due> m_schedule;
+    std::uint64_t m_frames;
+    double m_estimatedLoad;
+};
+
+#endif // CANLOADGENERATOR_H
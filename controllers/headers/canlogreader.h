@@ -0,0 +1,82 @@
+#ifndef CANLOGREADER_H
+#define CANLOGREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include "canframe.h"
+
+/**
+ * @brief Sequential reader for candump (.log) and Vector ASC captures.
+ *
+ * The capture is memory-mapped and parsed in place, line by line, straight
+ * into CanFrames; nothing is copied or allocated per frame, so multi-gigabyte
+ * captures stream at memory bandwidth and the kernel can evict pages behind
+ * the cursor.
+ *
+ * Supported lines:
+ *  - candump -l: "(1436509052.249713) can0 123#1122" and FD "123##<flags><data>"
+ *  - ASC: classic "0.012345 1 123x Rx d 8 11 22 ..." and
+ *    "0.012345 CANFD 1 Rx 123 [name] <brs> <esi> <dlc> <len> 11 22 ..."
+ *
+ * Remote, error and event lines are skipped. Frame timestamps are the
+ * capture's own, in microseconds, and frame.bus is the capture's channel
+ * (ASC channel - 1, or candump interfaces in order of first appearance).
+ *
+ * Not thread-safe; it is driven by CanReceiveWorker on the ingest thread.
+ */
+class CanLogReader
+{
+public:
+    enum Format {
+        UnknownFormat,
+        CandumpFormat,
+        AscFormat
+    };
+
+    CanLogReader();
+    ~CanLogReader();
+
+    CanLogReader(const CanLogReader &) = delete;
+    CanLogReader &operator=(const CanLogReader &) = delete;
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+    void rewind();
+
+    Format format() const;
+    QString errorString() const;
+    qint64 size() const;
+    qint64 position() const;
+    // Lines that looked like frames but could not be parsed.
+    qint64 malformedLines() const;
+
+    // Reads the next frame in file order. Returns false at end of capture.
+    bool readFrame(CanFrame &frame);
+
+private:
+    bool parseCandumpLine(const char *line, const char *end, CanFrame &frame);
+    bool parseAscLine(const char *line, const char *end, CanFrame &frame);
+    void parseAscHeader(const char *line, const char *end);
+    quint8 candumpBus(const char *name, int length);
+
+    QFile m_file;
+    const char *m_data;
+    qint64 m_size;
+    qint64 m_position;
+    qint64 m_malformedLines;
+    Format m_format;
+    QString m_errorString;
+
+    // ASC header state
+    bool m_ascDecimal;
+    bool m_ascRelativeTimestamps;
+    qint64 m_ascLastTimestampUs;
+
+    QVector<QByteArray> m_candumpInterfaces;
+};
+
+#endif // CANLOGREADER_H
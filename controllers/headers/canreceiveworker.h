@@ -0,0 +1,123 @@
+#ifndef CANRECEIVEWORKER_H
+#define CANRECEIVEWORKER_H
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+
+#include "canframe.h"
+#include "canloadgenerator.h"
+#include "canlogreader.h"
+#include "nativecansocket.h"
+#include "spscringbuffer.h"
+
+#ifdef HAVE_QT_SERIALBUS
+#include <QCanBusDevice>
+#include <QCanBusFrame>
+#endif
+
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * @brief Owns the CAN device on a dedicated ingest thread.
+ *
+ * The worker is moved to its own QThread by CanBusController. It drains the
+ * device as soon as frames arrive, stamps them and pushes them into a
+ * lock-free SPSC ring. The consumer is woken with at most one queued
+ * framesPending() signal per drain cycle, never once per frame, so a bus
+ * burst cannot flood the consumer's event loop and a stalled consumer only
+ * ever costs dropped (counted) frames, never a blocked reader.
+ *
+ * Four sources can feed the ring: the QtSerialBus plugin device, a
+ * NativeCanSocket that batches reads with recvmmsg() and carries kernel
+ * receive timestamps, a recorded capture replayed through CanLogReader, or
+ * synthetic traffic from a CanLoadGenerator. Generated frames are paced
+ * exactly like a replayed capture.
+ *
+ * Replay keeps the capture's inter-frame spacing divided by the replay
+ * speed; speed 0 replays as fast as the consumer drains. Frames are
+ * stamped with the time they are released, so ages, estimates and trends
+ * stay on the monotonic clock at any speed, and carry the capture's own
+ * time, rebased onto replay start, in sourceTimestampUs for what
+ * integrates over vehicle time. Replay never drops frames; when the ring
+ * is full it waits for the consumer instead.
+ */
+class CanReceiveWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr std::size_t RingCapacity = 4096;
+    using FrameRing = SpscRingBuffer<CanFrame, RingCapacity>;
+
+    // Live and generated frames are tagged with bus; replayed ones keep the
+    // capture's.
+    explicit CanReceiveWorker(quint8 bus = 0, QObject *parent = nullptr);
+    ~CanReceiveWorker();
+
+    quint8 bus() const;
+
+    // Consumer side, callable from any single consumer thread.
+    std::size_t drain(CanFrame *out, std::size_t maxFrames);
+    std::size_t ringHighWaterMark() const;
+    std::size_t droppedFrames() const;
+    quint64 receivedFrames() const;
+    quint64 errorFrames() const;
+
+public slots:
+    // Must run on the worker thread.
+    bool openDevice(const QString &plugin, const QString &interface);
+    bool openNativeSocket(const QString &interface);
+    bool openReplay(const QString &path, double speed);
+    bool openGenerator(const CanLoadProfile &profile, double speed);
+    void closeDevice();
+    void writeFrame(quint32 frameId, const QByteArray &data, bool extended);
+
+signals:
+    void framesPending();
+    void errorOccurred(const QString &error);
+    void replayFinished(qint64 frames, qint64 malformedLines);
+#ifdef HAVE_QT_SERIALBUS
+    void stateChanged(QCanBusDevice::CanBusDeviceState state);
+#endif
+
+private slots:
+#ifdef HAVE_QT_SERIALBUS
+    void handleFramesReceived();
+    void handleErrorOccurred(QCanBusDevice::CanBusError error);
+#endif
+    void handleSocketReadable();
+    void replayNext();
+
+private:
+    void startReplay(double speed);
+    bool readReplayFrame(CanFrame &frame);
+    void notifyConsumer();
+
+    const quint8 m_bus;
+#ifdef HAVE_QT_SERIALBUS
+    QCanBusDevice *m_canDevice;
+#endif
+    NativeCanSocket m_nativeSocket;
+    QSocketNotifier *m_socketNotifier;
+    CanFrame m_readBatch[NativeCanSocket::MaxBatchSize];
+    CanLogReader m_logReader;
+    CanLoadGenerator m_loadGenerator;
+    bool m_generating;        // replaying from m_loadGenerator, not m_logReader
+    QTimer *m_replayTimer;
+    double m_replaySpeed;
+    qint64 m_replayLogStartUs;
+    qint64 m_replayClockStartUs;
+    qint64 m_replayedFrames;
+    CanFrame m_replayFrame;   // next frame due, already read from the log
+    bool m_replayFrameValid;
+    std::atomic<quint32> m_kernelDropped;
+    std::atomic<quint64> m_receivedFrames;
+    std::atomic<quint64> m_errorFrames;
+    FrameRing m_ring;
+    std::atomic<bool> m_drainPending;
+};
+
+#endif // CANRECEIVEWORKER_H
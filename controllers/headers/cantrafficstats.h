@@ -0,0 +1,112 @@
+#ifndef CANTRAFFICSTATS_H
+#define CANTRAFFICSTATS_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+#include "canframe.h"
+
+/**
+ * @brief Per-ID and per-bus CAN traffic statistics.
+ *
+ * Keeps, for every (bus, ID, 11/29-bit) seen, the frame count, inter-arrival gaps
+ * (min/avg/max, from frame timestamps), the last payload and a histogram of
+ * DLC codes, plus per-bus frame counts and the bus time those frames
+ * occupied. IDs live in a fixed open-addressed table, so recording is a hash
+ * probe and a handful of relaxed atomic stores with no locks or allocation;
+ * frames of IDs beyond Capacity are only counted.
+ *
+ * record() and markUnknown() must be called from one thread, the one that
+ * decodes. snapshot() may be called from any single other thread; rates
+ * are computed over the interval since the previous snapshot.
+ */
+class CanTrafficStats
+{
+public:
+    static constexpr int Capacity = 8192;
+    static constexpr int MaxBuses = 256;
+    static constexpr int DlcCodeCount = 16;
+    static constexpr double DefaultBitrate = 500000.0;
+    static constexpr double DefaultDataBitrate = 2000000.0;
+    // New unknown IDs logged per second at most; the rest are only counted.
+    static constexpr int UnknownIdLogsPerSecond = 5;
+
+    struct IdStatistics
+    {
+        quint8 bus;
+        quint32 frameId;
+        quint8 flags;       // CanFrame::Flag of the last frame
+        bool unknown;       // no decode table knows this ID
+        quint64 frames;
+        double frameRate;   // frames/s since the previous snapshot
+        qint64 minGapUs;
+        qint64 avgGapUs;
+        qint64 maxGapUs;
+        QByteArray lastPayload;
+        std::array<quint32, DlcCodeCount> dlcHistogram;
+    };
+
+    struct BusStatistics
+    {
+        quint64 frames;
+        double frameRate;   // frames/s since the previous snapshot
+        double utilization; // share of bus time used since the previous snapshot
+    };
+
+    struct Snapshot
+    {
+        qint64 timestampUs;
+        QVector<IdStatistics> ids;     // ordered by bus, 11-bit before 29-bit, then ID
+        QVector<BusStatistics> buses;  // indexed by bus, up to the highest bus seen
+        quint64 frames;
+        quint64 unknownFrames;
+        quint64 untrackedFrames;       // frames of IDs that did not fit the table
+    };
+
+    CanTrafficStats();
+    ~CanTrafficStats();
+
+    CanTrafficStats(const CanTrafficStats &) = delete;
+    CanTrafficStats &operator=(const CanTrafficStats &) = delete;
+
+    // Bit rates used to turn frames into bus time. Any thread.
+    void setBitrate(int bus, double bitrate, double dataBitrate = DefaultDataBitrate);
+
+    void record(const CanFrame &frame);
+    void record(const QVector<CanFrame> &frames);
+    // Counts a frame no decode table knows. The first frame of each such ID
+    // is logged, rate-limited to UnknownIdLogsPerSecond.
+    void markUnknown(quint8 bus, quint32 frameId, bool extended);
+
+    quint64 unknownFrames() const;
+    Snapshot snapshot();
+
+    static int dlcCode(int length);
+
+private:
+    struct Entry;
+    struct Bus;
+
+    Entry *find(quint8 bus, quint32 frameId, bool extended, bool insert);
+
+    std::unique_ptr<Entry[]> m_entries;
+    std::unique_ptr<Bus[]> m_buses;
+    std::atomic<int> m_highestBus;
+    std::atomic<int> m_usedEntries;
+    std::atomic<quint64> m_untrackedFrames;
+    std::atomic<quint64> m_unknownFrames;
+
+    // Writer-side unknown-ID log limiter
+    qint64 m_unknownLogWindowUs;
+    int m_unknownLogsInWindow;
+    int m_unknownLogsSuppressed;
+
+    // Snapshot-side state for rates
+    qint64 m_previousSnapshotUs;
+};
+
+#endif // CANTRAFFICSTATS_H
@@ -0,0 +1,74 @@
+#ifndef DBCBITFIELD_H
+#define DBCBITFIELD_H
+
+#include <QtGlobal>
+
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Compile-time description of one DBC signal's bit layout.
+ *
+ * Used by the headers dbc2cpp generates from a DBC at build time. Every
+ * template argument is a constant, so raw() compiles down to the handful of
+ * byte loads, shifts and masks the signal actually needs; there is no table
+ * lookup and no padding copy.
+ *
+ * FirstByte/ByteCount select the payload bytes spanned by the signal.
+ * Bytes are assembled little-endian (Intel) or big-endian (Motorola) into
+ * one integer, shifted right by Shift and masked to Length bits.
+ */
+template <int FirstByte, int ByteCount, int Shift, int Length, bool BigEndian, bool Signed>
+struct DbcBitField
+{
+    static_assert(ByteCount >= 1 && ByteCount <= 8, "signal must fit in a 64-bit window");
+    static_assert(Length >= 1 && Shift + Length <= ByteCount * 8, "signal exceeds its byte span");
+
+    static constexpr int requiredBytes = FirstByte + ByteCount;
+    static constexpr quint64 mask = Length >= 64 ? ~quint64(0) : ((quint64(1) << Length) - 1);
+
+    static quint64 raw(const quint8 *data)
+    {
+        return (gather(data, std::make_index_sequence<ByteCount>()) >> Shift) & mask;
+    }
+
+    static double rawValue(const quint8 *data)
+    {
+        const quint64 bits = raw(data);
+        if (Signed && Length < 64 && ((bits >> (Length - 1)) & 1)) {
+            return static_cast<double>(static_cast<qint64>(bits | ~mask));
+        }
+        if (Signed) {
+            return static_cast<double>(static_cast<qint64>(bits));
+        }
+        return static_cast<double>(bits);
+    }
+
+private:
+    template <std::size_t... I>
+    static quint64 gather(const quint8 *data, std::index_sequence<I...>)
+    {
+        if (BigEndian) {
+            return (... | (quint64(data[FirstByte + I]) << (8 * (ByteCount - 1 - I))));
+        }
+        return (... | (quint64(data[FirstByte + I]) << (8 * I)));
+    }
+};
+
+// Physical value of a generated signal type: raw * factor + offset, clamped
+// to [minimum, maximum] when the DBC gives a real range.
+template <typename Signal>
+inline double dbcPhysicalValue(const quint8 *data)
+{
+    double value = Signal::rawValue(data) * Signal::factor + Signal::offset;
+    if (Signal::clamped) {
+        if (value < Signal::minimum) {
+            value = Signal::minimum;
+        } else if (value > Signal::maximum) {
+            value = Signal::maximum;
+        }
+    }
+    return value;
+}
+
+#endif // DBCBITFIELD_H
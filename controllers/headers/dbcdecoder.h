@@ -0,0 +1,169 @@
+#ifndef DBCDECODER_H
+#define DBCDECODER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+
+/**
+ * @brief Table-driven CAN signal decoder built from a DBC file.
+ *
+ * loadFile()/loadFromData() parse the BO_/SG_ sections of a DBC into two flat tables: one
+ * MessageDescriptor per frame ID and a packed array of SignalDescriptors,
+ * stored contiguously per message. Bit positions are resolved at load time
+ * into a byte offset, shift and mask, so decoding a signal at runtime is
+ * one unaligned 64-bit load, an optional byte swap, a shift and a mask.
+ *
+ * Standard 11-bit IDs are looked up through a direct-indexed table;
+ * extended IDs fall back to a hash.
+ */
+class DbcDecoder
+{
+public:
+    enum SignalFlag : quint8 {
+        BigEndian = 0x01, // Motorola byte order (@0)
+        Signed = 0x02,    // two's complement raw value (-)
+        Clamped = 0x04    // [min|max] range is meaningful
+    };
+
+    struct SignalDescriptor
+    {
+        quint8 byteOffset;   // first byte of the 64-bit window to load
+        quint8 shift;        // right shift applied to the window
+        quint8 length;       // bit length, 1..64
+        quint8 flags;        // SignalFlag
+        quint8 requiredBytes; // payload bytes needed for the signal to be present
+        quint16 startBit;    // as written in the DBC
+        double factor;
+        double offset;
+        double minimum;
+        double maximum;
+    };
+
+    struct MessageDescriptor
+    {
+        quint32 frameId;     // without ExtendedIdFlag
+        quint16 firstSignal;
+        quint16 signalCount;
+        quint8 length;
+        bool extended;       // 29-bit ID
+    };
+
+    // Marks extended IDs in DBC message IDs, and in the IDs of the
+    // decoders dbc2cpp generates
+    static constexpr quint32 ExtendedIdFlag = 0x80000000u;
+
+    DbcDecoder();
+
+    bool loadFile(const QString &path);
+    bool loadFromData(const QByteArray &dbc);
+    QString errorString() const;
+
+    // FNV-1a of the DBC bytes last loaded; matches the SourceChecksum that
+    // dbc2cpp writes into generated decoders.
+    quint32 sourceChecksum() const;
+    static quint32 checksum(const QByteArray &data);
+
+    int messageCount() const;
+    int signalCount() const;
+    int signalIndex(const QString &name) const;
+    QString signalName(int index) const;
+    QString signalUnit(int index) const;
+    const SignalDescriptor &signalDescriptor(int index) const;
+
+    // Standard and extended IDs of the same value are different messages.
+    const MessageDescriptor *findMessage(quint32 frameId, bool extended) const
+    {
+        int index;
+        if (extended) {
+            index = m_extendedIndex.value(frameId, -1);
+        } else {
+            index = frameId < StandardIdCount ? m_standardIndex[frameId] : -1;
+        }
+        return index >= 0 ? &m_messages[index] : nullptr;
+    }
+
+    // Position of msg in the message table, 0..messageCount() - 1
+    int messageIndex(const MessageDescriptor &msg) const { return static_cast<int>(&msg - m_messages.constData()); }
+    const MessageDescriptor &messageDescriptor(int index) const { return m_messages[index]; }
+
+    // Decodes every signal of msg that fits in size bytes, calling
+    // onSignal(signalIndex, physicalValue) for each. data may be shorter
+    // than 64 bytes; it is never read past size. With wanted (one entry per
+    // signal index), signals whose entry is 0 are skipped.
+    template <typename Callback>
+    int decode(const MessageDescriptor &msg, const quint8 *data, int size, Callback &&onSignal,
+               const quint8 *wanted = nullptr) const
+    {
+        quint8 padded[PaddedPayloadSize];
+        const int copy = size < MaxPayloadSize ? size : MaxPayloadSize;
+        std::memcpy(padded, data, static_cast<std::size_t>(copy));
+        std::memset(padded + copy, 0, static_cast<std::size_t>(PaddedPayloadSize - copy));
+
+        int decoded = 0;
+        const SignalDescriptor *signal = m_signals.constData() + msg.firstSignal;
+        const SignalDescriptor *end = signal + msg.signalCount;
+        for (int index = msg.firstSignal; signal != end; ++signal, ++index) {
+            if (signal->requiredBytes > copy || (wanted && !wanted[index])) {
+                continue;
+            }
+            onSignal(index, physicalValue(*signal, padded));
+            ++decoded;
+        }
+        return decoded;
+    }
+
+    static double physicalValue(const SignalDescriptor &signal, const quint8 *padded)
+    {
+        const quint8 *bytes = padded + signal.byteOffset;
+        const quint64 window = (signal.flags & BigEndian) ? qFromBigEndian<quint64>(bytes)
+                                                          : qFromLittleEndian<quint64>(bytes);
+
+        const quint64 mask = signal.length >= 64 ? ~quint64(0) : ((quint64(1) << signal.length) - 1);
+        const quint64 raw = (window >> signal.shift) & mask;
+
+        double value;
+        if ((signal.flags & Signed) && signal.length < 64 && (raw >> (signal.length - 1)) & 1) {
+            value = static_cast<double>(static_cast<qint64>(raw | ~mask));
+        } else if (signal.flags & Signed) {
+            value = static_cast<double>(static_cast<qint64>(raw));
+        } else {
+            value = static_cast<double>(raw);
+        }
+
+        value = value * signal.factor + signal.offset;
+        if (signal.flags & Clamped) {
+            if (value < signal.minimum) {
+                value = signal.minimum;
+            } else if (value > signal.maximum) {
+                value = signal.maximum;
+            }
+        }
+        return value;
+    }
+
+private:
+    static constexpr quint32 StandardIdCount = 0x800;
+    static constexpr int MaxPayloadSize = 64;
+    // One extra 64-bit word so a window starting at the last byte stays in bounds.
+    static constexpr int PaddedPayloadSize = MaxPayloadSize + 8;
+
+    bool resolveLayout(SignalDescriptor &signal, int startBit, int length, bool bigEndian);
+    void clear();
+
+    QVector<MessageDescriptor> m_messages;
+    QVector<SignalDescriptor> m_signals;
+    QVector<QString> m_signalNames;
+    QVector<QString> m_signalUnits;
+    QHash<QString, int> m_signalByName;
+    QVector<qint16> m_standardIndex;
+    QHash<quint32, int> m_extendedIndex;
+    quint32 m_sourceChecksum;
+    QString m_errorString;
+};
+
+#endif // DBCDECODER_H
@@ -0,0 +1,204 @@
+#ifndef DIAGNOSTICCLIENT_H
+#define DIAGNOSTICCLIENT_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVariant>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QVector>
+
+#include "canframe.h"
+#include "isotp.h"
+
+/**
+ * @brief Polls OBD-II PIDs and UDS data identifiers over ISO-TP.
+ *
+ * A configuration file lists the ECUs and what to read from each, one
+ * entry per line:
+ *
+ *     ecu engine 0x7E0 0x7E8 bus 0 timeout 100ms dids 4
+ *     ecu hybrid 0x18DA10F1 0x18DAF110 ids 29
+ *     pid engine 0x0C every 100ms
+ *     did engine 0xF40D 1 every 500ms scale 1 offset 0 as oilLevel
+ *     rate 200
+ *     busload 0.8
+ *
+ * "ecu" names the request and response IDs, the bus, the response timeout
+ * (P2) and how many data identifiers the ECU takes per request. "ids 29"
+ * uses extended (29-bit) IDs even where they would fit in 11 bits; IDs
+ * above 0x7FF are always extended. "pid" polls
+ * a service 01 PID, "did" reads a data identifier of the given length
+ * with service 0x22; either takes a period and a name ("as"), PIDs default
+ * to their J1979 name. "rate" caps the diagnostic frames sent per second
+ * and "busload" pauses new requests while the bus is busier than that.
+ *
+ * Each ECU has one request in flight at a time, as ISO-TP and the ECU's
+ * server allow, and the ECUs are polled concurrently. A request carries as
+ * many due values as the service allows (six PIDs, "dids" identifiers),
+ * topped up with values due within half their period, and the next
+ * request goes out as soon as the response is in. An ECU rejecting a
+ * combined request is asked one value at a time from then on.
+ *
+ * Lives on the thread delivering frames to handleFrames(), normally
+ * CanBusController's.
+ */
+class DiagnosticClient : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ isRunning NOTIFY runningChanged)
+    Q_PROPERTY(QVariantList values READ values NOTIFY valuesUpdated)
+
+public:
+    enum Service : quint8 {
+        CurrentDataService = 0x01,
+        ReadDataByIdentifierService = 0x22
+    };
+
+    static constexpr int MaxPidsPerRequest = 6;
+    static constexpr int DefaultDidsPerRequest = 4;
+    static constexpr int MaxDidsPerRequest = 16;
+    static constexpr int DefaultTimeoutMs = 100;
+    static constexpr double DefaultMaxFrameRate = 200.0;
+    static constexpr double DefaultMaxBusLoad = 0.8;
+    // P2* once the ECU has answered "response pending"
+    static constexpr qint64 ResponsePendingTimeoutUs = 5000000;
+    // Before asking an ECU that answered "busy" again
+    static constexpr qint64 BusyRetryUs = 20000;
+    // A value missing from this many responses in a row is dropped
+    static constexpr int MaxMisses = 3;
+    static constexpr int MaxRawSize = 32;
+
+    explicit DiagnosticClient(QObject *parent = nullptr);
+
+    // Replaces the ECUs and values polled; the current ones are kept if the
+    // file has errors.
+    bool loadFile(const QString &path);
+    bool loadFromData(const QByteArray &config);
+    QString errorString() const;
+
+    // Return the index of the new ECU or value, -1 if the arguments are
+    // out of range.
+    int addEcu(const QString &name, quint32 requestId, quint32 responseId, int bus = 0,
+               int timeoutMs = DefaultTimeoutMs, int didsPerRequest = DefaultDidsPerRequest, bool extended = false);
+    int addPid(int ecu, quint8 pid, int periodMs, const QString &name = QString());
+    int addDid(int ecu, quint16 did, int length, int periodMs, const QString &name = QString(), double scale = 1.0,
+               double offset = 0.0);
+    void clear();
+
+    void setMaxFrameRate(double framesPerSecond);
+    void setMaxBusLoad(double load);
+
+    bool isRunning() const;
+    // Latest value by name, invalid until the first response
+    Q_INVOKABLE QVariant value(const QString &name) const;
+    // One entry per value: name, ecu, value, raw (hex), ageMs and updates.
+    QVariantList values() const;
+    // requests, responses, timeouts, negativeResponses, transportErrors,
+    // framesSent, valuesReceived and valuesPerSecond.
+    Q_INVOKABLE QVariantMap statistics() const;
+
+public slots:
+    void start();
+    void stop();
+    void handleFrames(const QVector<CanFrame> &frames);
+    // Utilization of the buses, 0..1, e.g. CanBusController::busUtilization()
+    void setBusLoad(double load);
+
+signals:
+    void transmit(quint32 frameId, const QByteArray &data, int bus, bool extended);
+    void runningChanged(bool running);
+    // Once per batch of frames that brought new values
+    void valuesUpdated();
+
+private slots:
+    void service();
+
+private:
+    struct Ecu
+    {
+        QString name;
+        quint32 requestId;
+        quint32 responseId;
+        quint8 bus;
+        bool extended;          // 29-bit request and response IDs
+        qint64 timeoutUs;
+        int didsPerRequest;
+        bool singleValues;      // rejected a combined request
+        IsoTpChannel channel;
+
+        // The request in flight, if outstanding is not empty
+        quint8 service;
+        QVector<int> outstanding;
+        qint64 deadlineUs;
+        qint64 retryAtUs;
+    };
+
+    struct Item
+    {
+        QString name;
+        int ecu;
+        quint8 service;
+        quint16 id;
+        int length;             // 0 = rest of the response, so always asked alone
+        double scale;
+        double offset;
+        qint64 periodUs;
+        qint64 dueUs;
+        bool supported;
+        int misses;
+
+        bool valid;
+        double value;
+        quint8 raw[MaxRawSize];
+        int rawSize;
+        qint64 updatedUs;
+        quint64 updates;
+    };
+
+    int addItem(int ecu, quint8 service, quint16 id, int length, int periodMs, const QString &name, double scale,
+                double offset);
+    void handleEvent(int ecu, IsoTpChannel::Event event, qint64 nowUs);
+    void handleResponse(int ecu, qint64 nowUs);
+    void finishRequest(Ecu &ecu);
+    void startRequest(int ecu, qint64 nowUs);
+    void flush(Ecu &ecu, qint64 nowUs);
+    void refillTokens(qint64 nowUs);
+    void scheduleService(qint64 nowUs);
+    int findOutstanding(const Ecu &ecu, quint16 id) const;
+    void storeValue(Item &item, const quint8 *data, int size, qint64 nowUs);
+
+    QString m_errorString;
+    QVector<Ecu> m_ecus;
+    QVector<Item> m_items;
+    quint32 m_minResponseId;
+    quint32 m_maxResponseId;
+
+    bool m_running;
+    QTimer *m_serviceTimer;
+    int m_firstEcu;             // rotates, so no ECU gets the tokens first every time
+    QVector<int> m_candidates;
+    bool m_valuesUpdated;
+
+    // Token bucket over the frames sent
+    double m_maxFrameRate;
+    double m_tokens;
+    qint64 m_tokensUpdatedUs;
+    double m_maxBusLoad;
+    double m_busLoad;
+
+    quint64 m_requests;
+    quint64 m_responses;
+    quint64 m_timeouts;
+    quint64 m_negativeResponses;
+    quint64 m_transportErrors;
+    quint64 m_framesSent;
+    quint64 m_valuesReceived;
+    qint64 m_rateWindowStartUs;
+    quint64 m_rateWindowValues;
+    double m_valuesPerSecond;
+};
+
+#endif // DIAGNOSTICCLIENT_H
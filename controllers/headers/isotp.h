@@ -0,0 +1,321 @@
+#ifndef ISOTP_H
+#define ISOTP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief ISO-TP timing and flow control we ask the other side for.
+ */
+struct IsoTpConfig
+{
+    // Consecutive frames the sender may send between our flow control
+    // frames; 0 lets it send the whole message after one.
+    std::uint8_t blockSize = 0;
+    // STmin we ask for, in the ISO 15765-2 encoding (0x00..0x7F ms,
+    // 0xF1..0xF9 100..900 µs)
+    std::uint8_t separationTime = 0;
+    // Unused bytes of a frame; OBD-II requires all frames to be 8 bytes
+    std::uint8_t padding = 0xCC;
+    // N_Bs (waiting for flow control) and N_Cr (waiting for the next
+    // consecutive frame)
+    std::int64_t timeoutUs = 1000000;
+    // Flow control WAIT frames accepted in a row before giving up
+    int maxWaitFrames = 10;
+};
+
+/**
+ * @brief ISO 15765-2 (ISO-TP) transport for one pair of CAN IDs.
+ *
+ * Segments a message of up to 4095 bytes into a single frame or a first
+ * frame and consecutive frames, honouring the receiver's block size and
+ * STmin, and reassembles incoming ones, answering first frames with flow
+ * control. Classic CAN with normal addressing: every frame is FrameLength
+ * bytes, padded.
+ *
+ * Free of I/O and clocks: the owner feeds every frame received on the
+ * response ID to receive(), sends whatever nextFrame() hands out and calls
+ * poll() by nextDeadlineUs() for timeouts. Sending and receiving are
+ * independent, one message at a time in each direction.
+ *
+ * Deliberately free of Qt so the standalone tools can share it.
+ */
+class IsoTpChannel
+{
+public:
+    static constexpr int FrameLength = 8;
+    static constexpr std::size_t MaxMessageSize = 4095;
+    static constexpr std::int64_t NoDeadline = INT64_MAX;
+
+    enum Event {
+        NoEvent,
+        MessageReceived,    // message() holds it until the next one starts
+        TransmitFailed,     // flow control timed out or refused the message
+        ReceiveFailed       // a consecutive frame timed out or came out of sequence
+    };
+
+    explicit IsoTpChannel(const IsoTpConfig &config = IsoTpConfig())
+        : m_config(config)
+    {
+        reset();
+    }
+
+    void setConfig(const IsoTpConfig &config) { m_config = config; }
+    const IsoTpConfig &config() const { return m_config; }
+
+    // Drops any message half sent or half received.
+    void reset()
+    {
+        m_txState = TxIdle;
+        m_txOffset = 0;
+        m_rxState = RxIdle;
+        m_flowControlPending = false;
+    }
+
+    bool isSending() const { return m_txState != TxIdle; }
+    bool isReceiving() const { return m_rxState != RxIdle; }
+    // A flow control frame is waiting to go out; the sender's N_Cr is
+    // running, so it should not wait behind anything else.
+    bool flowControlPending() const { return m_flowControlPending; }
+    const std::vector<std::uint8_t> &message() const { return m_rx; }
+
+    // Queues a message; false while the previous one is still being sent.
+    bool send(const std::uint8_t *data, std::size_t size)
+    {
+        if (m_txState != TxIdle || size == 0 || size > MaxMessageSize) {
+            return false;
+        }
+        m_tx.assign(data, data + size);
+        m_txOffset = 0;
+        m_txState = TxFirst;
+        return true;
+    }
+
+    Event receive(const std::uint8_t *data, int length, std::int64_t nowUs)
+    {
+        if (length < 1) {
+            return NoEvent;
+        }
+        switch (data[0] >> 4) {
+        case SingleFrame: {
+            const int size = data[0] & 0x0F;
+            if (size == 0 || size > length - 1) {
+                return NoEvent;
+            }
+            // A new message ends any reception in progress
+            m_rxState = RxIdle;
+            m_rx.assign(data + 1, data + 1 + size);
+            return MessageReceived;
+        }
+        case FirstFrame: {
+            const std::size_t size = (static_cast<std::size_t>(data[0] & 0x0F) << 8) | data[1];
+            if (length < FrameLength || size < std::size_t(FrameLength)) {
+                return NoEvent;
+            }
+            m_rx.assign(data + 2, data + FrameLength);
+            m_rxSize = size;
+            m_rxSequence = 1;
+            m_rxBlockRemaining = m_config.blockSize;
+            m_rxState = RxConsecutive;
+            m_rxDeadlineUs = nowUs + m_config.timeoutUs;
+            m_flowControlPending = true;
+            return NoEvent;
+        }
+        case ConsecutiveFrame: {
+            if (m_rxState != RxConsecutive) {
+                return NoEvent;
+            }
+            if ((data[0] & 0x0F) != m_rxSequence) {
+                m_rxState = RxIdle;
+                m_flowControlPending = false;
+                return ReceiveFailed;
+            }
+            const std::size_t count = std::min<std::size_t>(length - 1, m_rxSize - m_rx.size());
+            m_rx.insert(m_rx.end(), data + 1, data + 1 + count);
+            m_rxSequence = (m_rxSequence + 1) & 0x0F;
+            if (m_rx.size() == m_rxSize) {
+                m_rxState = RxIdle;
+                return MessageReceived;
+            }
+            if (m_config.blockSize != 0 && --m_rxBlockRemaining == 0) {
+                m_rxBlockRemaining = m_config.blockSize;
+                m_flowControlPending = true;
+            }
+            m_rxDeadlineUs = nowUs + m_config.timeoutUs;
+            return NoEvent;
+        }
+        case FlowControl:
+            return handleFlowControl(data, length, nowUs);
+        default:
+            return NoEvent;
+        }
+    }
+
+    // Writes the next frame due by nowUs to frame (FrameLength bytes);
+    // false if nothing is.
+    bool nextFrame(std::int64_t nowUs, std::uint8_t *frame)
+    {
+        std::memset(frame, m_config.padding, FrameLength);
+        if (m_flowControlPending) {
+            m_flowControlPending = false;
+            frame[0] = FlowControl << 4;    // continue to send
+            frame[1] = m_config.blockSize;
+            frame[2] = m_config.separationTime;
+            return true;
+        }
+
+        switch (m_txState) {
+        case TxFirst:
+            if (m_tx.size() < std::size_t(FrameLength)) {
+                frame[0] = static_cast<std::uint8_t>(m_tx.size());
+                std::memcpy(frame + 1, m_tx.data(), m_tx.size());
+                m_txState = TxIdle;
+                return true;
+            }
+            frame[0] = static_cast<std::uint8_t>((FirstFrame << 4) | (m_tx.size() >> 8));
+            frame[1] = static_cast<std::uint8_t>(m_tx.size() & 0xFF);
+            std::memcpy(frame + 2, m_tx.data(), FrameLength - 2);
+            m_txOffset = FrameLength - 2;
+            m_txSequence = 1;
+            m_txWaitFrames = 0;
+            m_txState = TxWaitFlowControl;
+            m_txDeadlineUs = nowUs + m_config.timeoutUs;
+            return true;
+        case TxConsecutive: {
+            if (nowUs < m_txNextUs) {
+                return false;
+            }
+            const std::size_t count = std::min<std::size_t>(FrameLength - 1, m_tx.size() - m_txOffset);
+            frame[0] = static_cast<std::uint8_t>((ConsecutiveFrame << 4) | m_txSequence);
+            std::memcpy(frame + 1, m_tx.data() + m_txOffset, count);
+            m_txOffset += count;
+            m_txSequence = (m_txSequence + 1) & 0x0F;
+            if (m_txOffset == m_tx.size()) {
+                m_txState = TxIdle;
+            } else if (m_txBlockRemaining != 0 && --m_txBlockRemaining == 0) {
+                m_txState = TxWaitFlowControl;
+                m_txDeadlineUs = nowUs + m_config.timeoutUs;
+            } else {
+                m_txNextUs = nowUs + m_txSeparationUs;
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Reports a timeout that has expired by nowUs; call until NoEvent.
+    Event poll(std::int64_t nowUs)
+    {
+        if (m_txState == TxWaitFlowControl && nowUs >= m_txDeadlineUs) {
+            m_txState = TxIdle;
+            return TransmitFailed;
+        }
+        if (m_rxState == RxConsecutive && nowUs >= m_rxDeadlineUs) {
+            m_rxState = RxIdle;
+            m_flowControlPending = false;
+            return ReceiveFailed;
+        }
+        return NoEvent;
+    }
+
+    // When nextFrame() or poll() next have something to do
+    std::int64_t nextDeadlineUs() const
+    {
+        if (m_flowControlPending || m_txState == TxFirst) {
+            return 0;
+        }
+        std::int64_t deadline = NoDeadline;
+        if (m_txState == TxConsecutive) {
+            deadline = m_txNextUs;
+        } else if (m_txState == TxWaitFlowControl) {
+            deadline = m_txDeadlineUs;
+        }
+        if (m_rxState == RxConsecutive) {
+            deadline = std::min(deadline, m_rxDeadlineUs);
+        }
+        return deadline;
+    }
+
+    static std::int64_t separationTimeUs(std::uint8_t encoded)
+    {
+        if (encoded <= 0x7F) {
+            return encoded * 1000;
+        }
+        if (encoded >= 0xF1 && encoded <= 0xF9) {
+            return (encoded - 0xF0) * 100;
+        }
+        return 127000;  // reserved values mean the longest
+    }
+
+private:
+    enum FrameType : std::uint8_t {
+        SingleFrame,
+        FirstFrame,
+        ConsecutiveFrame,
+        FlowControl
+    };
+
+    enum TxState {
+        TxIdle,
+        TxFirst,            // single or first frame not sent yet
+        TxWaitFlowControl,
+        TxConsecutive
+    };
+
+    enum RxState {
+        RxIdle,
+        RxConsecutive
+    };
+
+    Event handleFlowControl(const std::uint8_t *data, int length, std::int64_t nowUs)
+    {
+        if (m_txState != TxWaitFlowControl || length < 3) {
+            return NoEvent;
+        }
+        switch (data[0] & 0x0F) {
+        case 0:     // continue to send
+            m_txBlockRemaining = data[1];
+            m_txSeparationUs = separationTimeUs(data[2]);
+            m_txNextUs = nowUs;
+            m_txWaitFrames = 0;
+            m_txState = TxConsecutive;
+            return NoEvent;
+        case 1:     // wait
+            if (++m_txWaitFrames > m_config.maxWaitFrames) {
+                m_txState = TxIdle;
+                return TransmitFailed;
+            }
+            m_txDeadlineUs = nowUs + m_config.timeoutUs;
+            return NoEvent;
+        default:    // overflow or invalid
+            m_txState = TxIdle;
+            return TransmitFailed;
+        }
+    }
+
+    IsoTpConfig m_config;
+
+    std::vector<std::uint8_t> m_tx;
+    std::size_t m_txOffset;
+    TxState m_txState;
+    std::uint8_t m_txSequence = 0;
+    int m_txBlockRemaining = 0;     // 0 = no further flow control
+    int m_txWaitFrames = 0;
+    std::int64_t m_txSeparationUs = 0;
+    std::int64_t m_txNextUs = 0;
+    std::int64_t m_txDeadlineUs = 0;
+
+    std::vector<std::uint8_t> m_rx;
+    std::size_t m_rxSize = 0;
+    RxState m_rxState;
+    std::uint8_t m_rxSequence = 0;
+    int m_rxBlockRemaining = 0;
+    std::int64_t m_rxDeadlineUs = 0;
+    bool m_flowControlPending;
+};
+
+#endif // ISOTP_H
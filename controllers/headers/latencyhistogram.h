@@ -0,0 +1,55 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QVariantMap>
+#include <QtGlobal>
+
+#include <array>
+
+/**
+ * @brief Fixed-size histogram of latencies in microseconds.
+ *
+ * Values below 16 us get a bucket each; above, every power of two is split
+ * into eight buckets, so a percentile is never off by more than an eighth
+ * of its value. Covers up to 2^27 us (about two minutes); longer values
+ * share the last bucket, whose percentiles report maxUs(). Min, max and
+ * mean are exact. Recording is a few integer
+ * operations and never allocates.
+ */
+class LatencyHistogram
+{
+public:
+    // Highest power of two split into buckets
+    static constexpr int MaxMagnitude = 26;
+    static constexpr int BucketCount = 16 + (MaxMagnitude - 4 + 1) * 8;
+
+    LatencyHistogram();
+
+    void record(qint64 latencyUs);
+    void merge(const LatencyHistogram &other);
+    void clear();
+
+    quint64 count() const { return m_count; }
+    qint64 minUs() const { return m_count ? m_minUs : 0; }
+    qint64 maxUs() const { return m_maxUs; }
+    double meanUs() const { return m_count ? static_cast<double>(m_sumUs) / static_cast<double>(m_count) : 0.0; }
+    // Upper edge of the bucket holding the given fraction (0..1) of the
+    // values, at most maxUs(); 0 when empty.
+    qint64 percentileUs(double fraction) const;
+
+    // count, minUs, meanUs, p50Us, p90Us, p99Us and maxUs; with buckets, also
+    // the non-empty buckets as [upper edge in us, count] pairs.
+    QVariantMap toVariantMap(bool buckets = false) const;
+
+private:
+    static int bucketIndex(qint64 latencyUs);
+    static qint64 bucketUpperUs(int index);
+
+    std::array<quint64, BucketCount> m_buckets;
+    quint64 m_count;
+    qint64 m_minUs;
+    qint64 m_maxUs;
+    qint64 m_sumUs;
+};
+
+#endif // LATENCYHISTOGRAM_H
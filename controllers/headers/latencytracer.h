@@ -0,0 +1,93 @@
+#ifndef LATENCYTRACER_H
+#define LATENCYTRACER_H
+
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QVariantMap>
+
+#include <array>
+
+#include "latencyhistogram.h"
+#include "vehiclesignalstore.h"
+
+class QQuickWindow;
+
+/**
+ * @brief Measures how old a signal value is when it reaches the screen.
+ *
+ * Every delivered value carries the time its CAN frame was received. The
+ * tracer takes it, with the times the value was decoded, sent to the GUI
+ * thread and bound in QML, and holds it until the window's next scene graph
+ * sync picks the binding up; the frameSwapped() that follows that sync is
+ * when the value was first on screen. A value replaced before a sync never
+ * reached the screen and is not counted.
+ *
+ * Per signal it keeps a histogram of receive-to-swap latency, and over all
+ * signals one per stage:
+ *
+ *   ingest     frame received -> its decode batch started
+ *   notify     decoded -> sent in a notification flush
+ *   deliver    sent -> QML bindings updated on the GUI thread
+ *   present    bindings updated -> frame swapped
+ *
+ * Timestamps are canMonotonicMicros(). recordBound() is called on the GUI
+ * thread; sync and swap may come from the render thread.
+ */
+class LatencyTracer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LatencyTracer(QObject *parent = nullptr);
+
+    // Values are traced to window's frames; without one, to recordBound().
+    void setWindow(QQuickWindow *window);
+
+    // The value of id now bound in QML was received, decoded and sent at
+    // the given times, and bound at boundUs.
+    void recordBound(VehicleSignalStore::SignalId id, qint64 receivedUs, qint64 decodedUs, qint64 sentUs,
+                     qint64 boundUs);
+
+    // frames (swaps that showed a traced value), stages (ingest, notify,
+    // deliver, present and total) and signals (one entry per signal with a
+    // name and its histogram); histograms as LatencyHistogram::toVariantMap.
+    QVariantMap statistics(bool buckets = false) const;
+    // statistics() with buckets, as JSON.
+    bool dump(const QString &path, QString *error = nullptr) const;
+    void reset();
+
+private:
+    struct Stamps
+    {
+        qint64 receivedUs;
+        qint64 decodedUs;
+        qint64 sentUs;
+        qint64 boundUs;
+    };
+
+    void record(VehicleSignalStore::SignalId id, const Stamps &stamps, qint64 presentedUs);
+    void recordSynced();
+    void recordSwapped();
+
+    QPointer<QQuickWindow> m_window;
+    QMetaObject::Connection m_syncConnection;
+    QMetaObject::Connection m_swapConnection;
+
+    mutable QMutex m_mutex;
+    // Bound but not yet synced, and synced but not yet swapped
+    std::array<Stamps, VehicleSignalStore::SignalCount> m_bound;
+    VehicleSignalStore::SignalMask m_boundMask;
+    std::array<Stamps, VehicleSignalStore::SignalCount> m_synced;
+    VehicleSignalStore::SignalMask m_syncedMask;
+
+    quint64 m_frames;
+    LatencyHistogram m_ingest;
+    LatencyHistogram m_notify;
+    LatencyHistogram m_deliver;
+    LatencyHistogram m_present;
+    LatencyHistogram m_total;
+    std::array<LatencyHistogram, VehicleSignalStore::SignalCount> m_signals;
+};
+
+#endif // LATENCYTRACER_H
@@ -42,6 +42,10 @@ public:
     bool shuffle() const;
     bool repeat() const;
 
+    // Title and artist parsed from an "Artist - Title" file name
+    static QString getFileTitle(const QString &filePath);
+    static QString getFileArtist(const QString &filePath);
+
 public slots:
     // Media control
     void play();
@@ -91,8 +95,6 @@ private slots:
 
 private:
     void extractMetadata(const QString &filePath);
-    QString getFileTitle(const QString &filePath);
-    QString getFileArtist(const QString &filePath);
     QStringList getSupportedAudioFiles(const QDir &dir);
     void loadCurrentTrack();
     
@@ -0,0 +1,64 @@
+#ifndef NATIVECANSOCKET_H
+#define NATIVECANSOCKET_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <memory>
+
+#include "canframe.h"
+
+/**
+ * @brief Thin wrapper around a raw Linux SocketCAN (AF_CAN/CAN_RAW) socket.
+ *
+ * Unlike the QtSerialBus "socketcan" plugin, which issues one read() per
+ * frame, readBatch() pulls up to a whole batch of frames out of the kernel
+ * with a single non-blocking recvmmsg() call. Each frame carries the
+ * kernel's SO_TIMESTAMPING receive stamp, converted onto the monotonic
+ * clock used by canMonotonicMicros().
+ *
+ * Not thread-safe; it is owned and driven by CanReceiveWorker on the
+ * ingest thread. On platforms without SocketCAN open() always fails.
+ */
+class NativeCanSocket
+{
+public:
+    static constexpr int MaxBatchSize = 64;
+
+    NativeCanSocket();
+    ~NativeCanSocket();
+
+    NativeCanSocket(const NativeCanSocket &) = delete;
+    NativeCanSocket &operator=(const NativeCanSocket &) = delete;
+
+    bool open(const QString &interface);
+    void close();
+    bool isOpen() const;
+    int socketDescriptor() const;
+    QString errorString() const;
+    // Frames the kernel discarded because the socket queue was full, as
+    // last reported through SO_RXQ_OVFL.
+    quint32 kernelDroppedFrames() const;
+    // Error frames reported by the controller since open().
+    quint64 errorFrames() const;
+
+    // Reads up to maxFrames (<= MaxBatchSize) frames without blocking.
+    // Returns the number of frames read, 0 when the socket is drained and
+    // -1 on error (see errorString()).
+    int readBatch(CanFrame *out, int maxFrames);
+    bool writeFrame(quint32 frameId, const QByteArray &data, bool extended);
+
+private:
+    void setError(const QString &context);
+
+    int m_fd;
+    quint32 m_kernelDropped;
+    quint64 m_errorFrames;
+    QString m_errorString;
+
+    // recvmmsg() scratch space, allocated once at open().
+    struct BatchBuffers;
+    std::unique_ptr<BatchBuffers> m_buffers;
+};
+
+#endif // NATIVECANSOCKET_H
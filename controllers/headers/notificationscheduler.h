@@ -0,0 +1,113 @@
+#ifndef NOTIFICATIONSCHEDULER_H
+#define NOTIFICATIONSCHEDULER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <array>
+#include <atomic>
+
+#include "vehiclesignalstore.h"
+
+class QQuickWindow;
+
+/**
+ * @brief Coalesces signal store changes into one notification per frame.
+ *
+ * The decoder marks signals as changed as often as the bus carries them;
+ * the scheduler collects them and hands the set to flushed() once per
+ * rendered frame of the attached window (just after its animations
+ * advance, before the scene graph syncs), so QML bindings and gauge
+ * repaints run at most at the display rate. Without a window it flushes
+ * every FallbackIntervalMs.
+ *
+ * Per signal, a deadband drops changes smaller than it relative to the
+ * value last delivered, and a maximum rate holds a signal back until its
+ * interval has passed. Counters of changes, deliveries and suppressions
+ * show what the coalescing saves.
+ *
+ * Lives on, and must only be used from, the thread writing the store.
+ * The window may live on another thread: frames are requested and timed
+ * on the window's thread and the flush is queued over to this one.
+ */
+class NotificationScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int FallbackIntervalMs = 16;
+    // Upper bound on a flush waiting for a frame the window may never
+    // render, e.g. while it is hidden.
+    static constexpr int MaxFrameWaitMs = 100;
+
+    explicit NotificationScheduler(const VehicleSignalStore &store, QObject *parent = nullptr);
+
+    // Flushes in step with window's frames; nullptr falls back to the timer.
+    // The window must outlive the scheduler or be reset first.
+    void setWindow(QQuickWindow *window);
+
+    // Changes of at most deadband from the last delivered value are not
+    // notified; 0 notifies every change.
+    void setDeadband(VehicleSignalStore::SignalId id, double deadband);
+    double deadband(VehicleSignalStore::SignalId id) const;
+    // At most maxRate notifications per second for the signal; 0 is once
+    // per frame.
+    void setMaxRate(VehicleSignalStore::SignalId id, double maxRate);
+    double maxRate(VehicleSignalStore::SignalId id) const;
+
+    void markChanged(VehicleSignalStore::SignalId id);
+    // Asks for another frameStarted() even if nothing changes.
+    void requestFrame();
+
+    // Average time from frameStarted() until the window's frame is swapped
+    // to the screen; 0 without a window or before the first frame.
+    qint64 presentationDelayUs() const;
+
+    // Totals and per-signal counters, for QML and logs.
+    QVariantMap statistics() const;
+
+signals:
+    // Signals to notify, lowest ID first.
+    void flushed(VehicleSignalStore::SignalMask signalMask);
+    // Start of each window frame, or timer flush, before flushed().
+    void frameStarted(qint64 frameStartUs);
+    // End of every flush, after flushed() if anything was delivered.
+    void flushCompleted();
+
+public slots:
+    // Delivers pending changes now, as the next frame would. The window or
+    // the fallback timer calls it; call it directly without an event loop.
+    void flush();
+
+private:
+    void requestFlush();
+    void recordFrameSwapped();
+
+    const VehicleSignalStore &m_store;
+    QPointer<QQuickWindow> m_window;
+    QMetaObject::Connection m_frameConnection;
+    QMetaObject::Connection m_swapConnection;
+    QTimer *m_flushTimer;
+    QTimer *m_rateTimer;
+    bool m_flushRequested;
+    VehicleSignalStore::SignalMask m_pending;
+
+    std::array<double, VehicleSignalStore::SignalCount> m_deadbands;
+    std::array<qint64, VehicleSignalStore::SignalCount> m_minIntervalsUs;
+    std::array<double, VehicleSignalStore::SignalCount> m_deliveredValues;
+    std::array<bool, VehicleSignalStore::SignalCount> m_deliveredValid;
+    std::array<qint64, VehicleSignalStore::SignalCount> m_deliveredUs;
+
+    std::array<quint64, VehicleSignalStore::SignalCount> m_changes;
+    std::array<quint64, VehicleSignalStore::SignalCount> m_delivered;
+    std::array<quint64, VehicleSignalStore::SignalCount> m_deadbandSuppressed;
+    quint64 m_flushes;
+
+    // frameSwapped arrives on the render thread
+    std::atomic<qint64> m_frameStartUs;
+    std::atomic<qint64> m_presentationDelayUs;
+};
+
+#endif // NOTIFICATIONSCHEDULER_H
@@ -0,0 +1,89 @@
+#ifndef OBDPID_H
+#define OBDPID_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief SAE J1979 service 01 PIDs: data lengths and scaling.
+ *
+ * A response to a request for several PIDs is the PIDs and their data
+ * back to back, so splitting it needs the length of each; the table covers
+ * every PID up to 0x64. The common ones also have a name and a linear
+ * scaling of their first one or two bytes.
+ *
+ * Deliberately free of Qt so the standalone tools can share it.
+ */
+struct ObdPidScaling
+{
+    std::uint8_t pid;
+    const char *name;
+    int bytes;          // big-endian bytes scaled
+    double scale;
+    double offset;
+};
+
+// Data bytes of pid, 0 if not known
+inline int obdPidLength(std::uint8_t pid)
+{
+    static const std::uint8_t lengths[] = {
+        4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1,    // 0x00
+        2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2,    // 0x10
+        4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1,    // 0x20
+        1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2,    // 0x30
+        4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4,    // 0x40
+        4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1,    // 0x50
+        4, 1, 1, 2, 5                                      // 0x60
+    };
+    return pid < sizeof(lengths) ? lengths[pid] : 0;
+}
+
+// Scaling of pid, nullptr if it has none here
+inline const ObdPidScaling *obdPidScaling(std::uint8_t pid)
+{
+    static const ObdPidScaling scalings[] = {
+        { 0x04, "engineLoad", 1, 100.0 / 255.0, 0 },
+        { 0x05, "coolantTemperature", 1, 1, -40 },
+        { 0x0A, "fuelPressure", 1, 3, 0 },
+        { 0x0B, "intakeManifoldPressure", 1, 1, 0 },
+        { 0x0C, "engineSpeed", 2, 0.25, 0 },
+        { 0x0D, "vehicleSpeed", 1, 1, 0 },
+        { 0x0E, "timingAdvance", 1, 0.5, -64 },
+        { 0x0F, "intakeAirTemperature", 1, 1, -40 },
+        { 0x10, "massAirFlow", 2, 0.01, 0 },
+        { 0x11, "throttlePosition", 1, 100.0 / 255.0, 0 },
+        { 0x1F, "runTime", 2, 1, 0 },
+        { 0x21, "distanceWithMil", 2, 1, 0 },
+        { 0x2F, "fuelLevel", 1, 100.0 / 255.0, 0 },
+        { 0x31, "distanceSinceCodesCleared", 2, 1, 0 },
+        { 0x33, "barometricPressure", 1, 1, 0 },
+        { 0x42, "controlModuleVoltage", 2, 0.001, 0 },
+        { 0x43, "absoluteLoad", 2, 100.0 / 255.0, 0 },
+        { 0x45, "relativeThrottlePosition", 1, 100.0 / 255.0, 0 },
+        { 0x46, "ambientAirTemperature", 1, 1, -40 },
+        { 0x49, "acceleratorPedalPosition", 1, 100.0 / 255.0, 0 },
+        { 0x5C, "oilTemperature", 1, 1, -40 },
+        { 0x5E, "fuelRate", 2, 0.05, 0 },
+    };
+    for (const ObdPidScaling &scaling : scalings) {
+        if (scaling.pid == pid) {
+            return &scaling;
+        }
+    }
+    return nullptr;
+}
+
+// Physical value of pid's data; PIDs without a scaling read as the
+// unsigned big-endian number in their first four bytes.
+inline double obdPidValue(std::uint8_t pid, const std::uint8_t *data, int length)
+{
+    const ObdPidScaling *scaling = obdPidScaling(pid);
+    const int bytes = scaling ? scaling->bytes : (length < 4 ? length : 4);
+    std::uint32_t raw = 0;
+    for (int i = 0; i < bytes && i < length; ++i) {
+        raw = (raw << 8) | data[i];
+    }
+    return scaling ? raw * scaling->scale + scaling->offset : raw;
+}
+
+#endif // OBDPID_H
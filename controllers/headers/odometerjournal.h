@@ -0,0 +1,123 @@
+#ifndef ODOMETERJOURNAL_H
+#define ODOMETERJOURNAL_H
+
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <cstdint>
+
+class QThread;
+
+namespace OdometerJournalFormat {
+
+constexpr char Magic[4] = {'V', 'S', 'O', 'D'};
+// Bumped whenever Record changes; open() reads records of this version only
+constexpr std::uint32_t Version = 1;
+constexpr int MaxExtraValues = 30;
+
+// Fixed-size, so a torn write at the end of the file can only damage the
+// last record.
+struct Record
+{
+    char magic[4];
+    std::uint32_t crc;           // CRC-32 of the bytes after this field
+    std::uint64_t sequence;      // increases with every record written
+    double odometerKm;
+    double tripKm;
+    std::uint32_t version;
+    std::uint32_t extraCount;    // values used in extra
+    double extra[MaxExtraValues]; // state of other distance-based features
+};
+
+static_assert(sizeof(Record) == 280, "journal record layout changed");
+
+} // namespace OdometerJournalFormat
+
+/**
+ * @brief Crash-safe storage for the odometer and trip distance.
+ *
+ * The journal is an append-only file of checksummed records, each holding
+ * the odometer, the trip distance and up to MaxExtraValues more values
+ * that advance with them; open() takes the newest intact one and ignores
+ * anything a power loss tore. update() only remembers the latest values.
+ * A background thread appends and syncs them at most every
+ * CommitIntervalMs, so flash sees a few small writes a minute however often
+ * the distance changes, and a power cut loses at most the last
+ * CommitIntervalMs of driving. A journal of another format version is
+ * left alone: open() fails rather than start over on top of it.
+ *
+ * Once the file holds CompactRecords records (and on every open) it is
+ * rewritten as a single record through a synced temporary file that is
+ * renamed over it, so there is always one complete journal on disk.
+ *
+ * update() and requestCommit() may be called from any thread.
+ */
+class OdometerJournal
+{
+public:
+    static constexpr int CommitIntervalMs = 15000;
+    static constexpr int CompactRecords = 1024;
+    static constexpr int MaxExtraValues = OdometerJournalFormat::MaxExtraValues;
+
+    OdometerJournal();
+    ~OdometerJournal();
+
+    OdometerJournal(const OdometerJournal &) = delete;
+    OdometerJournal &operator=(const OdometerJournal &) = delete;
+
+    // Opens or creates the journal. hasState() tells whether it held a
+    // value; if not, the first update() starts it.
+    bool open(const QString &path);
+    // Commits pending values and stops the commit thread.
+    void close();
+    bool isOpen() const;
+    QString path() const;
+    QString errorString() const;
+
+    bool hasState() const;
+    double odometerKm() const;
+    double tripKm() const;
+
+    // Values stored alongside the odometer, e.g. the trip computer's
+    // state; at most MaxExtraValues.
+    QVector<double> extraValues() const;
+
+    void update(double odometerKm, double tripKm);
+    void updateExtra(const double *values, int count);
+    // Commits soon instead of at the next interval, e.g. after a trip reset.
+    void requestCommit();
+    // Synchronously writes pending values.
+    bool commit();
+
+private:
+    void commitLoop();
+    bool appendRecord(OdometerJournalFormat::Record record);
+    bool compact(OdometerJournalFormat::Record record);
+    static bool syncFile(QFile &file);
+
+    QString m_path;
+    QString m_errorString;
+
+    // Latest values and whether they still need writing
+    mutable QMutex m_stateMutex;
+    bool m_hasState;
+    OdometerJournalFormat::Record m_state;
+    quint64 m_updates;
+    quint64 m_committedUpdates;
+
+    // Serialises file access between commit() callers and the commit thread
+    QMutex m_fileMutex;
+    QFile m_file;
+    quint64 m_sequence;
+    int m_recordCount;
+
+    QThread *m_commitThread;
+    QWaitCondition m_commitWake;
+    bool m_commitRequested;
+    bool m_stopCommitting;
+};
+
+#endif // ODOMETERJOURNAL_H
@@ -0,0 +1,58 @@
+#ifndef PROPERTYMIRROR_H
+#define PROPERTYMIRROR_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QQmlPropertyMap>
+#include <QVariantHash>
+#include <QVector>
+
+/**
+ * @brief Read-only QML copy of properties of objects living on another thread.
+ *
+ * QML bindings must not touch an object owned by another thread. watch()
+ * copies the named properties of such an object into this map and copies
+ * them again, on the object's own thread, whenever it emits the given
+ * notify signal. Changes are handed over in batches: however often they
+ * come, at most one queued update per turn of this thread's event loop.
+ *
+ * Meant for objects whose properties change at human rates (status,
+ * statistics); high-rate state wants its own batching, see
+ * VehicleDataProxy. Writes from QML are ignored.
+ */
+class PropertyMirror : public QQmlPropertyMap
+{
+    Q_OBJECT
+
+public:
+    explicit PropertyMirror(QObject *parent = nullptr);
+    ~PropertyMirror() override;
+
+    // Reads properties of source now, so call before source moves to
+    // another thread, and again every time notifySignal is emitted.
+    template<typename Object, typename Signal>
+    void watch(Object *source, Signal notifySignal, const QList<QByteArray> &properties)
+    {
+        for (const QByteArray &property : properties) {
+            insert(QString::fromLatin1(property), source->property(property.constData()));
+        }
+        m_connections.append(connect(source, notifySignal, source, [this, source, properties]() {
+            stage(source, properties);
+        }, Qt::DirectConnection));
+    }
+
+protected:
+    QVariant updateValue(const QString &key, const QVariant &input) override;
+
+private:
+    // Source's thread
+    void stage(const QObject *source, const QList<QByteArray> &properties);
+    void apply();
+
+    QVector<QMetaObject::Connection> m_connections;
+    QMutex m_mutex;
+    QVariantHash m_pending;
+    bool m_applyQueued;
+};
+
+#endif // PROPERTYMIRROR_H
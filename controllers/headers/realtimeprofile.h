@@ -0,0 +1,336 @@
+#ifndef REALTIMEPROFILE_H
+#define REALTIMEPROFILE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+/**
+ * @brief Real-time scheduling profile for the CAN ingest and decode threads.
+ *
+ * Written as a comma-separated key=value list like a CanLoadProfile, e.g.
+ * "priority=80,cpus=2-3,lock=1":
+ *
+ *   priority   SCHED_FIFO priority of the ingest threads, 1..98; the merge
+ *              and decode threads run one below, so a busy consumer never
+ *              holds off the readers. 0 keeps SCHED_OTHER (default 0)
+ *   cpus       CPUs the threads are pinned to, ranges joined with '+',
+ *              e.g. "3" or "2-3+6" (default: any)
+ *   lock       1 locks all current and future memory with mlockall(), so
+ *              buffers are faulted in when allocated and never paged out.
+ *              Refused unless RLIMIT_MEMLOCK (or CAP_IPC_LOCK) allows
+ *              everything mapped so far plus LockHeadroomMb to grow, since
+ *              past the limit allocations fail rather than go unlocked
+ *              (default 0)
+ *   stack-kb   stack pre-faulted on every thread the profile is applied
+ *              to, 0..4096 (default 256)
+ *
+ * Every setting is read back after it is applied. A thread refused one
+ * (typically for lack of CAP_SYS_NICE or RLIMIT_MEMLOCK) keeps what it got
+ * so far and the error names the setting refused.
+ *
+ * Deliberately free of Qt so tools/canlatency can share it.
+ */
+struct RealtimeProfile
+{
+    // Memory lock=1 expects the process to map after it is applied
+    static constexpr long LockHeadroomMb = 256;
+
+    int priority = 0;
+    std::vector<int> cpus;
+    bool lockMemory = false;
+    int stackKb = 256;
+
+    bool isEnabled() const { return priority > 0 || !cpus.empty() || lockMemory; }
+
+    // Parses spec on top of the defaults. On failure returns false and
+    // names the offending entry in error.
+    bool parse(const std::string &spec, std::string *error = nullptr)
+    {
+        std::size_t start = 0;
+        while (start < spec.size()) {
+            std::size_t end = spec.find(',', start);
+            if (end == std::string::npos) {
+                end = spec.size();
+            }
+            const std::string entry = spec.substr(start, end - start);
+            start = end + 1;
+            if (entry.empty()) {
+                continue;
+            }
+            if (!parseEntry(entry)) {
+                if (error) {
+                    *error = "bad real-time profile entry '" + entry + "'";
+                }
+                return false;
+            }
+        }
+        if (priority < 0 || priority > 98 || stackKb < 0 || stackKb > 4096) {
+            if (error) {
+                *error = "real-time profile out of range";
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // Locks the process' memory if the profile asks for it and the memlock
+    // limit leaves room for it to grow. Freed heap is then kept rather than
+    // returned to the kernel, so it does not have to be faulted in again.
+    bool applyToProcess(std::string *error = nullptr) const
+    {
+        if (!lockMemory) {
+            return true;
+        }
+#ifdef __linux__
+        long mappedKb = 0;
+        bool unlimited = false;
+        readMemoryStatus(&mappedKb, &unlimited);
+        rlimit limit;
+        if (!unlimited && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+            const long neededMb = mappedKb / 1024 + LockHeadroomMb;
+            const long limitMb = static_cast<long>(limit.rlim_cur / (1024 * 1024));
+            if (limitMb < neededMb) {
+                if (error) {
+                    *error = "lock=1 needs a memlock limit of " + std::to_string(neededMb) + " MiB ("
+                             + std::to_string(mappedKb / 1024) + " MiB mapped plus "
+                             + std::to_string(LockHeadroomMb) + " MiB to grow) but it is "
+                             + std::to_string(limitMb) + " MiB; raise it with ulimit -l or grant CAP_IPC_LOCK";
+                }
+                return false;
+            }
+        }
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            return fail(error, "mlockall", errno);
+        }
+#ifdef __GLIBC__
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+#endif
+        return true;
+#else
+        return fail(error, "mlockall", ENOSYS);
+#endif
+    }
+
+    // Applies priority (less priorityOffset, but at least 1), affinity and
+    // stack pre-faulting to the calling thread and checks they took.
+    bool applyToCurrentThread(int priorityOffset = 0, std::string *error = nullptr) const
+    {
+#ifdef __linux__
+        const pthread_t thread = pthread_self();
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+            const int result = pthread_setaffinity_np(thread, sizeof(set), &set);
+            if (result != 0) {
+                return fail(error, "CPU affinity " + cpuList(cpus), result);
+            }
+            cpu_set_t actual;
+            if (pthread_getaffinity_np(thread, sizeof(actual), &actual) != 0 || !CPU_EQUAL(&set, &actual)) {
+                return fail(error, "CPU affinity " + cpuList(cpus), EINVAL);
+            }
+        }
+        if (priority > 0) {
+            sched_param parameters;
+            std::memset(&parameters, 0, sizeof(parameters));
+            parameters.sched_priority = priority - priorityOffset < 1 ? 1 : priority - priorityOffset;
+            const int result = pthread_setschedparam(thread, SCHED_FIFO, &parameters);
+            if (result != 0) {
+                return fail(error, "SCHED_FIFO " + std::to_string(parameters.sched_priority), result);
+            }
+            int policy = 0;
+            sched_param actual;
+            if (pthread_getschedparam(thread, &policy, &actual) != 0 || policy != SCHED_FIFO
+                || actual.sched_priority != parameters.sched_priority) {
+                return fail(error, "SCHED_FIFO " + std::to_string(parameters.sched_priority), EINVAL);
+            }
+        }
+        if (stackKb > 0) {
+            // Touch every page below the current frame once; the pages stay
+            // mapped (and locked, with lock=1) for the life of the thread
+            const std::size_t size = static_cast<std::size_t>(stackKb) * 1024;
+            volatile unsigned char *stack = static_cast<volatile unsigned char *>(alloca(size));
+            for (std::size_t offset = 0; offset < size; offset += 4096) {
+                stack[offset] = 0;
+            }
+        }
+        return true;
+#else
+        (void)priorityOffset;
+        return fail(error, "real-time profile", ENOSYS);
+#endif
+    }
+
+    // Scheduling policy, priority and CPUs of the calling thread, and the
+    // memory locked by the process, e.g. "SCHED_FIFO 80, CPUs 2-3, 51200 kB locked".
+    static std::string describeCurrentThread()
+    {
+#ifdef __linux__
+        std::string description;
+        int policy = 0;
+        sched_param parameters;
+        if (pthread_getschedparam(pthread_self(), &policy, &parameters) == 0) {
+            description = policy == SCHED_FIFO ? "SCHED_FIFO " + std::to_string(parameters.sched_priority)
+                        : policy == SCHED_RR   ? "SCHED_RR " + std::to_string(parameters.sched_priority)
+                                               : std::string("SCHED_OTHER");
+        }
+        cpu_set_t set;
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            std::vector<int> allowed;
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    allowed.push_back(cpu);
+                }
+            }
+            description += ", CPUs " + cpuList(allowed);
+        }
+        if (std::FILE *status = std::fopen("/proc/self/status", "r")) {
+            char line[256];
+            long lockedKb = -1;
+            while (std::fgets(line, sizeof(line), status)) {
+                if (std::sscanf(line, "VmLck: %ld kB", &lockedKb) == 1) {
+                    break;
+                }
+            }
+            std::fclose(status);
+            if (lockedKb >= 0) {
+                description += ", " + std::to_string(lockedKb) + " kB locked";
+            }
+        }
+        return description;
+#else
+        return "default scheduling";
+#endif
+    }
+
+    // "2-3+6"
+    static std::string cpuList(const std::vector<int> &cpus)
+    {
+        std::string list;
+        for (std::size_t i = 0; i < cpus.size(); ++i) {
+            std::size_t last = i;
+            while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1) {
+                ++last;
+            }
+            if (!list.empty()) {
+                list += '+';
+            }
+            list += std::to_string(cpus[i]);
+            if (last > i) {
+                list += '-' + std::to_string(cpus[last]);
+            }
+            i = last;
+        }
+        return list;
+    }
+
+private:
+#ifdef __linux__
+    // Address space mapped by the process, and whether it may lock any
+    // amount of memory whatever its limit (CAP_IPC_LOCK)
+    static void readMemoryStatus(long *mappedKb, bool *unlimited)
+    {
+        if (std::FILE *status = std::fopen("/proc/self/status", "r")) {
+            char line[256];
+            unsigned long long capabilities = 0;
+            while (std::fgets(line, sizeof(line), status)) {
+                if (std::sscanf(line, "VmSize: %ld kB", mappedKb) == 1) {
+                    continue;
+                }
+                if (std::sscanf(line, "CapEff: %llx", &capabilities) == 1) {
+                    *unlimited = (capabilities >> 14 & 1u) != 0;     // CAP_IPC_LOCK
+                }
+            }
+            std::fclose(status);
+        }
+    }
+#endif
+
+    static bool fail(std::string *error, const std::string &what, int code)
+    {
+        if (error) {
+            *error = what + ": " + std::strerror(code);
+        }
+        return false;
+    }
+
+    bool parseEntry(const std::string &entry)
+    {
+        const std::size_t separator = entry.find('=');
+        if (separator == std::string::npos) {
+            return false;
+        }
+        const std::string key = entry.substr(0, separator);
+        const char *value = entry.c_str() + separator + 1;
+        char *end = nullptr;
+
+        if (key == "priority") {
+            priority = static_cast<int>(std::strtol(value, &end, 10));
+        } else if (key == "lock") {
+            lockMemory = std::strtol(value, &end, 10) != 0;
+        } else if (key == "stack-kb") {
+            stackKb = static_cast<int>(std::strtol(value, &end, 10));
+        } else if (key == "cpus") {
+            return parseCpus(value);
+        } else {
+            return false;
+        }
+        return end != value && *end == '\0';
+    }
+
+    bool parseCpus(const char *value)
+    {
+        cpus.clear();
+        for (;;) {
+            char *end = nullptr;
+            const long first = std::strtol(value, &end, 10);
+            long last = first;
+            if (end == value) {
+                return false;
+            }
+            if (*end == '-') {
+                value = end + 1;
+                last = std::strtol(value, &end, 10);
+                if (end == value) {
+                    return false;
+                }
+            }
+            if (first < 0 || last < first || last >= 1024) {
+                return false;
+            }
+            for (long cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+            if (*end == '\0') {
+                std::sort(cpus.begin(), cpus.end());
+                cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+                return true;
+            }
+            if (*end != '+') {
+                return false;
+            }
+            value = end + 1;
+        }
+    }
+};
+
+#endif // REALTIMEPROFILE_H
@@ -0,0 +1,95 @@
+#ifndef SIGNALHISTORY_H
+#define SIGNALHISTORY_H
+
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+#include "vehiclesignalstore.h"
+
+/**
+ * @brief Bounded history of every vehicle signal for trend graphs.
+ *
+ * Each signal keeps a ring of its most recent raw samples and a pyramid of
+ * min/max/sum/count buckets: level 0 buckets span baseBucketUs, each level
+ * above spans levelFactor times more. A bucket's slot in its level's ring
+ * follows from its time alone (index modulo the ring size), so append()
+ * touches one slot per level and never allocates, and a gap in the data
+ * simply leaves stale slots that queries recognise and skip.
+ *
+ * trend() picks, for the requested span and column count, the coarsest
+ * level whose buckets still fit in a column and that reaches back far
+ * enough, so a column reads fewer than levelFactor buckets unless the span
+ * outgrows the top level. Column edges are accurate to one bucket.
+ *
+ * append() must be called from one thread, the one updating the signal
+ * store. samples() and trend() may be called from any thread; a per-signal
+ * seqlock makes them retry reads that raced with an append.
+ */
+class SignalHistory
+{
+public:
+    struct Config
+    {
+        int rawCapacity = 4096;        // raw samples per signal, power of two
+        int bucketsPerLevel = 1024;    // buckets per level and signal, power of two
+        int levels = 8;
+        qint64 baseBucketUs = 10000;
+        int levelFactor = 4;
+
+        // Largest raw and bucket rings whose total for all signals fits in
+        // bytes, keeping the other settings; at least 64 raw samples and 16
+        // buckets per level.
+        static Config forMemoryBudget(qint64 bytes);
+        qint64 memoryUsage() const;
+        // Time the coarsest level reaches back.
+        qint64 retentionUs() const;
+    };
+
+    struct Sample
+    {
+        qint64 timestampUs;
+        double value;
+    };
+
+    struct Point
+    {
+        qint64 startUs;     // start of the column
+        double min;
+        double max;
+        double mean;
+        quint32 count;      // samples aggregated; 0 when the column has no data
+    };
+
+    SignalHistory();
+    explicit SignalHistory(const Config &config);
+    ~SignalHistory();
+
+    SignalHistory(const SignalHistory &) = delete;
+    SignalHistory &operator=(const SignalHistory &) = delete;
+
+    // Drops all history and reallocates. Only while no other thread uses it.
+    void configure(const Config &config);
+    const Config &config() const { return m_config; }
+
+    void append(VehicleSignalStore::SignalId id, double value, qint64 timestampUs);
+
+    // Raw samples in [fromUs, toUs), oldest first, at most maxSamples of the
+    // newest ones.
+    QVector<Sample> samples(VehicleSignalStore::SignalId id, qint64 fromUs, qint64 toUs, int maxSamples = 4096) const;
+    // [fromUs, toUs) cut into columns of equal width.
+    QVector<Point> trend(VehicleSignalStore::SignalId id, qint64 fromUs, qint64 toUs, int columns) const;
+
+private:
+    struct Ring;
+
+    template<typename Read>
+    void readConsistent(VehicleSignalStore::SignalId id, Read read) const;
+    Point readColumn(VehicleSignalStore::SignalId id, int level, qint64 startUs, qint64 endUs) const;
+
+    Config m_config;
+    std::unique_ptr<Ring> m_ring;
+};
+
+#endif // SIGNALHISTORY_H
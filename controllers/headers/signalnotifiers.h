@@ -0,0 +1,40 @@
+#ifndef SIGNALNOTIFIERS_H
+#define SIGNALNOTIFIERS_H
+
+#include <QMetaMethod>
+#include <QMetaProperty>
+
+#include <array>
+
+#include "vehiclesignalstore.h"
+
+class QObject;
+
+/**
+ * @brief NOTIFY signals of a class's vehicle signal properties, by SignalId.
+ *
+ * Looks each signal's property up by VehicleSignalStore::signalName() once,
+ * so a class whose properties carry those names emits its change
+ * notifications from a mask without a case per signal. Signals the class
+ * has no notifying property for are left out of mask().
+ */
+class SignalNotifiers
+{
+public:
+    explicit SignalNotifiers(const QMetaObject &metaObject);
+
+    // Signals with a notifying property
+    VehicleSignalStore::SignalMask mask() const { return m_mask; }
+
+    // Emits the NOTIFY signal of every property in signalMask & mask(),
+    // lowest ID first, with the property's current value. Each is traced
+    // under traceCategory, named after its signal.
+    void notify(QObject *object, VehicleSignalStore::SignalMask signalMask, const char *traceCategory) const;
+
+private:
+    std::array<QMetaProperty, VehicleSignalStore::SignalCount> m_properties;
+    std::array<QMetaMethod, VehicleSignalStore::SignalCount> m_notifySignals;
+    VehicleSignalStore::SignalMask m_mask;
+};
+
+#endif // SIGNALNOTIFIERS_H
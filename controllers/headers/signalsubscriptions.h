@@ -0,0 +1,61 @@
+#ifndef SIGNALSUBSCRIPTIONS_H
+#define SIGNALSUBSCRIPTIONS_H
+
+#include <QVector>
+
+#include <array>
+#include <limits>
+
+#include "vehiclesignalstore.h"
+
+/**
+ * @brief Which store signals someone consumes, and how fresh they want them.
+ *
+ * A consumer (the QML properties, the warning rules, the trip computer,
+ * the history, a view) subscribes to a set of signals at a rate: changes
+ * are always delivered, and while a signal holds still it is sampled
+ * again at least rate times a second. Rate 0 asks for changes only,
+ * qInf() for every frame. The decoder extracts only signals someone
+ * subscribed to, and refreshes each at the highest rate asked for it.
+ *
+ * Plain data, used on the thread writing the store.
+ */
+class SignalSubscriptions
+{
+public:
+    // Refresh interval of a signal subscribed for changes only
+    static constexpr qint64 NoRefreshUs = std::numeric_limits<qint64>::max();
+
+    SignalSubscriptions();
+
+    // Returns the subscription's ID, > 0.
+    int subscribe(VehicleSignalStore::SignalMask signalMask, double rate);
+    // Replaces the signals and rate of a subscription; false if id is not
+    // subscribed.
+    bool update(int id, VehicleSignalStore::SignalMask signalMask, double rate);
+    bool unsubscribe(int id);
+    int count() const;
+
+    // Signals with at least one subscriber
+    VehicleSignalStore::SignalMask subscribedMask() const { return m_mask; }
+    bool isSubscribed(VehicleSignalStore::SignalId id) const { return (m_mask & VehicleSignalStore::signalBit(id)) != 0; }
+    // Longest a subscribed signal may go without a fresh sample
+    qint64 refreshIntervalUs(VehicleSignalStore::SignalId id) const { return m_refreshUs[id]; }
+
+private:
+    struct Subscription
+    {
+        int id;
+        VehicleSignalStore::SignalMask signalMask;
+        double rate;
+    };
+
+    void rebuild();
+
+    QVector<Subscription> m_subscriptions;
+    int m_nextId;
+    VehicleSignalStore::SignalMask m_mask;
+    std::array<qint64, VehicleSignalStore::SignalCount> m_refreshUs;
+};
+
+#endif // SIGNALSUBSCRIPTIONS_H
@@ -0,0 +1,111 @@
+#ifndef SPSCRINGBUFFER_H
+#define SPSCRINGBUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free single-producer/single-consumer ring buffer.
+ *
+ * Exactly one thread may call push() and exactly one (other) thread may call
+ * pop()/popBatch(). Capacity must be a power of two; one slot is never left
+ * unused because head and tail are free-running counters.
+ *
+ * The producer keeps a high-water mark and a count of items it had to drop
+ * because the ring was full, so the consumer side can report back-pressure
+ * without any locking.
+ */
+template <typename T, std::size_t Capacity>
+class SpscRingBuffer
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRingBuffer capacity must be a power of two");
+
+public:
+    SpscRingBuffer() = default;
+    SpscRingBuffer(const SpscRingBuffer &) = delete;
+    SpscRingBuffer &operator=(const SpscRingBuffer &) = delete;
+
+    static constexpr std::size_t capacity() { return Capacity; }
+
+    // Producer side. Returns false (and counts a drop) when the ring is full.
+    template <typename U>
+    bool push(U &&item)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        const std::size_t tail = m_tail.load(std::memory_order_acquire);
+        const std::size_t used = head - tail;
+        if (used >= Capacity) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_slots[head & Mask] = std::forward<U>(item);
+        m_head.store(head + 1, std::memory_order_release);
+
+        if (used + 1 > m_highWaterMark.load(std::memory_order_relaxed)) {
+            m_highWaterMark.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer side. Moves at most one item out.
+    bool pop(T &item)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        item = std::move(m_slots[tail & Mask]);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Moves up to maxItems items into out, publishing the new
+    // tail once for the whole batch. Returns the number of items moved.
+    std::size_t popBatch(T *out, std::size_t maxItems)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        const std::size_t head = m_head.load(std::memory_order_acquire);
+        std::size_t count = head - tail;
+        if (count > maxItems) {
+            count = maxItems;
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            out[i] = std::move(m_slots[(tail + i) & Mask]);
+        }
+        if (count > 0) {
+            m_tail.store(tail + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // Approximate when called concurrently with the other side.
+    std::size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    bool isEmpty() const { return size() == 0; }
+
+    std::size_t highWaterMark() const { return m_highWaterMark.load(std::memory_order_relaxed); }
+    std::size_t droppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr std::size_t Mask = Capacity - 1;
+    static constexpr std::size_t CacheLine = 64;
+
+    // Producer-owned and consumer-owned indices live on separate cache lines
+    // so the two threads do not false-share.
+    alignas(CacheLine) std::atomic<std::size_t> m_head{0};
+    std::atomic<std::size_t> m_highWaterMark{0};
+    std::atomic<std::size_t> m_dropped{0};
+    alignas(CacheLine) std::atomic<std::size_t> m_tail{0};
+    alignas(CacheLine) std::array<T, Capacity> m_slots{};
+};
+
+#endif // SPSCRINGBUFFER_H
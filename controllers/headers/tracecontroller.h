@@ -0,0 +1,91 @@
+#ifndef TRACECONTROLLER_H
+#define TRACECONTROLLER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+#include <atomic>
+
+class QQuickWindow;
+class QThread;
+
+/**
+ * @brief Runtime control of the TraceRecorder, and its flight recorder.
+ *
+ * Switches recording on and off, saves what was recorded, and marks the
+ * window's frames in the trace: animation, scene graph sync and render of
+ * each frame, and its swap.
+ *
+ * With a stutter directory set, a frame that takes longer than the stutter
+ * threshold from animation to swap, or that follows the previous one that
+ * much later while the window was rendering continuously, is a stutter: a
+ * second later, so the trace shows how the system recovered, the last
+ * captureSeconds of every thread are saved to a stutter-<time>.json in
+ * that directory, on a thread of their own so the GUI thread keeps
+ * rendering. Stutters while a capture is pending or being written, or
+ * within captureSeconds after one, do not start another.
+ *
+ * Frame events and stutter detection need VEHICLESYS_TRACING.
+ */
+class TraceController : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(bool available READ isAvailable CONSTANT)
+
+public:
+    static constexpr int DefaultStutterMs = 50;
+    static constexpr int DefaultCaptureSeconds = 5;
+
+    explicit TraceController(QObject *parent = nullptr);
+    // Waits for a capture being written
+    ~TraceController() override;
+
+    bool isEnabled() const;
+    void setEnabled(bool enabled);
+    // Whether trace points were compiled in
+    bool isAvailable() const;
+
+    // Frame events and stutters come from window, which must live on this
+    // thread.
+    void setWindow(QQuickWindow *window);
+    // Captures stutters into directory; empty stops capturing.
+    void setStutterCapture(const QString &directory, int thresholdMs = DefaultStutterMs,
+                           int captureSeconds = DefaultCaptureSeconds);
+
+    // Everything recorded, or its last lastSeconds, as a Chrome JSON or,
+    // for a .pftrace path, Perfetto trace.
+    Q_INVOKABLE bool save(const QString &path, int lastSeconds = 0);
+
+signals:
+    void enabledChanged(bool enabled);
+    void stutterCaptured(const QString &path);
+
+private:
+    void markFrameStart();
+    void markSynchronizing();
+    void markFrameSwapped();
+    void scheduleCapture();
+    void capture();
+    void finishCapture(const QString &path, bool saved, const QString &error);
+
+    QPointer<QQuickWindow> m_window;
+    QList<QMetaObject::Connection> m_windowConnections;
+
+    QString m_stutterDirectory;
+    std::atomic<qint64> m_stutterNs;    // 0 while not capturing
+    int m_captureSeconds;
+    bool m_capturePending;
+    qint64 m_lastCaptureNs;
+    QThread *m_captureThread;
+
+    // Frame timing; the start is set on the GUI thread, the rest belongs
+    // to the render thread
+    std::atomic<qint64> m_frameStartNs;
+    qint64 m_syncedFrameStartNs;
+    qint64 m_lastSwapNs;
+    qint64 m_lastIntervalNs;
+};
+
+#endif // TRACECONTROLLER_H
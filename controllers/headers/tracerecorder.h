@@ -0,0 +1,107 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QString>
+#include <QtGlobal>
+
+#include <atomic>
+
+/**
+ * @brief Low-overhead event tracing into per-thread ring buffers.
+ *
+ * The VEHICLESYS_TRACE_* macros below record scopes, instants and counters
+ * while recording is enabled; disabled, a trace point costs one relaxed
+ * load and a branch, and built without VEHICLESYS_TRACING it is gone.
+ * Names and categories must be string literals or otherwise outlive the
+ * recorder, since only the pointers are stored.
+ *
+ * Each thread writes to its own ring of EventsPerThread events, allocated
+ * on its first event and kept for the life of the process, without locks.
+ * Rings always wrap, overwriting their oldest events, so they hold the last
+ * few seconds of a busy thread: left enabled, the recorder is a flight
+ * recorder and save() with a window captures what led up to a problem.
+ *
+ * save() writes the Chrome trace event JSON format (chrome://tracing,
+ * ui.perfetto.dev) or, for a .pftrace/.perfetto-trace path, a Perfetto
+ * protobuf trace. It may run on any thread while others keep recording.
+ */
+class TraceRecorder
+{
+public:
+    static constexpr int EventsPerThread = 32768;
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    // steady_clock nanoseconds, the clock of canMonotonicMicros()
+    static qint64 nowNs();
+
+    // Phases of the Chrome trace event format
+    static void complete(const char *category, const char *name, qint64 startNs, qint64 durationNs);
+    static void instant(const char *category, const char *name);
+    static void counter(const char *category, const char *name, qint64 value);
+    static void begin(const char *category, const char *name);
+    static void end(const char *category, const char *name);
+
+    // Events of the last windowMs before now (0: everything still held),
+    // from every thread.
+    static bool save(const QString &path, qint64 windowMs = 0, QString *error = nullptr);
+
+private:
+    static void record(char phase, const char *category, const char *name, qint64 timestampNs, qint64 value);
+
+    static std::atomic<bool> s_enabled;
+};
+
+/**
+ * @brief Records a complete event for its own lifetime.
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name)
+        : m_category(category)
+        , m_name(name)
+        , m_startNs(TraceRecorder::isEnabled() ? TraceRecorder::nowNs() : 0)
+    {
+    }
+    ~TraceScope()
+    {
+        if (m_startNs) {
+            TraceRecorder::complete(m_category, m_name, m_startNs, TraceRecorder::nowNs() - m_startNs);
+        }
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *m_category;
+    const char *m_name;
+    qint64 m_startNs;
+};
+
+#define VEHICLESYS_TRACE_CONCAT2(a, b) a##b
+#define VEHICLESYS_TRACE_CONCAT(a, b) VEHICLESYS_TRACE_CONCAT2(a, b)
+
+#ifdef VEHICLESYS_TRACING
+// The enclosing block, as one complete event
+#define VEHICLESYS_TRACE_SCOPE(category, name) \
+    const TraceScope VEHICLESYS_TRACE_CONCAT(traceScope, __LINE__)(category, name)
+#define VEHICLESYS_TRACE_INSTANT(category, name) \
+    do { if (TraceRecorder::isEnabled()) TraceRecorder::instant(category, name); } while (false)
+#define VEHICLESYS_TRACE_COUNTER(category, name, value) \
+    do { if (TraceRecorder::isEnabled()) TraceRecorder::counter(category, name, value); } while (false)
+// Spans crossing function boundaries, on one thread
+#define VEHICLESYS_TRACE_BEGIN(category, name) \
+    do { if (TraceRecorder::isEnabled()) TraceRecorder::begin(category, name); } while (false)
+#define VEHICLESYS_TRACE_END(category, name) \
+    do { if (TraceRecorder::isEnabled()) TraceRecorder::end(category, name); } while (false)
+#else
+#define VEHICLESYS_TRACE_SCOPE(category, name) do { } while (false)
+#define VEHICLESYS_TRACE_INSTANT(category, name) do { } while (false)
+#define VEHICLESYS_TRACE_COUNTER(category, name, value) do { } while (false)
+#define VEHICLESYS_TRACE_BEGIN(category, name) do { } while (false)
+#define VEHICLESYS_TRACE_END(category, name) do { } while (false)
+#endif
+
+#endif // TRACERECORDER_H
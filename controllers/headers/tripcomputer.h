@@ -0,0 +1,136 @@
+#ifndef TRIPCOMPUTER_H
+#define TRIPCOMPUTER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVariantMap>
+
+#include "vehiclesignalstore.h"
+
+/**
+ * @brief Trip averages, fuel economy and range, kept up to date per sample.
+ *
+ * Three trips run side by side: A and B, which the driver resets, and one
+ * reset automatically when the fuel level jumps by RefuelPercent. Each keeps
+ * its distance, driving time (moving), idle time (engine running, standing
+ * still), top speed and fuel used; averages are derived from those when read.
+ *
+ * There is no fuel flow signal, so the flow is modelled from engine speed
+ * and throttle and calibrated against the fuel level: whenever the (slowly
+ * filtered) level has dropped by CalibrationLitres, the litres per model
+ * unit move towards what the tank actually lost. Range is the fuel left
+ * over a consumption averaged across the last RangeSmoothingKm or so.
+ *
+ * addInterval() does a fixed amount of work per speed sample. Properties
+ * are announced at most every UpdateIntervalMs. saveState() and
+ * restoreState() carry everything across restarts as a flat array of
+ * StateValues doubles.
+ *
+ * Lives on, and must only be used from, the thread writing the store.
+ */
+class TripComputer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QVariantMap tripA READ tripA NOTIFY updated)
+    Q_PROPERTY(QVariantMap tripB READ tripB NOTIFY updated)
+    Q_PROPERTY(QVariantMap sinceRefuel READ sinceRefuel NOTIFY updated)
+    Q_PROPERTY(double instantConsumption READ instantConsumption NOTIFY updated)
+    Q_PROPERTY(double fuelRate READ fuelRate NOTIFY updated)
+    Q_PROPERTY(double range READ range NOTIFY updated)
+
+public:
+    enum Trip {
+        TripA,
+        TripB,
+        SinceRefuel,
+        TripCount
+    };
+    Q_ENUM(Trip)
+
+    static constexpr int UpdateIntervalMs = 500;
+    static constexpr int StateValues = 20;
+
+    explicit TripComputer(const VehicleSignalStore &store, QObject *parent = nullptr);
+
+    // Usable fuel in a full tank, 50 L unless set
+    void setTankCapacity(double litres);
+    double tankCapacity() const;
+
+    // distance, averageSpeed (km/h), maxSpeed (km/h), drivingTime and
+    // idleTime (s), fuelUsed (L) and averageConsumption (L/100 km)
+    Q_INVOKABLE QVariantMap tripData(int trip) const;
+    QVariantMap tripA() const;
+    QVariantMap tripB() const;
+    QVariantMap sinceRefuel() const;
+
+    // L/100 km at the last sample, 0 when standing still
+    double instantConsumption() const;
+    // L/h at the last sample
+    double fuelRate() const;
+    // km left at the smoothed consumption
+    double range() const;
+
+    // Accounts for intervalUs of driving that covered distanceKm and ended
+    // at speedKmh, at the engine speed, throttle and fuel level the store
+    // holds now.
+    void addInterval(qint64 intervalUs, double distanceKm, double speedKmh);
+
+    // Writes StateValues values to state; restoreState() ignores state of
+    // any other length.
+    void saveState(double *state) const;
+    bool restoreState(const double *state, int count);
+
+public slots:
+    void resetTrip(int trip);
+
+signals:
+    void updated();
+    void tripReset(int trip);
+
+private:
+    // Fuel flow per model unit (engine speed in krpm times load) before
+    // any calibration, and the load at closed throttle
+    static constexpr double DefaultLitresPerUnitHour = 6.5;
+    static constexpr double IdleLoad = 0.15;
+    static constexpr double CalibrationLitres = 2.0;
+    static constexpr double CalibrationGain = 0.3;
+    static constexpr double RefuelPercent = 5.0;
+    // The fuel level sloshes; it is low-passed over about this long
+    static constexpr double FuelFilterSeconds = 30.0;
+    static constexpr double RangeSmoothingKm = 25.0;
+    static constexpr double DefaultConsumption = 8.0;
+    // Below this instantaneous L/100 km is meaningless
+    static constexpr double MinConsumptionSpeed = 3.0;
+    static constexpr int StateVersion = 1;
+
+    struct TripState
+    {
+        double distanceKm;
+        double drivingSeconds;
+        double idleSeconds;
+        double maxSpeedKmh;
+        double fuelLitres;
+    };
+
+    void updateFuelLevel(double seconds);
+    void markUpdated();
+
+    const VehicleSignalStore &m_store;
+    double m_tankLitres;
+
+    TripState m_trips[TripCount];
+
+    double m_fuelRate;
+    double m_instantConsumption;
+    double m_rangeConsumption;      // L/100 km
+
+    double m_litresPerUnitHour;
+    double m_filteredFuelPercent;   // negative until the first valid level
+    // Filtered level and model units since the last calibration
+    double m_anchorFuelPercent;
+    double m_unitHoursSinceAnchor;
+
+    QTimer *m_updateTimer;
+};
+
+#endif // TRIPCOMPUTER_H
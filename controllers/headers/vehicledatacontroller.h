@@ -3,109 +3,331 @@
 
 #include <QObject>
 #include <QString>
-#include <QTimer>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
 
+#include <array>
+
+#include "canframe.h"
+#include "dbcdecoder.h"
+#include "odometerjournal.h"
+#include "signalhistory.h"
+#include "signalsubscriptions.h"
+#include "vehiclesignalstore.h"
+#include "vehiclestatedelta.h"
+#include "vehiclestatepublisher.h"
+
+class CanTrafficStats;
+class NotificationScheduler;
+class TripComputer;
+class WarningRuleEngine;
+class QQuickWindow;
+
+/**
+ * @brief Decodes CAN frames into the vehicle signal store and everything fed from it.
+ *
+ * Lives on the thread frames arrive on, normally a worker shared with
+ * CanBusController; QML sees it through a VehicleDataProxy on the GUI
+ * thread, which stateChanged() keeps up to date once per notification
+ * flush. Unless noted otherwise its methods must be called on its own
+ * thread.
+ */
 class VehicleDataController : public QObject
 {
     Q_OBJECT
-    Q_PROPERTY(int speed READ speed NOTIFY speedChanged)
-    Q_PROPERTY(int rpm READ rpm NOTIFY rpmChanged)
-    Q_PROPERTY(int fuelLevel READ fuelLevel NOTIFY fuelLevelChanged)
-    Q_PROPERTY(int engineTemperature READ engineTemperature NOTIFY engineTemperatureChanged)
+    Q_PROPERTY(double speed READ speed NOTIFY speedChanged)
+    Q_PROPERTY(double rpm READ rpm NOTIFY rpmChanged)
+    Q_PROPERTY(double fuelLevel READ fuelLevel NOTIFY fuelLevelChanged)
+    Q_PROPERTY(double engineTemperature READ engineTemperature NOTIFY engineTemperatureChanged)
     Q_PROPERTY(bool leftTurnSignal READ leftTurnSignal NOTIFY leftTurnSignalChanged)
     Q_PROPERTY(bool rightTurnSignal READ rightTurnSignal NOTIFY rightTurnSignalChanged)
     Q_PROPERTY(bool headlights READ headlights NOTIFY headlightsChanged)
     Q_PROPERTY(bool parkingBrake READ parkingBrake NOTIFY parkingBrakeChanged)
     Q_PROPERTY(QString gear READ gear NOTIFY gearChanged)
     Q_PROPERTY(double odometer READ odometer NOTIFY odometerChanged)
-    Q_PROPERTY(int batteryVoltage READ batteryVoltage NOTIFY batteryVoltageChanged)
+    Q_PROPERTY(double batteryVoltage READ batteryVoltage NOTIFY batteryVoltageChanged)
     Q_PROPERTY(bool engineRunning READ engineRunning NOTIFY engineRunningChanged)
     Q_PROPERTY(bool seatbelt READ seatbelt NOTIFY seatbeltChanged)
     Q_PROPERTY(bool doorOpen READ doorOpen NOTIFY doorOpenChanged)
+    Q_PROPERTY(bool acOn READ acOn NOTIFY acOnChanged)
+    Q_PROPERTY(int fanSpeed READ fanSpeed NOTIFY fanSpeedChanged)
+    Q_PROPERTY(double cabinTemperature READ cabinTemperature NOTIFY cabinTemperatureChanged)
+    Q_PROPERTY(QStringList activeWarnings READ activeWarnings NOTIFY activeWarningsChanged)
 
 public:
     explicit VehicleDataController(QObject *parent = nullptr);
 
     // Getters
-    int speed() const;
-    int rpm() const;
-    int fuelLevel() const;
-    int engineTemperature() const;
+    double speed() const;
+    double rpm() const;
+    double fuelLevel() const;
+    double engineTemperature() const;
     bool leftTurnSignal() const;
     bool rightTurnSignal() const;
     bool headlights() const;
     bool parkingBrake() const;
     QString gear() const;
     double odometer() const;
-    int batteryVoltage() const;
+    double batteryVoltage() const;
     bool engineRunning() const;
     bool seatbelt() const;
     bool doorOpen() const;
+    bool acOn() const;
+    int fanSpeed() const;
+    double cabinTemperature() const;
+
+    // Replaces the decode table with one built from the DBC at path. The
+    // current table is kept if the file cannot be loaded.
+    Q_INVOKABLE bool loadDbc(const QString &path);
+    // Gives frames from one bus their own decode table. Buses without one
+    // use the table loaded by loadDbc().
+    Q_INVOKABLE bool loadBusDbc(int bus, const QString &path);
+
+    // Current vehicle state. The properties above read it on this object's
+    // thread; other threads take sample() or snapshot() from it.
+    const VehicleSignalStore &signalStore() const;
+    // Value of any store signal by name, invalid until first received.
+    // Any thread.
+    Q_INVOKABLE QVariant signalValue(const QString &name) const;
+    static const QString &gearName(int gear);
+
+    // Property notifications and stateChanged() are coalesced to one per
+    // frame of window (a timer without one), which may live on another
+    // thread. A signal's deadband and maximum rate thin them further; both
+    // return false for unknown signal names.
+    void setNotificationWindow(QQuickWindow *window);
+    Q_INVOKABLE bool setSignalDeadband(const QString &name, double deadband);
+    Q_INVOKABLE bool setSignalMaxRate(const QString &name, double maxRate);
+    Q_INVOKABLE QVariantMap notificationStatistics() const;
+    // Average time from a frame of the window starting to it reaching the
+    // screen, 0 before the first. Any thread.
+    qint64 presentationDelayUs() const;
+    // Runs the notification flush the next window frame or timer tick
+    // would, for callers without an event loop.
+    void flushNotifications();
+    // Every signal and the active warnings, as a delta from nothing
+    VehicleStateDelta fullState() const;
+
+    // Every sample of every signal is kept in a bounded history; other
+    // threads may query it. configureHistory() drops what it holds and
+    // resizes it to fit memoryBytes, so call it before frames arrive.
+    const SignalHistory &signalHistory() const;
+    void configureHistory(qint64 memoryBytes);
+    // The last spanSeconds of a signal in columns of min, max, mean and
+    // sample count, oldest first; "time" is each column's start in seconds
+    // relative to now (negative). Empty for unknown signal names. Any
+    // thread.
+    Q_INVOKABLE QVariantList signalTrend(const QString &name, double spanSeconds, int columns) const;
+
+    // Signals are decoded only while something subscribes to them; the
+    // properties, the warning rules, the trip computer and the history do
+    // from the start. subscribe() adds a consumer of the named signals at
+    // a rate (see SignalSubscriptions) and returns its ID, -1 if a name is
+    // unknown. A frame repeating the last payload of its ID is not decoded
+    // again until one of its subscribed signals is due a refresh.
+    Q_INVOKABLE int subscribe(const QStringList &names, double rate = 0);
+    Q_INVOKABLE bool unsubscribe(int subscription);
+    // The properties' own subscription, e.g. off while the dashboard is
+    // hidden; signalValue() and the proxy's estimates read through it too.
+    Q_INVOKABLE void setPropertiesActive(bool active);
+    // Samples per second the history gets of signals holding still; 0
+    // leaves it with what the other subscribers have decoded.
+    void setHistorySampleRate(double rate);
+    // Frames of known IDs, those decoded, repeats and unsubscribed ones
+    // skipped, catch-up decodes and signals decoded since startup, and the
+    // number of subscriptions.
+    Q_INVOKABLE QVariantMap decodeStatistics() const;
+
+    // Warnings come from the rules in :/rules/warnings.rules unless
+    // loadWarningRules() replaces them; the current rules are kept if the
+    // file has errors. activeWarnings lists the names of those that are on.
+    bool loadWarningRules(const QString &path);
+    QStringList activeWarnings() const;
+    // Lets a latched warning go off once its condition has cleared.
+    Q_INVOKABLE bool acknowledgeWarning(const QString &name);
+    // Recent warnings turning on and off: time (ms since the epoch), name,
+    // message, level and active.
+    Q_INVOKABLE QVariantList warningLog() const;
+
+    // Restores the odometer, trip distance and trip computer from the
+    // journal at path and keeps it up to date from then on. Without one
+    // they start from defaults on every run.
+    bool openOdometerJournal(const QString &path);
+    static QString defaultOdometerJournalPath();
+
+    // Publishes the store into the shared-memory segment name after every
+    // batch of updates, for other processes to read with
+    // VehicleStateReader. Off unless opened.
+    bool openStatePublication(const QString &name);
+
+    // Trip A follows the trip odometer; resetTripOdometer() resets both.
+    TripComputer *tripComputer() const;
+
+    // Frames no decode table knows are counted in stats, which must be the
+    // instance the frames were recorded in, on this thread. Without one
+    // they are dropped silently.
+    void setTrafficStats(CanTrafficStats *stats);
 
 public slots:
     void processCanFrame(quint32 frameId, const QByteArray &data);
+    void processCanFrames(const QVector<CanFrame> &frames);
     void resetTripOdometer();
     void toggleEngineState();
 
 signals:
-    void speedChanged(int speed);
-    void rpmChanged(int rpm);
-    void fuelLevelChanged(int fuelLevel);
-    void engineTemperatureChanged(int engineTemperature);
+    void speedChanged(double speed);
+    void rpmChanged(double rpm);
+    void fuelLevelChanged(double fuelLevel);
+    void engineTemperatureChanged(double engineTemperature);
     void leftTurnSignalChanged(bool leftTurnSignal);
     void rightTurnSignalChanged(bool rightTurnSignal);
     void headlightsChanged(bool headlights);
     void parkingBrakeChanged(bool parkingBrake);
     void gearChanged(const QString &gear);
     void odometerChanged(double odometer);
-    void batteryVoltageChanged(int batteryVoltage);
+    void batteryVoltageChanged(double batteryVoltage);
     void engineRunningChanged(bool engineRunning);
     void seatbeltChanged(bool seatbelt);
     void doorOpenChanged(bool doorOpen);
+    void acOnChanged(bool acOn);
+    void fanSpeedChanged(int fanSpeed);
+    void cabinTemperatureChanged(double cabinTemperature);
     
-    // Warning signals
+    void activeWarningsChanged();
+    // Once per notification flush that delivered anything, for a
+    // VehicleDataProxy; only built while something is connected.
+    void stateChanged(const VehicleStateDelta &delta);
+
+    // Raised when the warning rule of the same name turns on
     void lowFuelWarning();
     void engineOverheatWarning();
     void batteryLowWarning();
 
 private slots:
-    void updateOdometer();
+    void emitNotifications(VehicleSignalStore::SignalMask signalMask);
+    void sendStateDelta();
+    void announceWarning(int rule, bool active);
+    void handleTripReset(int trip);
 
 private:
-    void setSpeed(int speed);
-    void setRpm(int rpm);
-    void setFuelLevel(int fuelLevel);
-    void setEngineTemperature(int engineTemperature);
-    void setLeftTurnSignal(bool leftTurnSignal);
-    void setRightTurnSignal(bool rightTurnSignal);
-    void setHeadlights(bool headlights);
-    void setParkingBrake(bool parkingBrake);
-    void setGear(const QString &gear);
-    void setBatteryVoltage(int batteryVoltage);
-    void setEngineRunning(bool engineRunning);
-    void setSeatbelt(bool seatbelt);
-    void setDoorOpen(bool doorOpen);
-
-    // Vehicle state variables
-    int m_speed;
-    int m_rpm;
-    int m_fuelLevel;
-    int m_engineTemperature;
-    bool m_leftTurnSignal;
-    bool m_rightTurnSignal;
-    bool m_headlights;
-    bool m_parkingBrake;
-    QString m_gear;
-    double m_odometer;
-    double m_tripOdometer;
-    int m_batteryVoltage;
-    bool m_engineRunning;
-    bool m_seatbelt;
-    bool m_doorOpen;
-    
-    // Timers and helpers
-    QTimer *m_odometerTimer;
-    int m_previousSpeed;
+    // Store signal each DBC signal feeds, NoSignal if none
+    static constexpr quint8 NoSignal = 0xFF;
+    // Longer between two speed samples and the bus was silent; no distance
+    // is guessed for the gap.
+    static constexpr qint64 MaxSpeedGapUs = 2000000;
+    // Speed is sampled at least this often while it holds still, well
+    // inside MaxSpeedGapUs
+    static constexpr double DistanceSampleRate = 10.0;
+    static constexpr double DefaultHistorySampleRate = 10.0;
+
+    // Last payload decoded for a message, to skip repeats of it
+    struct MessageState
+    {
+        qint64 decodedUs;
+        qint64 repeatUs;        // last repeat skipped since, 0 if none
+        qint64 repeatSourceOffsetUs;
+        quint8 bus;
+        quint8 length;          // 0 before the first decode
+        bool changed;           // the last decode was of a new payload
+        quint8 payload[CanFrame::MaxPayloadSize];
+    };
+
+    // DBC decode table and the store signal each of its signals feeds
+    struct DecodeTable
+    {
+        DecodeTable() : loaded(false), useGeneratedDecoder(false) {}
+
+        DbcDecoder decoder;
+        QVector<quint8> bindings;
+        bool loaded;
+        // True when decoder was loaded from the DBC the build generated
+        // VehicleDbc from, so the compile-time decoder can replace the table walk
+        bool useGeneratedDecoder;
+
+        // Decode plan: per signal whether it is decoded, per message the
+        // longest a repeated payload goes undecoded (-1 when none of its
+        // signals is), and the payload last decoded
+        QVector<quint8> wanted;
+        QVector<qint64> refreshUs;
+        QVector<MessageState> messages;
+    };
+
+    bool loadTable(DecodeTable &table, const QString &path);
+    DecodeTable &tableForBus(quint8 bus);
+    // sourceOffsetUs is CanFrame::sourceTimeUs() - timestampUs
+    void decodeFrame(DecodeTable &table, quint8 bus, quint32 frameId, bool extended, const quint8 *data, int size,
+                     qint64 timestampUs, qint64 sourceOffsetUs);
+    void decodeSignals(const DecodeTable &table, const DbcDecoder::MessageDescriptor &message, const quint8 *data,
+                       int size, qint64 timestampUs);
+    void applySignal(quint8 binding, double value, qint64 timestampUs);
+    // Adds the distance covered since the previous speed sample and feeds
+    // the interval to the trip computer, both over the frames' source time
+    // so replays faster than real time cover the captured distance
+    void integrateDistance(double speedKmh, qint64 timestampUs);
+    void journalTripState();
+    static void bindSignals(DecodeTable &table);
+    // Rebuilds the decode plans after the subscriptions changed
+    void updateDecodePlans();
+    void updateDecodePlan(DecodeTable &table) const;
+    // Refresh interval a decoded signal needs for itself and the signals
+    // derived from it, -1 if nobody subscribes to any of them
+    qint64 decodeIntervalUs(VehicleSignalStore::SignalId id) const;
+    // Subscribes, updates or (with an empty mask) unsubscribes *id
+    void setSubscription(int *id, VehicleSignalStore::SignalMask signalMask, double rate);
+
+    // Must run between m_signals.beginUpdate() and endUpdate(); changes
+    // are announced at the scheduler's next flush.
+    void updateSignal(VehicleSignalStore::SignalId id, double value, qint64 timestampUs);
+    // Runs the warning rules over the signals changed since the last call;
+    // once per batch of updates.
+    void evaluateWarnings();
+    // Copies the store into the shared-memory segment, if open; once per
+    // batch of updates as well.
+    void publishState();
+
+    VehicleSignalStore m_signals;
+    SignalHistory m_history;
+    NotificationScheduler *m_notifier;
+    WarningRuleEngine *m_warnings;
+    // Signals changed since the warning rules last ran
+    VehicleSignalStore::SignalMask m_warningInputs;
+    // Collected for the next stateChanged()
+    VehicleStateDelta m_delta;
+    quint64 m_deltaSequence;
+    // Receive and decode time of each signal's last change, and the start
+    // of the decode batch in progress
+    std::array<qint64, VehicleSignalStore::SignalCount> m_receivedUs;
+    std::array<qint64, VehicleSignalStore::SignalCount> m_decodedUs;
+    qint64 m_batchStartUs;
+
+    DecodeTable m_decodeTable;
+    // Indexed by CanFrame::bus; entries that are not loaded fall back to
+    // m_decodeTable
+    QVector<DecodeTable> m_busDecodeTables;
+    CanTrafficStats *m_trafficStats;
+
+    SignalSubscriptions m_subscriptions;
+    // Built-in subscriptions, 0 while off
+    int m_propertySubscription;
+    int m_warningSubscription;
+    int m_historySubscription;
+    int m_distanceSubscription;
+    int m_tripSubscription;
+    quint64 m_framesSeen;
+    quint64 m_framesDecoded;
+    quint64 m_repeatsSkipped;
+    quint64 m_unsubscribedSkipped;
+    quint64 m_catchUps;
+    quint64 m_signalsDecoded;
+
+    TripComputer *m_tripComputer;
+    OdometerJournal m_odometerJournal;
+    VehicleStatePublisher m_statePublisher;
+    // Source time of the last speed sample distance was integrated up to,
+    // and the source time offset of the frame being decoded
+    qint64 m_lastSpeedUs;
+    qint64 m_sourceOffsetUs;
 };
 
 #endif // VEHICLEDATACONTROLLER_H
\ No newline at end of file
@@ -0,0 +1,176 @@
+#ifndef VEHICLEDATAPROXY_H
+#define VEHICLEDATAPROXY_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+#include <array>
+
+#include "vehiclestatedelta.h"
+#include "vehiclesignalstore.h"
+
+class LatencyTracer;
+class QQuickWindow;
+class VehicleDataController;
+
+/**
+ * @brief QML face of a VehicleDataController running on another thread.
+ *
+ * Has the controller's properties and signals, kept on the GUI thread: the
+ * controller sends one VehicleStateDelta per notification flush over a
+ * queued connection and the proxy applies it, so however busy the bus is
+ * the GUI thread handles at most one update per frame and never decodes.
+ *
+ * Gauge estimates are computed here, at the start of every frame of the
+ * window, from a lock-free snapshot of the controller's signal store.
+ * Queries the store or history cannot answer are forwarded to the
+ * controller's thread and wait for it; commands are queued. Every delta's
+ * values are traced to the frame that shows them, see LatencyTracer.
+ */
+class VehicleDataProxy : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(double speed READ speed NOTIFY speedChanged)
+    Q_PROPERTY(double rpm READ rpm NOTIFY rpmChanged)
+    Q_PROPERTY(double fuelLevel READ fuelLevel NOTIFY fuelLevelChanged)
+    Q_PROPERTY(double engineTemperature READ engineTemperature NOTIFY engineTemperatureChanged)
+    Q_PROPERTY(bool leftTurnSignal READ leftTurnSignal NOTIFY leftTurnSignalChanged)
+    Q_PROPERTY(bool rightTurnSignal READ rightTurnSignal NOTIFY rightTurnSignalChanged)
+    Q_PROPERTY(bool headlights READ headlights NOTIFY headlightsChanged)
+    Q_PROPERTY(bool parkingBrake READ parkingBrake NOTIFY parkingBrakeChanged)
+    Q_PROPERTY(QString gear READ gear NOTIFY gearChanged)
+    Q_PROPERTY(double odometer READ odometer NOTIFY odometerChanged)
+    Q_PROPERTY(double batteryVoltage READ batteryVoltage NOTIFY batteryVoltageChanged)
+    Q_PROPERTY(bool engineRunning READ engineRunning NOTIFY engineRunningChanged)
+    Q_PROPERTY(bool seatbelt READ seatbelt NOTIFY seatbeltChanged)
+    Q_PROPERTY(bool doorOpen READ doorOpen NOTIFY doorOpenChanged)
+    Q_PROPERTY(bool acOn READ acOn NOTIFY acOnChanged)
+    Q_PROPERTY(int fanSpeed READ fanSpeed NOTIFY fanSpeedChanged)
+    Q_PROPERTY(double cabinTemperature READ cabinTemperature NOTIFY cabinTemperatureChanged)
+    Q_PROPERTY(QStringList activeWarnings READ activeWarnings NOTIFY activeWarningsChanged)
+
+public:
+    // Takes the controller's current state, waiting for its thread if it
+    // already runs on another one.
+    explicit VehicleDataProxy(VehicleDataController *controller, QObject *parent = nullptr);
+
+    double speed() const;
+    double rpm() const;
+    double fuelLevel() const;
+    double engineTemperature() const;
+    bool leftTurnSignal() const;
+    bool rightTurnSignal() const;
+    bool headlights() const;
+    bool parkingBrake() const;
+    QString gear() const;
+    double odometer() const;
+    double batteryVoltage() const;
+    bool engineRunning() const;
+    bool seatbelt() const;
+    bool doorOpen() const;
+    bool acOn() const;
+    int fanSpeed() const;
+    double cabinTemperature() const;
+    QStringList activeWarnings() const;
+
+    // Estimates and latency tracing follow window's frames; the window must
+    // live on this thread.
+    void setWindow(QQuickWindow *window);
+
+    // As VehicleDataController's, read straight from its store and history
+    Q_INVOKABLE QVariant signalValue(const QString &name) const;
+    Q_INVOKABLE QVariantList signalTrend(const QString &name, double spanSeconds, int columns) const;
+    // Estimate of a signal at the time the frame being rendered reaches the
+    // screen, interpolated from its last two samples. Gauges re-read it on
+    // estimatesChanged(), once per frame while any estimate is moving.
+    Q_INVOKABLE double signalEstimate(const QString &name) const;
+
+    // Forwarded to the controller's thread
+    Q_INVOKABLE QVariantMap notificationStatistics() const;
+    Q_INVOKABLE QVariantMap decodeStatistics() const;
+    Q_INVOKABLE QVariantList warningLog() const;
+    Q_INVOKABLE int subscribe(const QStringList &names, double rate = 0);
+    Q_INVOKABLE bool unsubscribe(int subscription);
+
+    // Queued to the controller; these return false only for unknown names
+    Q_INVOKABLE bool setSignalDeadband(const QString &name, double deadband);
+    Q_INVOKABLE bool setSignalMaxRate(const QString &name, double maxRate);
+    Q_INVOKABLE bool acknowledgeWarning(const QString &name);
+    Q_INVOKABLE void setPropertiesActive(bool active);
+
+    // Deltas applied, property notifications they carried and the longest
+    // a delta took to apply, in microseconds.
+    Q_INVOKABLE QVariantMap proxyStatistics() const;
+
+    // Age of delivered values when first on screen, see
+    // LatencyTracer::statistics(); the dump adds the histogram buckets.
+    Q_INVOKABLE QVariantMap latencyStatistics() const;
+    Q_INVOKABLE bool dumpLatency(const QString &path) const;
+    Q_INVOKABLE void resetLatency();
+
+public slots:
+    void resetTripOdometer();
+    void toggleEngineState();
+
+signals:
+    void speedChanged(double speed);
+    void rpmChanged(double rpm);
+    void fuelLevelChanged(double fuelLevel);
+    void engineTemperatureChanged(double engineTemperature);
+    void leftTurnSignalChanged(bool leftTurnSignal);
+    void rightTurnSignalChanged(bool rightTurnSignal);
+    void headlightsChanged(bool headlights);
+    void parkingBrakeChanged(bool parkingBrake);
+    void gearChanged(const QString &gear);
+    void odometerChanged(double odometer);
+    void batteryVoltageChanged(double batteryVoltage);
+    void engineRunningChanged(bool engineRunning);
+    void seatbeltChanged(bool seatbelt);
+    void doorOpenChanged(bool doorOpen);
+    void acOnChanged(bool acOn);
+    void fanSpeedChanged(int fanSpeed);
+    void cabinTemperatureChanged(double cabinTemperature);
+
+    void estimatesChanged();
+    void activeWarningsChanged();
+
+    // Raised when the warning rule of the same name turns on
+    void lowFuelWarning();
+    void engineOverheatWarning();
+    void batteryLowWarning();
+
+private slots:
+    void applyDelta(const VehicleStateDelta &delta);
+    void startFrame();
+
+private:
+    double value(VehicleSignalStore::SignalId id) const { return m_values[id]; }
+    // Runs call on the controller's thread and waits for it
+    template<typename Call>
+    void callController(Call call) const;
+
+    VehicleDataController *m_controller;
+    const VehicleSignalStore &m_store;
+    QPointer<QQuickWindow> m_window;
+    QMetaObject::Connection m_frameConnection;
+    LatencyTracer *m_latencyTracer;
+
+    std::array<double, VehicleSignalStore::SignalCount> m_values;
+    QStringList m_activeWarnings;
+    quint64 m_sequence;         // of the last delta applied
+
+    // Store as of the start of the frame being prepared, and when that
+    // frame is expected on screen
+    VehicleSignalStore::Snapshot m_frameSnapshot;
+    qint64 m_presentationTimeUs;
+    bool m_estimatesMoving;
+
+    quint64 m_deltas;
+    quint64 m_notifications;
+    qint64 m_maxApplyUs;
+};
+
+#endif // VEHICLEDATAPROXY_H
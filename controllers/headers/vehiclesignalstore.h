@@ -0,0 +1,158 @@
+#ifndef VEHICLESIGNALSTORE_H
+#define VEHICLESIGNALSTORE_H
+
+#include <QtGlobal>
+
+#include <array>
+#include <atomic>
+
+/**
+ * @brief Vehicle state as structure-of-arrays, readable from any thread.
+ *
+ * Every signal the cluster shows has a SignalId; its value, timestamp,
+ * validity and the sequence number of the update that last changed it live
+ * in parallel arrays indexed by that ID. One thread writes, bracketing each
+ * group of related changes (typically the signals of one CAN frame) with
+ * beginUpdate() and endUpdate(). Readers on any thread take sample() or a
+ * whole snapshot() without locks: a store-wide seqlock makes them retry if
+ * an update was in progress, so a snapshot never mixes two updates.
+ *
+ * Values are kept at full precision as doubles whatever the signal's type;
+ * booleans are 0 or 1. The sample before the current one is kept as well,
+ * so estimate() can interpolate between the two or extrapolate past the
+ * newest, e.g. to the time a frame being rendered will reach the screen.
+ */
+class VehicleSignalStore
+{
+public:
+    enum SignalId : quint8 {
+        SpeedSignal,
+        RpmSignal,
+        FuelLevelSignal,
+        EngineTemperatureSignal,
+        LeftTurnSignalSignal,
+        RightTurnSignalSignal,
+        HeadlightsSignal,
+        ParkingBrakeSignal,
+        GearSignal,
+        OdometerSignal,
+        BatteryVoltageSignal,
+        EngineRunningSignal,
+        SeatbeltSignal,
+        DoorOpenSignal,
+        AcOnSignal,
+        FanSpeedSignal,
+        CabinTemperatureSignal,
+        TripOdometerSignal,
+        ThrottlePositionSignal,
+        EngineLoadSignal,
+        SignalCount
+    };
+
+    // Bit SignalId set for each signal in a set of them
+    using SignalMask = quint64;
+    static_assert(SignalCount <= 64, "SignalMask holds one bit per signal");
+    static constexpr SignalMask signalBit(SignalId id) { return SignalMask(1) << id; }
+    static constexpr SignalMask AllSignals = SignalCount < 64 ? (SignalMask(1) << SignalCount) - 1 : ~SignalMask(0);
+
+    enum SignalType : quint8 {
+        IntegerType,
+        BooleanType,
+        RealType
+    };
+
+    // estimate() extrapolates at most this far, and never further than the
+    // interval between the last two samples; past that it holds the value.
+    static constexpr qint64 MaxExtrapolationUs = 100000;
+
+    struct Sample
+    {
+        double value;
+        qint64 timestampUs;     // canMonotonicMicros() of the update, 0 if never updated
+        quint64 sequence;       // update that last changed value or validity
+        bool valid;
+    };
+
+    struct Snapshot
+    {
+        quint64 sequence;       // last update completed when the snapshot was taken
+        std::array<double, SignalCount> values;
+        std::array<qint64, SignalCount> timestampsUs;
+        std::array<quint64, SignalCount> sequences;
+        std::array<double, SignalCount> previousValues;
+        std::array<qint64, SignalCount> previousTimestampsUs;
+        SignalMask validMask;   // signals valid
+
+        Sample sample(SignalId id) const
+        {
+            return Sample{values[id], timestampsUs[id], sequences[id], (validMask & signalBit(id)) != 0};
+        }
+        double estimate(SignalId id, qint64 timeUs) const
+        {
+            return VehicleSignalStore::estimate(previousValues[id], previousTimestampsUs[id], values[id],
+                                                timestampsUs[id], timeUs);
+        }
+        // Whether estimate() still changes after timeUs
+        bool isExtrapolating(SignalId id, qint64 timeUs) const
+        {
+            return values[id] != previousValues[id]
+                   && timeUs < timestampsUs[id] + qMin(timestampsUs[id] - previousTimestampsUs[id],
+                                                       MaxExtrapolationUs);
+        }
+    };
+
+    VehicleSignalStore();
+
+    VehicleSignalStore(const VehicleSignalStore &) = delete;
+    VehicleSignalStore &operator=(const VehicleSignalStore &) = delete;
+
+    // Property name of a signal ("speed", "rpm", ...) and its type.
+    static const char *signalName(SignalId id);
+    static SignalType signalType(SignalId id);
+    // SignalCount if no signal has that name.
+    static SignalId signalId(const char *name);
+
+    // Writer side. set() and invalidate() must be called between
+    // beginUpdate() and endUpdate(); they return true if the value or the
+    // validity changed. set() records a new sample either way.
+    void beginUpdate();
+    bool set(SignalId id, double value, qint64 timestampUs);
+    bool invalidate(SignalId id, qint64 timestampUs);
+    void endUpdate();
+    // Initial value, not yet valid. Only before any reader starts.
+    void reset(SignalId id, double value);
+
+    // Reads on the writer thread need no synchronisation.
+    double value(SignalId id) const { return m_values[id].load(std::memory_order_relaxed); }
+    bool isValid(SignalId id) const { return m_valid[id].load(std::memory_order_relaxed); }
+
+    // Any thread.
+    quint64 sequence() const;
+    Sample sample(SignalId id) const;
+    Snapshot snapshot() const;
+    // Best estimate of the signal at timeUs (canMonotonicMicros() time):
+    // linear between the last two samples, extrapolated past the newest.
+    double estimate(SignalId id, qint64 timeUs) const;
+    // Whether estimate() still changes after timeUs. Writer thread.
+    bool isExtrapolating(SignalId id, qint64 timeUs) const;
+
+    static double estimate(double previousValue, qint64 previousTimestampUs, double value, qint64 timestampUs,
+                           qint64 timeUs);
+
+private:
+    template<typename Read>
+    void readConsistent(Read read) const;
+
+    // Twice the number of completed updates, odd while one is in progress.
+    std::atomic<quint64> m_version;
+    quint64 m_updateSequence;
+
+    std::atomic<double> m_values[SignalCount];
+    std::atomic<qint64> m_timestampsUs[SignalCount];
+    std::atomic<quint64> m_sequences[SignalCount];
+    std::atomic<bool> m_valid[SignalCount];
+    std::atomic<double> m_previousValues[SignalCount];
+    std::atomic<qint64> m_previousTimestampsUs[SignalCount];
+};
+
+#endif // VEHICLESIGNALSTORE_H
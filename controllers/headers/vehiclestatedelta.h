@@ -0,0 +1,47 @@
+#ifndef VEHICLESTATEDELTA_H
+#define VEHICLESTATEDELTA_H
+
+#include <QMetaType>
+#include <QStringList>
+
+#include <array>
+
+#include "vehiclesignalstore.h"
+
+/**
+ * @brief What changed for QML in one notification flush.
+ *
+ * VehicleDataController sends one per flush of its NotificationScheduler,
+ * from the decode thread; VehicleDataProxy applies it on the GUI thread.
+ * values holds the delivered value of every signal in signalMask, other
+ * entries are unspecified, and so are their receive and decode times. A
+ * full state carries the sequence of the last delta sent before it, so
+ * older deltas still queued can be told apart.
+ */
+struct VehicleStateDelta
+{
+    VehicleStateDelta() : sequence(0), signalMask(0), validMask(0), sentUs(0), warningsChanged(false)
+    {
+        values.fill(0.0);
+        receivedUs.fill(0);
+        decodedUs.fill(0);
+    }
+
+    quint64 sequence;       // counts the deltas sent
+    VehicleSignalStore::SignalMask signalMask;
+    VehicleSignalStore::SignalMask validMask;   // validity of the signals in signalMask
+    std::array<double, VehicleSignalStore::SignalCount> values;
+    // canMonotonicMicros() the value's frame was received and decoded, and
+    // the delta was sent, for LatencyTracer
+    std::array<qint64, VehicleSignalStore::SignalCount> receivedUs;
+    std::array<qint64, VehicleSignalStore::SignalCount> decodedUs;
+    qint64 sentUs;
+
+    bool warningsChanged;
+    QStringList activeWarnings;     // when warningsChanged
+    QStringList raisedWarnings;     // rules that turned on since the last delta, in order
+};
+
+Q_DECLARE_METATYPE(VehicleStateDelta)
+
+#endif // VEHICLESTATEDELTA_H
@@ -0,0 +1,120 @@
+#ifndef VEHICLESTATEFORMAT_H
+#define VEHICLESTATEFORMAT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Layout of the shared-memory segment vehicle state is published in.
+ *
+ * One POSIX shared-memory object (DefaultName unless configured) holds a
+ * Header, a schema of SignalCount SchemaEntry records naming each signal
+ * and its type, and one SignalSlot per signal with the latest value, the
+ * one before it and their timestamps. Timestamps are CLOCK_MONOTONIC
+ * microseconds, comparable across processes on the same machine.
+ *
+ * The writer publishes under a seqlock: Header::sequence is odd while it
+ * writes and advances by two per publication, so a reader that saw the
+ * same even sequence before and after copying has a consistent state.
+ * Readers only load from the mapping; they never block the writer.
+ *
+ * LayoutVersion changes whenever the meaning of any field here changes;
+ * readers refuse other versions. Signals are found by name through the
+ * schema, so adding signals keeps existing readers working. schemaHash
+ * changes whenever names, types or their order do.
+ *
+ * The writer sets writerRunning to 0 when it shuts down. A writer that
+ * starts again creates a new segment under the same name, so readers
+ * should reopen once writerRunning is 0 or publishedUs stops advancing.
+ *
+ * Deliberately free of Qt so the reader library can share it.
+ */
+namespace VehicleStateFormat {
+
+constexpr std::uint32_t Magic = 0x4D485356;    // "VSHM"
+constexpr std::uint16_t LayoutVersion = 1;
+constexpr char DefaultName[] = "/vehiclesys-state";
+constexpr int NameSize = 32;
+constexpr int MaxSignals = 64;
+
+enum SignalType : std::uint8_t {
+    IntegerType,
+    BooleanType,
+    RealType
+};
+
+struct Header
+{
+    std::uint32_t magic;
+    std::uint16_t layoutVersion;
+    std::uint16_t headerSize;
+    std::uint32_t signalCount;
+    std::uint32_t schemaOffset;     // from the start of the segment
+    std::uint32_t slotsOffset;
+    std::uint32_t totalSize;
+    std::uint64_t schemaHash;
+    std::int64_t createdUs;
+    std::int32_t writerPid;
+    std::atomic<std::uint32_t> writerRunning;
+
+    // Seqlock-protected from here on; own cache line, away from the
+    // fields above that never change
+    alignas(64) std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> storeSequence;   // VehicleSignalStore update published
+    std::atomic<std::int64_t> publishedUs;
+    std::atomic<std::uint64_t> validMask;       // bit per signal index
+};
+
+struct SchemaEntry
+{
+    char name[NameSize];    // NUL-terminated
+    std::uint8_t type;      // SignalType
+    std::uint8_t reserved[7];
+};
+
+struct SignalSlot
+{
+    std::atomic<double> value;
+    std::atomic<std::int64_t> timestampUs;          // 0 if never updated
+    std::atomic<double> previousValue;
+    std::atomic<std::int64_t> previousTimestampUs;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<double>::is_always_lock_free,
+              "shared-memory atomics must be lock-free");
+static_assert(sizeof(SchemaEntry) == 40, "schema entry layout changed");
+static_assert(sizeof(SignalSlot) == 32, "signal slot layout changed");
+
+inline std::uint32_t schemaOffset()
+{
+    return static_cast<std::uint32_t>(sizeof(Header));
+}
+
+inline std::uint32_t slotsOffset(std::uint32_t signalCount)
+{
+    const std::uint32_t end = schemaOffset() + signalCount * static_cast<std::uint32_t>(sizeof(SchemaEntry));
+    return (end + 63u) & ~63u;
+}
+
+inline std::uint32_t segmentSize(std::uint32_t signalCount)
+{
+    return slotsOffset(signalCount) + signalCount * static_cast<std::uint32_t>(sizeof(SignalSlot));
+}
+
+// FNV-1a over every entry's name and type
+inline std::uint64_t schemaHash(const SchemaEntry *schema, std::uint32_t signalCount)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::uint32_t index = 0; index < signalCount; ++index) {
+        for (const char *c = schema[index].name; *c; ++c) {
+            hash = (hash ^ static_cast<std::uint8_t>(*c)) * 1099511628211ull;
+        }
+        hash = (hash ^ schema[index].type) * 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace VehicleStateFormat
+
+#endif // VEHICLESTATEFORMAT_H
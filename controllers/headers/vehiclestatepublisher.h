@@ -0,0 +1,54 @@
+#ifndef VEHICLESTATEPUBLISHER_H
+#define VEHICLESTATEPUBLISHER_H
+
+#include <QString>
+
+#include "vehiclesignalstore.h"
+#include "vehiclestateformat.h"
+
+/**
+ * @brief Publishes vehicle state into POSIX shared memory for other processes.
+ *
+ * open() creates the segment described by VehicleStateFormat, sized for
+ * every VehicleSignalStore signal, and writes its schema. publish() then
+ * copies a store snapshot into it under the segment's seqlock: plain
+ * stores into the mapping, no syscall and no allocation. Readers in other
+ * processes use VehicleStateReader.
+ *
+ * A segment left behind by a writer that crashed is replaced on open();
+ * close() unlinks it. publish() must only be called from one thread.
+ */
+class VehicleStatePublisher
+{
+public:
+    VehicleStatePublisher();
+    ~VehicleStatePublisher();
+
+    VehicleStatePublisher(const VehicleStatePublisher &) = delete;
+    VehicleStatePublisher &operator=(const VehicleStatePublisher &) = delete;
+
+    // name is a POSIX shared-memory object name, e.g. "/vehiclesys-state"
+    bool open(const QString &name = QLatin1String(VehicleStateFormat::DefaultName));
+    void close();
+    bool isOpen() const;
+    QString name() const;
+    QString errorString() const;
+
+    // Publishes snapshot unless it is the store update published last.
+    void publish(const VehicleSignalStore::Snapshot &snapshot);
+    quint64 publicationCount() const;
+
+private:
+    static_assert(VehicleSignalStore::SignalCount <= VehicleStateFormat::MaxSignals,
+                  "the valid mask has one bit per signal");
+
+    VehicleStateFormat::Header *m_header;
+    VehicleStateFormat::SignalSlot *m_slots;
+    quint32 m_mappingSize;
+    quint64 m_lastStoreSequence;
+    quint64 m_publications;
+    QString m_name;
+    QString m_errorString;
+};
+
+#endif // VEHICLESTATEPUBLISHER_H
@@ -0,0 +1,106 @@
+#ifndef VEHICLESTATEREADER_H
+#define VEHICLESTATEREADER_H
+
+#include <cstdint>
+#include <string>
+
+#include "vehiclestateformat.h"
+
+/**
+ * @brief Reads the vehicle state VehicleSys publishes in shared memory.
+ *
+ * open() maps the segment (see VehicleStateFormat) read-only and checks
+ * its layout; after that every read is a handful of loads from the
+ * mapping, with no lock or allocation, and retries only while the writer
+ * is in the middle of a publication. A read that keeps retrying checks
+ * now and then that the writer still lives and eventually gives up, so a
+ * writer that died mid-publication fails the read instead of hanging it;
+ * readError() tells what to do about it.
+ *
+ *     VehicleStateReader reader;
+ *     if (reader.open()) {
+ *         const int speed = reader.signalIndex("speed");
+ *         VehicleStateReader::Signal sample;
+ *         if (reader.read(speed, &sample) && sample.valid)
+ *             std::printf("%.1f km/h\n", sample.value);
+ *         else if (reader.readError() == VehicleStateReader::WriterStopped)
+ *             reader.open();
+ *     }
+ *
+ * A reader object may be used from one thread at a time; any number of
+ * readers, in any number of processes, may read concurrently.
+ *
+ * Deliberately free of Qt, for processes that do not use it.
+ */
+class VehicleStateReader
+{
+public:
+    struct Signal
+    {
+        double value;
+        std::int64_t timestampUs;   // CLOCK_MONOTONIC, 0 if never updated
+        double previousValue;
+        std::int64_t previousTimestampUs;
+        bool valid;
+    };
+
+    // Why the last read() or readAll() failed
+    enum ReadError {
+        NoReadError,
+        NoSuchSignal,
+        WriterStopped,      // shut down or died, maybe mid-publication; reopen
+        WriterBusy          // alive, but never finished a publication in time; retry
+    };
+
+    VehicleStateReader();
+    ~VehicleStateReader();
+
+    VehicleStateReader(const VehicleStateReader &) = delete;
+    VehicleStateReader &operator=(const VehicleStateReader &) = delete;
+
+    bool open(const char *name = VehicleStateFormat::DefaultName);
+    void close();
+    bool isOpen() const { return m_header != nullptr; }
+    const std::string &errorString() const { return m_errorString; }
+
+    // Whether the writer is still publishing into this segment, i.e. has
+    // not shut down and its process exists; reopen when it is not.
+    bool isWriterRunning() const;
+
+    int signalCount() const;
+    // -1 if the segment has no signal of that name
+    int signalIndex(const char *name) const;
+    const char *signalName(int index) const;
+    VehicleStateFormat::SignalType signalType(int index) const;
+    std::uint64_t schemaHash() const;
+
+    // Advances with every publication; cheap to poll for changes.
+    std::uint64_t sequence() const;
+
+    // Latest sample of one signal; false if index is out of range or no
+    // consistent sample could be read, see readError().
+    bool read(int index, Signal *signal) const;
+    // Every signal at once, consistent with each other: signals[0..count)
+    // for the first count signals. Returns the number read, and the
+    // publication time and store update they belong to if asked; -1 if no
+    // consistent state could be read, see readError().
+    int readAll(Signal *signals, int count, std::int64_t *publishedUs = nullptr,
+                std::uint64_t *storeSequence = nullptr) const;
+    ReadError readError() const { return m_readError; }
+
+    // Value of the signal at timeUs, interpolated between its last two
+    // samples and extrapolated past the newest by at most the interval
+    // between them or MaxExtrapolationUs, as VehicleSys's own gauges do.
+    static constexpr std::int64_t MaxExtrapolationUs = 100000;
+    static double estimate(const Signal &signal, std::int64_t timeUs);
+
+private:
+    const VehicleStateFormat::Header *m_header;
+    const VehicleStateFormat::SchemaEntry *m_schema;
+    const VehicleStateFormat::SignalSlot *m_slots;
+    std::size_t m_mappingSize;
+    std::string m_errorString;
+    mutable ReadError m_readError;
+};
+
+#endif // VEHICLESTATEREADER_H
@@ -0,0 +1,175 @@
+#ifndef WARNINGRULEENGINE_H
+#define WARNINGRULEENGINE_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVariantList>
+#include <QVector>
+
+#include "vehiclesignalstore.h"
+
+/**
+ * @brief Declarative cluster warnings over the vehicle signals.
+ *
+ * A rules file has one warning per line:
+ *
+ *     warning engineOverheat when engineTemperature >= 105
+ *         clear engineTemperature <= 100 for 2s level critical latch "Engine overheating"
+ *
+ * (on a single line). Conditions are arithmetic and comparisons over
+ * signal names with !, && and ||. A warning turns on once its "when"
+ * condition has held for the "for" duration and off once its "clear"
+ * condition has held as long; without a clear condition it clears when
+ * "when" stops holding, and the gap between the two thresholds is the
+ * hysteresis that stops a noisy value flapping the warning. A latched
+ * warning stays on until acknowledged after it clears. A condition reading
+ * a signal that is not valid yet does not hold.
+ *
+ * Conditions compile to postfix code once, at load. Each signal lists the
+ * rules reading it, so evaluate() only runs the rules whose inputs
+ * changed; a timer revisits rules waiting out their duration.
+ *
+ * Lives on, and must only be used from, the thread writing the store.
+ */
+class WarningRuleEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Level {
+        InfoLevel,
+        WarningLevel,
+        CriticalLevel
+    };
+
+    static constexpr int LogCapacity = 256;
+
+    explicit WarningRuleEngine(const VehicleSignalStore &store, QObject *parent = nullptr);
+
+    // Replaces all rules; the current ones are kept if the file has errors.
+    bool loadFile(const QString &path);
+    bool loadFromData(const QByteArray &rules);
+    QString errorString() const;
+
+    int ruleCount() const;
+    // Signals read by any rule
+    VehicleSignalStore::SignalMask inputMask() const;
+    int ruleIndex(const QString &name) const;
+    QString ruleName(int rule) const;
+    QString ruleMessage(int rule) const;
+    Level ruleLevel(int rule) const;
+
+    bool isActive(int rule) const;
+    // Names of the warnings that are on, in rule order.
+    QStringList activeRules() const;
+    // Lets a latched warning go off once its clear condition holds.
+    bool acknowledge(int rule);
+
+    // Re-evaluates the rules reading any signal in changedMask against the
+    // store.
+    void evaluate(VehicleSignalStore::SignalMask changedMask);
+
+    // The last LogCapacity warnings turning on or off, oldest first, for
+    // QML.
+    QVariantList log() const;
+
+signals:
+    void warningChanged(int rule, bool active);
+
+private slots:
+    void evaluateDue();
+
+private:
+    enum Opcode : quint8 {
+        PushConstant,
+        PushSignal,
+        Negate,
+        Not,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual,
+        And,
+        Or
+    };
+
+    struct Instruction
+    {
+        Opcode opcode;
+        quint8 signal;      // PushSignal
+        double constant;    // PushConstant
+    };
+
+    struct Rule
+    {
+        QString name;
+        QString message;
+        Level level;
+        int whenCode;       // first instruction of each condition in m_code
+        int whenLength;
+        int clearCode;
+        int clearLength;    // 0 clears when "when" stops holding
+        VehicleSignalStore::SignalMask inputs;  // read by either condition
+        qint64 onDelayUs;
+        qint64 offDelayUs;
+        bool latch;
+
+        bool active;
+        bool acknowledged;
+        qint64 pendingSinceUs;  // when the condition to switch started holding, 0 if none
+        quint32 evaluatedPass;
+    };
+
+    // Copies the rule's description, which a reload may replace
+    struct Event
+    {
+        qint64 timeMs;      // wall clock
+        QString name;
+        QString message;
+        Level level;
+        bool active;
+    };
+
+    class Parser;
+
+    struct Inputs
+    {
+        double values[VehicleSignalStore::SignalCount];
+        VehicleSignalStore::SignalMask validMask;
+    };
+
+    Inputs readInputs() const;
+    bool run(int code, int length, const Inputs &inputs) const;
+    void evaluateRule(int rule, const Inputs &inputs, qint64 nowUs);
+    void setActive(int rule, bool active);
+    void scheduleDue();
+
+    const VehicleSignalStore &m_store;
+    QString m_errorString;
+
+    QVector<Rule> m_rules;
+    QVector<Instruction> m_code;
+    // Rules reading signal s are m_signalRules[m_signalRuleStart[s] ..
+    // m_signalRuleStart[s + 1])
+    QVector<int> m_signalRuleStart;
+    QVector<int> m_signalRules;
+    quint32 m_pass;
+
+    // Rules waiting out their duration
+    QVector<int> m_pendingRules;
+    QTimer *m_dueTimer;
+
+    QVector<Event> m_log;
+    int m_logNext;
+};
+
+#endif // WARNINGRULEENGINE_H
@@ -0,0 +1,148 @@
+#include "canblackbox.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <cerrno>
+#include <chrono>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+CanBlackBox::CanBlackBox()
+    : m_mapping(nullptr)
+    , m_mappingSize(0)
+    , m_realtimeOffsetUs(0)
+    , m_flushThread(nullptr)
+    , m_stopFlushing(false)
+{
+}
+
+CanBlackBox::~CanBlackBox()
+{
+    close();
+}
+
+bool CanBlackBox::open(const QString &path, qint64 fileSize)
+{
+    close();
+
+    fileSize = qMax(fileSize, MinimumFileSize);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        m_errorString = QStringLiteral("Cannot open %1: %2").arg(path, m_file.errorString());
+        return false;
+    }
+
+    const bool sameSize = m_file.size() == fileSize;
+    if (!sameSize && !m_file.resize(fileSize)) {
+        m_errorString = QStringLiteral("Cannot size %1: %2").arg(path, m_file.errorString());
+        m_file.close();
+        return false;
+    }
+
+    m_mapping = m_file.map(0, fileSize);
+    if (!m_mapping) {
+        m_errorString = QStringLiteral("Cannot map %1: %2").arg(path, m_file.errorString());
+        m_file.close();
+        return false;
+    }
+    m_mappingSize = fileSize;
+
+    const quint64 mappedSize = static_cast<quint64>(fileSize);
+    if (!sameSize || !m_ring.attach(m_mapping, mappedSize)) {
+        m_ring.format(m_mapping, mappedSize);
+    }
+
+    using namespace std::chrono;
+    m_realtimeOffsetUs = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count()
+                         - canMonotonicMicros();
+
+    m_stopFlushing = false;
+    m_flushThread = QThread::create([this]() { flushLoop(); });
+    m_flushThread->setObjectName(QStringLiteral("CanBlackBoxFlush"));
+    m_flushThread->start(QThread::LowPriority);
+
+    qDebug() << "CAN black box recording to" << path << "with" << m_ring.recordCount() << "frames kept";
+    m_errorString.clear();
+    return true;
+}
+
+void CanBlackBox::close()
+{
+    if (m_flushThread) {
+        {
+            QMutexLocker locker(&m_flushMutex);
+            m_stopFlushing = true;
+            m_flushWake.wakeAll();
+        }
+        m_flushThread->wait();
+        delete m_flushThread;
+        m_flushThread = nullptr;
+    }
+
+    if (m_mapping) {
+        flush();
+        m_ring = CanBlackBoxRing();
+        m_file.unmap(m_mapping);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool CanBlackBox::isOpen() const
+{
+    return m_mapping != nullptr;
+}
+
+QString CanBlackBox::path() const
+{
+    return m_file.fileName();
+}
+
+QString CanBlackBox::errorString() const
+{
+    return m_errorString;
+}
+
+quint32 CanBlackBox::recordCount() const
+{
+    return m_ring.recordCount();
+}
+
+void CanBlackBox::flush()
+{
+    if (!m_mapping) {
+        return;
+    }
+#ifdef Q_OS_UNIX
+    // Only dirty pages are written, so this costs what was recorded since
+    // the previous flush.
+    if (msync(m_mapping, static_cast<std::size_t>(m_mappingSize), MS_SYNC) != 0) {
+        qWarning() << "CAN black box flush failed:" << qt_error_string(errno);
+    }
+#endif
+}
+
+void CanBlackBox::flushLoop()
+{
+    QMutexLocker locker(&m_flushMutex);
+    while (!m_stopFlushing) {
+        m_flushWake.wait(&m_flushMutex, FlushIntervalMs);
+        if (m_stopFlushing) {
+            break;
+        }
+        // The writer never takes this lock, so flushing cannot stall it.
+        locker.unlock();
+        flush();
+        locker.relock();
+    }
+}
@@ -1,19 +1,39 @@
 #include "canbuscontroller.h"
+#include "canbusmerger.h"
+#include "canreceiveworker.h"
+#include "tracerecorder.h"
 #include <QDebug>
+#include <QMetaMethod>
 #include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QVariantMap>
 
-#ifdef HAVE_QT_SERIALBUS
-#include <QCanBus>
-#endif
+namespace {
+// Upper bound on frames handed to the decoder per batch; keeps a single
+// drain from monopolising the consumer thread during a burst.
+constexpr int MaxFramesPerBatch = 256;
+}
+
+const QString CanBusController::QtSerialBusBackend = QStringLiteral("qtserialbus");
+const QString CanBusController::NativeSocketCanBackend = QStringLiteral("native");
+const QString CanBusController::ReplayBackend = QStringLiteral("replay");
+const QString CanBusController::GeneratorBackend = QStringLiteral("generator");
 
 CanBusController::CanBusController(QObject *parent)
     : QObject(parent)
-#ifdef HAVE_QT_SERIALBUS
-    , m_canDevice(nullptr)
-#endif
+    , m_merger(new CanBusMerger)
+    , m_interfaces(QStringList() << QStringLiteral("vcan0"))
+    , m_deviceOpen(false)
+    , m_ringHighWaterMark(0)
+    , m_droppedFrames(0)
     , m_simulationTimer(new QTimer(this))
     , m_connected(false)
     , m_status("Disconnected")
+    , m_backend(QtSerialBusBackend)
+    , m_replaySpeed(1.0)
+    , m_replaying(false)
+    , m_statisticsTimer(new QTimer(this))
+    , m_errorFrames(0)
     , m_speed(0)
     , m_rpm(800)
     , m_fuelLevel(85)
@@ -23,18 +43,42 @@ CanBusController::CanBusController(QObject *parent)
     , m_headlights(false)
     , m_engineRunning(true)
 {
+    qRegisterMetaType<CanFrame>();
+    qRegisterMetaType<QVector<CanFrame>>();
+#ifdef HAVE_QT_SERIALBUS
+    qRegisterMetaType<QCanBusDevice::CanBusDeviceState>();
+#endif
+
+    m_frameBatch.reserve(MaxFramesPerBatch);
+    m_simulatedFrames.reserve(8);
+
+    // Readers wake the merger directly, so this thread only ever sees
+    // merged batches. Readers are created per bus on connect.
+    m_mergeThread.setObjectName(QStringLiteral("CanMerge"));
+    m_merger->moveToThread(&m_mergeThread);
+    connect(m_merger, &CanBusMerger::framesPending,
+            this, &CanBusController::drainReceivedFrames, Qt::QueuedConnection);
+    m_mergeThread.start();
+
+    connect(m_statisticsTimer, &QTimer::timeout, this, &CanBusController::updateTrafficStatistics);
+    m_statisticsTimer->start(StatisticsIntervalMs);
+
     connect(m_simulationTimer, &QTimer::timeout, this, &CanBusController::simulateVehicleData);
     setupSimulatedData();
 }
 
 CanBusController::~CanBusController()
 {
-#ifdef HAVE_QT_SERIALBUS
-    if (m_canDevice) {
-        m_canDevice->disconnectDevice();
-        delete m_canDevice;
+    closeDevice();
+    m_mergeThread.quit();
+    m_mergeThread.wait();
+    for (QThread *thread : m_ingestThreads) {
+        thread->quit();
+        thread->wait();
     }
-#endif
+    delete m_merger;
+    qDeleteAll(m_receiveWorkers);
+    qDeleteAll(m_ingestThreads);
 }
 
 bool CanBusController::connected() const
@@ -47,50 +91,392 @@ QString CanBusController::status() const
     return m_status;
 }
 
+int CanBusController::ringHighWaterMark() const
+{
+    return m_ringHighWaterMark;
+}
+
+qint64 CanBusController::droppedFrames() const
+{
+    return m_droppedFrames;
+}
+
+bool CanBusController::recording() const
+{
+    return m_blackBox.isOpen();
+}
+
+bool CanBusController::startRecorder(const QString &path, qint64 fileSize)
+{
+    const bool wasRecording = m_blackBox.isOpen();
+    if (!m_blackBox.open(path, fileSize)) {
+        qWarning() << "CAN black box disabled:" << m_blackBox.errorString();
+        if (wasRecording) {
+            emit recordingChanged(false);
+        }
+        return false;
+    }
+    if (!wasRecording) {
+        emit recordingChanged(true);
+    }
+    return true;
+}
+
+void CanBusController::stopRecorder()
+{
+    if (m_blackBox.isOpen()) {
+        m_blackBox.close();
+        emit recordingChanged(false);
+    }
+}
+
+QVariantList CanBusController::busStatistics() const
+{
+    QVariantList buses;
+    for (int bus = 0; bus < m_interfaces.size(); ++bus) {
+        const CanReceiveWorker *worker = bus < m_receiveWorkers.size() ? m_receiveWorkers.at(bus) : nullptr;
+        QVariantMap entry;
+        entry.insert(QStringLiteral("interface"), m_interfaces.at(bus));
+        entry.insert(QStringLiteral("connected"), bus < m_busConnected.size() && m_busConnected.at(bus));
+        entry.insert(QStringLiteral("frames"), worker ? static_cast<qlonglong>(worker->receivedFrames()) : 0);
+        entry.insert(QStringLiteral("dropped"), worker ? static_cast<qlonglong>(worker->droppedFrames()) : 0);
+        entry.insert(QStringLiteral("ringHighWaterMark"), worker ? static_cast<int>(worker->ringHighWaterMark()) : 0);
+        entry.insert(QStringLiteral("errorFrames"), worker ? static_cast<qlonglong>(worker->errorFrames()) : 0);
+        const bool measured = bus < m_trafficSnapshot.buses.size();
+        entry.insert(QStringLiteral("frameRate"), measured ? m_trafficSnapshot.buses.at(bus).frameRate : 0.0);
+        entry.insert(QStringLiteral("utilization"), measured ? m_trafficSnapshot.buses.at(bus).utilization : 0.0);
+        buses.append(entry);
+    }
+    return buses;
+}
+
+QVariantList CanBusController::trafficStatistics() const
+{
+    QVariantList ids;
+    ids.reserve(m_trafficSnapshot.ids.size());
+    for (const CanTrafficStats::IdStatistics &statistics : m_trafficSnapshot.ids) {
+        QVariantList dlcHistogram;
+        dlcHistogram.reserve(CanTrafficStats::DlcCodeCount);
+        for (quint32 count : statistics.dlcHistogram) {
+            dlcHistogram.append(count);
+        }
+
+        QVariantMap entry;
+        entry.insert(QStringLiteral("bus"), statistics.bus);
+        entry.insert(QStringLiteral("frameId"), statistics.frameId);
+        entry.insert(QStringLiteral("extended"), (statistics.flags & CanFrame::ExtendedId) != 0);
+        entry.insert(QStringLiteral("fd"), (statistics.flags & CanFrame::FlexibleDataRate) != 0);
+        entry.insert(QStringLiteral("unknown"), statistics.unknown);
+        entry.insert(QStringLiteral("frames"), static_cast<qlonglong>(statistics.frames));
+        entry.insert(QStringLiteral("frameRate"), statistics.frameRate);
+        entry.insert(QStringLiteral("minGapUs"), static_cast<qlonglong>(statistics.minGapUs));
+        entry.insert(QStringLiteral("avgGapUs"), static_cast<qlonglong>(statistics.avgGapUs));
+        entry.insert(QStringLiteral("maxGapUs"), static_cast<qlonglong>(statistics.maxGapUs));
+        entry.insert(QStringLiteral("length"), statistics.lastPayload.size());
+        entry.insert(QStringLiteral("lastPayload"), QString::fromLatin1(statistics.lastPayload.toHex(' ')));
+        entry.insert(QStringLiteral("dlcHistogram"), dlcHistogram);
+        ids.append(entry);
+    }
+    return ids;
+}
+
+double CanBusController::busUtilization() const
+{
+    double utilization = 0;
+    for (const CanTrafficStats::BusStatistics &bus : m_trafficSnapshot.buses) {
+        utilization = qMax(utilization, bus.utilization);
+    }
+    return utilization;
+}
+
+qint64 CanBusController::errorFrames() const
+{
+    return m_errorFrames;
+}
+
+qint64 CanBusController::unknownFrames() const
+{
+    return static_cast<qint64>(m_trafficSnapshot.unknownFrames);
+}
+
+const CanTrafficStats::Snapshot &CanBusController::trafficSnapshot() const
+{
+    return m_trafficSnapshot;
+}
+
+CanTrafficStats *CanBusController::trafficStats()
+{
+    return &m_trafficStats;
+}
+
+void CanBusController::setBusBitrate(int bus, double bitrate, double dataBitrate)
+{
+    m_trafficStats.setBitrate(bus, bitrate, dataBitrate);
+}
+
+void CanBusController::updateTrafficStatistics()
+{
+    VEHICLESYS_TRACE_SCOPE("timer", "updateTrafficStatistics");
+    m_trafficSnapshot = m_trafficStats.snapshot();
+
+    qint64 errorFrames = 0;
+    for (const CanReceiveWorker *worker : m_receiveWorkers) {
+        errorFrames += static_cast<qint64>(worker->errorFrames());
+    }
+    m_errorFrames = errorFrames;
+
+    emit trafficStatisticsChanged();
+}
+
+QString CanBusController::defaultRecorderPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+           + QStringLiteral("/blackbox.canbb");
+}
+
+QString CanBusController::backend() const
+{
+    return m_backend;
+}
+
+QStringList CanBusController::interfaces() const
+{
+    return m_interfaces;
+}
+
+QString CanBusController::replayFile() const
+{
+    return m_replayFile;
+}
+
+double CanBusController::replaySpeed() const
+{
+    return m_replaySpeed;
+}
+
+QString CanBusController::generatorProfile() const
+{
+    return m_generatorProfile;
+}
+
+void CanBusController::setBackend(const QString &backend)
+{
+    if (backend != QtSerialBusBackend && backend != NativeSocketCanBackend && backend != ReplayBackend
+        && backend != GeneratorBackend) {
+        qWarning() << "Unknown CAN backend:" << backend;
+        return;
+    }
+    if (m_backend != backend) {
+        m_backend = backend;
+        emit backendChanged(m_backend);
+    }
+}
+
+void CanBusController::setInterfaces(const QStringList &interfaces)
+{
+    if (interfaces.isEmpty() || interfaces.size() > 256) {
+        qWarning() << "CAN interface list must name 1 to 256 interfaces:" << interfaces;
+        return;
+    }
+    if (m_interfaces != interfaces) {
+        m_interfaces = interfaces;
+        emit interfacesChanged(m_interfaces);
+    }
+}
+
+void CanBusController::setReplayFile(const QString &path)
+{
+    if (m_replayFile != path) {
+        m_replayFile = path;
+        emit replayFileChanged(m_replayFile);
+    }
+}
+
+void CanBusController::setGeneratorProfile(const QString &profile)
+{
+    std::string error;
+    if (!CanLoadProfile().parse(profile.toStdString(), &error)) {
+        qWarning() << "Invalid CAN load profile:" << QString::fromStdString(error);
+        return;
+    }
+    if (m_generatorProfile != profile) {
+        m_generatorProfile = profile;
+        emit generatorProfileChanged(m_generatorProfile);
+    }
+}
+
+void CanBusController::setReplaySpeed(double speed)
+{
+    speed = qMax(0.0, speed);
+    if (!qFuzzyCompare(m_replaySpeed + 1.0, speed + 1.0)) {
+        m_replaySpeed = speed;
+        emit replaySpeedChanged(m_replaySpeed);
+    }
+}
+
 void CanBusController::connectToSimulator()
 {
-    connectToBus("vcan0");
+    connectToBuses();
+}
+
+void CanBusController::setRealtimeProfile(const RealtimeProfile &profile)
+{
+    m_realtimeProfile = profile;
+    if (!profile.isEnabled()) {
+        return;
+    }
+    // Queued, so a controller not yet moved to its decode thread takes the
+    // call along with it
+    applyRealtimeProfile(this, 1);
+    applyRealtimeProfile(m_merger, 1);
+    for (CanReceiveWorker *worker : m_receiveWorkers) {
+        applyRealtimeProfile(worker, 0);
+    }
+}
+
+void CanBusController::applyRealtimeProfile(QObject *threadContext, int priorityOffset) const
+{
+    const RealtimeProfile profile = m_realtimeProfile;
+    QMetaObject::invokeMethod(threadContext, [profile, priorityOffset]() {
+        const QString thread = QThread::currentThread()->objectName();
+        std::string error;
+        if (profile.applyToCurrentThread(priorityOffset, &error)) {
+            qInfo().noquote() << thread << "real-time profile:"
+                              << QString::fromStdString(RealtimeProfile::describeCurrentThread());
+        } else {
+            qWarning().noquote() << thread << "real-time profile not applied:" << QString::fromStdString(error);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void CanBusController::ensureReceiveWorkers(int count)
+{
+    // Each worker owns one CAN device and lives on its own ingest thread; we
+    // only ever talk to it through queued calls or its lock-free ring.
+    while (m_receiveWorkers.size() < count) {
+        const int bus = m_receiveWorkers.size();
+        QThread *thread = new QThread;
+        thread->setObjectName(QStringLiteral("CanIngest%1").arg(bus));
+        CanReceiveWorker *worker = new CanReceiveWorker(static_cast<quint8>(bus));
+        worker->moveToThread(thread);
+
+        connect(worker, &CanReceiveWorker::framesPending,
+                m_merger, &CanBusMerger::mergePending, Qt::QueuedConnection);
+        connect(worker, &CanReceiveWorker::errorOccurred,
+                this, &CanBusController::handleErrorOccurred, Qt::QueuedConnection);
+        connect(worker, &CanReceiveWorker::replayFinished,
+                this, &CanBusController::handleReplayFinished, Qt::QueuedConnection);
+#ifdef HAVE_QT_SERIALBUS
+        connect(worker, &CanReceiveWorker::stateChanged, this, [this, bus](QCanBusDevice::CanBusDeviceState state) {
+            handleStateChanged(bus, state);
+        }, Qt::QueuedConnection);
+#endif
+        thread->start();
+        if (m_realtimeProfile.isEnabled()) {
+            applyRealtimeProfile(worker, 0);
+        }
+
+        m_ingestThreads.append(thread);
+        m_receiveWorkers.append(worker);
+        m_busOpen.append(false);
+        m_busConnected.append(false);
+    }
 }
 
-void CanBusController::connectToBus(const QString &interface)
+void CanBusController::connectToBuses()
 {
     if (m_connected) {
         return;
     }
 
+    QVector<CanReceiveWorker *> sources;
+
+    if (m_backend == ReplayBackend) {
+        // Replayed frames go through the same ring, merge and drain as live
+        // ones. A capture already carries its own bus numbers.
+        ensureReceiveWorkers(1);
+        CanReceiveWorker *worker = m_receiveWorkers.first();
+        bool opened = false;
+        const QString path = m_replayFile;
+        const double speed = m_replaySpeed;
+        QMetaObject::invokeMethod(worker, [worker, path, speed, &opened]() {
+            opened = worker->openReplay(path, speed);
+        }, Qt::BlockingQueuedConnection);
+
+        if (opened) {
+            m_busOpen[0] = true;
+            m_busConnected[0] = true;
+            m_replaying = true;
+            sources.append(worker);
+        }
+    } else if (m_backend == GeneratorBackend) {
+        // Synthetic load takes the replay path, paced by replaySpeed.
+        ensureReceiveWorkers(1);
+        CanReceiveWorker *worker = m_receiveWorkers.first();
+        CanLoadProfile profile;
+        profile.parse(m_generatorProfile.toStdString());
+        const double speed = m_replaySpeed;
+        QMetaObject::invokeMethod(worker, [worker, profile, speed]() {
+            worker->openGenerator(profile, speed);
+        }, Qt::BlockingQueuedConnection);
+
+        m_busOpen[0] = true;
+        m_busConnected[0] = true;
+        m_replaying = true;
+        sources.append(worker);
+    } else {
+        ensureReceiveWorkers(m_interfaces.size());
+        for (int bus = 0; bus < m_interfaces.size(); ++bus) {
+            CanReceiveWorker *worker = m_receiveWorkers.at(bus);
+            const QString interface = m_interfaces.at(bus);
+            bool opened = false;
+
+            if (m_backend == NativeSocketCanBackend) {
+                // Raw sockets have no asynchronous connect; a successful bind
+                // means frames can flow immediately.
+                QMetaObject::invokeMethod(worker, [worker, interface, &opened]() {
+                    opened = worker->openNativeSocket(interface);
+                }, Qt::BlockingQueuedConnection);
+                m_busConnected[bus] = opened;
+            }
 #ifdef HAVE_QT_SERIALBUS
-    // Try to connect to specified interface (e.g., vcan0 for virtual CAN)
-    qDebug() << "Attempting to connect to CAN interface:" << interface;
-    
-    // Create device using socketcan plugin with specified interface
-    m_canDevice = QCanBus::instance()->createDevice(QStringLiteral("socketcan"), interface);
-    
-    if (!m_canDevice) {
-        qDebug() << "Failed to create CAN device for interface:" << interface;
-        // Check available devices
-        QString errorString;
-        auto availableDevices = QCanBus::instance()->availableDevices(QStringLiteral("socketcan"), &errorString);
-        qDebug() << "Available devices:" << availableDevices.size();
-        for (const auto &device : availableDevices) {
-            qDebug() << "  -" << device.name() << device.description();
+            if (m_backend == QtSerialBusBackend) {
+                // Try to connect to specified interface (e.g., vcan0 for
+                // virtual CAN). The device is created on the ingest thread so
+                // its notifier and reads never touch this thread's event loop.
+                QMetaObject::invokeMethod(worker, [worker, interface, &opened]() {
+                    opened = worker->openDevice(QStringLiteral("socketcan"), interface);
+                }, Qt::BlockingQueuedConnection);
+            }
+#endif
+
+            if (opened) {
+                m_busOpen[bus] = true;
+                sources.append(worker);
+            } else {
+                qWarning() << "CAN bus" << bus << "not available:" << interface;
+            }
         }
     }
 
-    if (m_canDevice) {
-        connect(m_canDevice, &QCanBusDevice::framesReceived, this, &CanBusController::handleFramesReceived);
-        connect(m_canDevice, &QCanBusDevice::errorOccurred, this, &CanBusController::handleErrorOccurred);
-        connect(m_canDevice, &QCanBusDevice::stateChanged, this, &CanBusController::handleStateChanged);
+    if (!sources.isEmpty()) {
+        CanBusMerger *merger = m_merger;
+        QMetaObject::invokeMethod(merger, [merger, sources]() {
+            merger->setSources(sources);
+        }, Qt::BlockingQueuedConnection);
+        m_deviceOpen = true;
 
-        if (m_canDevice->connectDevice()) {
-            m_status = "Connecting to CAN Bus...";
+        if (m_replaying) {
+            m_connected = true;
+            m_status = m_backend == GeneratorBackend ? "Generating synthetic CAN load" : "Replaying CAN log";
+            m_replayClock.start();
+            emit connectedChanged(m_connected);
             emit statusChanged(m_status);
-            return;
         } else {
-            delete m_canDevice;
-            m_canDevice = nullptr;
+            updateBusStatus();
         }
+        return;
     }
-#endif
 
     // Start simulation mode (fallback or when SerialBus not available)
     m_status = "Simulation Mode Active";
@@ -100,6 +486,26 @@ void CanBusController::connectToBus(const QString &interface)
     emit statusChanged(m_status);
 }
 
+void CanBusController::updateBusStatus()
+{
+    const int connectedBuses = m_busConnected.count(true);
+    const bool anyOpen = m_busOpen.contains(true);
+
+    m_connected = connectedBuses > 0;
+    if (m_interfaces.size() == 1) {
+        m_status = m_connected ? "Connected to CAN Bus"
+                   : anyOpen   ? "Connecting to CAN Bus..."
+                               : "Disconnected from CAN Bus";
+    } else if (m_connected) {
+        m_status = QStringLiteral("Connected to %1 of %2 CAN buses").arg(connectedBuses).arg(m_interfaces.size());
+    } else {
+        m_status = anyOpen ? "Connecting to CAN buses..." : "Disconnected from CAN buses";
+    }
+
+    emit connectedChanged(m_connected);
+    emit statusChanged(m_status);
+}
+
 void CanBusController::disconnectFromSimulator()
 {
     if (!m_connected) {
@@ -107,14 +513,8 @@ void CanBusController::disconnectFromSimulator()
     }
 
     m_simulationTimer->stop();
-    
-#ifdef HAVE_QT_SERIALBUS
-    if (m_canDevice) {
-        m_canDevice->disconnectDevice();
-        delete m_canDevice;
-        m_canDevice = nullptr;
-    }
-#endif
+    closeDevice();
+    m_replaying = false;
 
     m_connected = false;
     m_status = "Disconnected";
@@ -122,69 +522,170 @@ void CanBusController::disconnectFromSimulator()
     emit statusChanged(m_status);
 }
 
-void CanBusController::sendFrame(quint32 frameId, const QByteArray &data)
+void CanBusController::closeDevice()
 {
-#ifdef HAVE_QT_SERIALBUS
-    if (!m_canDevice || !m_connected) {
+    if (!m_deviceOpen) {
         return;
     }
 
-    QCanBusFrame frame(frameId, data);
-    m_canDevice->writeFrame(frame);
-#else
-    Q_UNUSED(frameId)
-    Q_UNUSED(data)
-#endif
+    for (int bus = 0; bus < m_receiveWorkers.size(); ++bus) {
+        if (!m_busOpen.at(bus)) {
+            continue;
+        }
+        CanReceiveWorker *worker = m_receiveWorkers.at(bus);
+        QMetaObject::invokeMethod(worker, [worker]() {
+            worker->closeDevice();
+        }, Qt::BlockingQueuedConnection);
+        m_busOpen[bus] = false;
+        m_busConnected[bus] = false;
+    }
+
+    CanBusMerger *merger = m_merger;
+    QMetaObject::invokeMethod(merger, [merger]() {
+        merger->setSources(QVector<CanReceiveWorker *>());
+    }, Qt::BlockingQueuedConnection);
+    m_deviceOpen = false;
 }
 
-#ifdef HAVE_QT_SERIALBUS
-void CanBusController::handleFramesReceived()
+void CanBusController::sendFrame(quint32 frameId, const QByteArray &data, int bus, bool extended)
 {
-    if (!m_canDevice) {
+    if (!m_deviceOpen || !m_connected) {
         return;
     }
+    if (bus < 0 || bus >= m_receiveWorkers.size() || !m_busOpen.at(bus)) {
+        qWarning() << "Cannot send on CAN bus" << bus << "- it is not open";
+        return;
+    }
+
+    extended = extended || frameId > 0x7FF;
+    CanReceiveWorker *worker = m_receiveWorkers.at(bus);
+    QMetaObject::invokeMethod(worker, [worker, frameId, data, extended]() {
+        worker->writeFrame(frameId, data, extended);
+    }, Qt::QueuedConnection);
 
-    while (m_canDevice->framesAvailable()) {
-        const QCanBusFrame frame = m_canDevice->readFrame();
-        if (frame.isValid()) {
-            emit frameReceived(frame.frameId(), frame.payload());
+    if (m_blackBox.isOpen()) {
+        CanFrame frame = CanFrame::fromBytes(frameId, data.constData(), data.size(), canMonotonicMicros());
+        frame.flags |= CanFrame::Transmitted;
+        if (extended) {
+            frame.flags |= CanFrame::ExtendedId;
         }
+        frame.bus = static_cast<quint8>(bus);
+        m_blackBox.record(frame);
     }
 }
 
-void CanBusController::handleErrorOccurred(QCanBusDevice::CanBusError error)
+void CanBusController::drainReceivedFrames()
 {
-    if (m_canDevice) {
-        QString errorString = m_canDevice->errorString();
-        m_status = "Error: " + errorString;
-        emit statusChanged(m_status);
-        emit errorOccurred(errorString);
+    VEHICLESYS_TRACE_SCOPE("can", "drain");
+    // Hand the decoder whole batches until the merged ring is empty.
+    // Anything the merger pushes while we are draining triggers a fresh
+    // wake-up.
+    for (;;) {
+        m_frameBatch.resize(MaxFramesPerBatch);
+        const std::size_t count = m_merger->drain(m_frameBatch.data(), MaxFramesPerBatch);
+        m_frameBatch.resize(static_cast<int>(count));
+        if (count == 0) {
+            break;
+        }
+        publishFrames(m_frameBatch);
+    }
+
+    // Aggregate over every ring a frame passes through; busStatistics()
+    // has the per-bus breakdown.
+    std::size_t highWaterMark = m_merger->ringHighWaterMark();
+    std::size_t dropped = m_merger->droppedFrames();
+    for (const CanReceiveWorker *worker : m_receiveWorkers) {
+        highWaterMark = qMax(highWaterMark, worker->ringHighWaterMark());
+        dropped += worker->droppedFrames();
+    }
+    if (static_cast<int>(highWaterMark) != m_ringHighWaterMark || static_cast<qint64>(dropped) != m_droppedFrames) {
+        if (static_cast<qint64>(dropped) != m_droppedFrames) {
+            qWarning() << "CAN ingest ring overflow, dropped frames:" << dropped
+                       << "late merged frames:" << m_merger->lateFrames();
+        }
+        m_ringHighWaterMark = static_cast<int>(highWaterMark);
+        m_droppedFrames = static_cast<qint64>(dropped);
+        emit ingestStatsChanged();
     }
 }
 
-void CanBusController::handleStateChanged(QCanBusDevice::CanBusDeviceState state)
+void CanBusController::publishFrames(const QVector<CanFrame> &frames)
 {
+    // Counted before decoding so the decoder can flag unknown IDs in it.
+    m_trafficStats.record(frames);
+    emit frameBatchReceived(frames);
+
+    // Decode first; the recorder only copies the batch into its mapping.
+    if (m_blackBox.isOpen() && !m_replaying) {
+        m_blackBox.record(frames);
+    }
+
+    // Per-frame compatibility signal, only paid for when someone listens.
+    static const QMetaMethod frameReceivedSignal = QMetaMethod::fromSignal(&CanBusController::frameReceived);
+    if (isSignalConnected(frameReceivedSignal)) {
+        for (const CanFrame &frame : frames) {
+            emit frameReceived(frame.frameId, frame.payloadBytes());
+        }
+    }
+}
+
+void CanBusController::handleErrorOccurred(const QString &error)
+{
+    m_status = "Error: " + error;
+    emit statusChanged(m_status);
+    emit errorOccurred(error);
+}
+
+void CanBusController::handleReplayFinished(qint64 frames, qint64 malformedLines)
+{
+    // The last frames may still be queued in the merger; pull them through
+    // so every replayed frame is decoded and this is end-to-end throughput
+    // of parse or generation, rings, merge and decode.
+    CanBusMerger *merger = m_merger;
+    int queuedFrames = 0;
+    do {
+        QMetaObject::invokeMethod(merger, [merger, &queuedFrames]() {
+            merger->mergePending();
+            queuedFrames = merger->queuedFrames();
+        }, Qt::BlockingQueuedConnection);
+        drainReceivedFrames();
+    } while (queuedFrames > 0);
+
+    const qint64 elapsedMs = qMax<qint64>(1, m_replayClock.elapsed());
+    qDebug() << "CAN replay finished:" << frames << "frames in" << elapsedMs << "ms,"
+             << frames * 1000 / elapsedMs << "frames/s," << malformedLines << "malformed lines";
+
+    m_status = "Replay finished";
+    emit statusChanged(m_status);
+}
+
+#ifdef HAVE_QT_SERIALBUS
+void CanBusController::handleStateChanged(int bus, QCanBusDevice::CanBusDeviceState state)
+{
+    // Late notifications from a bus we already closed are of no interest.
+    if (bus >= m_busOpen.size() || !m_busOpen.at(bus)) {
+        return;
+    }
+
     switch (state) {
     case QCanBusDevice::ConnectedState:
-        m_connected = true;
-        m_status = "Connected to CAN Bus";
+        m_busConnected[bus] = true;
         break;
     case QCanBusDevice::ConnectingState:
-        m_status = "Connecting to CAN Bus";
-        break;
     case QCanBusDevice::UnconnectedState:
-        m_connected = false;
-        m_status = "Disconnected from CAN Bus";
+        m_busConnected[bus] = false;
         break;
+    default:
+        return;
     }
-    
-    emit connectedChanged(m_connected);
-    emit statusChanged(m_status);
+
+    updateBusStatus();
 }
 #endif
 
 void CanBusController::simulateVehicleData()
 {
+    VEHICLESYS_TRACE_SCOPE("timer", "simulateVehicleData");
     // Simulate realistic vehicle behavior
     QRandomGenerator *rng = QRandomGenerator::global();
     
@@ -225,33 +726,40 @@ void CanBusController::simulateVehicleData()
         m_headlights = !m_headlights;
     }
 
-    // Emit CAN frames with simulated data matching DBC format and VehicleDataController expectations
+    // Emit CAN frames with simulated data matching DBC format and VehicleDataController expectations.
+    // Simulated frames share one timestamp and are published as a single batch,
+    // built in place so a simulation tick never touches the heap.
+    const qint64 timestampUs = canMonotonicMicros();
+    QVector<CanFrame> &frames = m_simulatedFrames;
+    frames.resize(0);
     
     // 0x100: Engine_Data (RPM, load, temperature, fuel) - 8 bytes
-    QByteArray engineData(8, 0);
+    CanFrame engineFrame = CanFrame::make(0x100, 8, timestampUs);
+    quint8 *engineData = engineFrame.payload;
     // Engine Speed (RPM) - bytes 0-1, scale 0.25, so multiply by 4 for raw value
     quint16 rpmRaw = m_rpm * 4;
-    engineData[0] = static_cast<char>(rpmRaw & 0xFF);
-    engineData[1] = static_cast<char>((rpmRaw >> 8) & 0xFF);
+    engineData[0] = static_cast<quint8>(rpmRaw & 0xFF);
+    engineData[1] = static_cast<quint8>((rpmRaw >> 8) & 0xFF);
     // Engine Load - byte 2 (not used in simulation, set to reasonable value)
-    engineData[2] = static_cast<char>(50); // 50% load
+    engineData[2] = static_cast<quint8>(50); // 50% load
     // Engine Coolant Temperature - byte 3, offset +40, so add 40 to actual temp
-    engineData[3] = static_cast<char>(m_engineTemp + 40);
+    engineData[3] = static_cast<quint8>(m_engineTemp + 40);
     // Throttle Position - byte 4 (correlate with speed)
-    engineData[4] = static_cast<char>(qMin(100, m_speed * 2));
+    engineData[4] = static_cast<quint8>(qMin(100, m_speed * 2));
     // Engine Oil Pressure - bytes 5-6 (not critical for simulation)
-    engineData[5] = static_cast<char>(150); // Low byte of reasonable pressure
-    engineData[6] = static_cast<char>(0);   // High byte
+    engineData[5] = static_cast<quint8>(150); // Low byte of reasonable pressure
+    engineData[6] = static_cast<quint8>(0);   // High byte
     // Fuel Level - byte 7, scale 0.392157, so divide by 0.392157 for raw
-    engineData[7] = static_cast<char>(m_fuelLevel / 0.392157);
-    emit frameReceived(0x100, engineData);
+    engineData[7] = static_cast<quint8>(m_fuelLevel / 0.392157);
+    frames.append(engineFrame);
 
     // 0x200: Vehicle_Speed - 8 bytes
-    QByteArray speedData(8, 0);
+    CanFrame speedFrame = CanFrame::make(0x200, 8, timestampUs);
+    quint8 *speedData = speedFrame.payload;
     // Vehicle Speed - bytes 0-1, scale 0.1, so multiply by 10 for raw value
     quint16 speedRaw = m_speed * 10;
-    speedData[0] = static_cast<char>(speedRaw & 0xFF);
-    speedData[1] = static_cast<char>((speedRaw >> 8) & 0xFF);
+    speedData[0] = static_cast<quint8>(speedRaw & 0xFF);
+    speedData[1] = static_cast<quint8>((speedRaw >> 8) & 0xFF);
     // Wheel speeds (simulate same as vehicle speed)
     speedData[2] = speedData[0]; // Wheel FL low
     speedData[3] = speedData[1]; // Wheel FL high  
@@ -259,29 +767,32 @@ void CanBusController::simulateVehicleData()
     speedData[5] = speedData[1]; // Wheel FR high
     speedData[6] = speedData[0]; // Wheel RL low
     speedData[7] = speedData[1]; // Wheel RL high
-    emit frameReceived(0x200, speedData);
+    frames.append(speedFrame);
 
     // 0x400: Transmission_Data - 8 bytes
-    QByteArray transData(8, 0);
+    CanFrame transFrame = CanFrame::make(0x400, 8, timestampUs);
+    quint8 *transData = transFrame.payload;
     // Gear position in lower 4 bits (simulate Drive = 3)
     quint8 gearValue = (m_speed > 0) ? 3 : 0; // Drive if moving, Park if stopped
-    transData[0] = static_cast<char>(gearValue & 0x0F);
+    transData[0] = static_cast<quint8>(gearValue & 0x0F);
     // Park status in bit 1 of byte 2
     quint8 parkStatus = (m_speed == 0) ? 0x02 : 0x00;
-    transData[2] = static_cast<char>(parkStatus);
-    emit frameReceived(0x400, transData);
+    transData[2] = parkStatus;
+    frames.append(transFrame);
 
     // 0x500: Battery_Status - 8 bytes  
-    QByteArray batteryData(8, 0);
+    CanFrame batteryFrame = CanFrame::make(0x500, 8, timestampUs);
+    quint8 *batteryData = batteryFrame.payload;
     // Battery voltage - bytes 0-1, scale 0.01, so multiply by 100 for raw
     quint16 voltageRaw = 1400; // 14.0V typical running voltage
     if (!m_engineRunning) voltageRaw = 1200; // 12.0V when engine off
-    batteryData[0] = static_cast<char>(voltageRaw & 0xFF);
-    batteryData[1] = static_cast<char>((voltageRaw >> 8) & 0xFF);
-    emit frameReceived(0x500, batteryData);
+    batteryData[0] = static_cast<quint8>(voltageRaw & 0xFF);
+    batteryData[1] = static_cast<quint8>((voltageRaw >> 8) & 0xFF);
+    frames.append(batteryFrame);
 
     // 0x600: Warning_Lights - 8 bytes
-    QByteArray signalsData(8, 0);
+    CanFrame signalsFrame = CanFrame::make(0x600, 8, timestampUs);
+    quint8 *signalsData = signalsFrame.payload;
     // Warnings in byte 0 (not used in current simulation)
     signalsData[0] = 0;
     // Signal bits in byte 1
@@ -289,8 +800,10 @@ void CanBusController::simulateVehicleData()
     if (m_leftTurnSignal) signalBits |= 0x01;
     if (m_rightTurnSignal) signalBits |= 0x02;
     if (m_headlights) signalBits |= 0x04;
-    signalsData[1] = static_cast<char>(signalBits);
-    emit frameReceived(0x600, signalsData);
+    signalsData[1] = signalBits;
+    frames.append(signalsFrame);
+
+    publishFrames(frames);
 }
 
 void CanBusController::setupSimulatedData()
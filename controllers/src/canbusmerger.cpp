@@ -0,0 +1,189 @@
+#include "canbusmerger.h"
+#include "canreceiveworker.h"
+#include "tracerecorder.h"
+#include <QTimer>
+
+#include <limits>
+
+namespace {
+// Frames pulled from a source ring per drain call.
+constexpr int CollectBatchSize = 256;
+// Per-bus backlog cap. Beyond it frames stay in the source ring, so a slow
+// consumer is felt (and counted) per bus rather than here.
+constexpr int MaxQueuedFrames = 4096;
+}
+
+CanBusMerger::CanBusMerger(QObject *parent)
+    : QObject(parent)
+    , m_releaseTimer(new QTimer(this))
+    , m_lastReleasedUs(std::numeric_limits<qint64>::min())
+    , m_lateFrames(0)
+    , m_drainPending(false)
+{
+    m_releaseTimer->setSingleShot(true);
+    m_releaseTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_releaseTimer, &QTimer::timeout, this, &CanBusMerger::mergePending);
+}
+
+std::size_t CanBusMerger::drain(CanFrame *out, std::size_t maxFrames)
+{
+    m_drainPending.store(false, std::memory_order_release);
+    return m_ring.popBatch(out, maxFrames);
+}
+
+std::size_t CanBusMerger::ringHighWaterMark() const
+{
+    return m_ring.highWaterMark();
+}
+
+std::size_t CanBusMerger::droppedFrames() const
+{
+    return m_ring.droppedCount();
+}
+
+qint64 CanBusMerger::lateFrames() const
+{
+    return m_lateFrames.load(std::memory_order_relaxed);
+}
+
+int CanBusMerger::queuedFrames() const
+{
+    int queued = 0;
+    for (const BusQueue &queue : m_queues) {
+        queued += queue.frames.size() - queue.head;
+    }
+    return queued;
+}
+
+void CanBusMerger::setSources(const QVector<CanReceiveWorker *> &sources)
+{
+    m_releaseTimer->stop();
+
+    // Discard what the previous sources left behind. Draining them also
+    // re-arms their wake-ups for the next time they are used.
+    for (BusQueue &queue : m_queues) {
+        do {
+            queue.frames.resize(0);
+            queue.head = 0;
+        } while (!collect(queue));
+    }
+    m_queues.clear();
+    for (CanReceiveWorker *source : sources) {
+        BusQueue queue;
+        queue.source = source;
+        queue.frames.reserve(CollectBatchSize);
+        queue.head = 0;
+        queue.newestTimestampUs = std::numeric_limits<qint64>::min();
+        m_queues.append(queue);
+    }
+    m_lastReleasedUs = std::numeric_limits<qint64>::min();
+
+    // Sources opened before this call may already have frames waiting.
+    mergePending();
+}
+
+void CanBusMerger::mergePending()
+{
+    VEHICLESYS_TRACE_SCOPE("can", "merge");
+    bool backlogged = false;
+    for (BusQueue &queue : m_queues) {
+        backlogged |= !collect(queue);
+    }
+
+    const qint64 nowUs = canMonotonicMicros();
+    const bool singleSource = m_queues.size() == 1;
+
+    for (;;) {
+        // Oldest head frame across all buses.
+        int oldest = -1;
+        qint64 oldestUs = std::numeric_limits<qint64>::max();
+        for (int i = 0; i < m_queues.size(); ++i) {
+            const BusQueue &queue = m_queues.at(i);
+            if (queue.head < queue.frames.size() && queue.frames.at(queue.head).timestampUs < oldestUs) {
+                oldest = i;
+                oldestUs = queue.frames.at(queue.head).timestampUs;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+
+        bool ready = singleSource || oldestUs <= nowUs - MergeWindowUs;
+        if (!ready) {
+            ready = true;
+            for (int i = 0; i < m_queues.size() && ready; ++i) {
+                ready = i == oldest || m_queues.at(i).newestTimestampUs >= oldestUs;
+            }
+        }
+        if (!ready) {
+            // Some bus may still produce an older frame; give it until the
+            // window closes.
+            const qint64 waitUs = oldestUs + MergeWindowUs - nowUs;
+            m_releaseTimer->start(static_cast<int>(qBound<qint64>(1, (waitUs + 999) / 1000, MergeWindowUs / 1000 + 1)));
+            break;
+        }
+
+        if (m_ring.size() >= RingCapacity) {
+            // Consumer is behind; retry shortly instead of dropping.
+            m_releaseTimer->start(1);
+            break;
+        }
+
+        BusQueue &queue = m_queues[oldest];
+        if (oldestUs < m_lastReleasedUs) {
+            m_lateFrames.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            m_lastReleasedUs = oldestUs;
+        }
+        m_ring.push(queue.frames.at(queue.head));
+        ++queue.head;
+    }
+
+    for (BusQueue &queue : m_queues) {
+        if (queue.head == queue.frames.size()) {
+            queue.frames.resize(0);
+            queue.head = 0;
+        }
+    }
+
+    // A capped source may have swallowed its wake-up; come back for the rest.
+    if (backlogged && !m_releaseTimer->isActive()) {
+        m_releaseTimer->start(0);
+    }
+
+    notifyConsumer();
+}
+
+bool CanBusMerger::collect(BusQueue &queue)
+{
+    // Compact released frames away before growing the queue.
+    if (queue.head > 0) {
+        queue.frames.erase(queue.frames.begin(), queue.frames.begin() + queue.head);
+        queue.head = 0;
+    }
+
+    while (queue.frames.size() < MaxQueuedFrames) {
+        const int size = queue.frames.size();
+        const int batch = qMin(CollectBatchSize, MaxQueuedFrames - size);
+        queue.frames.resize(size + batch);
+        const std::size_t count = queue.source->drain(queue.frames.data() + size, static_cast<std::size_t>(batch));
+        queue.frames.resize(size + static_cast<int>(count));
+        if (count > 0) {
+            queue.newestTimestampUs = qMax(queue.newestTimestampUs, queue.frames.last().timestampUs);
+        }
+        if (count < static_cast<std::size_t>(batch)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CanBusMerger::notifyConsumer()
+{
+    if (m_ring.isEmpty()) {
+        return;
+    }
+    if (!m_drainPending.exchange(true, std::memory_order_acq_rel)) {
+        emit framesPending();
+    }
+}
@@ -0,0 +1,516 @@
+#include "canlogreader.h"
+
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+namespace {
+// Lines inspected when guessing the capture format.
+constexpr int FormatProbeLines = 64;
+// candump prints extended IDs with 8 digits; bit 29 marks an error frame.
+constexpr quint32 CandumpErrorFlag = 0x20000000u;
+
+const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    return p;
+}
+
+const char *tokenEnd(const char *p, const char *end)
+{
+    while (p < end && *p != ' ' && *p != '\t') {
+        ++p;
+    }
+    return p;
+}
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool parseNumber(const char *begin, const char *end, int base, quint32 &value)
+{
+    if (begin == end) {
+        return false;
+    }
+    quint32 result = 0;
+    for (const char *p = begin; p < end; ++p) {
+        const int digit = hexDigit(*p);
+        if (digit < 0 || digit >= base) {
+            return false;
+        }
+        result = result * static_cast<quint32>(base) + static_cast<quint32>(digit);
+    }
+    value = result;
+    return true;
+}
+
+// "<seconds>.<fraction>" to microseconds without going through double, so
+// epoch timestamps keep their full resolution.
+bool parseTimestampUs(const char *begin, const char *end, qint64 &timestampUs)
+{
+    qint64 seconds = 0;
+    const char *p = begin;
+    while (p < end && *p >= '0' && *p <= '9') {
+        seconds = seconds * 10 + (*p - '0');
+        ++p;
+    }
+    if (p == begin) {
+        return false;
+    }
+
+    qint64 micros = 0;
+    if (p < end && *p == '.') {
+        ++p;
+        int digits = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 6) {
+                micros = micros * 10 + (*p - '0');
+                ++digits;
+            }
+            ++p;
+        }
+        for (; digits < 6; ++digits) {
+            micros *= 10;
+        }
+    }
+    if (p != end) {
+        return false;
+    }
+
+    timestampUs = seconds * 1000000 + micros;
+    return true;
+}
+
+bool startsWith(const char *p, const char *end, const char *prefix)
+{
+    const std::size_t length = std::strlen(prefix);
+    return static_cast<std::size_t>(end - p) >= length && std::memcmp(p, prefix, length) == 0;
+}
+
+// CAN FD DLC codes 9..15 map to these payload lengths.
+int fdDlcToLength(int dlc)
+{
+    static const int lengths[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+    return lengths[dlc & 0xF];
+}
+}
+
+CanLogReader::CanLogReader()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_position(0)
+    , m_malformedLines(0)
+    , m_format(UnknownFormat)
+    , m_ascDecimal(false)
+    , m_ascRelativeTimestamps(false)
+    , m_ascLastTimestampUs(0)
+{
+}
+
+CanLogReader::~CanLogReader()
+{
+    close();
+}
+
+bool CanLogReader::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = QStringLiteral("Cannot open %1: %2").arg(path, m_file.errorString());
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size <= 0) {
+        m_errorString = QStringLiteral("%1 is empty").arg(path);
+        m_file.close();
+        return false;
+    }
+
+    uchar *mapped = m_file.map(0, m_size);
+    if (!mapped) {
+        m_errorString = QStringLiteral("Cannot map %1: %2").arg(path, m_file.errorString());
+        m_file.close();
+        return false;
+    }
+    m_data = reinterpret_cast<const char *>(mapped);
+
+#ifdef Q_OS_LINUX
+    // Read-ahead aggressively and let the kernel drop pages we have passed.
+    madvise(mapped, static_cast<std::size_t>(m_size), MADV_SEQUENTIAL);
+#endif
+
+    // Sniff the first lines for either a candump "(timestamp)" prefix or an
+    // ASC header / frame line.
+    const char *p = m_data;
+    const char *end = m_data + m_size;
+    for (int line = 0; line < FormatProbeLines && p < end && m_format == UnknownFormat; ++line) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const char *text = skipSpaces(p, lineEnd);
+        if (text < lineEnd && *text == '(') {
+            m_format = CandumpFormat;
+        } else if (startsWith(text, lineEnd, "date ") || startsWith(text, lineEnd, "base ")
+                   || startsWith(text, lineEnd, "Begin Triggerblock")
+                   || startsWith(text, lineEnd, "Begin TriggerBlock")) {
+            m_format = AscFormat;
+        } else {
+            const char *firstEnd = tokenEnd(text, lineEnd);
+            qint64 timestampUs;
+            if (firstEnd > text && parseTimestampUs(text, firstEnd, timestampUs)) {
+                m_format = AscFormat;
+            }
+        }
+        p = lineEnd + 1;
+    }
+
+    if (m_format == UnknownFormat) {
+        m_errorString = QStringLiteral("%1 is neither a candump log nor an ASC file").arg(path);
+        close();
+        return false;
+    }
+
+    m_errorString.clear();
+    return true;
+}
+
+void CanLogReader::close()
+{
+    if (m_data) {
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+        m_data = nullptr;
+    }
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_size = 0;
+    m_format = UnknownFormat;
+    rewind();
+}
+
+bool CanLogReader::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+void CanLogReader::rewind()
+{
+    m_position = 0;
+    m_malformedLines = 0;
+    m_ascDecimal = false;
+    m_ascRelativeTimestamps = false;
+    m_ascLastTimestampUs = 0;
+    m_candumpInterfaces.clear();
+}
+
+CanLogReader::Format CanLogReader::format() const
+{
+    return m_format;
+}
+
+QString CanLogReader::errorString() const
+{
+    return m_errorString;
+}
+
+qint64 CanLogReader::size() const
+{
+    return m_size;
+}
+
+qint64 CanLogReader::position() const
+{
+    return m_position;
+}
+
+qint64 CanLogReader::malformedLines() const
+{
+    return m_malformedLines;
+}
+
+bool CanLogReader::readFrame(CanFrame &frame)
+{
+    const char *end = m_data + m_size;
+    while (m_position < m_size) {
+        const char *line = m_data + m_position;
+        const char *lineEnd = static_cast<const char *>(std::memchr(line, '\n', static_cast<std::size_t>(end - line)));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        m_position = (lineEnd - m_data) + 1;
+
+        const char *text = skipSpaces(line, lineEnd);
+        if (lineEnd > text && lineEnd[-1] == '\r') {
+            --lineEnd;
+        }
+        if (text == lineEnd) {
+            continue;
+        }
+
+        const bool parsed = m_format == CandumpFormat ? parseCandumpLine(text, lineEnd, frame)
+                                                      : parseAscLine(text, lineEnd, frame);
+        if (parsed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CanLogReader::parseCandumpLine(const char *line, const char *end, CanFrame &frame)
+{
+    // (<seconds>.<micros>) <interface> <id>#<data> | <id>##<flags><data> | <id>#R
+    if (*line != '(') {
+        return false;
+    }
+    const char *close = static_cast<const char *>(std::memchr(line, ')', static_cast<std::size_t>(end - line)));
+    qint64 timestampUs;
+    if (!close || !parseTimestampUs(line + 1, close, timestampUs)) {
+        ++m_malformedLines;
+        return false;
+    }
+
+    const char *interface = skipSpaces(close + 1, end);
+    const char *interfaceEnd = tokenEnd(interface, end);
+    const char *token = skipSpaces(interfaceEnd, end);
+    const char *tokenStop = tokenEnd(token, end);
+    const char *hash = static_cast<const char *>(std::memchr(token, '#', static_cast<std::size_t>(tokenStop - token)));
+    quint32 frameId;
+    if (interface == interfaceEnd || !hash || !parseNumber(token, hash, 16, frameId)) {
+        ++m_malformedLines;
+        return false;
+    }
+
+    const bool extended = hash - token > 3;
+    if (extended && (frameId & CandumpErrorFlag)) {
+        return false;
+    }
+
+    const char *data = hash + 1;
+    bool fd = false;
+    quint8 fdFlags = 0;
+    if (data < tokenStop && *data == 'R') {
+        return false; // remote request, no payload to decode
+    }
+    if (data < tokenStop && *data == '#') {
+        const int flags = data + 1 < tokenStop ? hexDigit(data[1]) : -1;
+        if (flags < 0) {
+            ++m_malformedLines;
+            return false;
+        }
+        fd = true;
+        fdFlags = static_cast<quint8>(flags);
+        data += 2;
+    }
+
+    frame = CanFrame::make(frameId, 0, timestampUs);
+    int length = 0;
+    for (const char *p = data; p < tokenStop;) {
+        if (*p == '.') {
+            ++p;
+            continue;
+        }
+        const int high = hexDigit(*p);
+        const int low = p + 1 < tokenStop ? hexDigit(p[1]) : -1;
+        if (high < 0 || low < 0 || length >= CanFrame::MaxPayloadSize) {
+            ++m_malformedLines;
+            return false;
+        }
+        frame.payload[length++] = static_cast<quint8>((high << 4) | low);
+        p += 2;
+    }
+
+    frame.length = static_cast<quint8>(length);
+    if (extended) {
+        frame.flags |= CanFrame::ExtendedId;
+    }
+    if (fd || length > 8) {
+        frame.flags |= CanFrame::FlexibleDataRate;
+    }
+    if (fdFlags & 0x1) { // CANFD_BRS
+        frame.flags |= CanFrame::BitrateSwitch;
+    }
+    frame.bus = candumpBus(interface, static_cast<int>(interfaceEnd - interface));
+    return true;
+}
+
+bool CanLogReader::parseAscLine(const char *line, const char *end, CanFrame &frame)
+{
+    const char *first = line;
+    const char *firstEnd = tokenEnd(first, end);
+    qint64 timestampUs;
+    if (!parseTimestampUs(first, firstEnd, timestampUs)) {
+        // Header, comment or trigger block marker.
+        if (startsWith(first, end, "base ")) {
+            parseAscHeader(first, end);
+        }
+        return false;
+    }
+    if (m_ascRelativeTimestamps) {
+        timestampUs += m_ascLastTimestampUs;
+    }
+    m_ascLastTimestampUs = timestampUs;
+
+    // Collect the remaining whitespace-separated fields.
+    constexpr int MaxFields = 16 + CanFrame::MaxPayloadSize;
+    const char *fields[MaxFields];
+    const char *fieldEnds[MaxFields];
+    int fieldCount = 0;
+    for (const char *p = skipSpaces(firstEnd, end); p < end && fieldCount < MaxFields; p = skipSpaces(p, end)) {
+        fields[fieldCount] = p;
+        p = tokenEnd(p, end);
+        fieldEnds[fieldCount] = p;
+        ++fieldCount;
+    }
+    if (fieldCount < 2) {
+        return false;
+    }
+
+    const int dataBase = m_ascDecimal ? 10 : 16;
+    const bool canFd = fieldEnds[0] - fields[0] == 5 && std::memcmp(fields[0], "CANFD", 5) == 0;
+    quint32 channel;
+    int field = canFd ? 1 : 0;
+    if (!parseNumber(fields[field], fieldEnds[field], 10, channel) || channel == 0) {
+        return false; // ErrorFrame, Statistic:, event lines, ...
+    }
+    ++field;
+
+    const char *idField;
+    const char *idEnd;
+    const char *direction;
+    if (fieldCount < field + 2) {
+        return false; // "1 ErrorFrame" and other short channel events
+    }
+    if (canFd) {
+        // CANFD <ch> <dir> <id> [<name>] <brs> <esi> <dlc> <len> <data...>
+        direction = fields[field++];
+        idField = fields[field];
+        idEnd = fieldEnds[field++];
+    } else {
+        // <ch> <id>[x] <dir> d <dlc> <data...>
+        idField = fields[field];
+        idEnd = fieldEnds[field++];
+        direction = fields[field++];
+    }
+
+    const bool extended = idEnd > idField && (idEnd[-1] == 'x' || idEnd[-1] == 'X');
+    quint32 frameId;
+    if (!parseNumber(idField, extended ? idEnd - 1 : idEnd, m_ascDecimal ? 10 : 16, frameId)) {
+        // "1 ErrorFrame" and other non-frame events on a channel.
+        return false;
+    }
+
+    int length;
+    bool bitrateSwitch = false;
+    if (canFd) {
+        // An optional symbolic message name precedes the 0/1 BRS field.
+        if (field < fieldCount && !(fieldEnds[field] - fields[field] == 1
+                                    && (*fields[field] == '0' || *fields[field] == '1'))) {
+            ++field;
+        }
+        quint32 brs, esi, dlc, dataLength;
+        if (fieldCount < field + 4
+            || !parseNumber(fields[field], fieldEnds[field], 2, brs)
+            || !parseNumber(fields[field + 1], fieldEnds[field + 1], 2, esi)
+            || !parseNumber(fields[field + 2], fieldEnds[field + 2], 16, dlc)
+            || !parseNumber(fields[field + 3], fieldEnds[field + 3], 10, dataLength)) {
+            ++m_malformedLines;
+            return false;
+        }
+        Q_UNUSED(esi)
+        bitrateSwitch = brs != 0;
+        length = qMin(static_cast<int>(dataLength), fdDlcToLength(static_cast<int>(dlc)));
+        field += 4;
+    } else {
+        quint32 dlc;
+        if (field < fieldCount && (*fields[field] == 'r' || *fields[field] == 'R')) {
+            return false; // remote request
+        }
+        if (fieldCount < field + 2) {
+            ++m_malformedLines;
+            return false;
+        }
+        ++field; // 'd'
+        if (!parseNumber(fields[field], fieldEnds[field], 16, dlc)) {
+            ++m_malformedLines;
+            return false;
+        }
+        length = qMin(static_cast<int>(dlc), 8);
+        ++field;
+    }
+
+    if (fieldCount < field + length) {
+        ++m_malformedLines;
+        return false;
+    }
+
+    frame = CanFrame::make(frameId, length, timestampUs);
+    for (int i = 0; i < length; ++i, ++field) {
+        quint32 byte;
+        if (!parseNumber(fields[field], fieldEnds[field], dataBase, byte) || byte > 0xFF) {
+            ++m_malformedLines;
+            return false;
+        }
+        frame.payload[i] = static_cast<quint8>(byte);
+    }
+
+    if (extended) {
+        frame.flags |= CanFrame::ExtendedId;
+    }
+    if (canFd) {
+        frame.flags |= CanFrame::FlexibleDataRate;
+    }
+    if (bitrateSwitch) {
+        frame.flags |= CanFrame::BitrateSwitch;
+    }
+    if (*direction == 'T') {
+        frame.flags |= CanFrame::Transmitted;
+    }
+    frame.bus = static_cast<quint8>(channel - 1);
+    return true;
+}
+
+void CanLogReader::parseAscHeader(const char *line, const char *end)
+{
+    // base <hex|dec>  timestamps <absolute|relative>
+    const char *p = skipSpaces(tokenEnd(line, end), end);
+    m_ascDecimal = startsWith(p, end, "dec");
+    p = skipSpaces(tokenEnd(p, end), end);
+    if (startsWith(p, end, "timestamps")) {
+        p = skipSpaces(tokenEnd(p, end), end);
+        m_ascRelativeTimestamps = startsWith(p, end, "relative");
+    }
+}
+
+quint8 CanLogReader::candumpBus(const char *name, int length)
+{
+    for (int i = 0; i < m_candumpInterfaces.size(); ++i) {
+        const QByteArray &known = m_candumpInterfaces.at(i);
+        if (known.size() == length && std::memcmp(known.constData(), name, static_cast<std::size_t>(length)) == 0) {
+            return static_cast<quint8>(i);
+        }
+    }
+    if (m_candumpInterfaces.size() >= 0xFF) {
+        return 0xFF;
+    }
+    m_candumpInterfaces.append(QByteArray(name, length));
+    return static_cast<quint8>(m_candumpInterfaces.size() - 1);
+}
@@ -0,0 +1,362 @@
+#include "canreceiveworker.h"
+#include "tracerecorder.h"
+#include <QDebug>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#ifdef HAVE_QT_SERIALBUS
+#include <QCanBus>
+#endif
+
+static_assert(CanLoadGenerator::ExtendedIdFlag == CanFrame::ExtendedId
+              && CanLoadGenerator::FlexibleDataRateFlag == CanFrame::FlexibleDataRate
+              && CanLoadGenerator::BitrateSwitchFlag == CanFrame::BitrateSwitch,
+              "CanLoadGenerator flags must match CanFrame::Flag");
+
+CanReceiveWorker::CanReceiveWorker(quint8 bus, QObject *parent)
+    : QObject(parent)
+    , m_bus(bus)
+#ifdef HAVE_QT_SERIALBUS
+    , m_canDevice(nullptr)
+#endif
+    , m_socketNotifier(nullptr)
+    , m_generating(false)
+    , m_replayTimer(new QTimer(this))
+    , m_replaySpeed(1.0)
+    , m_replayLogStartUs(0)
+    , m_replayClockStartUs(0)
+    , m_replayedFrames(0)
+    , m_replayFrameValid(false)
+    , m_kernelDropped(0)
+    , m_receivedFrames(0)
+    , m_errorFrames(0)
+    , m_drainPending(false)
+{
+    // Child of the worker, so it follows it onto the ingest thread.
+    m_replayTimer->setSingleShot(true);
+    m_replayTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_replayTimer, &QTimer::timeout, this, &CanReceiveWorker::replayNext);
+}
+
+CanReceiveWorker::~CanReceiveWorker()
+{
+    closeDevice();
+}
+
+quint8 CanReceiveWorker::bus() const
+{
+    return m_bus;
+}
+
+std::size_t CanReceiveWorker::drain(CanFrame *out, std::size_t maxFrames)
+{
+    // Clear the flag before popping: anything pushed after this point will
+    // schedule another wake-up, so no frame can be left stranded in the ring.
+    m_drainPending.store(false, std::memory_order_release);
+    return m_ring.popBatch(out, maxFrames);
+}
+
+std::size_t CanReceiveWorker::ringHighWaterMark() const
+{
+    return m_ring.highWaterMark();
+}
+
+std::size_t CanReceiveWorker::droppedFrames() const
+{
+    return m_ring.droppedCount() + m_kernelDropped.load(std::memory_order_relaxed);
+}
+
+quint64 CanReceiveWorker::receivedFrames() const
+{
+    return m_receivedFrames.load(std::memory_order_relaxed);
+}
+
+quint64 CanReceiveWorker::errorFrames() const
+{
+    return m_errorFrames.load(std::memory_order_relaxed);
+}
+
+bool CanReceiveWorker::openDevice(const QString &plugin, const QString &interface)
+{
+#ifdef HAVE_QT_SERIALBUS
+    closeDevice();
+
+    qDebug() << "Attempting to connect to CAN interface:" << interface;
+
+    m_canDevice = QCanBus::instance()->createDevice(plugin, interface);
+
+    if (!m_canDevice) {
+        qDebug() << "Failed to create CAN device for interface:" << interface;
+        // Check available devices
+        QString errorString;
+        auto availableDevices = QCanBus::instance()->availableDevices(plugin, &errorString);
+        qDebug() << "Available devices:" << availableDevices.size();
+        for (const auto &device : availableDevices) {
+            qDebug() << "  -" << device.name() << device.description();
+        }
+        return false;
+    }
+
+    // Error frames are only delivered when asked for; they are counted, not
+    // queued for decoding.
+    m_canDevice->setConfigurationParameter(QCanBusDevice::ErrorFilterKey,
+                                           QVariant::fromValue(QCanBusFrame::FrameErrors(QCanBusFrame::AnyError)));
+    m_errorFrames.store(0, std::memory_order_relaxed);
+
+    connect(m_canDevice, &QCanBusDevice::framesReceived, this, &CanReceiveWorker::handleFramesReceived);
+    connect(m_canDevice, &QCanBusDevice::errorOccurred, this, &CanReceiveWorker::handleErrorOccurred);
+    connect(m_canDevice, &QCanBusDevice::stateChanged, this, &CanReceiveWorker::stateChanged);
+
+    if (!m_canDevice->connectDevice()) {
+        delete m_canDevice;
+        m_canDevice = nullptr;
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(plugin)
+    Q_UNUSED(interface)
+    return false;
+#endif
+}
+
+bool CanReceiveWorker::openNativeSocket(const QString &interface)
+{
+    closeDevice();
+
+    qDebug() << "Attempting native SocketCAN connection to:" << interface;
+
+    if (!m_nativeSocket.open(interface)) {
+        qDebug() << "Native SocketCAN open failed:" << m_nativeSocket.errorString();
+        return false;
+    }
+
+    m_kernelDropped.store(0, std::memory_order_relaxed);
+    m_errorFrames.store(0, std::memory_order_relaxed);
+    m_socketNotifier = new QSocketNotifier(m_nativeSocket.socketDescriptor(), QSocketNotifier::Read, this);
+    connect(m_socketNotifier, &QSocketNotifier::activated, this, &CanReceiveWorker::handleSocketReadable);
+    return true;
+}
+
+bool CanReceiveWorker::openReplay(const QString &path, double speed)
+{
+    closeDevice();
+
+    qDebug() << "Replaying CAN capture:" << path
+             << "at" << (speed > 0 ? QString::number(speed) + "x" : QStringLiteral("max speed"));
+
+    if (!m_logReader.open(path)) {
+        qDebug() << "CAN replay failed:" << m_logReader.errorString();
+        return false;
+    }
+
+    startReplay(speed);
+    return true;
+}
+
+bool CanReceiveWorker::openGenerator(const CanLoadProfile &profile, double speed)
+{
+    closeDevice();
+
+    m_loadGenerator = CanLoadGenerator(profile);
+    qDebug() << "Generating synthetic CAN load:" << profile.messageCount << "IDs,"
+             << qRound(m_loadGenerator.framesPerSecond()) << "frames/s scheduled,"
+             << qRound(m_loadGenerator.estimatedBusLoad() * 100) << "% bus load, seed" << profile.seed
+             << "at" << (speed > 0 ? QString::number(speed) + "x" : QStringLiteral("max speed"));
+
+    m_generating = true;
+    m_replayFrame = CanFrame::make(0, 0, 0);
+    m_replayFrame.bus = m_bus;
+    startReplay(speed);
+    return true;
+}
+
+void CanReceiveWorker::startReplay(double speed)
+{
+    m_replaySpeed = speed > 0 ? speed : 0;
+    m_replayedFrames = 0;
+    m_replayFrameValid = readReplayFrame(m_replayFrame);
+    m_replayLogStartUs = m_replayFrameValid ? m_replayFrame.timestampUs : 0;
+    m_replayClockStartUs = canMonotonicMicros();
+    m_replayTimer->start(0);
+}
+
+bool CanReceiveWorker::readReplayFrame(CanFrame &frame)
+{
+    return m_generating ? m_loadGenerator.next(frame) : m_logReader.readFrame(frame);
+}
+
+void CanReceiveWorker::closeDevice()
+{
+    m_replayTimer->stop();
+    m_replayFrameValid = false;
+    m_generating = false;
+    m_logReader.close();
+
+    if (m_socketNotifier) {
+        m_socketNotifier->setEnabled(false);
+        delete m_socketNotifier;
+        m_socketNotifier = nullptr;
+    }
+    m_nativeSocket.close();
+
+#ifdef HAVE_QT_SERIALBUS
+    if (m_canDevice) {
+        m_canDevice->disconnectDevice();
+        delete m_canDevice;
+        m_canDevice = nullptr;
+    }
+#endif
+}
+
+void CanReceiveWorker::writeFrame(quint32 frameId, const QByteArray &data, bool extended)
+{
+    if (m_nativeSocket.isOpen()) {
+        if (!m_nativeSocket.writeFrame(frameId, data, extended)) {
+            emit errorOccurred(m_nativeSocket.errorString());
+        }
+        return;
+    }
+
+#ifdef HAVE_QT_SERIALBUS
+    if (!m_canDevice) {
+        return;
+    }
+
+    QCanBusFrame frame(frameId, data);
+    frame.setExtendedFrameFormat(extended);
+    m_canDevice->writeFrame(frame);
+#else
+    Q_UNUSED(frameId)
+    Q_UNUSED(data)
+    Q_UNUSED(extended)
+#endif
+}
+
+#ifdef HAVE_QT_SERIALBUS
+void CanReceiveWorker::handleFramesReceived()
+{
+    VEHICLESYS_TRACE_SCOPE("can", "receive");
+    if (!m_canDevice) {
+        return;
+    }
+
+    while (m_canDevice->framesAvailable()) {
+        const QCanBusFrame frame = m_canDevice->readFrame();
+        if (!frame.isValid()) {
+            continue;
+        }
+        if (frame.frameType() == QCanBusFrame::ErrorFrame) {
+            m_errorFrames.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        const QByteArray payload = frame.payload();
+        CanFrame entry = CanFrame::fromBytes(frame.frameId(), payload.constData(), payload.size(),
+                                             canMonotonicMicros());
+        if (frame.hasExtendedFrameFormat()) {
+            entry.flags |= CanFrame::ExtendedId;
+        }
+        if (frame.hasFlexibleDataRateFormat()) {
+            entry.flags |= CanFrame::FlexibleDataRate;
+        }
+        if (frame.hasBitrateSwitch()) {
+            entry.flags |= CanFrame::BitrateSwitch;
+        }
+        entry.bus = m_bus;
+        // A full ring counts the frame as dropped rather than blocking the
+        // reader; the consumer reports the drop count.
+        m_ring.push(entry);
+        m_receivedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    notifyConsumer();
+}
+
+void CanReceiveWorker::handleErrorOccurred(QCanBusDevice::CanBusError error)
+{
+    Q_UNUSED(error)
+    if (m_canDevice) {
+        emit errorOccurred(m_canDevice->errorString());
+    }
+}
+#endif
+
+void CanReceiveWorker::handleSocketReadable()
+{
+    VEHICLESYS_TRACE_SCOPE("can", "receive");
+    // One recvmmsg() per batch; keep going until the kernel queue is empty so
+    // a level-triggered notifier does not fire again for data already seen.
+    for (;;) {
+        const int count = m_nativeSocket.readBatch(m_readBatch, NativeCanSocket::MaxBatchSize);
+        if (count < 0) {
+            m_socketNotifier->setEnabled(false);
+            emit errorOccurred(m_nativeSocket.errorString());
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            m_readBatch[i].bus = m_bus;
+            m_ring.push(m_readBatch[i]);
+        }
+        m_receivedFrames.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+        if (count < NativeCanSocket::MaxBatchSize) {
+            break;
+        }
+    }
+
+    m_kernelDropped.store(m_nativeSocket.kernelDroppedFrames(), std::memory_order_relaxed);
+    m_errorFrames.store(m_nativeSocket.errorFrames(), std::memory_order_relaxed);
+    notifyConsumer();
+}
+
+void CanReceiveWorker::replayNext()
+{
+    VEHICLESYS_TRACE_SCOPE("can", "replay");
+    const qint64 nowUs = canMonotonicMicros();
+
+    while (m_replayFrameValid) {
+        const qint64 logOffsetUs = m_replayFrame.timestampUs - m_replayLogStartUs;
+        // Stamped with when it goes out, like a live frame arriving then
+        qint64 dueUs = nowUs;
+        if (m_replaySpeed > 0) {
+            dueUs = m_replayClockStartUs + static_cast<qint64>(logOffsetUs / m_replaySpeed);
+            if (dueUs > nowUs) {
+                // Everything due so far goes out as one batch; sleep until the next frame.
+                m_replayTimer->start(static_cast<int>((dueUs - nowUs + 999) / 1000));
+                notifyConsumer();
+                return;
+            }
+        }
+
+        // A replay must not lose frames, so a full ring means wait, not drop.
+        if (m_ring.size() >= RingCapacity) {
+            m_replayTimer->start(m_replaySpeed > 0 ? 1 : 0);
+            notifyConsumer();
+            return;
+        }
+
+        CanFrame frame = m_replayFrame;
+        frame.timestampUs = dueUs;
+        frame.sourceTimestampUs = m_replayClockStartUs + logOffsetUs;
+        m_ring.push(frame);
+        m_receivedFrames.fetch_add(1, std::memory_order_relaxed);
+        ++m_replayedFrames;
+        m_replayFrameValid = readReplayFrame(m_replayFrame);
+    }
+
+    notifyConsumer();
+    emit replayFinished(m_replayedFrames, m_generating ? 0 : m_logReader.malformedLines());
+    m_generating = false;
+    m_logReader.close();
+}
+
+void CanReceiveWorker::notifyConsumer()
+{
+    if (m_ring.isEmpty()) {
+        return;
+    }
+    // Only one wake-up in flight at a time.
+    if (!m_drainPending.exchange(true, std::memory_order_acq_rel)) {
+        emit framesPending();
+    }
+}
@@ -0,0 +1,287 @@
+#include "cantrafficstats.h"
+#include "canbittiming.h"
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr quint64 UsedKey = quint64(1) << 40;
+// Standard and extended frames with the same ID are different messages
+constexpr quint64 ExtendedKey = quint64(1) << 41;
+constexpr int TableBits = 13;
+static_assert((1 << TableBits) == CanTrafficStats::Capacity, "Capacity must match TableBits");
+// Inserts stop at this fill level so probe chains stay short and every
+// lookup of an absent ID ends at a free slot.
+constexpr int MaxUsedEntries = CanTrafficStats::Capacity * 3 / 4;
+
+// The writer is the only thread storing to these, so a relaxed load and
+// store is enough and avoids a locked read-modify-write per counter.
+template<typename T>
+inline void bump(std::atomic<T> &counter, T amount = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+}
+
+struct CanTrafficStats::Entry
+{
+    std::atomic<quint64> key;           // 0 while free, UsedKey | [ExtendedKey] | bus << 32 | frameId once taken
+    std::atomic<quint64> frames;
+    std::atomic<qint64> lastTimestampUs;
+    std::atomic<qint64> minGapUs;
+    std::atomic<qint64> maxGapUs;
+    std::atomic<qint64> gapSumUs;
+    std::atomic<quint8> flags;
+    std::atomic<quint8> length;
+    std::atomic<bool> unknown;
+    std::atomic<quint32> payloadVersion; // seqlock over length and payload, odd while writing
+    std::atomic<quint64> payload[CanFrame::MaxPayloadSize / 8];
+    std::atomic<quint32> dlcHistogram[DlcCodeCount];
+    quint64 snapshotFrames;             // snapshot() only
+};
+
+struct CanTrafficStats::Bus
+{
+    std::atomic<quint64> frames;
+    std::atomic<quint64> busyNs;
+    std::atomic<double> bitrate;        // 0 = DefaultBitrate
+    std::atomic<double> dataBitrate;    // 0 = DefaultDataBitrate
+    quint64 snapshotFrames;             // snapshot() only
+    quint64 snapshotBusyNs;             // snapshot() only
+};
+
+CanTrafficStats::CanTrafficStats()
+    // Value-initialised, so every counter and key starts at zero.
+    : m_entries(new Entry[Capacity]())
+    , m_buses(new Bus[MaxBuses]())
+    , m_highestBus(-1)
+    , m_usedEntries(0)
+    , m_untrackedFrames(0)
+    , m_unknownFrames(0)
+    , m_unknownLogWindowUs(0)
+    , m_unknownLogsInWindow(0)
+    , m_unknownLogsSuppressed(0)
+    , m_previousSnapshotUs(0)
+{
+}
+
+CanTrafficStats::~CanTrafficStats() = default;
+
+void CanTrafficStats::setBitrate(int bus, double bitrate, double dataBitrate)
+{
+    if (bus < 0 || bus >= MaxBuses || bitrate <= 0 || dataBitrate <= 0) {
+        return;
+    }
+    m_buses[bus].bitrate.store(bitrate, std::memory_order_relaxed);
+    m_buses[bus].dataBitrate.store(dataBitrate, std::memory_order_relaxed);
+}
+
+int CanTrafficStats::dlcCode(int length)
+{
+    if (length <= 8) {
+        return length;
+    }
+    if (length <= 24) {
+        return 9 + (length - 9) / 4;    // 12, 16, 20, 24 -> 9..12
+    }
+    return length <= 32 ? 13 : length <= 48 ? 14 : 15;
+}
+
+CanTrafficStats::Entry *CanTrafficStats::find(quint8 bus, quint32 frameId, bool extended, bool insert)
+{
+    const quint64 key = UsedKey | (extended ? ExtendedKey : 0) | (quint64(bus) << 32) | frameId;
+    quint32 index = static_cast<quint32>((key * 0x9E3779B97F4A7C15ull) >> (64 - TableBits));
+    for (;;) {
+        Entry &entry = m_entries[index];
+        const quint64 current = entry.key.load(std::memory_order_relaxed);
+        if (current == key) {
+            return &entry;
+        }
+        if (current == 0) {
+            if (!insert || m_usedEntries >= MaxUsedEntries) {
+                return nullptr;
+            }
+            ++m_usedEntries;
+            // Publishes a zeroed entry; the snapshot side may see it before
+            // its first frame is counted.
+            entry.key.store(key, std::memory_order_release);
+            return &entry;
+        }
+        index = (index + 1) & (Capacity - 1);
+    }
+}
+
+void CanTrafficStats::record(const CanFrame &frame)
+{
+    Bus &bus = m_buses[frame.bus];
+    const double bitrate = bus.bitrate.load(std::memory_order_relaxed);
+    const double dataBitrate = bus.dataBitrate.load(std::memory_order_relaxed);
+    const double frameTimeUs = canFrameTimeUs(frame.length, frame.flags & CanFrame::ExtendedId,
+                                              frame.flags & CanFrame::FlexibleDataRate,
+                                              frame.flags & CanFrame::BitrateSwitch,
+                                              bitrate > 0 ? bitrate : DefaultBitrate,
+                                              dataBitrate > 0 ? dataBitrate : DefaultDataBitrate);
+    bump(bus.frames);
+    bump(bus.busyNs, static_cast<quint64>(frameTimeUs * 1000.0));
+    if (frame.bus > m_highestBus.load(std::memory_order_relaxed)) {
+        m_highestBus.store(frame.bus, std::memory_order_relaxed);
+    }
+
+    Entry *entry = find(frame.bus, frame.frameId, (frame.flags & CanFrame::ExtendedId) != 0, true);
+    if (!entry) {
+        bump(m_untrackedFrames);
+        return;
+    }
+
+    const quint64 frames = entry->frames.load(std::memory_order_relaxed);
+    if (frames > 0) {
+        const qint64 gapUs = qMax<qint64>(0, frame.timestampUs - entry->lastTimestampUs.load(std::memory_order_relaxed));
+        if (frames == 1 || gapUs < entry->minGapUs.load(std::memory_order_relaxed)) {
+            entry->minGapUs.store(gapUs, std::memory_order_relaxed);
+        }
+        if (gapUs > entry->maxGapUs.load(std::memory_order_relaxed)) {
+            entry->maxGapUs.store(gapUs, std::memory_order_relaxed);
+        }
+        bump(entry->gapSumUs, gapUs);
+    }
+    entry->lastTimestampUs.store(frame.timestampUs, std::memory_order_relaxed);
+    entry->flags.store(frame.flags, std::memory_order_relaxed);
+
+    const quint32 version = entry->payloadVersion.load(std::memory_order_relaxed);
+    entry->payloadVersion.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry->length.store(frame.length, std::memory_order_relaxed);
+    for (int word = 0; word * 8 < frame.length; ++word) {
+        quint64 bytes;
+        std::memcpy(&bytes, frame.payload + word * 8, sizeof(bytes));
+        entry->payload[word].store(bytes, std::memory_order_relaxed);
+    }
+    entry->payloadVersion.store(version + 2, std::memory_order_release);
+
+    bump(entry->dlcHistogram[dlcCode(frame.length)]);
+    entry->frames.store(frames + 1, std::memory_order_relaxed);
+}
+
+void CanTrafficStats::record(const QVector<CanFrame> &frames)
+{
+    for (const CanFrame &frame : frames) {
+        record(frame);
+    }
+}
+
+void CanTrafficStats::markUnknown(quint8 bus, quint32 frameId, bool extended)
+{
+    bump(m_unknownFrames);
+
+    // IDs the table had no room for are only counted.
+    Entry *entry = find(bus, frameId, extended, false);
+    if (!entry || entry->unknown.load(std::memory_order_relaxed)) {
+        return;
+    }
+    entry->unknown.store(true, std::memory_order_relaxed);
+
+    const qint64 nowUs = canMonotonicMicros();
+    if (nowUs - m_unknownLogWindowUs >= 1000000) {
+        if (m_unknownLogsSuppressed > 0) {
+            qDebug() << m_unknownLogsSuppressed << "more unknown CAN IDs not logged";
+        }
+        m_unknownLogWindowUs = nowUs;
+        m_unknownLogsInWindow = 0;
+        m_unknownLogsSuppressed = 0;
+    }
+    if (m_unknownLogsInWindow < UnknownIdLogsPerSecond) {
+        ++m_unknownLogsInWindow;
+        qDebug() << "Unknown CAN frame ID:" << Qt::hex << frameId << Qt::dec << (extended ? "(29-bit)" : "(11-bit)")
+                 << "on bus" << bus;
+    } else {
+        ++m_unknownLogsSuppressed;
+    }
+}
+
+quint64 CanTrafficStats::unknownFrames() const
+{
+    return m_unknownFrames.load(std::memory_order_relaxed);
+}
+
+CanTrafficStats::Snapshot CanTrafficStats::snapshot()
+{
+    Snapshot snapshot;
+    snapshot.timestampUs = canMonotonicMicros();
+    const double elapsedS = m_previousSnapshotUs > 0 ? (snapshot.timestampUs - m_previousSnapshotUs) / 1e6 : 0.0;
+    m_previousSnapshotUs = snapshot.timestampUs;
+
+    snapshot.frames = 0;
+    const int highestBus = m_highestBus.load(std::memory_order_relaxed);
+    snapshot.buses.resize(highestBus + 1);
+    for (int index = 0; index <= highestBus; ++index) {
+        Bus &bus = m_buses[index];
+        const quint64 frames = bus.frames.load(std::memory_order_relaxed);
+        const quint64 busyNs = bus.busyNs.load(std::memory_order_relaxed);
+        BusStatistics &statistics = snapshot.buses[index];
+        statistics.frames = frames;
+        statistics.frameRate = elapsedS > 0 ? (frames - bus.snapshotFrames) / elapsedS : 0.0;
+        statistics.utilization = elapsedS > 0 ? (busyNs - bus.snapshotBusyNs) / (elapsedS * 1e9) : 0.0;
+        bus.snapshotFrames = frames;
+        bus.snapshotBusyNs = busyNs;
+        snapshot.frames += frames;
+    }
+
+    snapshot.ids.reserve(m_usedEntries.load(std::memory_order_relaxed));
+    for (int index = 0; index < Capacity; ++index) {
+        Entry &entry = m_entries[index];
+        const quint64 key = entry.key.load(std::memory_order_acquire);
+        if (key == 0) {
+            continue;
+        }
+
+        IdStatistics statistics;
+        statistics.bus = static_cast<quint8>(key >> 32);
+        statistics.frameId = static_cast<quint32>(key);
+        statistics.flags = entry.flags.load(std::memory_order_relaxed);
+        statistics.unknown = entry.unknown.load(std::memory_order_relaxed);
+        statistics.frames = entry.frames.load(std::memory_order_relaxed);
+        statistics.frameRate = elapsedS > 0 ? (statistics.frames - entry.snapshotFrames) / elapsedS : 0.0;
+        entry.snapshotFrames = statistics.frames;
+        statistics.minGapUs = entry.minGapUs.load(std::memory_order_relaxed);
+        statistics.maxGapUs = entry.maxGapUs.load(std::memory_order_relaxed);
+        statistics.avgGapUs = statistics.frames > 1
+                                  ? entry.gapSumUs.load(std::memory_order_relaxed) / static_cast<qint64>(statistics.frames - 1)
+                                  : 0;
+
+        quint64 words[CanFrame::MaxPayloadSize / 8];
+        int length = 0;
+        for (;;) {
+            const quint32 version = entry.payloadVersion.load(std::memory_order_acquire);
+            if (version & 1) {
+                continue;
+            }
+            length = entry.length.load(std::memory_order_relaxed);
+            for (int word = 0; word * 8 < length; ++word) {
+                words[word] = entry.payload[word].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.payloadVersion.load(std::memory_order_relaxed) == version) {
+                break;
+            }
+        }
+        statistics.lastPayload = QByteArray(reinterpret_cast<const char *>(words), length);
+
+        for (int code = 0; code < DlcCodeCount; ++code) {
+            statistics.dlcHistogram[code] = entry.dlcHistogram[code].load(std::memory_order_relaxed);
+        }
+        snapshot.ids.append(statistics);
+    }
+    std::sort(snapshot.ids.begin(), snapshot.ids.end(), [](const IdStatistics &a, const IdStatistics &b) {
+        if (a.bus != b.bus) {
+            return a.bus < b.bus;
+        }
+        const bool aExtended = a.flags & CanFrame::ExtendedId;
+        const bool bExtended = b.flags & CanFrame::ExtendedId;
+        return aExtended != bExtended ? bExtended : a.frameId < b.frameId;
+    });
+
+    snapshot.unknownFrames = m_unknownFrames.load(std::memory_order_relaxed);
+    snapshot.untrackedFrames = m_untrackedFrames.load(std::memory_order_relaxed);
+    return snapshot;
+}
@@ -0,0 +1,278 @@
+#include "dbcdecoder.h"
+#include <QDebug>
+#include <QFile>
+#include <QRegularExpression>
+
+namespace {
+// BO_ <id> <name>: <length> <transmitter>
+const QRegularExpression messagePattern(
+    QStringLiteral("^BO_\\s+(\\d+)\\s+(\\w+)\\s*:\\s*(\\d+)"));
+// SG_ <name> [M|m<n>] : <start>|<length>@<order><sign> (<factor>,<offset>) [<min>|<max>] "<unit>"
+const QRegularExpression signalPattern(
+    QStringLiteral("^SG_\\s+(\\w+)\\s*(M|m\\d+)?\\s*:\\s*(\\d+)\\|(\\d+)@([01])([+-])\\s*"
+                   "\\(([^,]+),([^)]+)\\)\\s*\\[([^|]+)\\|([^\\]]+)\\]\\s*\"([^\"]*)\""));
+}
+
+DbcDecoder::DbcDecoder()
+    : m_standardIndex(StandardIdCount, -1)
+    , m_sourceChecksum(0)
+{
+}
+
+bool DbcDecoder::loadFile(const QString &path)
+{
+    QFile file(path);
+    // Binary, so sourceChecksum() sees the same bytes as dbc2cpp.
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = QStringLiteral("Cannot open DBC %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    return loadFromData(file.readAll());
+}
+
+bool DbcDecoder::loadFromData(const QByteArray &dbc)
+{
+    clear();
+
+    int currentMessage = -1;
+    int lineNumber = 0;
+    // Only for naming messages in load errors
+    QVector<QString> messageNames;
+    const QList<QByteArray> lines = dbc.split('\n');
+    for (const QByteArray &rawLine : lines) {
+        ++lineNumber;
+        const QString line = QString::fromLatin1(rawLine).trimmed();
+
+        if (line.startsWith(QLatin1String("BO_ "))) {
+            const QRegularExpressionMatch match = messagePattern.match(line);
+            if (!match.hasMatch()) {
+                m_errorString = QStringLiteral("Malformed BO_ at line %1").arg(lineNumber);
+                clear();
+                return false;
+            }
+
+            // An ID too long for 11 bits is extended even without the flag
+            const quint32 dbcId = match.captured(1).toUInt();
+            const quint32 frameId = dbcId & ~ExtendedIdFlag;
+
+            MessageDescriptor message;
+            message.frameId = frameId;
+            message.firstSignal = static_cast<quint16>(m_signals.size());
+            message.signalCount = 0;
+            message.length = static_cast<quint8>(qMin(match.captured(3).toInt(), MaxPayloadSize));
+            message.extended = (dbcId & ExtendedIdFlag) || frameId >= StandardIdCount;
+
+            // Vector's VECTOR__INDEPENDENT_SIG_MSG pseudo-message carries no frame.
+            if (match.captured(2) == QLatin1String("VECTOR__INDEPENDENT_SIG_MSG")) {
+                currentMessage = -1;
+                continue;
+            }
+
+            if (findMessage(frameId, message.extended)) {
+                m_errorString = QStringLiteral("Duplicate message ID %1 at line %2").arg(dbcId).arg(lineNumber);
+                clear();
+                return false;
+            }
+
+            currentMessage = m_messages.size();
+            m_messages.append(message);
+            messageNames.append(match.captured(2));
+            if (message.extended) {
+                m_extendedIndex.insert(frameId, currentMessage);
+            } else {
+                m_standardIndex[static_cast<int>(frameId)] = static_cast<qint16>(currentMessage);
+            }
+            continue;
+        }
+
+        if (line.startsWith(QLatin1String("SG_ "))) {
+            if (currentMessage < 0) {
+                continue;
+            }
+
+            const QRegularExpressionMatch match = signalPattern.match(line);
+            if (!match.hasMatch()) {
+                m_errorString = QStringLiteral("Malformed SG_ at line %1").arg(lineNumber);
+                clear();
+                return false;
+            }
+
+            const QString name = match.captured(1);
+            const QString multiplex = match.captured(2);
+            if (multiplex.startsWith(QLatin1Char('m'))) {
+                qWarning() << "DBC: skipping multiplexed signal" << name;
+                continue;
+            }
+
+            SignalDescriptor signal;
+            std::memset(&signal, 0, sizeof(signal));
+            const int startBit = match.captured(3).toInt();
+            const int length = match.captured(4).toInt();
+            const bool bigEndian = match.captured(5) == QLatin1String("0");
+            if (!resolveLayout(signal, startBit, length, bigEndian)) {
+                qWarning() << "DBC: unsupported layout for signal" << name
+                           << "start" << startBit << "length" << length;
+                continue;
+            }
+
+            if (match.captured(6) == QLatin1String("-")) {
+                signal.flags |= Signed;
+            }
+            signal.factor = match.captured(7).trimmed().toDouble();
+            signal.offset = match.captured(8).trimmed().toDouble();
+            signal.minimum = match.captured(9).trimmed().toDouble();
+            signal.maximum = match.captured(10).trimmed().toDouble();
+            // A [0|0] range means "unspecified" in DBC files.
+            if (signal.maximum > signal.minimum) {
+                signal.flags |= Clamped;
+            }
+
+            // Signals of one message must stay contiguous in the packed array.
+            MessageDescriptor &message = m_messages[currentMessage];
+            if (message.firstSignal + message.signalCount != m_signals.size()) {
+                m_errorString = QStringLiteral("SG_ outside its BO_ block at line %1").arg(lineNumber);
+                clear();
+                return false;
+            }
+
+            // Signals are looked up by name alone, so a second one would
+            // silently take the first one's bindings
+            const auto existing = m_signalByName.constFind(name);
+            if (existing != m_signalByName.constEnd()) {
+                int owner = 0;
+                while (m_messages.at(owner).firstSignal + m_messages.at(owner).signalCount <= existing.value()) {
+                    ++owner;
+                }
+                m_errorString = QStringLiteral("Duplicate signal name %1 in %2 at line %3, already in %4")
+                                    .arg(name, messageNames.at(currentMessage))
+                                    .arg(lineNumber)
+                                    .arg(messageNames.at(owner));
+                clear();
+                return false;
+            }
+
+            m_signalByName.insert(name, m_signals.size());
+            m_signals.append(signal);
+            m_signalNames.append(name);
+            m_signalUnits.append(match.captured(11));
+            ++message.signalCount;
+            continue;
+        }
+
+        // Any other top-level keyword ends the current message block.
+        if (!line.isEmpty() && !line.startsWith(QLatin1String("SG_"))) {
+            currentMessage = -1;
+        }
+    }
+
+    if (m_messages.isEmpty()) {
+        m_errorString = QStringLiteral("DBC contains no messages");
+        return false;
+    }
+
+    m_signals.squeeze();
+    m_messages.squeeze();
+    m_sourceChecksum = checksum(dbc);
+    m_errorString.clear();
+    qDebug() << "DBC loaded:" << m_messages.size() << "messages," << m_signals.size() << "signals";
+    return true;
+}
+
+QString DbcDecoder::errorString() const
+{
+    return m_errorString;
+}
+
+quint32 DbcDecoder::sourceChecksum() const
+{
+    return m_sourceChecksum;
+}
+
+quint32 DbcDecoder::checksum(const QByteArray &data)
+{
+    quint32 hash = 2166136261u;
+    for (const char c : data) {
+        hash ^= static_cast<quint8>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int DbcDecoder::messageCount() const
+{
+    return m_messages.size();
+}
+
+int DbcDecoder::signalCount() const
+{
+    return m_signals.size();
+}
+
+int DbcDecoder::signalIndex(const QString &name) const
+{
+    return m_signalByName.value(name, -1);
+}
+
+QString DbcDecoder::signalName(int index) const
+{
+    return m_signalNames.value(index);
+}
+
+QString DbcDecoder::signalUnit(int index) const
+{
+    return m_signalUnits.value(index);
+}
+
+const DbcDecoder::SignalDescriptor &DbcDecoder::signalDescriptor(int index) const
+{
+    return m_signals.at(index);
+}
+
+bool DbcDecoder::resolveLayout(SignalDescriptor &signal, int startBit, int length, bool bigEndian)
+{
+    if (length < 1 || length > 64 || startBit < 0 || startBit >= MaxPayloadSize * 8) {
+        return false;
+    }
+
+    signal.startBit = static_cast<quint16>(startBit);
+    signal.length = static_cast<quint8>(length);
+
+    if (!bigEndian) {
+        // Intel: start bit is the LSB; the window is loaded little-endian
+        // from the byte holding it.
+        const int lastBit = startBit + length - 1;
+        if (lastBit >= MaxPayloadSize * 8 || (startBit % 8) + length > 64) {
+            return false;
+        }
+        signal.byteOffset = static_cast<quint8>(startBit / 8);
+        signal.shift = static_cast<quint8>(startBit % 8);
+        signal.requiredBytes = static_cast<quint8>(lastBit / 8 + 1);
+        return true;
+    }
+
+    // Motorola: start bit is the MSB in DBC "sawtooth" numbering. Convert to
+    // a linear MSB-first position, then express the LSB as a shift into a
+    // byte-swapped 64-bit window.
+    const int msbLinear = (startBit / 8) * 8 + (7 - startBit % 8);
+    const int lsbLinear = msbLinear + length - 1;
+    if (lsbLinear >= MaxPayloadSize * 8 || (msbLinear % 8) + length > 64) {
+        return false;
+    }
+    signal.flags |= BigEndian;
+    signal.byteOffset = static_cast<quint8>(msbLinear / 8);
+    signal.shift = static_cast<quint8>(63 - (lsbLinear - signal.byteOffset * 8));
+    signal.requiredBytes = static_cast<quint8>(lsbLinear / 8 + 1);
+    return true;
+}
+
+void DbcDecoder::clear()
+{
+    m_messages.clear();
+    m_signals.clear();
+    m_signalNames.clear();
+    m_signalUnits.clear();
+    m_signalByName.clear();
+    m_standardIndex.fill(-1);
+    m_extendedIndex.clear();
+    m_sourceChecksum = 0;
+}
@@ -0,0 +1,741 @@
+#include "diagnosticclient.h"
+#include "obdpid.h"
+#include "tracerecorder.h"
+#include <QDebug>
+#include <QFile>
+#include <QList>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr quint8 NegativeResponse = 0x7F;
+constexpr quint8 PositiveResponseOffset = 0x40;
+constexpr quint8 BusyRepeatRequest = 0x21;
+constexpr quint8 ResponsePending = 0x78;
+
+quint32 parseNumber(const QByteArray &text, bool *ok)
+{
+    return text.toUInt(ok, 0);  // decimal or 0x hex
+}
+
+// "100ms", "2s" or "1.5s" in milliseconds, 0 if malformed
+int parseDuration(const QByteArray &text)
+{
+    bool ok = false;
+    double ms = 0;
+    if (text.endsWith("ms")) {
+        ms = text.left(text.size() - 2).toDouble(&ok);
+    } else if (text.endsWith('s')) {
+        ms = text.left(text.size() - 1).toDouble(&ok) * 1000.0;
+    }
+    return ok && ms >= 1.0 && ms <= 86400000.0 ? static_cast<int>(ms) : 0;
+}
+}
+
+DiagnosticClient::DiagnosticClient(QObject *parent)
+    : QObject(parent)
+    , m_minResponseId(0xFFFFFFFFu)
+    , m_maxResponseId(0)
+    , m_running(false)
+    , m_serviceTimer(new QTimer(this))
+    , m_firstEcu(0)
+    , m_valuesUpdated(false)
+    , m_maxFrameRate(DefaultMaxFrameRate)
+    , m_tokens(0.0)
+    , m_tokensUpdatedUs(0)
+    , m_maxBusLoad(DefaultMaxBusLoad)
+    , m_busLoad(0.0)
+    , m_requests(0)
+    , m_responses(0)
+    , m_timeouts(0)
+    , m_negativeResponses(0)
+    , m_transportErrors(0)
+    , m_framesSent(0)
+    , m_valuesReceived(0)
+    , m_rateWindowStartUs(0)
+    , m_rateWindowValues(0)
+    , m_valuesPerSecond(0.0)
+{
+    m_serviceTimer->setSingleShot(true);
+    m_serviceTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_serviceTimer, &QTimer::timeout, this, &DiagnosticClient::service);
+}
+
+bool DiagnosticClient::loadFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = QStringLiteral("Cannot open diagnostics %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    return loadFromData(file.readAll());
+}
+
+bool DiagnosticClient::loadFromData(const QByteArray &config)
+{
+    const QVector<Ecu> previousEcus = m_ecus;
+    const QVector<Item> previousItems = m_items;
+    const quint32 previousMinResponseId = m_minResponseId;
+    const quint32 previousMaxResponseId = m_maxResponseId;
+    const double previousMaxFrameRate = m_maxFrameRate;
+    const double previousMaxBusLoad = m_maxBusLoad;
+    const bool wasRunning = m_running;
+    stop();
+    clear();
+
+    QString error;
+    int lineNumber = 0;
+    const QList<QByteArray> lines = config.split('\n');
+    for (const QByteArray &rawLine : lines) {
+        ++lineNumber;
+        const QByteArray line = rawLine.simplified();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        const QList<QByteArray> tokens = line.split(' ');
+        const QByteArray &keyword = tokens.at(0);
+        bool ok = true;
+
+        if (keyword == "ecu" || keyword == "pid" || keyword == "did") {
+            const int fixed = keyword == "ecu" ? 4 : keyword == "pid" ? 3 : 4;
+            if (tokens.size() < fixed || (tokens.size() - fixed) % 2 != 0) {
+                error = QStringLiteral("expected %1 arguments and option/value pairs").arg(fixed - 1);
+                break;
+            }
+
+            int bus = 0;
+            int timeoutMs = DefaultTimeoutMs;
+            int didsPerRequest = DefaultDidsPerRequest;
+            bool extended = false;
+            int periodMs = 0;
+            double scale = 1.0;
+            double offset = 0.0;
+            QString name;
+            for (int i = fixed; i + 1 < tokens.size() && ok; i += 2) {
+                const QByteArray &option = tokens.at(i);
+                const QByteArray &value = tokens.at(i + 1);
+                if (option == "bus") {
+                    bus = value.toInt(&ok);
+                } else if (option == "timeout") {
+                    timeoutMs = parseDuration(value);
+                    ok = timeoutMs > 0;
+                } else if (option == "dids") {
+                    didsPerRequest = value.toInt(&ok);
+                } else if (option == "ids") {
+                    extended = value == "29";
+                    ok = extended || value == "11";
+                } else if (option == "every") {
+                    periodMs = parseDuration(value);
+                    ok = periodMs > 0;
+                } else if (option == "scale") {
+                    scale = value.toDouble(&ok);
+                } else if (option == "offset") {
+                    offset = value.toDouble(&ok);
+                } else if (option == "as") {
+                    name = QString::fromUtf8(value);
+                } else {
+                    ok = false;
+                }
+                if (!ok) {
+                    error = QStringLiteral("bad option \"%1 %2\"").arg(QString::fromUtf8(option), QString::fromUtf8(value));
+                }
+            }
+            if (!ok) {
+                break;
+            }
+
+            if (keyword == "ecu") {
+                bool requestOk = false;
+                bool responseOk = false;
+                const quint32 requestId = parseNumber(tokens.at(2), &requestOk);
+                const quint32 responseId = parseNumber(tokens.at(3), &responseOk);
+                if (!requestOk || !responseOk
+                    || addEcu(QString::fromUtf8(tokens.at(1)), requestId, responseId, bus, timeoutMs, didsPerRequest,
+                              extended) < 0) {
+                    error = QStringLiteral("invalid ECU");
+                    break;
+                }
+                continue;
+            }
+
+            int ecu = -1;
+            for (int index = 0; index < m_ecus.size(); ++index) {
+                if (m_ecus.at(index).name == QString::fromUtf8(tokens.at(1))) {
+                    ecu = index;
+                }
+            }
+            if (ecu < 0) {
+                error = QStringLiteral("unknown ECU \"%1\"").arg(QString::fromUtf8(tokens.at(1)));
+                break;
+            }
+            if (periodMs == 0) {
+                error = QStringLiteral("missing \"every\"");
+                break;
+            }
+            const quint32 id = parseNumber(tokens.at(2), &ok);
+            if (keyword == "pid") {
+                ok = ok && id <= 0xFF && addPid(ecu, static_cast<quint8>(id), periodMs, name) >= 0;
+            } else {
+                bool lengthOk = false;
+                const int length = tokens.at(3).toInt(&lengthOk);
+                ok = ok && lengthOk && id <= 0xFFFF
+                     && addDid(ecu, static_cast<quint16>(id), length, periodMs, name, scale, offset) >= 0;
+            }
+            if (!ok) {
+                error = QStringLiteral("invalid %1").arg(QString::fromUtf8(keyword).toUpper());
+                break;
+            }
+        } else if (keyword == "rate" && tokens.size() == 2) {
+            const double rate = tokens.at(1).toDouble(&ok);
+            if (!ok || rate <= 0) {
+                error = QStringLiteral("invalid rate");
+                break;
+            }
+            setMaxFrameRate(rate);
+        } else if (keyword == "busload" && tokens.size() == 2) {
+            const double load = tokens.at(1).toDouble(&ok);
+            if (!ok || load <= 0 || load > 1) {
+                error = QStringLiteral("invalid bus load");
+                break;
+            }
+            setMaxBusLoad(load);
+        } else {
+            error = QStringLiteral("unknown entry \"%1\"").arg(QString::fromUtf8(keyword));
+            break;
+        }
+    }
+
+    if (!error.isEmpty()) {
+        m_errorString = QStringLiteral("Diagnostics line %1: %2").arg(lineNumber).arg(error);
+        m_ecus = previousEcus;
+        m_items = previousItems;
+        m_minResponseId = previousMinResponseId;
+        m_maxResponseId = previousMaxResponseId;
+        m_maxFrameRate = previousMaxFrameRate;
+        m_maxBusLoad = previousMaxBusLoad;
+    } else {
+        m_errorString.clear();
+    }
+    if (wasRunning) {
+        start();
+    }
+    return error.isEmpty();
+}
+
+QString DiagnosticClient::errorString() const
+{
+    return m_errorString;
+}
+
+int DiagnosticClient::addEcu(const QString &name, quint32 requestId, quint32 responseId, int bus, int timeoutMs,
+                             int didsPerRequest, bool extended)
+{
+    if (requestId > 0x1FFFFFFFu || responseId > 0x1FFFFFFFu || bus < 0 || bus > 0xFF || timeoutMs <= 0
+        || didsPerRequest < 1) {
+        return -1;
+    }
+    Ecu ecu;
+    ecu.name = name;
+    ecu.requestId = requestId;
+    ecu.responseId = responseId;
+    ecu.bus = static_cast<quint8>(bus);
+    ecu.extended = extended || requestId > 0x7FFu || responseId > 0x7FFu;
+    ecu.timeoutUs = static_cast<qint64>(timeoutMs) * 1000;
+    ecu.didsPerRequest = qMin(didsPerRequest, int(MaxDidsPerRequest));
+    ecu.singleValues = false;
+    ecu.service = 0;
+    ecu.deadlineUs = 0;
+    ecu.retryAtUs = 0;
+    m_ecus.append(ecu);
+    m_minResponseId = qMin(m_minResponseId, responseId);
+    m_maxResponseId = qMax(m_maxResponseId, responseId);
+    return m_ecus.size() - 1;
+}
+
+int DiagnosticClient::addPid(int ecu, quint8 pid, int periodMs, const QString &name)
+{
+    const ObdPidScaling *scaling = obdPidScaling(pid);
+    QString itemName = name;
+    if (itemName.isEmpty()) {
+        itemName = scaling ? QString::fromLatin1(scaling->name)
+                           : QStringLiteral("pid%1").arg(pid, 2, 16, QLatin1Char('0'));
+    }
+    return addItem(ecu, CurrentDataService, pid, obdPidLength(pid), periodMs, itemName, 1.0, 0.0);
+}
+
+int DiagnosticClient::addDid(int ecu, quint16 did, int length, int periodMs, const QString &name, double scale,
+                             double offset)
+{
+    const QString itemName = name.isEmpty() ? QStringLiteral("did%1").arg(did, 4, 16, QLatin1Char('0')) : name;
+    return addItem(ecu, ReadDataByIdentifierService, did, length, periodMs, itemName, scale, offset);
+}
+
+int DiagnosticClient::addItem(int ecu, quint8 service, quint16 id, int length, int periodMs, const QString &name,
+                              double scale, double offset)
+{
+    if (ecu < 0 || ecu >= m_ecus.size() || periodMs <= 0 || length < 0 || length > int(IsoTpChannel::MaxMessageSize)) {
+        return -1;
+    }
+    Item item = {};
+    item.name = name;
+    item.ecu = ecu;
+    item.service = service;
+    item.id = id;
+    item.length = length;
+    item.scale = scale;
+    item.offset = offset;
+    item.periodUs = static_cast<qint64>(periodMs) * 1000;
+    item.supported = true;
+    m_items.append(item);
+    return m_items.size() - 1;
+}
+
+void DiagnosticClient::clear()
+{
+    m_ecus.clear();
+    m_items.clear();
+    m_minResponseId = 0xFFFFFFFFu;
+    m_maxResponseId = 0;
+}
+
+void DiagnosticClient::setMaxFrameRate(double framesPerSecond)
+{
+    if (framesPerSecond > 0) {
+        m_maxFrameRate = framesPerSecond;
+    }
+}
+
+void DiagnosticClient::setMaxBusLoad(double load)
+{
+    if (load > 0) {
+        m_maxBusLoad = load;
+    }
+}
+
+bool DiagnosticClient::isRunning() const
+{
+    return m_running;
+}
+
+QVariant DiagnosticClient::value(const QString &name) const
+{
+    for (const Item &item : m_items) {
+        if (item.name == name) {
+            return item.valid ? QVariant(item.value) : QVariant();
+        }
+    }
+    return QVariant();
+}
+
+QVariantList DiagnosticClient::values() const
+{
+    const qint64 nowUs = canMonotonicMicros();
+    QVariantList list;
+    list.reserve(m_items.size());
+    for (const Item &item : m_items) {
+        QVariantMap entry;
+        entry.insert(QStringLiteral("name"), item.name);
+        entry.insert(QStringLiteral("ecu"), m_ecus.at(item.ecu).name);
+        entry.insert(QStringLiteral("value"), item.valid ? QVariant(item.value) : QVariant());
+        entry.insert(QStringLiteral("raw"), QString::fromLatin1(
+                         QByteArray(reinterpret_cast<const char *>(item.raw), item.rawSize).toHex()));
+        entry.insert(QStringLiteral("ageMs"), item.valid ? (nowUs - item.updatedUs) / 1000 : qint64(-1));
+        entry.insert(QStringLiteral("updates"), static_cast<qulonglong>(item.updates));
+        entry.insert(QStringLiteral("supported"), item.supported);
+        list.append(entry);
+    }
+    return list;
+}
+
+QVariantMap DiagnosticClient::statistics() const
+{
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("requests"), static_cast<qulonglong>(m_requests));
+    statistics.insert(QStringLiteral("responses"), static_cast<qulonglong>(m_responses));
+    statistics.insert(QStringLiteral("timeouts"), static_cast<qulonglong>(m_timeouts));
+    statistics.insert(QStringLiteral("negativeResponses"), static_cast<qulonglong>(m_negativeResponses));
+    statistics.insert(QStringLiteral("transportErrors"), static_cast<qulonglong>(m_transportErrors));
+    statistics.insert(QStringLiteral("framesSent"), static_cast<qulonglong>(m_framesSent));
+    statistics.insert(QStringLiteral("valuesReceived"), static_cast<qulonglong>(m_valuesReceived));
+    statistics.insert(QStringLiteral("valuesPerSecond"), m_valuesPerSecond);
+    return statistics;
+}
+
+void DiagnosticClient::start()
+{
+    if (m_running) {
+        return;
+    }
+    const qint64 nowUs = canMonotonicMicros();
+    m_running = true;
+    m_tokens = 1.0;
+    m_tokensUpdatedUs = nowUs;
+    m_rateWindowStartUs = nowUs;
+    m_rateWindowValues = 0;
+    for (Item &item : m_items) {
+        item.dueUs = nowUs;
+    }
+    emit runningChanged(true);
+    service();
+}
+
+void DiagnosticClient::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    m_serviceTimer->stop();
+    for (Ecu &ecu : m_ecus) {
+        ecu.channel.reset();
+        ecu.outstanding.clear();
+    }
+    emit runningChanged(false);
+}
+
+void DiagnosticClient::handleFrames(const QVector<CanFrame> &frames)
+{
+    if (!m_running) {
+        return;
+    }
+    const qint64 nowUs = canMonotonicMicros();
+    bool received = false;
+    for (const CanFrame &frame : frames) {
+        if (frame.frameId < m_minResponseId || frame.frameId > m_maxResponseId
+            || (frame.flags & CanFrame::Transmitted)) {
+            continue;
+        }
+        for (int index = 0; index < m_ecus.size(); ++index) {
+            Ecu &ecu = m_ecus[index];
+            if (ecu.responseId == frame.frameId && ecu.bus == frame.bus
+                && ecu.extended == ((frame.flags & CanFrame::ExtendedId) != 0)) {
+                handleEvent(index, ecu.channel.receive(frame.payload, frame.length, nowUs), nowUs);
+                received = true;
+                break;
+            }
+        }
+    }
+    // Flow control and the next requests go out right away
+    if (received) {
+        service();
+    }
+}
+
+void DiagnosticClient::setBusLoad(double load)
+{
+    const bool wasPaused = m_busLoad > m_maxBusLoad;
+    m_busLoad = load;
+    if (m_running && wasPaused && load <= m_maxBusLoad) {
+        service();
+    }
+}
+
+void DiagnosticClient::service()
+{
+    VEHICLESYS_TRACE_SCOPE("timer", "diagnostics");
+    if (!m_running) {
+        return;
+    }
+    const qint64 nowUs = canMonotonicMicros();
+    refillTokens(nowUs);
+    const bool busFree = m_busLoad <= m_maxBusLoad;
+
+    const int count = m_ecus.size();
+    for (int n = 0; n < count; ++n) {
+        const int index = (m_firstEcu + n) % count;
+        Ecu &ecu = m_ecus[index];
+        for (IsoTpChannel::Event event = ecu.channel.poll(nowUs); event != IsoTpChannel::NoEvent;
+             event = ecu.channel.poll(nowUs)) {
+            handleEvent(index, event, nowUs);
+        }
+        if (!ecu.outstanding.isEmpty() && !ecu.channel.isSending() && !ecu.channel.isReceiving()
+            && nowUs >= ecu.deadlineUs) {
+            ++m_timeouts;
+            finishRequest(ecu);
+            // A silent ECU is asked again after another timeout, not flooded
+            ecu.retryAtUs = nowUs + ecu.timeoutUs;
+        }
+        flush(ecu, nowUs);
+        if (ecu.outstanding.isEmpty() && !ecu.channel.isSending() && busFree && m_tokens >= 1.0
+            && nowUs >= ecu.retryAtUs) {
+            startRequest(index, nowUs);
+            flush(ecu, nowUs);
+        }
+    }
+    if (count > 0) {
+        m_firstEcu = (m_firstEcu + 1) % count;
+    }
+
+    if (nowUs - m_rateWindowStartUs >= 1000000) {
+        m_valuesPerSecond = m_rateWindowValues * 1e6 / static_cast<double>(nowUs - m_rateWindowStartUs);
+        m_rateWindowStartUs = nowUs;
+        m_rateWindowValues = 0;
+    }
+    if (m_valuesUpdated) {
+        m_valuesUpdated = false;
+        emit valuesUpdated();
+    }
+    scheduleService(nowUs);
+}
+
+void DiagnosticClient::handleEvent(int index, IsoTpChannel::Event event, qint64 nowUs)
+{
+    Ecu &ecu = m_ecus[index];
+    switch (event) {
+    case IsoTpChannel::MessageReceived:
+        handleResponse(index, nowUs);
+        break;
+    case IsoTpChannel::TransmitFailed:
+    case IsoTpChannel::ReceiveFailed:
+        ++m_transportErrors;
+        if (!ecu.outstanding.isEmpty()) {
+            finishRequest(ecu);
+            ecu.retryAtUs = nowUs + ecu.timeoutUs;
+        }
+        break;
+    case IsoTpChannel::NoEvent:
+        break;
+    }
+}
+
+void DiagnosticClient::handleResponse(int index, qint64 nowUs)
+{
+    Ecu &ecu = m_ecus[index];
+    const std::vector<quint8> &message = ecu.channel.message();
+    if (ecu.outstanding.isEmpty() || message.empty()) {
+        return;
+    }
+
+    if (message.size() >= 3 && message[0] == NegativeResponse && message[1] == ecu.service) {
+        const quint8 code = message[2];
+        if (code == ResponsePending) {
+            ecu.deadlineUs = nowUs + ResponsePendingTimeoutUs;
+            return;
+        }
+        ++m_negativeResponses;
+        if (code == BusyRepeatRequest) {
+            ecu.retryAtUs = nowUs + BusyRetryUs;
+            for (int item : ecu.outstanding) {
+                m_items[item].dueUs = nowUs;
+            }
+        } else if (ecu.outstanding.size() > 1) {
+            // One of the values is out of range for the ECU, or the request
+            // too long; find out which one by one
+            qWarning() << "ECU" << ecu.name << "rejected a combined request with code" << code
+                       << "- polling its values one at a time";
+            ecu.singleValues = true;
+            for (int item : ecu.outstanding) {
+                m_items[item].dueUs = nowUs;
+            }
+        } else {
+            Item &item = m_items[ecu.outstanding.first()];
+            qWarning() << "ECU" << ecu.name << "does not provide" << item.name << "- code" << code;
+            item.supported = false;
+        }
+        finishRequest(ecu);
+        return;
+    }
+    if (message[0] != ecu.service + PositiveResponseOffset) {
+        return;
+    }
+
+    // Identifier and data of each value, back to back
+    const std::size_t idSize = ecu.service == CurrentDataService ? 1 : 2;
+    quint32 answered = 0;
+    std::size_t position = 1;
+    while (position + idSize <= message.size()) {
+        const quint16 id = idSize == 1 ? message[position] : static_cast<quint16>((message[position] << 8) | message[position + 1]);
+        const int slot = findOutstanding(ecu, id);
+        if (slot < 0) {
+            break;  // no way to tell how long its data is
+        }
+        Item &item = m_items[ecu.outstanding.at(slot)];
+        position += idSize;
+        const std::size_t length = item.length > 0 ? static_cast<std::size_t>(item.length) : message.size() - position;
+        if (position + length > message.size()) {
+            break;
+        }
+        storeValue(item, message.data() + position, static_cast<int>(length), nowUs);
+        answered |= 1u << slot;
+        position += length;
+    }
+
+    for (int slot = 0; slot < ecu.outstanding.size(); ++slot) {
+        Item &item = m_items[ecu.outstanding.at(slot)];
+        if (!(answered & (1u << slot)) && ++item.misses >= MaxMisses) {
+            qWarning() << "ECU" << ecu.name << "never answers for" << item.name << "- no longer polled";
+            item.supported = false;
+        }
+    }
+    ++m_responses;
+    finishRequest(ecu);
+}
+
+void DiagnosticClient::finishRequest(Ecu &ecu)
+{
+    ecu.outstanding.clear();
+}
+
+void DiagnosticClient::startRequest(int index, qint64 nowUs)
+{
+    Ecu &ecu = m_ecus[index];
+
+    // The most overdue value decides the service
+    int lead = -1;
+    for (int i = 0; i < m_items.size(); ++i) {
+        const Item &item = m_items.at(i);
+        if (item.ecu == index && item.supported && item.dueUs <= nowUs
+            && (lead < 0 || item.dueUs < m_items.at(lead).dueUs)) {
+            lead = i;
+        }
+    }
+    if (lead < 0) {
+        return;
+    }
+    const quint8 service = m_items.at(lead).service;
+    int limit = service == CurrentDataService ? int(MaxPidsPerRequest) : ecu.didsPerRequest;
+    if (ecu.singleValues || m_items.at(lead).length == 0) {
+        limit = 1;
+    }
+
+    // Values due by now, then those due within half a period, soonest first
+    m_candidates.clear();
+    m_candidates.append(lead);
+    if (limit > 1) {
+        for (int i = 0; i < m_items.size(); ++i) {
+            const Item &item = m_items.at(i);
+            if (i != lead && item.ecu == index && item.supported && item.service == service && item.length > 0
+                && item.dueUs <= nowUs + item.periodUs / 2) {
+                m_candidates.append(i);
+            }
+        }
+        if (m_candidates.size() > limit) {
+            std::partial_sort(m_candidates.begin() + 1, m_candidates.begin() + limit, m_candidates.end(),
+                              [this](int a, int b) { return m_items.at(a).dueUs < m_items.at(b).dueUs; });
+            m_candidates.resize(limit);
+        }
+    }
+
+    quint8 request[1 + 2 * MaxDidsPerRequest];
+    int size = 0;
+    request[size++] = service;
+    ecu.outstanding.clear();
+    for (int i : m_candidates) {
+        Item &item = m_items[i];
+        if (service == CurrentDataService) {
+            request[size++] = static_cast<quint8>(item.id);
+        } else {
+            request[size++] = static_cast<quint8>(item.id >> 8);
+            request[size++] = static_cast<quint8>(item.id & 0xFF);
+        }
+        // Keeps the phase unless polling has fallen behind
+        item.dueUs = qMax(item.dueUs + item.periodUs, nowUs);
+        ecu.outstanding.append(i);
+    }
+    if (!ecu.channel.send(request, static_cast<std::size_t>(size))) {
+        ecu.outstanding.clear();
+        return;
+    }
+    ecu.service = service;
+    ecu.deadlineUs = nowUs + ecu.timeoutUs;
+    ++m_requests;
+}
+
+// Sends what the channel has due, within the frame budget
+void DiagnosticClient::flush(Ecu &ecu, qint64 nowUs)
+{
+    quint8 frame[IsoTpChannel::FrameLength];
+    while (ecu.channel.nextDeadlineUs() <= nowUs) {
+        // The ECU is waiting on flow control, so it goes out regardless
+        if (m_tokens < 1.0 && !ecu.channel.flowControlPending()) {
+            break;
+        }
+        if (!ecu.channel.nextFrame(nowUs, frame)) {
+            break;
+        }
+        m_tokens -= 1.0;
+        ++m_framesSent;
+        // P2 runs from the last frame of the request
+        ecu.deadlineUs = nowUs + ecu.timeoutUs;
+        emit transmit(ecu.requestId, QByteArray(reinterpret_cast<const char *>(frame), IsoTpChannel::FrameLength),
+                      ecu.bus, ecu.extended);
+    }
+}
+
+void DiagnosticClient::refillTokens(qint64 nowUs)
+{
+    // A burst of at most 50 ms worth of frames
+    const double burst = qMax(1.0, m_maxFrameRate * 0.05);
+    m_tokens = qMin(burst, m_tokens + static_cast<double>(nowUs - m_tokensUpdatedUs) * m_maxFrameRate / 1e6);
+    m_tokensUpdatedUs = nowUs;
+}
+
+void DiagnosticClient::scheduleService(qint64 nowUs)
+{
+    const bool busFree = m_busLoad <= m_maxBusLoad;
+    qint64 wakeUs = IsoTpChannel::NoDeadline;
+    for (int index = 0; index < m_ecus.size(); ++index) {
+        const Ecu &ecu = m_ecus.at(index);
+        wakeUs = qMin<qint64>(wakeUs, ecu.channel.nextDeadlineUs());
+        if (!ecu.outstanding.isEmpty()) {
+            if (!ecu.channel.isSending() && !ecu.channel.isReceiving()) {
+                wakeUs = qMin<qint64>(wakeUs, ecu.deadlineUs);
+            }
+            continue;
+        }
+        if (!busFree) {
+            continue;   // setBusLoad() resumes
+        }
+        qint64 dueUs = IsoTpChannel::NoDeadline;
+        for (const Item &item : m_items) {
+            if (item.ecu == index && item.supported) {
+                dueUs = qMin(dueUs, item.dueUs);
+            }
+        }
+        if (dueUs != IsoTpChannel::NoDeadline) {
+            wakeUs = qMin<qint64>(wakeUs, qMax<qint64>(dueUs, ecu.retryAtUs));
+        }
+    }
+    if (wakeUs == IsoTpChannel::NoDeadline) {
+        m_serviceTimer->stop();
+        return;
+    }
+    // Whatever is due needs a frame from the budget
+    if (m_tokens < 1.0) {
+        wakeUs = qMax(wakeUs, nowUs + static_cast<qint64>((1.0 - m_tokens) * 1e6 / m_maxFrameRate));
+    }
+    m_serviceTimer->start(static_cast<int>(qMax<qint64>(0, (wakeUs - nowUs + 999) / 1000)));
+}
+
+int DiagnosticClient::findOutstanding(const Ecu &ecu, quint16 id) const
+{
+    for (int slot = 0; slot < ecu.outstanding.size(); ++slot) {
+        if (m_items.at(ecu.outstanding.at(slot)).id == id) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void DiagnosticClient::storeValue(Item &item, const quint8 *data, int size, qint64 nowUs)
+{
+    item.rawSize = qMin(size, int(MaxRawSize));
+    std::memcpy(item.raw, data, static_cast<std::size_t>(item.rawSize));
+    if (item.service == CurrentDataService) {
+        item.value = obdPidValue(static_cast<quint8>(item.id), data, size);
+    } else {
+        quint64 raw = 0;
+        for (int i = 0; i < size && i < 8; ++i) {
+            raw = (raw << 8) | data[i];
+        }
+        item.value = static_cast<double>(raw) * item.scale + item.offset;
+    }
+    item.valid = true;
+    item.updatedUs = nowUs;
+    ++item.updates;
+    item.misses = 0;
+    ++m_valuesReceived;
+    ++m_rateWindowValues;
+    m_valuesUpdated = true;
+}
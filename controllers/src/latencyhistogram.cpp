@@ -0,0 +1,101 @@
+#include "latencyhistogram.h"
+#include <QVariantList>
+#include <QtAlgorithms>
+
+#include <limits>
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+int LatencyHistogram::bucketIndex(qint64 latencyUs)
+{
+    if (latencyUs < 16) {
+        return latencyUs < 0 ? 0 : static_cast<int>(latencyUs);
+    }
+    const int magnitude = 63 - static_cast<int>(qCountLeadingZeroBits(static_cast<quint64>(latencyUs)));
+    if (magnitude > MaxMagnitude) {
+        return BucketCount - 1;
+    }
+    return 16 + (magnitude - 4) * 8 + static_cast<int>((latencyUs >> (magnitude - 3)) & 7);
+}
+
+qint64 LatencyHistogram::bucketUpperUs(int index)
+{
+    if (index < 16) {
+        return index;
+    }
+    const int magnitude = 4 + (index - 16) / 8;
+    const int step = (index - 16) % 8;
+    return (qint64(8 + step + 1) << (magnitude - 3)) - 1;
+}
+
+void LatencyHistogram::record(qint64 latencyUs)
+{
+    latencyUs = qMax<qint64>(0, latencyUs);
+    ++m_buckets[bucketIndex(latencyUs)];
+    ++m_count;
+    m_sumUs += latencyUs;
+    m_minUs = qMin(m_minUs, latencyUs);
+    m_maxUs = qMax(m_maxUs, latencyUs);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_sumUs += other.m_sumUs;
+    m_minUs = qMin(m_minUs, other.m_minUs);
+    m_maxUs = qMax(m_maxUs, other.m_maxUs);
+}
+
+void LatencyHistogram::clear()
+{
+    m_buckets.fill(0);
+    m_count = 0;
+    m_minUs = std::numeric_limits<qint64>::max();
+    m_maxUs = 0;
+    m_sumUs = 0;
+}
+
+qint64 LatencyHistogram::percentileUs(double fraction) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(fraction * static_cast<double>(m_count) + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            // The last bucket is open-ended
+            return i == BucketCount - 1 ? m_maxUs : qMin(bucketUpperUs(i), m_maxUs);
+        }
+    }
+    return m_maxUs;
+}
+
+QVariantMap LatencyHistogram::toVariantMap(bool buckets) const
+{
+    QVariantMap map;
+    map.insert(QStringLiteral("count"), static_cast<qulonglong>(m_count));
+    map.insert(QStringLiteral("minUs"), minUs());
+    map.insert(QStringLiteral("meanUs"), meanUs());
+    map.insert(QStringLiteral("p50Us"), percentileUs(0.5));
+    map.insert(QStringLiteral("p90Us"), percentileUs(0.9));
+    map.insert(QStringLiteral("p99Us"), percentileUs(0.99));
+    map.insert(QStringLiteral("maxUs"), m_maxUs);
+    if (buckets) {
+        QVariantList list;
+        for (int i = 0; i < BucketCount; ++i) {
+            if (m_buckets[i]) {
+                list.append(QVariant(QVariantList() << bucketUpperUs(i) << static_cast<qulonglong>(m_buckets[i])));
+            }
+        }
+        map.insert(QStringLiteral("buckets"), list);
+    }
+    return map;
+}
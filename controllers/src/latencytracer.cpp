@@ -0,0 +1,138 @@
+#include "latencytracer.h"
+#include "canframe.h"
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QQuickWindow>
+#include <QSaveFile>
+#include <QVariantList>
+#include <QtAlgorithms>
+
+LatencyTracer::LatencyTracer(QObject *parent)
+    : QObject(parent)
+    , m_boundMask(0)
+    , m_syncedMask(0)
+    , m_frames(0)
+{
+}
+
+void LatencyTracer::setWindow(QQuickWindow *window)
+{
+    disconnect(m_syncConnection);
+    disconnect(m_swapConnection);
+    m_window = window;
+    if (window) {
+        m_syncConnection = connect(window, &QQuickWindow::beforeSynchronizing, this,
+                                   &LatencyTracer::recordSynced, Qt::DirectConnection);
+        m_swapConnection = connect(window, &QQuickWindow::frameSwapped, this,
+                                   &LatencyTracer::recordSwapped, Qt::DirectConnection);
+    }
+}
+
+void LatencyTracer::recordBound(VehicleSignalStore::SignalId id, qint64 receivedUs, qint64 decodedUs, qint64 sentUs,
+                                qint64 boundUs)
+{
+    const Stamps stamps = {receivedUs, decodedUs, sentUs, boundUs};
+    QMutexLocker locker(&m_mutex);
+    if (!m_window) {
+        record(id, stamps, boundUs);
+        return;
+    }
+    m_bound[id] = stamps;
+    m_boundMask |= VehicleSignalStore::signalBit(id);
+}
+
+// Render thread, while the GUI thread is blocked.
+void LatencyTracer::recordSynced()
+{
+    QMutexLocker locker(&m_mutex);
+    for (VehicleSignalStore::SignalMask mask = m_boundMask; mask; mask &= mask - 1) {
+        const int id = qCountTrailingZeroBits(mask);
+        m_synced[id] = m_bound[id];
+    }
+    m_syncedMask |= m_boundMask;
+    m_boundMask = 0;
+}
+
+// Render thread.
+void LatencyTracer::recordSwapped()
+{
+    const qint64 swappedUs = canMonotonicMicros();
+    QMutexLocker locker(&m_mutex);
+    if (!m_syncedMask) {
+        return;
+    }
+    ++m_frames;
+    for (VehicleSignalStore::SignalMask mask = m_syncedMask; mask; mask &= mask - 1) {
+        const VehicleSignalStore::SignalId id = static_cast<VehicleSignalStore::SignalId>(qCountTrailingZeroBits(mask));
+        record(id, m_synced[id], swappedUs);
+    }
+    m_syncedMask = 0;
+}
+
+void LatencyTracer::record(VehicleSignalStore::SignalId id, const Stamps &stamps, qint64 presentedUs)
+{
+    m_ingest.record(stamps.decodedUs - stamps.receivedUs);
+    m_notify.record(stamps.sentUs - stamps.decodedUs);
+    m_deliver.record(stamps.boundUs - stamps.sentUs);
+    m_present.record(presentedUs - stamps.boundUs);
+    m_total.record(presentedUs - stamps.receivedUs);
+    m_signals[id].record(presentedUs - stamps.receivedUs);
+}
+
+QVariantMap LatencyTracer::statistics(bool buckets) const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap stages;
+    stages.insert(QStringLiteral("ingest"), m_ingest.toVariantMap(buckets));
+    stages.insert(QStringLiteral("notify"), m_notify.toVariantMap(buckets));
+    stages.insert(QStringLiteral("deliver"), m_deliver.toVariantMap(buckets));
+    stages.insert(QStringLiteral("present"), m_present.toVariantMap(buckets));
+    stages.insert(QStringLiteral("total"), m_total.toVariantMap(buckets));
+
+    QVariantList perSignal;
+    for (int id = 0; id < VehicleSignalStore::SignalCount; ++id) {
+        if (m_signals[id].count() == 0) {
+            continue;
+        }
+        QVariantMap entry = m_signals[id].toVariantMap(buckets);
+        entry.insert(QStringLiteral("name"),
+                     QString::fromLatin1(VehicleSignalStore::signalName(static_cast<VehicleSignalStore::SignalId>(id))));
+        perSignal.append(entry);
+    }
+
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("frames"), static_cast<qulonglong>(m_frames));
+    statistics.insert(QStringLiteral("stages"), stages);
+    statistics.insert(QStringLiteral("signals"), perSignal);
+    return statistics;
+}
+
+bool LatencyTracer::dump(const QString &path, QString *error) const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(QJsonDocument::fromVariant(statistics(true)).toJson()) < 0
+        || !file.commit()) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+void LatencyTracer::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_boundMask = 0;
+    m_syncedMask = 0;
+    m_frames = 0;
+    m_ingest.clear();
+    m_notify.clear();
+    m_deliver.clear();
+    m_present.clear();
+    m_total.clear();
+    for (LatencyHistogram &histogram : m_signals) {
+        histogram.clear();
+    }
+}
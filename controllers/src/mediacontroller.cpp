@@ -1,4 +1,5 @@
 #include "mediacontroller.h"
+#include "tracerecorder.h"
 #include <QFileInfo>
 #include <QStandardPaths>
 #include <QCoreApplication>
@@ -227,6 +228,7 @@ void MediaController::previous()
 // Playlist management
 void MediaController::loadMusicDirectory(const QString &path)
 {
+    VEHICLESYS_TRACE_SCOPE("media", "loadMusicDirectory");
     QString musicPath = path.isEmpty() ? "music" : path;
     
     // Try relative path first
@@ -477,6 +479,7 @@ void MediaController::handleError(QMediaPlayer::Error error)
 
 void MediaController::updateCurrentTime()
 {
+    VEHICLESYS_TRACE_SCOPE("timer", "mediaTime");
 #ifdef HAVE_QT_MULTIMEDIA
     // This ensures regular updates even if positionChanged isn't emitted frequently
     qint64 position = m_player->position();
@@ -491,6 +494,7 @@ void MediaController::updateCurrentTime()
 
 void MediaController::simulatePlayback()
 {
+    VEHICLESYS_TRACE_SCOPE("timer", "simulatePlayback");
     if (m_isPlaying && m_currentTime < m_totalTime) {
         m_currentTime += 1000; // Increment by 1 second (1000ms)
         emit currentTimeChanged(m_currentTime);
@@ -526,6 +530,7 @@ void MediaController::loadCurrentTrack()
 // Private helper methods
 void MediaController::extractMetadata(const QString &filePath)
 {
+    VEHICLESYS_TRACE_SCOPE("media", "extractMetadata");
     m_currentTitle = getFileTitle(filePath);
     m_currentArtist = getFileArtist(filePath);
     
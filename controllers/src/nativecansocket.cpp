@@ -0,0 +1,295 @@
+#include "nativecansocket.h"
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+#ifdef Q_OS_LINUX
+struct NativeCanSocket::BatchBuffers
+{
+    // Large enough for SCM_TIMESTAMPING plus the SO_RXQ_OVFL counter.
+    static constexpr std::size_t ControlSize = CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(quint32));
+
+    canfd_frame frames[MaxBatchSize];
+    iovec vectors[MaxBatchSize];
+    mmsghdr headers[MaxBatchSize];
+    alignas(cmsghdr) unsigned char control[MaxBatchSize][ControlSize];
+};
+
+namespace {
+qint64 timespecToMicros(const timespec &ts)
+{
+    return static_cast<qint64>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Kernel software timestamps are CLOCK_REALTIME; frames elsewhere in the
+// pipeline are stamped on the monotonic clock. Sample the offset once per
+// batch so both domains line up without a per-frame syscall.
+qint64 realtimeToMonotonicOffsetUs()
+{
+    timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    return canMonotonicMicros() - timespecToMicros(realtime);
+}
+}
+#else
+struct NativeCanSocket::BatchBuffers
+{
+};
+#endif
+
+NativeCanSocket::NativeCanSocket()
+    : m_fd(-1)
+    , m_kernelDropped(0)
+    , m_errorFrames(0)
+{
+}
+
+NativeCanSocket::~NativeCanSocket()
+{
+    close();
+}
+
+bool NativeCanSocket::open(const QString &interface)
+{
+    close();
+
+#ifdef Q_OS_LINUX
+    m_fd = ::socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+    if (m_fd < 0) {
+        setError(QStringLiteral("socket(PF_CAN)"));
+        return false;
+    }
+
+    const QByteArray name = interface.toLatin1();
+    ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, name.constData(), IFNAMSIZ - 1);
+    if (::ioctl(m_fd, SIOCGIFINDEX, &ifr) < 0) {
+        setError(QStringLiteral("SIOCGIFINDEX %1").arg(interface));
+        close();
+        return false;
+    }
+
+    // Accept CAN FD frames as well; classic frames still arrive as can_frame.
+    const int enable = 1;
+    ::setsockopt(m_fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable));
+
+    const int timestamping = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (::setsockopt(m_fd, SOL_SOCKET, SO_TIMESTAMPING, &timestamping, sizeof(timestamping)) < 0) {
+        setError(QStringLiteral("SO_TIMESTAMPING"));
+        close();
+        return false;
+    }
+
+    // Error frames are only delivered when asked for; they are counted, not
+    // queued for decoding.
+    const can_err_mask_t errorMask = CAN_ERR_MASK;
+    ::setsockopt(m_fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errorMask, sizeof(errorMask));
+
+    // Have the kernel report how many frames it dropped on a full socket queue.
+    ::setsockopt(m_fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+    sockaddr_can address;
+    std::memset(&address, 0, sizeof(address));
+    address.can_family = AF_CAN;
+    address.can_ifindex = ifr.ifr_ifindex;
+    if (::bind(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        setError(QStringLiteral("bind %1").arg(interface));
+        close();
+        return false;
+    }
+
+    m_kernelDropped = 0;
+    m_errorFrames = 0;
+    m_buffers.reset(new BatchBuffers);
+    for (int i = 0; i < MaxBatchSize; ++i) {
+        m_buffers->vectors[i].iov_base = &m_buffers->frames[i];
+        m_buffers->vectors[i].iov_len = sizeof(canfd_frame);
+    }
+
+    m_errorString.clear();
+    return true;
+#else
+    Q_UNUSED(interface)
+    m_errorString = QStringLiteral("Native SocketCAN is only available on Linux");
+    return false;
+#endif
+}
+
+void NativeCanSocket::close()
+{
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+    m_fd = -1;
+}
+
+bool NativeCanSocket::isOpen() const
+{
+    return m_fd >= 0;
+}
+
+int NativeCanSocket::socketDescriptor() const
+{
+    return m_fd;
+}
+
+QString NativeCanSocket::errorString() const
+{
+    return m_errorString;
+}
+
+quint32 NativeCanSocket::kernelDroppedFrames() const
+{
+    return m_kernelDropped;
+}
+
+quint64 NativeCanSocket::errorFrames() const
+{
+    return m_errorFrames;
+}
+
+int NativeCanSocket::readBatch(CanFrame *out, int maxFrames)
+{
+#ifdef Q_OS_LINUX
+    if (m_fd < 0) {
+        return -1;
+    }
+
+    const int batchSize = qMin(maxFrames, static_cast<int>(MaxBatchSize));
+    BatchBuffers &buffers = *m_buffers;
+
+    // recvmmsg() overwrites msg_controllen and msg_flags, so the headers are
+    // re-armed on every call.
+    for (int i = 0; i < batchSize; ++i) {
+        msghdr &header = buffers.headers[i].msg_hdr;
+        header.msg_name = nullptr;
+        header.msg_namelen = 0;
+        header.msg_iov = &buffers.vectors[i];
+        header.msg_iovlen = 1;
+        header.msg_control = buffers.control[i];
+        header.msg_controllen = BatchBuffers::ControlSize;
+        header.msg_flags = 0;
+    }
+
+    const int received = ::recvmmsg(m_fd, buffers.headers, batchSize, MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        setError(QStringLiteral("recvmmsg"));
+        return -1;
+    }
+
+    const qint64 offsetUs = realtimeToMonotonicOffsetUs();
+    int count = 0;
+    for (int i = 0; i < received; ++i) {
+        const unsigned int length = buffers.headers[i].msg_len;
+        if (length != CAN_MTU && length != CANFD_MTU) {
+            continue;
+        }
+
+        const canfd_frame &raw = buffers.frames[i];
+        if (raw.can_id & CAN_ERR_FLAG) {
+            ++m_errorFrames;
+            continue;
+        }
+        if (raw.can_id & CAN_RTR_FLAG) {
+            continue;
+        }
+
+        qint64 timestampUs = 0;
+        msghdr &header = buffers.headers[i].msg_hdr;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET) {
+                continue;
+            }
+            if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                quint32 dropped = 0;
+                std::memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                m_kernelDropped = dropped;
+            } else if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                scm_timestamping stamps;
+                std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                // ts[0] is the kernel software receive stamp.
+                if (stamps.ts[0].tv_sec != 0 || stamps.ts[0].tv_nsec != 0) {
+                    timestampUs = timespecToMicros(stamps.ts[0]) + offsetUs;
+                }
+            }
+        }
+
+        const bool extended = raw.can_id & CAN_EFF_FLAG;
+        CanFrame &frame = out[count++];
+        frame = CanFrame::make(extended ? (raw.can_id & CAN_EFF_MASK) : (raw.can_id & CAN_SFF_MASK),
+                               raw.len, timestampUs != 0 ? timestampUs : canMonotonicMicros());
+        std::memcpy(frame.payload, raw.data, frame.length);
+        if (extended) {
+            frame.flags |= CanFrame::ExtendedId;
+        }
+        if (length == CANFD_MTU) {
+            frame.flags |= CanFrame::FlexibleDataRate;
+            if (raw.flags & CANFD_BRS) {
+                frame.flags |= CanFrame::BitrateSwitch;
+            }
+        }
+    }
+    return count;
+#else
+    Q_UNUSED(out)
+    Q_UNUSED(maxFrames)
+    return -1;
+#endif
+}
+
+bool NativeCanSocket::writeFrame(quint32 frameId, const QByteArray &data, bool extended)
+{
+#ifdef Q_OS_LINUX
+    if (m_fd < 0 || data.size() > CANFD_MAX_DLEN || frameId > (extended ? CAN_EFF_MASK : CAN_SFF_MASK)) {
+        return false;
+    }
+
+    canfd_frame raw;
+    std::memset(&raw, 0, sizeof(raw));
+    raw.can_id = extended ? (frameId | CAN_EFF_FLAG) : frameId;
+    raw.len = static_cast<__u8>(data.size());
+    std::memcpy(raw.data, data.constData(), static_cast<std::size_t>(data.size()));
+
+    const std::size_t mtu = data.size() > CAN_MAX_DLEN ? CANFD_MTU : CAN_MTU;
+    if (::write(m_fd, &raw, mtu) != static_cast<ssize_t>(mtu)) {
+        setError(QStringLiteral("write"));
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(frameId)
+    Q_UNUSED(data)
+    Q_UNUSED(extended)
+    return false;
+#endif
+}
+
+void NativeCanSocket::setError(const QString &context)
+{
+#ifdef Q_OS_LINUX
+    m_errorString = context + QStringLiteral(": ") + QString::fromLocal8Bit(std::strerror(errno));
+#else
+    m_errorString = context;
+#endif
+}
@@ -0,0 +1,241 @@
+#include "notificationscheduler.h"
+#include "canframe.h"
+#include "tracerecorder.h"
+
+#include <QQuickWindow>
+#include <QVariantList>
+#include <QtAlgorithms>
+
+#include <cmath>
+#include <limits>
+
+NotificationScheduler::NotificationScheduler(const VehicleSignalStore &store, QObject *parent)
+    : QObject(parent)
+    , m_store(store)
+    , m_flushTimer(new QTimer(this))
+    , m_rateTimer(new QTimer(this))
+    , m_flushRequested(false)
+    , m_pending(0)
+    , m_flushes(0)
+    , m_frameStartUs(0)
+    , m_presentationDelayUs(0)
+{
+    m_deadbands.fill(0.0);
+    m_minIntervalsUs.fill(0);
+    // NaN differs from everything, so each signal's first change is delivered.
+    m_deliveredValues.fill(std::numeric_limits<double>::quiet_NaN());
+    m_deliveredValid.fill(false);
+    m_deliveredUs.fill(0);
+    m_changes.fill(0);
+    m_delivered.fill(0);
+    m_deadbandSuppressed.fill(0);
+
+    // Repeats while changes keep coming; see requestFlush()
+    m_flushTimer->setSingleShot(false);
+    connect(m_flushTimer, &QTimer::timeout, this, &NotificationScheduler::flush);
+    m_rateTimer->setSingleShot(true);
+    m_rateTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_rateTimer, &QTimer::timeout, this, &NotificationScheduler::requestFlush);
+}
+
+void NotificationScheduler::setWindow(QQuickWindow *window)
+{
+    disconnect(m_frameConnection);
+    disconnect(m_swapConnection);
+    m_window = window;
+    m_presentationDelayUs.store(0, std::memory_order_relaxed);
+    // A window's timer only guards against frames that never come
+    m_flushTimer->stop();
+    m_flushTimer->setSingleShot(window != nullptr);
+    if (m_flushRequested) {
+        m_flushRequested = false;
+        requestFlush();
+    }
+    if (window) {
+        // The frame starts on the window's thread, which need not be this
+        // one; flush() may run a little later
+        m_frameConnection = connect(window, &QQuickWindow::afterAnimating, this, [this]() {
+            m_frameStartUs.store(canMonotonicMicros(), std::memory_order_relaxed);
+            QMetaObject::invokeMethod(this, &NotificationScheduler::flush);
+        }, Qt::DirectConnection);
+        m_swapConnection = connect(window, &QQuickWindow::frameSwapped, this,
+                                   &NotificationScheduler::recordFrameSwapped, Qt::DirectConnection);
+    }
+}
+
+qint64 NotificationScheduler::presentationDelayUs() const
+{
+    return m_presentationDelayUs.load(std::memory_order_relaxed);
+}
+
+// Render thread.
+void NotificationScheduler::recordFrameSwapped()
+{
+    const qint64 frameStartUs = m_frameStartUs.load(std::memory_order_relaxed);
+    if (frameStartUs == 0) {
+        return;
+    }
+    const qint64 delayUs = canMonotonicMicros() - frameStartUs;
+    const qint64 averageUs = m_presentationDelayUs.load(std::memory_order_relaxed);
+    // Exponential average over roughly the last 16 frames
+    m_presentationDelayUs.store(averageUs == 0 ? delayUs : averageUs + (delayUs - averageUs) / 16,
+                                std::memory_order_relaxed);
+}
+
+void NotificationScheduler::setDeadband(VehicleSignalStore::SignalId id, double deadband)
+{
+    m_deadbands[id] = qMax(0.0, deadband);
+}
+
+double NotificationScheduler::deadband(VehicleSignalStore::SignalId id) const
+{
+    return m_deadbands[id];
+}
+
+void NotificationScheduler::setMaxRate(VehicleSignalStore::SignalId id, double maxRate)
+{
+    m_minIntervalsUs[id] = maxRate > 0 ? static_cast<qint64>(1e6 / maxRate) : 0;
+}
+
+double NotificationScheduler::maxRate(VehicleSignalStore::SignalId id) const
+{
+    return m_minIntervalsUs[id] > 0 ? 1e6 / static_cast<double>(m_minIntervalsUs[id]) : 0.0;
+}
+
+void NotificationScheduler::markChanged(VehicleSignalStore::SignalId id)
+{
+    ++m_changes[id];
+    m_pending |= VehicleSignalStore::signalBit(id);
+
+    // A signal still inside its rate interval needs no frame until it is due.
+    if (m_minIntervalsUs[id] > 0) {
+        const qint64 waitUs = m_deliveredUs[id] + m_minIntervalsUs[id] - canMonotonicMicros();
+        if (waitUs > 0) {
+            const int waitMs = static_cast<int>((waitUs + 999) / 1000);
+            if (!m_rateTimer->isActive() || m_rateTimer->remainingTime() > waitMs) {
+                m_rateTimer->start(waitMs);
+            }
+            return;
+        }
+    }
+    requestFlush();
+}
+
+void NotificationScheduler::requestFrame()
+{
+    requestFlush();
+}
+
+void NotificationScheduler::requestFlush()
+{
+    if (m_flushRequested) {
+        return;
+    }
+    m_flushRequested = true;
+    if (m_window) {
+        // Queued if the window lives on another thread
+        QMetaObject::invokeMethod(m_window.data(), "update");
+        m_flushTimer->start(MaxFrameWaitMs);
+    } else if (!m_flushTimer->isActive()) {
+        // Left running until a flush finds nothing new: restarting it
+        // would register a timer, which allocates, on every flush
+        m_flushTimer->start(FallbackIntervalMs);
+    }
+}
+
+void NotificationScheduler::flush()
+{
+    VEHICLESYS_TRACE_SCOPE("notify", "flush");
+    if (m_window || !m_flushRequested) {
+        m_flushTimer->stop();
+    }
+    m_flushRequested = false;
+
+    const qint64 nowUs = canMonotonicMicros();
+    if (!m_window) {
+        m_frameStartUs.store(nowUs, std::memory_order_relaxed);
+    }
+    emit frameStarted(m_window ? m_frameStartUs.load(std::memory_order_relaxed) : nowUs);
+    if (!m_pending) {
+        emit flushCompleted();
+        return;
+    }
+
+    VehicleSignalStore::SignalMask pending = m_pending;
+    VehicleSignalStore::SignalMask deliver = 0;
+    qint64 nextDueUs = std::numeric_limits<qint64>::max();
+    m_pending = 0;
+
+    while (pending) {
+        const int id = qCountTrailingZeroBits(pending);
+        pending &= pending - 1;
+
+        const qint64 dueUs = m_deliveredUs[id] + m_minIntervalsUs[id];
+        if (m_minIntervalsUs[id] > 0 && nowUs < dueUs) {
+            m_pending |= VehicleSignalStore::SignalMask(1) << id;
+            nextDueUs = qMin(nextDueUs, dueUs);
+            continue;
+        }
+
+        const VehicleSignalStore::SignalId signal = static_cast<VehicleSignalStore::SignalId>(id);
+        const double value = m_store.value(signal);
+        const bool valid = m_store.isValid(signal);
+        // Also drops changes that cancelled out since the last delivery.
+        if (valid == m_deliveredValid[id] && std::abs(value - m_deliveredValues[id]) <= m_deadbands[id]) {
+            ++m_deadbandSuppressed[id];
+            continue;
+        }
+
+        deliver |= VehicleSignalStore::signalBit(signal);
+        m_deliveredValues[id] = value;
+        m_deliveredValid[id] = valid;
+        m_deliveredUs[id] = nowUs;
+        ++m_delivered[id];
+    }
+
+    if (m_pending) {
+        const int waitMs = static_cast<int>((nextDueUs - nowUs + 999) / 1000);
+        if (!m_rateTimer->isActive() || m_rateTimer->remainingTime() > waitMs) {
+            m_rateTimer->start(waitMs);
+        }
+    }
+    if (deliver) {
+        ++m_flushes;
+        emit flushed(deliver);
+    }
+    emit flushCompleted();
+}
+
+QVariantMap NotificationScheduler::statistics() const
+{
+    quint64 changes = 0;
+    quint64 delivered = 0;
+    quint64 suppressed = 0;
+    QVariantList perSignal;
+    for (int id = 0; id < VehicleSignalStore::SignalCount; ++id) {
+        const VehicleSignalStore::SignalId signal = static_cast<VehicleSignalStore::SignalId>(id);
+        QVariantMap entry;
+        entry["name"] = QString::fromLatin1(VehicleSignalStore::signalName(signal));
+        entry["changes"] = m_changes[id];
+        entry["delivered"] = m_delivered[id];
+        entry["suppressed"] = m_deadbandSuppressed[id];
+        // Changes merged into a later notification
+        entry["coalesced"] = m_changes[id] - m_delivered[id] - m_deadbandSuppressed[id];
+        entry["deadband"] = m_deadbands[id];
+        entry["maxRate"] = maxRate(signal);
+        perSignal.append(entry);
+
+        changes += m_changes[id];
+        delivered += m_delivered[id];
+        suppressed += m_deadbandSuppressed[id];
+    }
+
+    QVariantMap statistics;
+    statistics["flushes"] = m_flushes;
+    statistics["changes"] = changes;
+    statistics["delivered"] = delivered;
+    statistics["suppressed"] = suppressed;
+    statistics["coalesced"] = changes - delivered - suppressed;
+    statistics["signals"] = perSignal;
+    return statistics;
+}
@@ -0,0 +1,361 @@
+#include "odometerjournal.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+using OdometerJournalFormat::Record;
+
+namespace {
+std::uint32_t crc32(const void *data, std::size_t size)
+{
+    const auto *bytes = static_cast<const std::uint8_t *>(data);
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+std::uint32_t recordCrc(const Record &record)
+{
+    const std::size_t offset = offsetof(Record, sequence);
+    return crc32(reinterpret_cast<const char *>(&record) + offset, sizeof(Record) - offset);
+}
+
+// Stamps record as the one with sequence, ready to write.
+void sealRecord(Record &record, quint64 sequence)
+{
+    std::memcpy(record.magic, OdometerJournalFormat::Magic, sizeof(record.magic));
+    record.version = OdometerJournalFormat::Version;
+    record.sequence = sequence;
+    record.crc = recordCrc(record);
+}
+}
+
+OdometerJournal::OdometerJournal()
+    : m_hasState(false)
+    , m_state()
+    , m_updates(0)
+    , m_committedUpdates(0)
+    , m_sequence(0)
+    , m_recordCount(0)
+    , m_commitThread(nullptr)
+    , m_commitRequested(false)
+    , m_stopCommitting(false)
+{
+}
+
+OdometerJournal::~OdometerJournal()
+{
+    close();
+}
+
+bool OdometerJournal::open(const QString &path)
+{
+    close();
+
+    m_path = path;
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // The newest intact record wins; torn or corrupt ones are skipped.
+    Record newest = {};
+    bool found = false;
+    int skipped = 0;
+    int otherVersion = 0;
+    QFile existing(path);
+    if (existing.open(QIODevice::ReadOnly)) {
+        const QByteArray contents = existing.readAll();
+        for (int offset = 0; offset + int(sizeof(Record)) <= contents.size(); offset += sizeof(Record)) {
+            Record record;
+            std::memcpy(&record, contents.constData() + offset, sizeof(Record));
+            if (std::memcmp(record.magic, OdometerJournalFormat::Magic, sizeof(record.magic)) != 0) {
+                ++skipped;
+                continue;
+            }
+            // Other versions may lay out, and checksum, the rest differently
+            if (record.version != OdometerJournalFormat::Version) {
+                ++otherVersion;
+                continue;
+            }
+            if (record.crc != recordCrc(record) || record.extraCount > MaxExtraValues) {
+                ++skipped;
+                continue;
+            }
+            if (!found || record.sequence > newest.sequence) {
+                newest = record;
+                found = true;
+            }
+        }
+        if (contents.size() % int(sizeof(Record)) != 0) {
+            ++skipped;
+        }
+    }
+    if (!found && otherVersion > 0) {
+        m_errorString = QStringLiteral("%1 is not a version %2 odometer journal")
+                            .arg(path).arg(OdometerJournalFormat::Version);
+        return false;
+    }
+    if (skipped > 0) {
+        qWarning() << "Odometer journal" << path << "had" << skipped << "damaged records";
+    }
+
+    {
+        QMutexLocker locker(&m_stateMutex);
+        m_hasState = found;
+        m_state = found ? newest : Record();
+        m_updates = 0;
+        m_committedUpdates = 0;
+        m_commitRequested = false;
+        m_stopCommitting = false;
+    }
+    m_sequence = found ? newest.sequence : 0;
+
+    // Start from a clean file holding just the state found
+    bool ok;
+    if (found) {
+        ok = compact(newest);
+    } else {
+        m_file.setFileName(path);
+        ok = m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        if (!ok) {
+            m_errorString = QStringLiteral("Cannot open %1: %2").arg(path, m_file.errorString());
+        }
+        m_recordCount = 0;
+    }
+    if (!ok) {
+        return false;
+    }
+
+    m_commitThread = QThread::create([this]() { commitLoop(); });
+    m_commitThread->setObjectName(QStringLiteral("OdometerJournal"));
+    m_commitThread->start(QThread::LowPriority);
+
+    if (found) {
+        qDebug() << "Odometer journal" << path << "restored" << newest.odometerKm << "km";
+    }
+    m_errorString.clear();
+    return true;
+}
+
+void OdometerJournal::close()
+{
+    if (m_commitThread) {
+        {
+            QMutexLocker locker(&m_stateMutex);
+            m_stopCommitting = true;
+            m_commitWake.wakeAll();
+        }
+        m_commitThread->wait();
+        delete m_commitThread;
+        m_commitThread = nullptr;
+    }
+
+    if (m_file.isOpen()) {
+        commit();
+        m_file.close();
+    }
+}
+
+bool OdometerJournal::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+QString OdometerJournal::path() const
+{
+    return m_path;
+}
+
+QString OdometerJournal::errorString() const
+{
+    return m_errorString;
+}
+
+bool OdometerJournal::hasState() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return m_hasState;
+}
+
+double OdometerJournal::odometerKm() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return m_state.odometerKm;
+}
+
+double OdometerJournal::tripKm() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return m_state.tripKm;
+}
+
+QVector<double> OdometerJournal::extraValues() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    QVector<double> values(static_cast<int>(m_state.extraCount));
+    std::memcpy(values.data(), m_state.extra, m_state.extraCount * sizeof(double));
+    return values;
+}
+
+void OdometerJournal::update(double odometerKm, double tripKm)
+{
+    QMutexLocker locker(&m_stateMutex);
+    m_hasState = true;
+    m_state.odometerKm = odometerKm;
+    m_state.tripKm = tripKm;
+    ++m_updates;
+}
+
+void OdometerJournal::updateExtra(const double *values, int count)
+{
+    count = qBound(0, count, int(MaxExtraValues));
+    QMutexLocker locker(&m_stateMutex);
+    m_hasState = true;
+    std::memcpy(m_state.extra, values, static_cast<std::size_t>(count) * sizeof(double));
+    m_state.extraCount = static_cast<std::uint32_t>(count);
+    ++m_updates;
+}
+
+void OdometerJournal::requestCommit()
+{
+    QMutexLocker locker(&m_stateMutex);
+    m_commitRequested = true;
+    m_commitWake.wakeAll();
+}
+
+bool OdometerJournal::commit()
+{
+    // Held across the snapshot too, so a later value is never overwritten
+    // by an earlier one committed concurrently.
+    QMutexLocker fileLocker(&m_fileMutex);
+    if (!m_file.isOpen()) {
+        return false;
+    }
+
+    Record record;
+    quint64 updates;
+    {
+        QMutexLocker locker(&m_stateMutex);
+        if (m_updates == m_committedUpdates) {
+            return true;
+        }
+        record = m_state;
+        updates = m_updates;
+    }
+
+    const bool ok = m_recordCount >= CompactRecords ? compact(record) : appendRecord(record);
+    if (!ok) {
+        qWarning() << "Odometer journal commit failed:" << m_errorString;
+        return false;
+    }
+
+    QMutexLocker locker(&m_stateMutex);
+    m_committedUpdates = updates;
+    return true;
+}
+
+void OdometerJournal::commitLoop()
+{
+    QMutexLocker locker(&m_stateMutex);
+    while (!m_stopCommitting) {
+        if (!m_commitRequested) {
+            m_commitWake.wait(&m_stateMutex, CommitIntervalMs);
+        }
+        if (m_stopCommitting) {
+            break;
+        }
+        m_commitRequested = false;
+        locker.unlock();
+        commit();
+        locker.relock();
+    }
+}
+
+bool OdometerJournal::appendRecord(Record record)
+{
+    sealRecord(record, m_sequence + 1);
+    if (m_file.write(reinterpret_cast<const char *>(&record), sizeof(record)) != qint64(sizeof(record))
+        || !syncFile(m_file)) {
+        m_errorString = QStringLiteral("Cannot write %1: %2").arg(m_path, m_file.errorString());
+        // A partial record would misalign the ones after it; rewrite the
+        // file on the next commit.
+        m_recordCount = CompactRecords;
+        return false;
+    }
+    ++m_sequence;
+    ++m_recordCount;
+    return true;
+}
+
+// Writes the single-record journal to a temporary file, syncs it and
+// renames it over the old one, so a crash leaves either file complete.
+bool OdometerJournal::compact(Record record)
+{
+    const QString temporaryPath = m_path + QStringLiteral(".tmp");
+    QFile temporary(temporaryPath);
+    sealRecord(record, m_sequence + 1);
+    if (!temporary.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || temporary.write(reinterpret_cast<const char *>(&record), sizeof(record)) != qint64(sizeof(record))
+        || !syncFile(temporary)) {
+        m_errorString = QStringLiteral("Cannot write %1: %2").arg(temporaryPath, temporary.errorString());
+        return false;
+    }
+    temporary.close();
+
+#ifdef Q_OS_UNIX
+    if (::rename(QFile::encodeName(temporaryPath).constData(), QFile::encodeName(m_path).constData()) != 0) {
+        m_errorString = QStringLiteral("Cannot replace %1: %2").arg(m_path, qt_error_string(errno));
+        return false;
+    }
+    // Make the rename itself durable
+    const int directory = ::open(QFile::encodeName(QFileInfo(m_path).absolutePath()).constData(), O_RDONLY);
+    if (directory >= 0) {
+        ::fsync(directory);
+        ::close(directory);
+    }
+    m_file.close();
+#else
+    m_file.close();
+    QFile::remove(m_path);
+    if (!QFile::rename(temporaryPath, m_path)) {
+        m_errorString = QStringLiteral("Cannot replace %1").arg(m_path);
+        return false;
+    }
+#endif
+
+    m_file.setFileName(m_path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        m_errorString = QStringLiteral("Cannot open %1: %2").arg(m_path, m_file.errorString());
+        return false;
+    }
+    ++m_sequence;
+    m_recordCount = 1;
+    return true;
+}
+
+bool OdometerJournal::syncFile(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_UNIX
+    return ::fsync(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
@@ -0,0 +1,54 @@
+#include "propertymirror.h"
+#include <QMutexLocker>
+
+PropertyMirror::PropertyMirror(QObject *parent)
+    : QQmlPropertyMap(this, parent)
+    , m_applyQueued(false)
+{
+}
+
+PropertyMirror::~PropertyMirror()
+{
+    for (const QMetaObject::Connection &connection : m_connections) {
+        disconnect(connection);
+    }
+}
+
+QVariant PropertyMirror::updateValue(const QString &key, const QVariant &input)
+{
+    Q_UNUSED(input)
+    return value(key);
+}
+
+void PropertyMirror::stage(const QObject *source, const QList<QByteArray> &properties)
+{
+    // Read outside the lock; some properties take a while to build
+    QVariantHash values;
+    for (const QByteArray &property : properties) {
+        values.insert(QString::fromLatin1(property), source->property(property.constData()));
+    }
+
+    QMutexLocker locker(&m_mutex);
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        m_pending.insert(it.key(), it.value());
+    }
+    if (!m_applyQueued) {
+        m_applyQueued = true;
+        QMetaObject::invokeMethod(this, &PropertyMirror::apply, Qt::QueuedConnection);
+    }
+}
+
+void PropertyMirror::apply()
+{
+    QVariantHash pending;
+    {
+        QMutexLocker locker(&m_mutex);
+        pending.swap(m_pending);
+        m_applyQueued = false;
+    }
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        if (value(it.key()) != it.value()) {
+            insert(it.key(), it.value());
+        }
+    }
+}
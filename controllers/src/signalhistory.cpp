@@ -0,0 +1,300 @@
+#include "signalhistory.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr int SignalCount = VehicleSignalStore::SignalCount;
+// Bucket index, min, max, sum and count
+constexpr qint64 BucketBytes = 8 + 8 + 8 + 8 + 4;
+constexpr qint64 RawSampleBytes = 8 + 8;
+
+int floorPowerOfTwo(qint64 value)
+{
+    int power = 1;
+    while (power <= value / 2 && power < (1 << 30)) {
+        power *= 2;
+    }
+    return power;
+}
+
+// Rounds towards minus infinity, so buckets before time 0 line up too.
+qint64 floorDivide(qint64 value, qint64 divisor)
+{
+    const qint64 quotient = value / divisor;
+    return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+}
+}
+
+struct SignalHistory::Ring
+{
+    explicit Ring(const Config &config)
+        : versions(new std::atomic<quint64>[SignalCount]())
+        , rawCounts(new std::atomic<quint64>[SignalCount]())
+        , rawTimes(new std::atomic<qint64>[static_cast<std::size_t>(SignalCount) * config.rawCapacity]())
+        , rawValues(new std::atomic<double>[static_cast<std::size_t>(SignalCount) * config.rawCapacity]())
+        , bucketIndexes(new std::atomic<qint64>[bucketSlots(config)])
+        , bucketMins(new std::atomic<double>[bucketSlots(config)]())
+        , bucketMaxs(new std::atomic<double>[bucketSlots(config)]())
+        , bucketSums(new std::atomic<double>[bucketSlots(config)]())
+        , bucketCounts(new std::atomic<quint32>[bucketSlots(config)]())
+        , lastTimestampsUs(SignalCount, 0)
+    {
+        // No bucket has this index, so every slot starts out stale.
+        for (std::size_t slot = 0; slot < bucketSlots(config); ++slot) {
+            bucketIndexes[slot].store(std::numeric_limits<qint64>::min(), std::memory_order_relaxed);
+        }
+        qint64 bucketUs = config.baseBucketUs;
+        for (int level = 0; level < config.levels; ++level) {
+            levelBucketUs.push_back(bucketUs);
+            bucketUs *= config.levelFactor;
+        }
+    }
+
+    static std::size_t bucketSlots(const Config &config)
+    {
+        return static_cast<std::size_t>(SignalCount) * config.levels * config.bucketsPerLevel;
+    }
+
+    std::unique_ptr<std::atomic<quint64>[]> versions;   // seqlock per signal, odd while appending
+    std::unique_ptr<std::atomic<quint64>[]> rawCounts;  // samples appended per signal
+    std::unique_ptr<std::atomic<qint64>[]> rawTimes;
+    std::unique_ptr<std::atomic<double>[]> rawValues;
+    std::unique_ptr<std::atomic<qint64>[]> bucketIndexes;
+    std::unique_ptr<std::atomic<double>[]> bucketMins;
+    std::unique_ptr<std::atomic<double>[]> bucketMaxs;
+    std::unique_ptr<std::atomic<double>[]> bucketSums;
+    std::unique_ptr<std::atomic<quint32>[]> bucketCounts;
+    std::vector<qint64> levelBucketUs;
+    std::vector<qint64> lastTimestampsUs;               // writer only
+};
+
+SignalHistory::Config SignalHistory::Config::forMemoryBudget(qint64 bytes)
+{
+    Config config;
+    const qint64 perSignal = bytes / SignalCount;
+    // An eighth for raw samples, the rest for the pyramid
+    config.rawCapacity = qMax(64, floorPowerOfTwo(perSignal / 8 / RawSampleBytes));
+    config.bucketsPerLevel = qMax(16, floorPowerOfTwo(perSignal * 7 / 8 / (config.levels * BucketBytes)));
+    return config;
+}
+
+qint64 SignalHistory::Config::memoryUsage() const
+{
+    return static_cast<qint64>(SignalCount) * (rawCapacity * RawSampleBytes + qint64(levels) * bucketsPerLevel * BucketBytes);
+}
+
+qint64 SignalHistory::Config::retentionUs() const
+{
+    qint64 bucketUs = baseBucketUs;
+    for (int level = 1; level < levels; ++level) {
+        bucketUs *= levelFactor;
+    }
+    return bucketUs * bucketsPerLevel;
+}
+
+SignalHistory::SignalHistory()
+{
+    configure(Config());
+}
+
+SignalHistory::SignalHistory(const Config &config)
+{
+    configure(config);
+}
+
+SignalHistory::~SignalHistory() = default;
+
+void SignalHistory::configure(const Config &config)
+{
+    m_config = config;
+    m_config.rawCapacity = floorPowerOfTwo(qMax(1, config.rawCapacity));
+    m_config.bucketsPerLevel = floorPowerOfTwo(qMax(1, config.bucketsPerLevel));
+    m_config.levels = qMax(1, config.levels);
+    m_config.baseBucketUs = qMax<qint64>(1, config.baseBucketUs);
+    m_config.levelFactor = qMax(2, config.levelFactor);
+    m_ring.reset(new Ring(m_config));
+}
+
+void SignalHistory::append(VehicleSignalStore::SignalId id, double value, qint64 timestampUs)
+{
+    Ring &ring = *m_ring;
+    // Out-of-order samples are filed at the newest time, keeping the raw
+    // ring sorted.
+    timestampUs = qMax(timestampUs, ring.lastTimestampsUs[id]);
+    ring.lastTimestampsUs[id] = timestampUs;
+
+    std::atomic<quint64> &version = ring.versions[id];
+    const quint64 begin = version.load(std::memory_order_relaxed) + 1;
+    version.store(begin, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const quint64 count = ring.rawCounts[id].load(std::memory_order_relaxed);
+    const std::size_t raw = static_cast<std::size_t>(id) * m_config.rawCapacity + (count & (m_config.rawCapacity - 1));
+    ring.rawTimes[raw].store(timestampUs, std::memory_order_relaxed);
+    ring.rawValues[raw].store(value, std::memory_order_relaxed);
+    ring.rawCounts[id].store(count + 1, std::memory_order_relaxed);
+
+    for (int level = 0; level < m_config.levels; ++level) {
+        const qint64 index = floorDivide(timestampUs, ring.levelBucketUs[level]);
+        const std::size_t slot = (static_cast<std::size_t>(id) * m_config.levels + level) * m_config.bucketsPerLevel
+                                 + static_cast<std::size_t>(index & (m_config.bucketsPerLevel - 1));
+        if (ring.bucketIndexes[slot].load(std::memory_order_relaxed) != index) {
+            ring.bucketIndexes[slot].store(index, std::memory_order_relaxed);
+            ring.bucketMins[slot].store(value, std::memory_order_relaxed);
+            ring.bucketMaxs[slot].store(value, std::memory_order_relaxed);
+            ring.bucketSums[slot].store(value, std::memory_order_relaxed);
+            ring.bucketCounts[slot].store(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (value < ring.bucketMins[slot].load(std::memory_order_relaxed)) {
+            ring.bucketMins[slot].store(value, std::memory_order_relaxed);
+        }
+        if (value > ring.bucketMaxs[slot].load(std::memory_order_relaxed)) {
+            ring.bucketMaxs[slot].store(value, std::memory_order_relaxed);
+        }
+        ring.bucketSums[slot].store(ring.bucketSums[slot].load(std::memory_order_relaxed) + value,
+                                    std::memory_order_relaxed);
+        ring.bucketCounts[slot].store(ring.bucketCounts[slot].load(std::memory_order_relaxed) + 1,
+                                      std::memory_order_relaxed);
+    }
+
+    version.store(begin + 1, std::memory_order_release);
+}
+
+template<typename Read>
+void SignalHistory::readConsistent(VehicleSignalStore::SignalId id, Read read) const
+{
+    const std::atomic<quint64> &version = m_ring->versions[id];
+    for (;;) {
+        const quint64 before = version.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        read();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+QVector<SignalHistory::Sample> SignalHistory::samples(VehicleSignalStore::SignalId id, qint64 fromUs, qint64 toUs,
+                                                      int maxSamples) const
+{
+    const Ring &ring = *m_ring;
+    const std::size_t base = static_cast<std::size_t>(id) * m_config.rawCapacity;
+    const quint64 mask = m_config.rawCapacity - 1;
+    QVector<Sample> result;
+
+    readConsistent(id, [&]() {
+        result.clear();
+        const quint64 count = ring.rawCounts[id].load(std::memory_order_relaxed);
+        const quint64 oldest = count > quint64(m_config.rawCapacity) ? count - m_config.rawCapacity : 0;
+        const auto timeAt = [&](quint64 position) {
+            return ring.rawTimes[base + (position & mask)].load(std::memory_order_relaxed);
+        };
+
+        // First sample at or after fromUs, then at most maxSamples back from
+        // the first one at or after toUs.
+        quint64 low = oldest;
+        quint64 high = count;
+        while (low < high) {
+            const quint64 middle = low + (high - low) / 2;
+            if (timeAt(middle) < fromUs) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        quint64 end = low;
+        high = count;
+        while (end < high) {
+            const quint64 middle = end + (high - end) / 2;
+            if (timeAt(middle) < toUs) {
+                end = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        const quint64 begin = qMax(low, end > quint64(qMax(0, maxSamples)) ? end - qMax(0, maxSamples) : 0);
+        result.reserve(static_cast<int>(end - begin));
+        for (quint64 position = begin; position < end; ++position) {
+            result.append(Sample{timeAt(position), ring.rawValues[base + (position & mask)].load(std::memory_order_relaxed)});
+        }
+    });
+    return result;
+}
+
+QVector<SignalHistory::Point> SignalHistory::trend(VehicleSignalStore::SignalId id, qint64 fromUs, qint64 toUs,
+                                                   int columns) const
+{
+    QVector<Point> points;
+    if (columns <= 0 || toUs <= fromUs) {
+        return points;
+    }
+
+    // Coarsest level with buckets no wider than a column, then coarser
+    // until the span fits in one ring.
+    const qint64 spanUs = toUs - fromUs;
+    const qint64 columnUs = qMax<qint64>(1, spanUs / columns);
+    int level = 0;
+    while (level + 1 < m_config.levels && m_ring->levelBucketUs[level + 1] <= columnUs) {
+        ++level;
+    }
+    while (level + 1 < m_config.levels && spanUs / m_ring->levelBucketUs[level] >= m_config.bucketsPerLevel) {
+        ++level;
+    }
+
+    points.reserve(columns);
+    for (int column = 0; column < columns; ++column) {
+        const qint64 startUs = fromUs + spanUs * column / columns;
+        const qint64 endUs = fromUs + spanUs * (column + 1) / columns;
+        points.append(readColumn(id, level, startUs, qMax(endUs, startUs + 1)));
+    }
+    return points;
+}
+
+SignalHistory::Point SignalHistory::readColumn(VehicleSignalStore::SignalId id, int level, qint64 startUs,
+                                               qint64 endUs) const
+{
+    const Ring &ring = *m_ring;
+    const qint64 bucketUs = ring.levelBucketUs[level];
+    // Buckets starting inside the column, so adjacent columns never count
+    // a bucket twice; a column narrower than a bucket takes the one it is in.
+    qint64 first = floorDivide(startUs - 1, bucketUs) + 1;
+    qint64 last = floorDivide(endUs - 1, bucketUs);
+    if (first > last) {
+        first = last;
+    }
+    first = qMax(first, last - m_config.bucketsPerLevel + 1);
+    const std::size_t base = (static_cast<std::size_t>(id) * m_config.levels + level) * m_config.bucketsPerLevel;
+    const qint64 mask = m_config.bucketsPerLevel - 1;
+
+    Point point;
+    readConsistent(id, [&]() {
+        point = Point{startUs, 0.0, 0.0, 0.0, 0};
+        double sum = 0;
+        for (qint64 index = first; index <= last; ++index) {
+            const std::size_t slot = base + static_cast<std::size_t>(index & mask);
+            if (ring.bucketIndexes[slot].load(std::memory_order_relaxed) != index) {
+                continue;
+            }
+            const double min = ring.bucketMins[slot].load(std::memory_order_relaxed);
+            const double max = ring.bucketMaxs[slot].load(std::memory_order_relaxed);
+            if (point.count == 0 || min < point.min) {
+                point.min = min;
+            }
+            if (point.count == 0 || max > point.max) {
+                point.max = max;
+            }
+            sum += ring.bucketSums[slot].load(std::memory_order_relaxed);
+            point.count += ring.bucketCounts[slot].load(std::memory_order_relaxed);
+        }
+        point.mean = point.count > 0 ? sum / point.count : 0.0;
+    });
+    return point;
+}
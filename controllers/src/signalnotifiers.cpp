@@ -0,0 +1,33 @@
+#include "signalnotifiers.h"
+#include "tracerecorder.h"
+#include <QObject>
+#include <QVariant>
+
+SignalNotifiers::SignalNotifiers(const QMetaObject &metaObject)
+    : m_mask(0)
+{
+    for (int id = 0; id < VehicleSignalStore::SignalCount; ++id) {
+        const VehicleSignalStore::SignalId signal = static_cast<VehicleSignalStore::SignalId>(id);
+        const int index = metaObject.indexOfProperty(VehicleSignalStore::signalName(signal));
+        if (index < 0 || !metaObject.property(index).hasNotifySignal()) {
+            continue;
+        }
+        m_properties[id] = metaObject.property(index);
+        m_notifySignals[id] = m_properties[id].notifySignal();
+        m_mask |= VehicleSignalStore::signalBit(signal);
+    }
+}
+
+void SignalNotifiers::notify(QObject *object, VehicleSignalStore::SignalMask signalMask,
+                             const char *traceCategory) const
+{
+    Q_UNUSED(traceCategory)
+    for (signalMask &= m_mask; signalMask; signalMask &= signalMask - 1) {
+        const int id = qCountTrailingZeroBits(signalMask);
+        VEHICLESYS_TRACE_SCOPE(traceCategory, VehicleSignalStore::signalName(static_cast<VehicleSignalStore::SignalId>(id)));
+        // Doubles, ints and bools fit in the variant, so this allocates no
+        // more than the getter itself
+        const QVariant value = m_properties[id].read(object);
+        m_notifySignals[id].invoke(object, Qt::DirectConnection, QGenericArgument(value.typeName(), value.constData()));
+    }
+}
@@ -0,0 +1,67 @@
+#include "signalsubscriptions.h"
+#include <QtAlgorithms>
+
+SignalSubscriptions::SignalSubscriptions()
+    : m_nextId(1)
+    , m_mask(0)
+{
+    m_refreshUs.fill(NoRefreshUs);
+}
+
+int SignalSubscriptions::subscribe(VehicleSignalStore::SignalMask signalMask, double rate)
+{
+    const int id = m_nextId++;
+    m_subscriptions.append(Subscription{id, signalMask, rate});
+    rebuild();
+    return id;
+}
+
+bool SignalSubscriptions::update(int id, VehicleSignalStore::SignalMask signalMask, double rate)
+{
+    for (Subscription &subscription : m_subscriptions) {
+        if (subscription.id == id) {
+            subscription.signalMask = signalMask;
+            subscription.rate = rate;
+            rebuild();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SignalSubscriptions::unsubscribe(int id)
+{
+    for (int index = 0; index < m_subscriptions.size(); ++index) {
+        if (m_subscriptions.at(index).id == id) {
+            m_subscriptions.remove(index);
+            rebuild();
+            return true;
+        }
+    }
+    return false;
+}
+
+int SignalSubscriptions::count() const
+{
+    return m_subscriptions.size();
+}
+
+void SignalSubscriptions::rebuild()
+{
+    m_mask = 0;
+    m_refreshUs.fill(NoRefreshUs);
+    for (const Subscription &subscription : m_subscriptions) {
+        m_mask |= subscription.signalMask;
+        if (!(subscription.rate > 0)) {
+            continue;
+        }
+        // qInf() comes out as 0: every frame
+        const qint64 intervalUs = subscription.rate >= 1e6 ? 0 : static_cast<qint64>(1e6 / subscription.rate);
+        for (VehicleSignalStore::SignalMask mask = subscription.signalMask; mask; mask &= mask - 1) {
+            const int id = qCountTrailingZeroBits(mask);
+            if (id < VehicleSignalStore::SignalCount) {
+                m_refreshUs[id] = qMin(m_refreshUs[id], intervalUs);
+            }
+        }
+    }
+}
@@ -1,4 +1,5 @@
 #include "system.h"
+#include "tracerecorder.h"
 
 /**
  * @brief Constructor for the System class.
@@ -83,6 +84,7 @@ void System::setUserName(const QString &userName)
 
 void System::updateCurrentTime()
 {
+    VEHICLESYS_TRACE_SCOPE("timer", "clock");
     QString newTime = QDateTime::currentDateTime().toString("hh:mm ap");
     
     if (m_currentTime != newTime) {
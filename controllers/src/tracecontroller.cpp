@@ -0,0 +1,193 @@
+#include "tracecontroller.h"
+#include "tracerecorder.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QQuickWindow>
+#include <QThread>
+#include <QTimer>
+
+namespace {
+// Lets a capture show how the system recovered from the stutter
+const int CaptureDelayMs = 1000;
+}
+
+TraceController::TraceController(QObject *parent)
+    : QObject(parent)
+    , m_stutterNs(0)
+    , m_captureSeconds(DefaultCaptureSeconds)
+    , m_capturePending(false)
+    , m_lastCaptureNs(0)
+    , m_captureThread(nullptr)
+    , m_frameStartNs(0)
+    , m_syncedFrameStartNs(0)
+    , m_lastSwapNs(0)
+    , m_lastIntervalNs(0)
+{
+}
+
+TraceController::~TraceController()
+{
+    if (m_captureThread) {
+        m_captureThread->wait();
+        delete m_captureThread;
+    }
+}
+
+bool TraceController::isEnabled() const
+{
+    return TraceRecorder::isEnabled();
+}
+
+void TraceController::setEnabled(bool enabled)
+{
+    if (enabled == TraceRecorder::isEnabled()) {
+        return;
+    }
+    TraceRecorder::setEnabled(enabled);
+    emit enabledChanged(enabled);
+}
+
+bool TraceController::isAvailable() const
+{
+#ifdef VEHICLESYS_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TraceController::setWindow(QQuickWindow *window)
+{
+    for (const QMetaObject::Connection &connection : qAsConst(m_windowConnections)) {
+        disconnect(connection);
+    }
+    m_windowConnections.clear();
+    m_window = window;
+#ifdef VEHICLESYS_TRACING
+    if (!window) {
+        return;
+    }
+    // Sync, render and swap run on the render thread when there is one
+    m_windowConnections << connect(window, &QQuickWindow::afterAnimating, this,
+                                   &TraceController::markFrameStart, Qt::DirectConnection)
+                        << connect(window, &QQuickWindow::beforeSynchronizing, this,
+                                   &TraceController::markSynchronizing, Qt::DirectConnection)
+                        << connect(window, &QQuickWindow::afterSynchronizing, this, []() {
+                               VEHICLESYS_TRACE_END("qml", "sync");
+                           }, Qt::DirectConnection)
+                        << connect(window, &QQuickWindow::beforeRendering, this, []() {
+                               VEHICLESYS_TRACE_BEGIN("qml", "render");
+                           }, Qt::DirectConnection)
+                        << connect(window, &QQuickWindow::afterRendering, this, []() {
+                               VEHICLESYS_TRACE_END("qml", "render");
+                           }, Qt::DirectConnection)
+                        << connect(window, &QQuickWindow::frameSwapped, this,
+                                   &TraceController::markFrameSwapped, Qt::DirectConnection);
+#endif
+}
+
+void TraceController::setStutterCapture(const QString &directory, int thresholdMs, int captureSeconds)
+{
+    m_stutterDirectory = directory;
+    m_captureSeconds = qMax(1, captureSeconds);
+    m_stutterNs.store(directory.isEmpty() ? 0 : qMax(1, thresholdMs) * qint64(1000000));
+}
+
+bool TraceController::save(const QString &path, int lastSeconds)
+{
+    QString error;
+    if (!TraceRecorder::save(path, lastSeconds * qint64(1000), &error)) {
+        qWarning() << "Cannot save trace to" << path << ":" << error;
+        return false;
+    }
+    return true;
+}
+
+// GUI thread
+void TraceController::markFrameStart()
+{
+    VEHICLESYS_TRACE_INSTANT("qml", "animate");
+    m_frameStartNs.store(TraceRecorder::nowNs(), std::memory_order_relaxed);
+}
+
+// Render thread, while the GUI thread is blocked: the frame started is the
+// one being synchronized, and no later one has started yet
+void TraceController::markSynchronizing()
+{
+    VEHICLESYS_TRACE_BEGIN("qml", "sync");
+    m_syncedFrameStartNs = m_frameStartNs.load(std::memory_order_relaxed);
+}
+
+// Render thread
+void TraceController::markFrameSwapped()
+{
+    VEHICLESYS_TRACE_INSTANT("qml", "frameSwapped");
+    const qint64 swapNs = TraceRecorder::nowNs();
+    const qint64 frameNs = m_syncedFrameStartNs ? swapNs - m_syncedFrameStartNs : 0;
+    const qint64 intervalNs = m_lastSwapNs ? swapNs - m_lastSwapNs : 0;
+    VEHICLESYS_TRACE_COUNTER("qml", "frame time (us)", frameNs / 1000);
+
+    // An idle window swaps far apart without stuttering; a long gap only
+    // counts right after a frame that came on time
+    const qint64 stutterNs = m_stutterNs.load();
+    const bool stutter = stutterNs && TraceRecorder::isEnabled()
+                         && (frameNs > stutterNs || (m_lastIntervalNs && m_lastIntervalNs <= stutterNs
+                                                     && intervalNs > stutterNs));
+    m_lastSwapNs = swapNs;
+    m_lastIntervalNs = intervalNs;
+    if (stutter) {
+        VEHICLESYS_TRACE_INSTANT("qml", "stutter");
+        QMetaObject::invokeMethod(this, &TraceController::scheduleCapture, Qt::QueuedConnection);
+    }
+}
+
+void TraceController::scheduleCapture()
+{
+    if (m_stutterDirectory.isEmpty() || m_capturePending
+        || (m_lastCaptureNs && TraceRecorder::nowNs() - m_lastCaptureNs < m_captureSeconds * qint64(1000000000))) {
+        return;
+    }
+    m_capturePending = true;
+    QTimer::singleShot(CaptureDelayMs, this, &TraceController::capture);
+}
+
+void TraceController::capture()
+{
+    m_lastCaptureNs = TraceRecorder::nowNs();
+    if (m_stutterDirectory.isEmpty() || !QDir().mkpath(m_stutterDirectory)) {
+        m_capturePending = false;
+        qWarning() << "Cannot capture stutter into" << m_stutterDirectory;
+        return;
+    }
+    const QString path = QDir(m_stutterDirectory).filePath(
+        QStringLiteral("stutter-%1.json").arg(QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd-hhmmss-zzz"))));
+    const qint64 windowMs = m_captureSeconds * qint64(1000);
+
+    // Serializing seconds of every thread's events takes long enough to
+    // drop frames; the recorder may be saved from any thread. Stays
+    // pending until written.
+    m_captureThread = QThread::create([this, path, windowMs]() {
+        QString error;
+        const bool saved = TraceRecorder::save(path, windowMs, &error);
+        QMetaObject::invokeMethod(this, [this, path, saved, error]() {
+            finishCapture(path, saved, error);
+        }, Qt::QueuedConnection);
+    });
+    m_captureThread->setObjectName(QStringLiteral("TraceCapture"));
+    m_captureThread->start(QThread::LowPriority);
+}
+
+void TraceController::finishCapture(const QString &path, bool saved, const QString &error)
+{
+    m_captureThread->wait();
+    delete m_captureThread;
+    m_captureThread = nullptr;
+    m_capturePending = false;
+    if (!saved) {
+        qWarning() << "Cannot save trace to" << path << ":" << error;
+        return;
+    }
+    qInfo() << "Stutter captured in" << path;
+    emit stutterCaptured(path);
+}
@@ -0,0 +1,476 @@
+#include "tracerecorder.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> TraceRecorder::s_enabled(false);
+
+namespace {
+
+// Every field is atomic so save() may copy a slot while its thread
+// overwrites it; a torn copy is detected and dropped, never read.
+struct TraceSlot
+{
+    std::atomic<const char *> category;
+    std::atomic<const char *> name;
+    std::atomic<qint64> timestampNs;
+    std::atomic<qint64> value;
+    std::atomic<char> phase;
+};
+
+struct TraceEvent
+{
+    char phase;
+    const char *category;
+    const char *name;
+    qint64 timestampNs;
+    // Duration of a complete event, the value of a counter
+    qint64 value;
+};
+
+struct ThreadBuffer
+{
+    QByteArray threadName;
+    qint64 tid = 0;
+    std::unique_ptr<TraceSlot[]> events{new TraceSlot[TraceRecorder::EventsPerThread]()};
+    // claimed runs one ahead of written while a slot is being filled
+    std::atomic<quint64> claimed{0};
+    std::atomic<quint64> written{0};
+};
+
+struct ThreadTrace
+{
+    QByteArray name;
+    qint64 tid;
+    std::vector<TraceEvent> events;
+};
+
+QMutex &registryMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+// Never shrinks: a buffer outlives its thread so its events can be saved
+std::vector<ThreadBuffer *> &registry()
+{
+    static std::vector<ThreadBuffer *> buffers;
+    return buffers;
+}
+
+thread_local ThreadBuffer *t_buffer = nullptr;
+
+qint64 currentTid()
+{
+#ifdef Q_OS_LINUX
+    return static_cast<qint64>(::syscall(SYS_gettid));
+#else
+    return static_cast<qint64>(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+#endif
+}
+
+QByteArray currentThreadName(qint64 tid)
+{
+    QThread *thread = QThread::currentThread();
+    if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+        return QByteArrayLiteral("GUI");
+    }
+    QByteArray name = thread->objectName().toUtf8();
+    if (name.isEmpty()) {
+        // Qt's own threads, e.g. QSGRenderThread, are only named by class
+        const QByteArray className = thread->metaObject()->className();
+        if (className != "QThread" && className != "QAdoptedThread") {
+            name = className;
+        }
+    }
+    return name.isEmpty() ? "Thread " + QByteArray::number(tid) : name;
+}
+
+ThreadBuffer *threadBuffer()
+{
+    if (!t_buffer) {
+        auto *buffer = new ThreadBuffer;
+        buffer->tid = currentTid();
+        buffer->threadName = currentThreadName(buffer->tid);
+        QMutexLocker locker(&registryMutex());
+        registry().push_back(buffer);
+        t_buffer = buffer;
+    }
+    return t_buffer;
+}
+
+// Copies what the buffer holds now; events overwritten while copying are
+// left out.
+std::vector<TraceEvent> snapshot(const ThreadBuffer &buffer)
+{
+    const quint64 capacity = TraceRecorder::EventsPerThread;
+    const quint64 end = buffer.written.load(std::memory_order_acquire);
+    const quint64 begin = end > capacity ? end - capacity : 0;
+
+    std::vector<TraceEvent> events(end - begin);
+    for (quint64 index = begin; index < end; ++index) {
+        const TraceSlot &slot = buffer.events[index % capacity];
+        TraceEvent &event = events[index - begin];
+        event.phase = slot.phase.load(std::memory_order_relaxed);
+        event.category = slot.category.load(std::memory_order_relaxed);
+        event.name = slot.name.load(std::memory_order_relaxed);
+        event.timestampNs = slot.timestampNs.load(std::memory_order_relaxed);
+        event.value = slot.value.load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const quint64 claimed = buffer.claimed.load(std::memory_order_relaxed);
+    const quint64 firstIntact = claimed > capacity ? claimed - capacity : 0;
+    if (firstIntact > begin) {
+        events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(qMin(firstIntact, end) - begin));
+    }
+    return events;
+}
+
+std::vector<ThreadTrace> collect(qint64 windowMs)
+{
+    std::vector<ThreadBuffer *> buffers;
+    {
+        QMutexLocker locker(&registryMutex());
+        buffers = registry();
+    }
+
+    const qint64 cutoffNs = windowMs > 0 ? TraceRecorder::nowNs() - windowMs * 1000000
+                                         : std::numeric_limits<qint64>::min();
+    std::vector<ThreadTrace> threads;
+    for (const ThreadBuffer *buffer : buffers) {
+        ThreadTrace thread{buffer->threadName, buffer->tid, snapshot(*buffer)};
+        auto outside = [cutoffNs](const TraceEvent &event) {
+            const qint64 endNs = event.phase == 'X' ? event.timestampNs + event.value : event.timestampNs;
+            return endNs < cutoffNs;
+        };
+        thread.events.erase(std::remove_if(thread.events.begin(), thread.events.end(), outside), thread.events.end());
+        threads.push_back(std::move(thread));
+    }
+    return threads;
+}
+
+void appendJsonString(QByteArray &out, const char *text)
+{
+    out += '"';
+    for (const char *c = text ? text : ""; *c; ++c) {
+        const unsigned char ch = static_cast<unsigned char>(*c);
+        if (ch == '"' || ch == '\\') {
+            out += '\\';
+            out += *c;
+        } else if (ch < 0x20) {
+            out += "\\u00";
+            out += "0123456789abcdef"[ch >> 4];
+            out += "0123456789abcdef"[ch & 15];
+        } else {
+            out += *c;
+        }
+    }
+    out += '"';
+}
+
+QByteArray microseconds(qint64 ns)
+{
+    return QByteArray::number(static_cast<double>(ns) / 1000.0, 'f', 3);
+}
+
+// Chrome trace event format, JSON object flavour
+QByteArray chromeTrace(const std::vector<ThreadTrace> &threads)
+{
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":0,\"args\":{\"name\":";
+    appendJsonString(out, QCoreApplication::applicationName().toUtf8().constData());
+    out += "}}";
+
+    for (const ThreadTrace &thread : threads) {
+        const QByteArray ids = ",\"pid\":" + pid + ",\"tid\":" + QByteArray::number(thread.tid);
+        out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\"" + ids + ",\"args\":{\"name\":";
+        appendJsonString(out, thread.name.constData());
+        out += "}}";
+
+        for (const TraceEvent &event : thread.events) {
+            out += ",\n{\"name\":";
+            appendJsonString(out, event.name);
+            out += ",\"cat\":";
+            appendJsonString(out, event.category);
+            out += ",\"ph\":\"";
+            out += event.phase;
+            out += "\",\"ts\":" + microseconds(event.timestampNs) + ids;
+            switch (event.phase) {
+            case 'X':
+                out += ",\"dur\":" + microseconds(event.value);
+                break;
+            case 'i':
+                out += ",\"s\":\"t\"";
+                break;
+            case 'C':
+                out += ",\"args\":{\"value\":" + QByteArray::number(event.value) + '}';
+                break;
+            }
+            out += '}';
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+// Just enough protobuf encoding for perfetto.protos.Trace
+class ProtoWriter
+{
+public:
+    void varint(int field, quint64 value)
+    {
+        key(field, 0);
+        raw(value);
+    }
+    void bytes(int field, const QByteArray &value)
+    {
+        key(field, 2);
+        raw(static_cast<quint64>(value.size()));
+        m_data += value;
+    }
+    void bytes(int field, const char *value) { bytes(field, QByteArray(value ? value : "")); }
+    void message(int field, const ProtoWriter &value) { bytes(field, value.m_data); }
+    const QByteArray &data() const { return m_data; }
+
+private:
+    void key(int field, int wireType) { raw(static_cast<quint64>(field) << 3 | static_cast<quint64>(wireType)); }
+    void raw(quint64 value)
+    {
+        while (value >= 0x80) {
+            m_data += static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        m_data += static_cast<char>(value);
+    }
+
+    QByteArray m_data;
+};
+
+namespace Perfetto {
+enum TracePacketField {
+    Timestamp = 8,
+    TrustedPacketSequenceId = 10,
+    TrackEventField = 11,
+    SequenceFlags = 13,
+    TimestampClockId = 58,
+    TrackDescriptorField = 60,
+};
+enum TrackEventField { Type = 9, TrackUuid = 11, Categories = 22, Name = 23, CounterValue = 30 };
+enum TrackEventType { SliceBegin = 1, SliceEnd = 2, Instant = 3, Counter = 4 };
+enum TrackDescriptorField { Uuid = 1, TrackName = 2, Process = 3, Thread = 4, ParentUuid = 5, CounterTrack = 8 };
+const quint64 ClockMonotonic = 3;
+const quint64 SequenceId = 1;
+const quint64 IncrementalStateCleared = 1;
+const quint64 ProcessUuid = 1;
+}
+
+void appendPacket(QByteArray &out, ProtoWriter &packet)
+{
+    packet.varint(Perfetto::TrustedPacketSequenceId, Perfetto::SequenceId);
+    ProtoWriter trace;
+    trace.message(1, packet);
+    out += trace.data();
+}
+
+void appendTrackEvent(QByteArray &out, qint64 timestampNs, quint64 trackUuid, int type, const TraceEvent *event)
+{
+    ProtoWriter trackEvent;
+    trackEvent.varint(Perfetto::Type, static_cast<quint64>(type));
+    trackEvent.varint(Perfetto::TrackUuid, trackUuid);
+    if (type == Perfetto::Counter) {
+        trackEvent.varint(Perfetto::CounterValue, static_cast<quint64>(event->value));
+    } else if (type != Perfetto::SliceEnd) {
+        trackEvent.bytes(Perfetto::Categories, event->category);
+        trackEvent.bytes(Perfetto::Name, event->name);
+    }
+
+    ProtoWriter packet;
+    packet.varint(Perfetto::Timestamp, static_cast<quint64>(timestampNs));
+    packet.varint(Perfetto::TimestampClockId, Perfetto::ClockMonotonic);
+    packet.message(Perfetto::TrackEventField, trackEvent);
+    appendPacket(out, packet);
+}
+
+// Perfetto TrackEvent protobuf: one track per thread, one counter track per
+// counter name. Complete events become begin/end pairs, which Perfetto
+// needs in order and properly nested on each track.
+QByteArray perfettoTrace(const std::vector<ThreadTrace> &threads)
+{
+    const quint64 pid = static_cast<quint64>(QCoreApplication::applicationPid());
+    QByteArray out;
+
+    ProtoWriter process;
+    process.varint(1, pid);
+    process.bytes(6, QCoreApplication::applicationName().toUtf8());
+    ProtoWriter processTrack;
+    processTrack.varint(Perfetto::Uuid, Perfetto::ProcessUuid);
+    processTrack.message(Perfetto::Process, process);
+    ProtoWriter first;
+    first.varint(Perfetto::SequenceFlags, Perfetto::IncrementalStateCleared);
+    first.message(Perfetto::TrackDescriptorField, processTrack);
+    appendPacket(out, first);
+
+    std::map<std::string, quint64> counterTracks;
+    for (const ThreadTrace &thread : threads) {
+        const quint64 threadUuid = (quint64(1) << 32) | static_cast<quint32>(thread.tid);
+        ProtoWriter descriptor;
+        descriptor.varint(1, pid);
+        descriptor.varint(2, static_cast<quint64>(thread.tid));
+        descriptor.bytes(5, thread.name);
+        ProtoWriter threadTrack;
+        threadTrack.varint(Perfetto::Uuid, threadUuid);
+        threadTrack.varint(Perfetto::ParentUuid, Perfetto::ProcessUuid);
+        threadTrack.message(Perfetto::Thread, descriptor);
+        ProtoWriter packet;
+        packet.message(Perfetto::TrackDescriptorField, threadTrack);
+        appendPacket(out, packet);
+
+        struct Edge
+        {
+            qint64 timestampNs;
+            int order;          // ends, then instants and counters, then begins
+            qint64 durationNs;  // longer begins first, so the outer slice opens first
+            int type;
+            const TraceEvent *event;
+        };
+        std::vector<Edge> edges;
+        edges.reserve(thread.events.size() * 2);
+        for (const TraceEvent &event : thread.events) {
+            switch (event.phase) {
+            case 'X':
+                edges.push_back({event.timestampNs, 2, event.value, Perfetto::SliceBegin, &event});
+                edges.push_back({event.timestampNs + event.value, 0, 0, Perfetto::SliceEnd, &event});
+                break;
+            case 'B':
+                edges.push_back({event.timestampNs, 2, 0, Perfetto::SliceBegin, &event});
+                break;
+            case 'E':
+                edges.push_back({event.timestampNs, 0, 0, Perfetto::SliceEnd, &event});
+                break;
+            case 'i':
+                edges.push_back({event.timestampNs, 1, 0, Perfetto::Instant, &event});
+                break;
+            case 'C':
+                edges.push_back({event.timestampNs, 1, 0, Perfetto::Counter, &event});
+                break;
+            }
+        }
+        std::stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+            if (a.timestampNs != b.timestampNs) {
+                return a.timestampNs < b.timestampNs;
+            }
+            return a.order != b.order ? a.order < b.order : a.durationNs > b.durationNs;
+        });
+
+        for (const Edge &edge : edges) {
+            quint64 trackUuid = threadUuid;
+            if (edge.type == Perfetto::Counter) {
+                auto track = counterTracks.find(edge.event->name);
+                if (track == counterTracks.end()) {
+                    const quint64 uuid = (quint64(2) << 32) | counterTracks.size();
+                    track = counterTracks.emplace(edge.event->name, uuid).first;
+                    ProtoWriter counterTrack;
+                    counterTrack.varint(Perfetto::Uuid, uuid);
+                    counterTrack.varint(Perfetto::ParentUuid, Perfetto::ProcessUuid);
+                    counterTrack.bytes(Perfetto::TrackName, edge.event->name);
+                    counterTrack.message(Perfetto::CounterTrack, ProtoWriter());
+                    ProtoWriter packet;
+                    packet.message(Perfetto::TrackDescriptorField, counterTrack);
+                    appendPacket(out, packet);
+                }
+                trackUuid = track->second;
+            }
+            appendTrackEvent(out, edge.timestampNs, trackUuid, edge.type, edge.event);
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+void TraceRecorder::setEnabled(bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 TraceRecorder::nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceRecorder::complete(const char *category, const char *name, qint64 startNs, qint64 durationNs)
+{
+    record('X', category, name, startNs, durationNs);
+}
+
+void TraceRecorder::instant(const char *category, const char *name)
+{
+    record('i', category, name, nowNs(), 0);
+}
+
+void TraceRecorder::counter(const char *category, const char *name, qint64 value)
+{
+    record('C', category, name, nowNs(), value);
+}
+
+void TraceRecorder::begin(const char *category, const char *name)
+{
+    record('B', category, name, nowNs(), 0);
+}
+
+void TraceRecorder::end(const char *category, const char *name)
+{
+    record('E', category, name, nowNs(), 0);
+}
+
+void TraceRecorder::record(char phase, const char *category, const char *name, qint64 timestampNs, qint64 value)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    const quint64 index = buffer->written.load(std::memory_order_relaxed);
+    buffer->claimed.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    TraceSlot &slot = buffer->events[index % EventsPerThread];
+    slot.phase.store(phase, std::memory_order_relaxed);
+    slot.category.store(category, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.timestampNs.store(timestampNs, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+bool TraceRecorder::save(const QString &path, qint64 windowMs, QString *error)
+{
+    const std::vector<ThreadTrace> threads = collect(windowMs);
+    const bool perfetto = path.endsWith(QLatin1String(".pftrace")) || path.endsWith(QLatin1String(".perfetto-trace"));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(perfetto ? perfettoTrace(threads) : chromeTrace(threads)) < 0
+        || !file.commit()) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,220 @@
+#include "tripcomputer.h"
+#include <QtGlobal>
+#include <QtNumeric>
+
+TripComputer::TripComputer(const VehicleSignalStore &store, QObject *parent)
+    : QObject(parent)
+    , m_store(store)
+    , m_tankLitres(50.0)
+    , m_trips()
+    , m_fuelRate(0.0)
+    , m_instantConsumption(0.0)
+    , m_rangeConsumption(DefaultConsumption)
+    , m_litresPerUnitHour(DefaultLitresPerUnitHour)
+    , m_filteredFuelPercent(-1.0)
+    , m_anchorFuelPercent(-1.0)
+    , m_unitHoursSinceAnchor(0.0)
+    , m_updateTimer(new QTimer(this))
+{
+    m_updateTimer->setSingleShot(true);
+    m_updateTimer->setInterval(UpdateIntervalMs);
+    connect(m_updateTimer, &QTimer::timeout, this, &TripComputer::updated);
+}
+
+void TripComputer::setTankCapacity(double litres)
+{
+    if (litres > 0.0) {
+        m_tankLitres = litres;
+        markUpdated();
+    }
+}
+
+double TripComputer::tankCapacity() const
+{
+    return m_tankLitres;
+}
+
+QVariantMap TripComputer::tripData(int trip) const
+{
+    if (trip < 0 || trip >= TripCount) {
+        return QVariantMap();
+    }
+    const TripState &state = m_trips[trip];
+    QVariantMap data;
+    data.insert(QStringLiteral("distance"), state.distanceKm);
+    data.insert(QStringLiteral("averageSpeed"),
+                state.drivingSeconds > 0.0 ? state.distanceKm * 3600.0 / state.drivingSeconds : 0.0);
+    data.insert(QStringLiteral("maxSpeed"), state.maxSpeedKmh);
+    data.insert(QStringLiteral("drivingTime"), state.drivingSeconds);
+    data.insert(QStringLiteral("idleTime"), state.idleSeconds);
+    data.insert(QStringLiteral("fuelUsed"), state.fuelLitres);
+    // Over the first hundred metres the average is mostly noise
+    data.insert(QStringLiteral("averageConsumption"),
+                state.distanceKm >= 0.1 ? state.fuelLitres * 100.0 / state.distanceKm : 0.0);
+    return data;
+}
+
+QVariantMap TripComputer::tripA() const { return tripData(TripA); }
+QVariantMap TripComputer::tripB() const { return tripData(TripB); }
+QVariantMap TripComputer::sinceRefuel() const { return tripData(SinceRefuel); }
+
+double TripComputer::instantConsumption() const
+{
+    return m_instantConsumption;
+}
+
+double TripComputer::fuelRate() const
+{
+    return m_fuelRate;
+}
+
+double TripComputer::range() const
+{
+    const double fuelPercent = m_filteredFuelPercent >= 0.0
+                                   ? m_filteredFuelPercent
+                                   : m_store.value(VehicleSignalStore::FuelLevelSignal);
+    return qMax(0.0, fuelPercent) / 100.0 * m_tankLitres * 100.0 / m_rangeConsumption;
+}
+
+void TripComputer::addInterval(qint64 intervalUs, double distanceKm, double speedKmh)
+{
+    const double seconds = static_cast<double>(intervalUs) / 1e6;
+    updateFuelLevel(seconds);
+
+    // Modelled flow: engine speed times load, the load at least what
+    // idling takes
+    const bool running = m_store.value(VehicleSignalStore::EngineRunningSignal) != 0.0;
+    const double throttle = qBound(0.0, m_store.value(VehicleSignalStore::ThrottlePositionSignal), 100.0);
+    const double units = running ? qMax(0.0, m_store.value(VehicleSignalStore::RpmSignal)) / 1000.0
+                                       * (IdleLoad + throttle / 100.0)
+                                 : 0.0;
+    m_unitHoursSinceAnchor += units * seconds / 3600.0;
+    m_fuelRate = units * m_litresPerUnitHour;
+    m_instantConsumption = speedKmh >= MinConsumptionSpeed ? m_fuelRate * 100.0 / speedKmh : 0.0;
+    const double fuelLitres = m_fuelRate * seconds / 3600.0;
+
+    const bool moving = distanceKm > 0.0;
+    for (TripState &trip : m_trips) {
+        trip.distanceKm += distanceKm;
+        trip.fuelLitres += fuelLitres;
+        if (moving) {
+            trip.drivingSeconds += seconds;
+        } else if (running) {
+            trip.idleSeconds += seconds;
+        }
+        trip.maxSpeedKmh = qMax(trip.maxSpeedKmh, speedKmh);
+    }
+
+    // Average weighted by distance over about RangeSmoothingKm; fuel burnt
+    // standing still raises it as if spent on the next kilometres
+    m_rangeConsumption += (fuelLitres * 100.0 - m_rangeConsumption * distanceKm) / RangeSmoothingKm;
+
+    markUpdated();
+}
+
+void TripComputer::saveState(double *state) const
+{
+    int i = 0;
+    state[i++] = StateVersion;
+    for (const TripState &trip : m_trips) {
+        state[i++] = trip.distanceKm;
+        state[i++] = trip.drivingSeconds;
+        state[i++] = trip.idleSeconds;
+        state[i++] = trip.maxSpeedKmh;
+        state[i++] = trip.fuelLitres;
+    }
+    state[i++] = m_litresPerUnitHour;
+    state[i++] = m_rangeConsumption;
+    state[i++] = m_anchorFuelPercent;
+    state[i++] = m_unitHoursSinceAnchor;
+    Q_ASSERT(i == StateValues);
+}
+
+bool TripComputer::restoreState(const double *state, int count)
+{
+    if (count != StateValues || state[0] != StateVersion) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!qIsFinite(state[i])) {
+            return false;
+        }
+    }
+
+    int i = 1;
+    for (TripState &trip : m_trips) {
+        trip.distanceKm = state[i++];
+        trip.drivingSeconds = state[i++];
+        trip.idleSeconds = state[i++];
+        trip.maxSpeedKmh = state[i++];
+        trip.fuelLitres = state[i++];
+    }
+    m_litresPerUnitHour = qBound(DefaultLitresPerUnitHour / 4.0, state[i++], DefaultLitresPerUnitHour * 4.0);
+    const double consumption = state[i++];
+    m_rangeConsumption = consumption > 0.0 ? consumption : DefaultConsumption;
+    // The level the filter starts from next is compared against this, so a
+    // refuel while switched off is still noticed
+    m_anchorFuelPercent = state[i++];
+    m_unitHoursSinceAnchor = qMax(0.0, state[i++]);
+    markUpdated();
+    return true;
+}
+
+void TripComputer::resetTrip(int trip)
+{
+    if (trip < 0 || trip >= TripCount) {
+        return;
+    }
+    m_trips[trip] = TripState();
+    markUpdated();
+    emit tripReset(trip);
+}
+
+void TripComputer::updateFuelLevel(double seconds)
+{
+    if (!m_store.isValid(VehicleSignalStore::FuelLevelSignal)) {
+        return;
+    }
+    const double level = m_store.value(VehicleSignalStore::FuelLevelSignal);
+    if (m_filteredFuelPercent < 0.0) {
+        m_filteredFuelPercent = level;
+    } else {
+        m_filteredFuelPercent += seconds / (FuelFilterSeconds + seconds) * (level - m_filteredFuelPercent);
+    }
+
+    if (m_anchorFuelPercent < 0.0) {
+        m_anchorFuelPercent = m_filteredFuelPercent;
+        m_unitHoursSinceAnchor = 0.0;
+        return;
+    }
+    if (m_filteredFuelPercent >= m_anchorFuelPercent + RefuelPercent) {
+        m_anchorFuelPercent = m_filteredFuelPercent;
+        m_unitHoursSinceAnchor = 0.0;
+        resetTrip(SinceRefuel);
+        return;
+    }
+    // Follows the level up while the filter catches up with a refuel
+    m_anchorFuelPercent = qMax(m_anchorFuelPercent, m_filteredFuelPercent);
+
+    const double usedLitres = (m_anchorFuelPercent - m_filteredFuelPercent) / 100.0 * m_tankLitres;
+    if (usedLitres < CalibrationLitres) {
+        return;
+    }
+    // A drop the model cannot account for at all (a leak, a sender fault)
+    // says nothing about the model; start over from here
+    if (m_unitHoursSinceAnchor * m_litresPerUnitHour >= CalibrationLitres / 4.0) {
+        const double measured = usedLitres / m_unitHoursSinceAnchor;
+        m_litresPerUnitHour = qBound(DefaultLitresPerUnitHour / 4.0,
+                                     m_litresPerUnitHour + CalibrationGain * (measured - m_litresPerUnitHour),
+                                     DefaultLitresPerUnitHour * 4.0);
+    }
+    m_anchorFuelPercent = m_filteredFuelPercent;
+    m_unitHoursSinceAnchor = 0.0;
+}
+
+void TripComputer::markUpdated()
+{
+    if (!m_updateTimer->isActive()) {
+        m_updateTimer->start();
+    }
+}
@@ -1,303 +1,813 @@
 #include "vehicledatacontroller.h"
+#include "cantrafficstats.h"
+#include "notificationscheduler.h"
+#include "signalnotifiers.h"
+#include "tracerecorder.h"
+#include "tripcomputer.h"
+#include "warningruleengine.h"
 #include <QDebug>
+#include <QMetaMethod>
+#include <QStandardPaths>
+#include <QtAlgorithms>
+
+#include <cstring>
+
+#ifdef HAVE_GENERATED_DBC
+#include "vehicledbc.h"
+#endif
 
 VehicleDataController::VehicleDataController(QObject *parent)
     : QObject(parent)
-    , m_speed(0)
-    , m_rpm(0)
-    , m_fuelLevel(100)
-    , m_engineTemperature(70)
-    , m_leftTurnSignal(false)
-    , m_rightTurnSignal(false)
-    , m_headlights(false)
-    , m_parkingBrake(true)
-    , m_gear("P")
-    , m_odometer(12345.6)
-    , m_tripOdometer(0.0)
-    , m_batteryVoltage(12)
-    , m_engineRunning(false)
-    , m_seatbelt(false)
-    , m_doorOpen(false)
-    , m_odometerTimer(new QTimer(this))
-    , m_previousSpeed(0)
-{
-    connect(m_odometerTimer, &QTimer::timeout, this, &VehicleDataController::updateOdometer);
-    m_odometerTimer->start(1000); // Update odometer every second
-}
-
-// Getters
-int VehicleDataController::speed() const { return m_speed; }
-int VehicleDataController::rpm() const { return m_rpm; }
-int VehicleDataController::fuelLevel() const { return m_fuelLevel; }
-int VehicleDataController::engineTemperature() const { return m_engineTemperature; }
-bool VehicleDataController::leftTurnSignal() const { return m_leftTurnSignal; }
-bool VehicleDataController::rightTurnSignal() const { return m_rightTurnSignal; }
-bool VehicleDataController::headlights() const { return m_headlights; }
-bool VehicleDataController::parkingBrake() const { return m_parkingBrake; }
-QString VehicleDataController::gear() const { return m_gear; }
-double VehicleDataController::odometer() const { return m_odometer; }
-int VehicleDataController::batteryVoltage() const { return m_batteryVoltage; }
-bool VehicleDataController::engineRunning() const { return m_engineRunning; }
-bool VehicleDataController::seatbelt() const { return m_seatbelt; }
-bool VehicleDataController::doorOpen() const { return m_doorOpen; }
+    , m_notifier(new NotificationScheduler(m_signals, this))
+    , m_warnings(new WarningRuleEngine(m_signals, this))
+    , m_warningInputs(0)
+    , m_deltaSequence(0)
+    , m_batchStartUs(0)
+    , m_trafficStats(nullptr)
+    , m_propertySubscription(0)
+    , m_warningSubscription(0)
+    , m_historySubscription(0)
+    , m_distanceSubscription(0)
+    , m_tripSubscription(0)
+    , m_framesSeen(0)
+    , m_framesDecoded(0)
+    , m_repeatsSkipped(0)
+    , m_unsubscribedSkipped(0)
+    , m_catchUps(0)
+    , m_signalsDecoded(0)
+    , m_tripComputer(new TripComputer(m_signals, this))
+    , m_lastSpeedUs(0)
+    , m_sourceOffsetUs(0)
+{
+    m_receivedUs.fill(0);
+    m_decodedUs.fill(0);
 
-void VehicleDataController::processCanFrame(quint32 frameId, const QByteArray &data)
+    // Shown until the first frame carrying each signal arrives
+    m_signals.reset(VehicleSignalStore::FuelLevelSignal, 100);
+    m_signals.reset(VehicleSignalStore::EngineTemperatureSignal, 70);
+    m_signals.reset(VehicleSignalStore::ParkingBrakeSignal, 1);
+    m_signals.reset(VehicleSignalStore::OdometerSignal, 12345.6);
+    m_signals.reset(VehicleSignalStore::BatteryVoltageSignal, 12);
+    m_signals.reset(VehicleSignalStore::CabinTemperatureSignal, 20);
+
+    // Below what the gauges and the one-decimal odometer can show
+    m_notifier->setDeadband(VehicleSignalStore::RpmSignal, 10);
+    m_notifier->setDeadband(VehicleSignalStore::OdometerSignal, 0.01);
+    connect(m_notifier, &NotificationScheduler::flushed, this, &VehicleDataController::emitNotifications);
+    connect(m_notifier, &NotificationScheduler::flushCompleted, this, &VehicleDataController::sendStateDelta);
+
+    // What the controller consumes itself; loadWarningRules() adds the
+    // rules' inputs
+    setPropertiesActive(true);
+    setHistorySampleRate(DefaultHistorySampleRate);
+    setSubscription(&m_distanceSubscription,
+                    VehicleSignalStore::signalBit(VehicleSignalStore::SpeedSignal)
+                        | VehicleSignalStore::signalBit(VehicleSignalStore::OdometerSignal)
+                        | VehicleSignalStore::signalBit(VehicleSignalStore::TripOdometerSignal),
+                    DistanceSampleRate);
+    setSubscription(&m_tripSubscription,
+                    VehicleSignalStore::signalBit(VehicleSignalStore::RpmSignal)
+                        | VehicleSignalStore::signalBit(VehicleSignalStore::ThrottlePositionSignal)
+                        | VehicleSignalStore::signalBit(VehicleSignalStore::FuelLevelSignal),
+                    0);
+
+    // Built-in vehicle DBC; fleet variants can swap it at startup via loadDbc()
+    if (!loadDbc(QStringLiteral(":/dbc/vehicle.dbc"))) {
+        qWarning() << "No CAN decode table loaded";
+    }
+
+    connect(m_tripComputer, &TripComputer::tripReset, this, &VehicleDataController::handleTripReset);
+
+    connect(m_warnings, &WarningRuleEngine::warningChanged, this, &VehicleDataController::announceWarning);
+    if (!loadWarningRules(QStringLiteral(":/rules/warnings.rules"))) {
+        qWarning() << "No warning rules loaded";
+    }
+}
+
+// Getters: views onto the signal store
+double VehicleDataController::speed() const { return m_signals.value(VehicleSignalStore::SpeedSignal); }
+double VehicleDataController::rpm() const { return m_signals.value(VehicleSignalStore::RpmSignal); }
+double VehicleDataController::fuelLevel() const { return m_signals.value(VehicleSignalStore::FuelLevelSignal); }
+double VehicleDataController::engineTemperature() const { return m_signals.value(VehicleSignalStore::EngineTemperatureSignal); }
+bool VehicleDataController::leftTurnSignal() const { return m_signals.value(VehicleSignalStore::LeftTurnSignalSignal) != 0.0; }
+bool VehicleDataController::rightTurnSignal() const { return m_signals.value(VehicleSignalStore::RightTurnSignalSignal) != 0.0; }
+bool VehicleDataController::headlights() const { return m_signals.value(VehicleSignalStore::HeadlightsSignal) != 0.0; }
+bool VehicleDataController::parkingBrake() const { return m_signals.value(VehicleSignalStore::ParkingBrakeSignal) != 0.0; }
+QString VehicleDataController::gear() const { return gearName(static_cast<int>(m_signals.value(VehicleSignalStore::GearSignal))); }
+double VehicleDataController::odometer() const { return m_signals.value(VehicleSignalStore::OdometerSignal); }
+double VehicleDataController::batteryVoltage() const { return m_signals.value(VehicleSignalStore::BatteryVoltageSignal); }
+bool VehicleDataController::engineRunning() const { return m_signals.value(VehicleSignalStore::EngineRunningSignal) != 0.0; }
+bool VehicleDataController::seatbelt() const { return m_signals.value(VehicleSignalStore::SeatbeltSignal) != 0.0; }
+bool VehicleDataController::doorOpen() const { return m_signals.value(VehicleSignalStore::DoorOpenSignal) != 0.0; }
+bool VehicleDataController::acOn() const { return m_signals.value(VehicleSignalStore::AcOnSignal) != 0.0; }
+int VehicleDataController::fanSpeed() const { return static_cast<int>(m_signals.value(VehicleSignalStore::FanSpeedSignal)); }
+double VehicleDataController::cabinTemperature() const { return m_signals.value(VehicleSignalStore::CabinTemperatureSignal); }
+
+// GearPosition values as shown on the cluster. Shared, preallocated names:
+// returning one never allocates.
+const QString &VehicleDataController::gearName(int gear)
 {
-    if (data.isEmpty()) {
-        return;
+    static const QString gearNames[] = {
+        QStringLiteral("P"), QStringLiteral("R"), QStringLiteral("N"), QStringLiteral("D"),
+        QStringLiteral("S"),  // Sport mode
+        QStringLiteral("M1"), QStringLiteral("M2"), QStringLiteral("M3"), // Manual 1st-3rd
+        QStringLiteral("M4"), QStringLiteral("M5"), QStringLiteral("M6")  // Manual 4th-6th
+    };
+    static const QString unknownGear = QStringLiteral("?");
+    return gear >= 0 && gear < 11 ? gearNames[gear] : unknownGear;
+}
+
+const VehicleSignalStore &VehicleDataController::signalStore() const
+{
+    return m_signals;
+}
+
+QVariant VehicleDataController::signalValue(const QString &name) const
+{
+    const VehicleSignalStore::SignalId id = VehicleSignalStore::signalId(name.toLatin1().constData());
+    if (id == VehicleSignalStore::SignalCount) {
+        return QVariant();
+    }
+    const VehicleSignalStore::Sample sample = m_signals.sample(id);
+    if (!sample.valid) {
+        return QVariant();
+    }
+    const double value = sample.value;
+    switch (VehicleSignalStore::signalType(id)) {
+    case VehicleSignalStore::BooleanType:
+        return value != 0.0;
+    case VehicleSignalStore::IntegerType:
+        return static_cast<int>(value);
+    case VehicleSignalStore::RealType:
+    default:
+        return value;
     }
+}
 
-    switch (frameId) {
-    case 0x100: // Engine_Data (256 decimal) - Engine speed, load, temperature, fuel
-        if (data.size() >= 8) {
-            // Engine Speed (RPM) - bytes 0-1, scale 0.25
-            int rpm = (static_cast<quint8>(data[0]) | (static_cast<quint8>(data[1]) << 8)) * 0.25;
-            setRpm(rpm);
-            
-            // Engine running state based on RPM
-            bool wasRunning = m_engineRunning;
-            bool running = rpm > 500;
-            if (running != wasRunning) {
-                setEngineRunning(running);
-            }
-            
-            // Engine Coolant Temperature - byte 3, scale 1, offset -40
-            if (data.size() >= 4) {
-                int temp = static_cast<quint8>(data[3]) - 40;
-                setEngineTemperature(temp);
-            }
-            
-            // Fuel Level - byte 7, scale 0.392157 (percent)
-            if (data.size() >= 8) {
-                int fuelLevel = static_cast<quint8>(data[7]) * 0.392157;
-                setFuelLevel(fuelLevel);
-            }
-        }
-        break;
-        
-    case 0x200: // Vehicle_Speed (512 decimal) - Vehicle speed
-        if (data.size() >= 2) {
-            // Vehicle Speed - bytes 0-1, scale 0.1 km/h
-            int speed = (static_cast<quint8>(data[0]) | (static_cast<quint8>(data[1]) << 8)) * 0.1;
-            setSpeed(speed);
-        }
-        break;
-        
-    case 0x400: // Transmission_Data (1024 decimal) - Gear position
-        if (data.size() >= 3) {
-            // Gear Position - lower 4 bits of byte 0
-            int gearValue = static_cast<quint8>(data[0]) & 0x0F;
-            QString gearStr;
-            switch (gearValue) {
-            case 0: gearStr = "P"; break;
-            case 1: gearStr = "R"; break;
-            case 2: gearStr = "N"; break;
-            case 3: gearStr = "D"; break;
-            case 4: gearStr = "S"; break; // Sport mode
-            case 5: gearStr = "M1"; break; // Manual 1st
-            case 6: gearStr = "M2"; break; // Manual 2nd
-            case 7: gearStr = "M3"; break; // Manual 3rd
-            case 8: gearStr = "M4"; break; // Manual 4th
-            case 9: gearStr = "M5"; break; // Manual 5th
-            case 10: gearStr = "M6"; break; // Manual 6th
-            default: gearStr = "?"; break;
-            }
-            setGear(gearStr);
-            
-            // Park status from bit 1 of byte 2
-            if (data.size() >= 3) {
-                quint8 status = static_cast<quint8>(data[2]);
-                setParkingBrake((status >> 1) & 0x01);
-            }
-        }
-        break;
-        
-    case 0x500: // Battery_Status (1280 decimal) - Battery voltage
-        if (data.size() >= 3) {
-            // Battery Voltage - bytes 0-1, scale 0.01 V
-            int voltage = (static_cast<quint8>(data[0]) | (static_cast<quint8>(data[1]) << 8)) * 0.01;
-            setBatteryVoltage(voltage);
+bool VehicleDataController::loadDbc(const QString &path)
+{
+    return loadTable(m_decodeTable, path);
+}
+
+bool VehicleDataController::loadBusDbc(int bus, const QString &path)
+{
+    if (bus < 0 || bus > 255) {
+        qWarning() << "Invalid CAN bus index for DBC:" << bus;
+        return false;
+    }
+    if (bus >= m_busDecodeTables.size()) {
+        m_busDecodeTables.resize(bus + 1);
+    }
+    if (!loadTable(m_busDecodeTables[bus], path)) {
+        return false;
+    }
+    qDebug() << "CAN bus" << bus << "decoded with" << path;
+    return true;
+}
+
+bool VehicleDataController::loadTable(DecodeTable &table, const QString &path)
+{
+    DbcDecoder decoder;
+    if (!decoder.loadFile(path)) {
+        qWarning() << "Failed to load DBC:" << decoder.errorString();
+        return false;
+    }
+
+    table.decoder = decoder;
+    table.loaded = true;
+#ifdef HAVE_GENERATED_DBC
+    table.useGeneratedDecoder = table.decoder.sourceChecksum() == VehicleDbc::SourceChecksum
+                                && table.decoder.signalCount() == VehicleDbc::SignalCount;
+    qDebug() << "DBC decoder:" << (table.useGeneratedDecoder ? "generated" : "runtime table");
+#endif
+    bindSignals(table);
+    updateDecodePlan(table);
+    return true;
+}
+
+void VehicleDataController::setNotificationWindow(QQuickWindow *window)
+{
+    m_notifier->setWindow(window);
+}
+
+bool VehicleDataController::setSignalDeadband(const QString &name, double deadband)
+{
+    const VehicleSignalStore::SignalId id = VehicleSignalStore::signalId(name.toLatin1().constData());
+    if (id == VehicleSignalStore::SignalCount) {
+        return false;
+    }
+    m_notifier->setDeadband(id, deadband);
+    return true;
+}
+
+bool VehicleDataController::setSignalMaxRate(const QString &name, double maxRate)
+{
+    const VehicleSignalStore::SignalId id = VehicleSignalStore::signalId(name.toLatin1().constData());
+    if (id == VehicleSignalStore::SignalCount) {
+        return false;
+    }
+    m_notifier->setMaxRate(id, maxRate);
+    return true;
+}
+
+QVariantMap VehicleDataController::notificationStatistics() const
+{
+    return m_notifier->statistics();
+}
+
+qint64 VehicleDataController::presentationDelayUs() const
+{
+    return m_notifier->presentationDelayUs();
+}
+
+void VehicleDataController::flushNotifications()
+{
+    m_notifier->flush();
+}
+
+VehicleStateDelta VehicleDataController::fullState() const
+{
+    VehicleStateDelta delta;
+    const VehicleSignalStore::Snapshot snapshot = m_signals.snapshot();
+    delta.sequence = m_deltaSequence;
+    delta.signalMask = VehicleSignalStore::AllSignals;
+    delta.validMask = snapshot.validMask;
+    delta.values = snapshot.values;
+    delta.warningsChanged = true;
+    delta.activeWarnings = activeWarnings();
+    return delta;
+}
+
+const SignalHistory &VehicleDataController::signalHistory() const
+{
+    return m_history;
+}
+
+void VehicleDataController::configureHistory(qint64 memoryBytes)
+{
+    m_history.configure(SignalHistory::Config::forMemoryBudget(memoryBytes));
+    qDebug() << "Signal history:" << m_history.config().memoryUsage() / 1024 << "KiB, reaching back"
+             << m_history.config().retentionUs() / 3600000000.0 << "hours";
+}
+
+QVariantList VehicleDataController::signalTrend(const QString &name, double spanSeconds, int columns) const
+{
+    QVariantList result;
+    const VehicleSignalStore::SignalId id = VehicleSignalStore::signalId(name.toLatin1().constData());
+    if (id == VehicleSignalStore::SignalCount || spanSeconds <= 0) {
+        return result;
+    }
+
+    const qint64 nowUs = canMonotonicMicros();
+    const QVector<SignalHistory::Point> points = m_history.trend(id, nowUs - static_cast<qint64>(spanSeconds * 1e6),
+                                                                 nowUs, columns);
+    result.reserve(points.size());
+    for (const SignalHistory::Point &point : points) {
+        QVariantMap entry;
+        entry["time"] = (point.startUs - nowUs) / 1e6;
+        entry["min"] = point.min;
+        entry["max"] = point.max;
+        entry["mean"] = point.mean;
+        entry["count"] = point.count;
+        result.append(entry);
+    }
+    return result;
+}
+
+int VehicleDataController::subscribe(const QStringList &names, double rate)
+{
+    VehicleSignalStore::SignalMask mask = 0;
+    for (const QString &name : names) {
+        const VehicleSignalStore::SignalId id = VehicleSignalStore::signalId(name.toLatin1().constData());
+        if (id == VehicleSignalStore::SignalCount) {
+            qWarning() << "Cannot subscribe to unknown signal" << name;
+            return -1;
         }
-        break;
-        
-    case 0x600: // Warning_Lights (1536 decimal) - Turn signals and indicators
-        if (data.size() >= 2) {
-            quint8 warnings = static_cast<quint8>(data[0]);
-            quint8 signalBits = static_cast<quint8>(data[1]);
-            
-            // Turn signals from byte 1
-            setLeftTurnSignal(signalBits & 0x01);
-            setRightTurnSignal((signalBits >> 1) & 0x01);
-            setHeadlights((signalBits >> 2) & 0x01);
+        mask |= VehicleSignalStore::signalBit(id);
+    }
+    int subscription = 0;
+    setSubscription(&subscription, mask, rate);
+    return subscription;
+}
+
+bool VehicleDataController::unsubscribe(int subscription)
+{
+    // The built-in ones have their own switches
+    if (subscription <= 0 || subscription == m_propertySubscription || subscription == m_warningSubscription
+        || subscription == m_historySubscription || subscription == m_distanceSubscription
+        || subscription == m_tripSubscription || !m_subscriptions.unsubscribe(subscription)) {
+        return false;
+    }
+    updateDecodePlans();
+    return true;
+}
+
+void VehicleDataController::setPropertiesActive(bool active)
+{
+    setSubscription(&m_propertySubscription, active ? VehicleSignalStore::AllSignals : 0, 0);
+}
+
+void VehicleDataController::setHistorySampleRate(double rate)
+{
+    setSubscription(&m_historySubscription, rate > 0 ? VehicleSignalStore::AllSignals : 0, rate);
+}
+
+QVariantMap VehicleDataController::decodeStatistics() const
+{
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("frames"), static_cast<qulonglong>(m_framesSeen));
+    statistics.insert(QStringLiteral("decoded"), static_cast<qulonglong>(m_framesDecoded));
+    statistics.insert(QStringLiteral("repeatsSkipped"), static_cast<qulonglong>(m_repeatsSkipped));
+    statistics.insert(QStringLiteral("unsubscribedSkipped"), static_cast<qulonglong>(m_unsubscribedSkipped));
+    statistics.insert(QStringLiteral("catchUps"), static_cast<qulonglong>(m_catchUps));
+    statistics.insert(QStringLiteral("signalsDecoded"), static_cast<qulonglong>(m_signalsDecoded));
+    statistics.insert(QStringLiteral("subscriptions"), m_subscriptions.count());
+    return statistics;
+}
+
+void VehicleDataController::setSubscription(int *id, VehicleSignalStore::SignalMask signalMask, double rate)
+{
+    if (signalMask == 0) {
+        if (*id > 0) {
+            m_subscriptions.unsubscribe(*id);
+            *id = 0;
         }
-        break;
-        
-    case 0x700: // Door_Status (1792 decimal) - Door and closure status
-        if (data.size() >= 1) {
-            quint8 doorStatus = static_cast<quint8>(data[0]);
-            // Set door open if any door is open
-            bool anyDoorOpen = (doorStatus & 0x0F) != 0; // Check first 4 bits (doors)
-            setDoorOpen(anyDoorOpen);
+    } else if (*id > 0) {
+        m_subscriptions.update(*id, signalMask, rate);
+    } else {
+        *id = m_subscriptions.subscribe(signalMask, rate);
+    }
+    updateDecodePlans();
+}
+
+void VehicleDataController::updateDecodePlans()
+{
+    if (m_decodeTable.loaded) {
+        updateDecodePlan(m_decodeTable);
+    }
+    for (DecodeTable &table : m_busDecodeTables) {
+        if (table.loaded) {
+            updateDecodePlan(table);
         }
-        break;
-        
-    case 0x300: // HVAC_Status (768 decimal) - HVAC and climate control
-        if (data.size() >= 1) {
-            // AC Status, Heater Status, Fan Speed, Temperature settings
-            // For now, just acknowledge the frame to prevent "unknown" errors
-            // Individual HVAC signals can be added later if needed
+    }
+}
+
+void VehicleDataController::updateDecodePlan(DecodeTable &table) const
+{
+    const int messageCount = table.decoder.messageCount();
+    table.wanted.fill(0, table.decoder.signalCount());
+    table.refreshUs.fill(-1, messageCount);
+    // Forgetting the payloads makes the next frame of each message decode
+    // in full, so newly subscribed signals catch up at once
+    MessageState unseen;
+    std::memset(&unseen, 0, sizeof(unseen));
+    table.messages.fill(unseen, messageCount);
+
+    for (int index = 0; index < messageCount; ++index) {
+        const DbcDecoder::MessageDescriptor &message = table.decoder.messageDescriptor(index);
+        qint64 &refreshUs = table.refreshUs[index];
+        for (int signal = message.firstSignal; signal < message.firstSignal + message.signalCount; ++signal) {
+            const quint8 binding = table.bindings.at(signal);
+            const qint64 intervalUs = binding == NoSignal
+                                          ? -1
+                                          : decodeIntervalUs(static_cast<VehicleSignalStore::SignalId>(binding));
+            if (intervalUs >= 0) {
+                table.wanted[signal] = 1;
+                refreshUs = refreshUs < 0 ? intervalUs : qMin(refreshUs, intervalUs);
+            }
         }
-        break;
-        
-    default:
-        qDebug() << "Unknown CAN frame ID:" << Qt::hex << frameId;
-        break;
     }
 }
 
-void VehicleDataController::resetTripOdometer()
+qint64 VehicleDataController::decodeIntervalUs(VehicleSignalStore::SignalId id) const
 {
-    m_tripOdometer = 0.0;
+    // Engine running follows the engine speed, the odometers the speed
+    VehicleSignalStore::SignalMask consumers = VehicleSignalStore::signalBit(id);
+    if (id == VehicleSignalStore::RpmSignal) {
+        consumers |= VehicleSignalStore::signalBit(VehicleSignalStore::EngineRunningSignal);
+    } else if (id == VehicleSignalStore::SpeedSignal) {
+        consumers |= VehicleSignalStore::signalBit(VehicleSignalStore::OdometerSignal)
+                     | VehicleSignalStore::signalBit(VehicleSignalStore::TripOdometerSignal);
+    }
+
+    qint64 intervalUs = -1;
+    for (; consumers; consumers &= consumers - 1) {
+        const VehicleSignalStore::SignalId consumer =
+            static_cast<VehicleSignalStore::SignalId>(qCountTrailingZeroBits(consumers));
+        if (m_subscriptions.isSubscribed(consumer)) {
+            const qint64 consumerUs = m_subscriptions.refreshIntervalUs(consumer);
+            intervalUs = intervalUs < 0 ? consumerUs : qMin(intervalUs, consumerUs);
+        }
+    }
+    return intervalUs;
 }
 
-void VehicleDataController::toggleEngineState()
+bool VehicleDataController::loadWarningRules(const QString &path)
 {
-    if (m_engineRunning) {
-        setRpm(0);
-        setEngineRunning(false);
-    } else {
-        setRpm(800); // Idle RPM
-        setEngineRunning(true);
+    if (!m_warnings->loadFile(path)) {
+        qWarning() << "Failed to load warning rules:" << m_warnings->errorString();
+        return false;
     }
+    setSubscription(&m_warningSubscription, m_warnings->inputMask(), 0);
+    emit activeWarningsChanged();
+    m_delta.warningsChanged = true;
+    m_notifier->requestFrame();
+    return true;
+}
+
+QStringList VehicleDataController::activeWarnings() const
+{
+    return m_warnings->activeRules();
+}
+
+bool VehicleDataController::acknowledgeWarning(const QString &name)
+{
+    return m_warnings->acknowledge(m_warnings->ruleIndex(name));
+}
+
+QVariantList VehicleDataController::warningLog() const
+{
+    return m_warnings->log();
 }
 
-void VehicleDataController::updateOdometer()
+bool VehicleDataController::openOdometerJournal(const QString &path)
 {
-    if (m_speed > 0) {
-        // Convert km/h to km per second, then add to odometer
-        double distanceIncrement = (m_speed / 3600.0); // km/h to km/s
-        m_odometer += distanceIncrement;
-        m_tripOdometer += distanceIncrement;
-        emit odometerChanged(m_odometer);
+    if (!m_odometerJournal.open(path)) {
+        qWarning() << "Odometer journal unavailable:" << m_odometerJournal.errorString();
+        return false;
     }
+    if (!m_odometerJournal.hasState()) {
+        // A new journal starts from the current readings
+        m_odometerJournal.update(odometer(), m_signals.value(VehicleSignalStore::TripOdometerSignal));
+        journalTripState();
+        return true;
+    }
+
+    const QVector<double> tripState = m_odometerJournal.extraValues();
+    if (!m_tripComputer->restoreState(tripState.constData(), tripState.size())) {
+        qWarning() << "Odometer journal holds no trip computer state, trips start from zero";
+    }
+
+    const qint64 nowUs = canMonotonicMicros();
+    m_signals.beginUpdate();
+    updateSignal(VehicleSignalStore::OdometerSignal, m_odometerJournal.odometerKm(), nowUs);
+    updateSignal(VehicleSignalStore::TripOdometerSignal, m_odometerJournal.tripKm(), nowUs);
+    m_signals.endUpdate();
+    evaluateWarnings();
+    publishState();
+    return true;
 }
 
-// Private setters with signal emission and warning checks
-void VehicleDataController::setSpeed(int speed)
+bool VehicleDataController::openStatePublication(const QString &name)
 {
-    if (m_speed != speed) {
-        m_speed = speed;
-        emit speedChanged(m_speed);
+    if (!m_statePublisher.open(name)) {
+        qWarning() << "Vehicle state publication unavailable:" << m_statePublisher.errorString();
+        return false;
     }
+    publishState();
+    return true;
+}
+
+QString VehicleDataController::defaultOdometerJournalPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+           + QStringLiteral("/odometer.journal");
+}
+
+TripComputer *VehicleDataController::tripComputer() const
+{
+    return m_tripComputer;
+}
+
+void VehicleDataController::setTrafficStats(CanTrafficStats *stats)
+{
+    m_trafficStats = stats;
 }
 
-void VehicleDataController::setRpm(int rpm)
+VehicleDataController::DecodeTable &VehicleDataController::tableForBus(quint8 bus)
 {
-    if (m_rpm != rpm) {
-        m_rpm = rpm;
-        emit rpmChanged(m_rpm);
+    if (bus < m_busDecodeTables.size() && m_busDecodeTables.at(bus).loaded) {
+        return m_busDecodeTables[bus];
     }
+    return m_decodeTable;
 }
 
-void VehicleDataController::setFuelLevel(int fuelLevel)
+void VehicleDataController::bindSignals(DecodeTable &table)
 {
-    if (m_fuelLevel != fuelLevel) {
-        m_fuelLevel = fuelLevel;
-        emit fuelLevelChanged(m_fuelLevel);
-        
-        // Low fuel warning
-        if (m_fuelLevel <= 10) {
-            emit lowFuelWarning();
+    static const struct {
+        const char *name;
+        VehicleSignalStore::SignalId signal;
+    } bindings[] = {
+        { "EngineSpeed", VehicleSignalStore::RpmSignal },
+        { "CoolantTemperature", VehicleSignalStore::EngineTemperatureSignal },
+        { "FuelLevel", VehicleSignalStore::FuelLevelSignal },
+        { "VehicleSpeed", VehicleSignalStore::SpeedSignal },
+        { "GearPosition", VehicleSignalStore::GearSignal },
+        { "ParkStatus", VehicleSignalStore::ParkingBrakeSignal },
+        { "BatteryVoltage", VehicleSignalStore::BatteryVoltageSignal },
+        { "LeftTurnSignal", VehicleSignalStore::LeftTurnSignalSignal },
+        { "RightTurnSignal", VehicleSignalStore::RightTurnSignalSignal },
+        { "Headlights", VehicleSignalStore::HeadlightsSignal },
+        { "DoorsOpen", VehicleSignalStore::DoorOpenSignal },
+        { "DriverSeatbelt", VehicleSignalStore::SeatbeltSignal },
+        { "AcStatus", VehicleSignalStore::AcOnSignal },
+        { "FanSpeed", VehicleSignalStore::FanSpeedSignal },
+        { "CabinTemperature", VehicleSignalStore::CabinTemperatureSignal },
+        { "ThrottlePosition", VehicleSignalStore::ThrottlePositionSignal },
+        { "EngineLoad", VehicleSignalStore::EngineLoadSignal },
+    };
+
+    table.bindings.fill(NoSignal, table.decoder.signalCount());
+    for (const auto &entry : bindings) {
+        const int index = table.decoder.signalIndex(QLatin1String(entry.name));
+        if (index >= 0) {
+            table.bindings[index] = entry.signal;
         }
     }
 }
 
-void VehicleDataController::setEngineTemperature(int engineTemperature)
+void VehicleDataController::processCanFrame(quint32 frameId, const QByteArray &data)
+{
+    VEHICLESYS_TRACE_SCOPE("decode", "processCanFrame");
+    m_batchStartUs = canMonotonicMicros();
+    m_signals.beginUpdate();
+    decodeFrame(m_decodeTable, 0, frameId, frameId > 0x7FF, reinterpret_cast<const quint8 *>(data.constData()),
+                data.size(), m_batchStartUs, 0);
+    m_signals.endUpdate();
+    evaluateWarnings();
+    publishState();
+}
+
+void VehicleDataController::processCanFrames(const QVector<CanFrame> &frames)
+{
+    VEHICLESYS_TRACE_SCOPE("decode", "processCanFrames");
+    VEHICLESYS_TRACE_COUNTER("decode", "batch frames", frames.size());
+    // One store update per frame: readers see a frame's signals together
+    // and never wait for more than one frame's decode.
+    const bool singleTable = m_busDecodeTables.isEmpty();
+    m_batchStartUs = canMonotonicMicros();
+    for (const CanFrame &frame : frames) {
+        m_signals.beginUpdate();
+        decodeFrame(singleTable ? m_decodeTable : tableForBus(frame.bus), frame.bus, frame.frameId,
+                    (frame.flags & CanFrame::ExtendedId) != 0, frame.payload, frame.length, frame.timestampUs,
+                    frame.sourceTimeUs() - frame.timestampUs);
+        m_signals.endUpdate();
+    }
+    evaluateWarnings();
+    publishState();
+}
+
+void VehicleDataController::decodeFrame(DecodeTable &table, quint8 bus, quint32 frameId, bool extended,
+                                        const quint8 *data, int size, qint64 timestampUs, qint64 sourceOffsetUs)
 {
-    if (m_engineTemperature != engineTemperature) {
-        m_engineTemperature = engineTemperature;
-        emit engineTemperatureChanged(m_engineTemperature);
-        
-        // Overheat warning
-        if (m_engineTemperature >= 105) {
-            emit engineOverheatWarning();
+    if (size <= 0) {
+        return;
+    }
+
+    const DbcDecoder::MessageDescriptor *message = table.decoder.findMessage(frameId, extended);
+    if (!message) {
+        if (m_trafficStats) {
+            m_trafficStats->markUnknown(bus, frameId, extended);
         }
+        return;
+    }
+    ++m_framesSeen;
+    const int index = table.decoder.messageIndex(*message);
+    const qint64 refreshUs = table.refreshUs.at(index);
+    if (refreshUs < 0) {
+        ++m_unsubscribedSkipped;
+        return;
+    }
+
+    // Periodic frames mostly repeat themselves. A repeat is decoded once,
+    // so estimates see the value settle, and then only as often as its
+    // subscribers want a refresh.
+    MessageState &state = table.messages[index];
+    const int length = qMin(size, int(CanFrame::MaxPayloadSize));
+    const bool repeated = state.length == length && state.bus == bus
+                          && std::memcmp(state.payload, data, static_cast<std::size_t>(length)) == 0;
+    if (repeated) {
+        if (!state.changed && timestampUs - state.decodedUs < refreshUs) {
+            state.repeatUs = timestampUs;
+            state.repeatSourceOffsetUs = sourceOffsetUs;
+            ++m_repeatsSkipped;
+            return;
+        }
+    } else if (state.repeatUs > state.decodedUs) {
+        // The previous payload held until its last repeat; sample it there
+        // first so interpolation and distance see where it ended
+        m_sourceOffsetUs = state.repeatSourceOffsetUs;
+        decodeSignals(table, *message, state.payload, state.length, state.repeatUs);
+        ++m_catchUps;
+    }
+
+    m_sourceOffsetUs = sourceOffsetUs;
+    decodeSignals(table, *message, data, length, timestampUs);
+    ++m_framesDecoded;
+    state.decodedUs = timestampUs;
+    state.repeatUs = 0;
+    state.bus = bus;
+    state.length = static_cast<quint8>(length);
+    state.changed = !repeated;
+    if (!repeated) {
+        std::memcpy(state.payload, data, static_cast<std::size_t>(length));
     }
 }
 
-void VehicleDataController::setLeftTurnSignal(bool leftTurnSignal)
+void VehicleDataController::decodeSignals(const DecodeTable &table, const DbcDecoder::MessageDescriptor &message,
+                                          const quint8 *data, int size, qint64 timestampUs)
 {
-    if (m_leftTurnSignal != leftTurnSignal) {
-        m_leftTurnSignal = leftTurnSignal;
-        emit leftTurnSignalChanged(m_leftTurnSignal);
+    const quint8 *bindings = table.bindings.constData();
+    const auto onSignal = [this, bindings, timestampUs](int signalIndex, double value) {
+        applySignal(bindings[signalIndex], value, timestampUs);
+        ++m_signalsDecoded;
+    };
+
+#ifdef HAVE_GENERATED_DBC
+    if (table.useGeneratedDecoder) {
+        VehicleDbc::decode(message.extended ? message.frameId | DbcDecoder::ExtendedIdFlag : message.frameId, data,
+                           size, onSignal, table.wanted.constData());
+        return;
     }
+#endif
+
+    table.decoder.decode(message, data, size, onSignal, table.wanted.constData());
 }
 
-void VehicleDataController::setRightTurnSignal(bool rightTurnSignal)
+void VehicleDataController::applySignal(quint8 binding, double value, qint64 timestampUs)
 {
-    if (m_rightTurnSignal != rightTurnSignal) {
-        m_rightTurnSignal = rightTurnSignal;
-        emit rightTurnSignalChanged(m_rightTurnSignal);
+    if (binding == NoSignal) {
+        return;
+    }
+    const VehicleSignalStore::SignalId id = static_cast<VehicleSignalStore::SignalId>(binding);
+
+    // Real signals keep full precision; enumerations such as the gear are
+    // whole numbers.
+    switch (VehicleSignalStore::signalType(id)) {
+    case VehicleSignalStore::BooleanType:
+        value = value != 0.0 ? 1.0 : 0.0;
+        break;
+    case VehicleSignalStore::IntegerType:
+        value = static_cast<int>(value);
+        break;
+    case VehicleSignalStore::RealType:
+        break;
+    }
+    if (id == VehicleSignalStore::SpeedSignal) {
+        integrateDistance(value, timestampUs);
+    }
+    updateSignal(id, value, timestampUs);
+
+    if (id == VehicleSignalStore::RpmSignal) {
+        // Engine running state based on RPM
+        updateSignal(VehicleSignalStore::EngineRunningSignal, value > 500 ? 1.0 : 0.0, timestampUs);
     }
 }
 
-void VehicleDataController::setHeadlights(bool headlights)
+void VehicleDataController::resetTripOdometer()
 {
-    if (m_headlights != headlights) {
-        m_headlights = headlights;
-        emit headlightsChanged(m_headlights);
+    m_tripComputer->resetTrip(TripComputer::TripA);
+}
+
+void VehicleDataController::toggleEngineState()
+{
+    const qint64 nowUs = canMonotonicMicros();
+    const bool running = !engineRunning();
+    m_signals.beginUpdate();
+    updateSignal(VehicleSignalStore::RpmSignal, running ? 800 : 0, nowUs); // Idle RPM when starting
+    updateSignal(VehicleSignalStore::EngineRunningSignal, running ? 1.0 : 0.0, nowUs);
+    m_signals.endUpdate();
+    evaluateWarnings();
+    publishState();
+}
+
+void VehicleDataController::integrateDistance(double speedKmh, qint64 timestampUs)
+{
+    // Over the time the vehicle drove it, which a fast replay compresses
+    const qint64 sourceUs = timestampUs + m_sourceOffsetUs;
+    const qint64 intervalUs = sourceUs - m_lastSpeedUs;
+    const bool continuous = m_lastSpeedUs > 0 && m_signals.isValid(VehicleSignalStore::SpeedSignal)
+                            && intervalUs > 0 && intervalUs <= MaxSpeedGapUs;
+    m_lastSpeedUs = qMax(m_lastSpeedUs, sourceUs);
+    if (!continuous) {
+        return;
+    }
+
+    // Trapezoid between the previous sample and this one, km/h over µs
+    const double distanceKm = qMax(0.0, (m_signals.value(VehicleSignalStore::SpeedSignal) + speedKmh) / 2.0
+                                            * static_cast<double>(intervalUs) / 3.6e9);
+    // Standing still counts too, as idle time
+    m_tripComputer->addInterval(intervalUs, distanceKm, speedKmh);
+    if (distanceKm > 0.0) {
+        const double odometerKm = odometer() + distanceKm;
+        const double tripKm = m_signals.value(VehicleSignalStore::TripOdometerSignal) + distanceKm;
+        updateSignal(VehicleSignalStore::OdometerSignal, odometerKm, timestampUs);
+        updateSignal(VehicleSignalStore::TripOdometerSignal, tripKm, timestampUs);
+        m_odometerJournal.update(odometerKm, tripKm);
     }
+    journalTripState();
+}
+
+void VehicleDataController::journalTripState()
+{
+    double state[TripComputer::StateValues];
+    m_tripComputer->saveState(state);
+    m_odometerJournal.updateExtra(state, TripComputer::StateValues);
 }
 
-void VehicleDataController::setParkingBrake(bool parkingBrake)
+void VehicleDataController::handleTripReset(int trip)
 {
-    if (m_parkingBrake != parkingBrake) {
-        m_parkingBrake = parkingBrake;
-        emit parkingBrakeChanged(m_parkingBrake);
+    if (trip == TripComputer::TripA) {
+        m_signals.beginUpdate();
+        updateSignal(VehicleSignalStore::TripOdometerSignal, 0.0, canMonotonicMicros());
+        m_signals.endUpdate();
+        evaluateWarnings();
+        publishState();
+        m_odometerJournal.update(odometer(), 0.0);
     }
+    journalTripState();
+    m_odometerJournal.requestCommit();
 }
 
-void VehicleDataController::setGear(const QString &gear)
+void VehicleDataController::updateSignal(VehicleSignalStore::SignalId id, double value, qint64 timestampUs)
 {
-    if (m_gear != gear) {
-        m_gear = gear;
-        emit gearChanged(m_gear);
+    m_history.append(id, value, timestampUs);
+    if (m_signals.set(id, value, timestampUs)) {
+        // Values set outside a decode batch count as decoded when set
+        m_receivedUs[id] = timestampUs;
+        m_decodedUs[id] = qMax(m_batchStartUs, timestampUs);
+        m_notifier->markChanged(id);
+        m_warningInputs |= VehicleSignalStore::signalBit(id);
     }
 }
 
-void VehicleDataController::setBatteryVoltage(int batteryVoltage)
+void VehicleDataController::evaluateWarnings()
 {
-    if (m_batteryVoltage != batteryVoltage) {
-        m_batteryVoltage = batteryVoltage;
-        emit batteryVoltageChanged(m_batteryVoltage);
-        
-        // Low battery warning
-        if (m_batteryVoltage <= 11) {
-            emit batteryLowWarning();
-        }
+    if (m_warningInputs) {
+        m_warnings->evaluate(m_warningInputs);
+        m_warningInputs = 0;
     }
 }
 
-void VehicleDataController::setEngineRunning(bool engineRunning)
+void VehicleDataController::publishState()
 {
-    if (m_engineRunning != engineRunning) {
-        m_engineRunning = engineRunning;
-        emit engineRunningChanged(m_engineRunning);
+    if (m_statePublisher.isOpen()) {
+        m_statePublisher.publish(m_signals.snapshot());
     }
 }
 
-void VehicleDataController::setSeatbelt(bool seatbelt)
+void VehicleDataController::announceWarning(int rule, bool active)
 {
-    if (m_seatbelt != seatbelt) {
-        m_seatbelt = seatbelt;
-        emit seatbeltChanged(m_seatbelt);
+    emit activeWarningsChanged();
+    m_delta.warningsChanged = true;
+    m_notifier->requestFrame();
+    if (!active) {
+        return;
+    }
+    const QString name = m_warnings->ruleName(rule);
+    m_delta.raisedWarnings.append(name);
+    if (name == QLatin1String("lowFuel")) {
+        emit lowFuelWarning();
+    } else if (name == QLatin1String("engineOverheat")) {
+        emit engineOverheatWarning();
+    } else if (name == QLatin1String("batteryLow")) {
+        emit batteryLowWarning();
     }
 }
 
-void VehicleDataController::setDoorOpen(bool doorOpen)
+void VehicleDataController::sendStateDelta()
 {
-    if (m_doorOpen != doorOpen) {
-        m_doorOpen = doorOpen;
-        emit doorOpenChanged(m_doorOpen);
+    VEHICLESYS_TRACE_SCOPE("notify", "sendStateDelta");
+    static const QMetaMethod stateChangedSignal = QMetaMethod::fromSignal(&VehicleDataController::stateChanged);
+    if (!m_delta.signalMask && !m_delta.warningsChanged) {
+        return;
     }
-}
\ No newline at end of file
+    if (isSignalConnected(stateChangedSignal)) {
+        for (VehicleSignalStore::SignalMask mask = m_delta.signalMask; mask; mask &= mask - 1) {
+            const VehicleSignalStore::SignalId id =
+                static_cast<VehicleSignalStore::SignalId>(qCountTrailingZeroBits(mask));
+            m_delta.values[id] = m_signals.value(id);
+            m_delta.receivedUs[id] = m_receivedUs[id];
+            m_delta.decodedUs[id] = m_decodedUs[id];
+            if (m_signals.isValid(id)) {
+                m_delta.validMask |= VehicleSignalStore::signalBit(id);
+            }
+        }
+        if (m_delta.warningsChanged) {
+            m_delta.activeWarnings = activeWarnings();
+        }
+        m_delta.sequence = ++m_deltaSequence;
+        m_delta.sentUs = canMonotonicMicros();
+        emit stateChanged(m_delta);
+    }
+    m_delta = VehicleStateDelta();
+}
+
+// Emits the property notifications for a flush of the notification
+// scheduler, in SignalId order.
+void VehicleDataController::emitNotifications(VehicleSignalStore::SignalMask signalMask)
+{
+    static const SignalNotifiers notifiers(staticMetaObject);
+    m_delta.signalMask |= signalMask;
+    notifiers.notify(this, signalMask, "notify");
+}
@@ -0,0 +1,280 @@
+#include "vehicledataproxy.h"
+#include "canframe.h"
+#include "latencytracer.h"
+#include "signalnotifiers.h"
+#include "tracerecorder.h"
+#include "vehicledatacontroller.h"
+#include <QDebug>
+#include <QQuickWindow>
+#include <QThread>
+#include <QtAlgorithms>
+
+VehicleDataProxy::VehicleDataProxy(VehicleDataController *controller, QObject *parent)
+    : QObject(parent)
+    , m_controller(controller)
+    , m_store(controller->signalStore())
+    , m_latencyTracer(new LatencyTracer(this))
+    , m_sequence(0)
+    , m_presentationTimeUs(0)
+    , m_estimatesMoving(false)
+    , m_deltas(0)
+    , m_notifications(0)
+    , m_maxApplyUs(0)
+{
+    qRegisterMetaType<VehicleStateDelta>();
+    m_values.fill(0.0);
+    m_frameSnapshot = m_store.snapshot();
+
+    // Connected before the state is taken, so no delta falls in between;
+    // those sent before it are skipped
+    connect(controller, &VehicleDataController::stateChanged, this, &VehicleDataProxy::applyDelta);
+    VehicleStateDelta state;
+    callController([&]() { state = m_controller->fullState(); });
+    m_values = state.values;
+    m_activeWarnings = state.activeWarnings;
+    m_sequence = state.sequence;
+}
+
+// Getters: the values last delivered
+double VehicleDataProxy::speed() const { return value(VehicleSignalStore::SpeedSignal); }
+double VehicleDataProxy::rpm() const { return value(VehicleSignalStore::RpmSignal); }
+double VehicleDataProxy::fuelLevel() const { return value(VehicleSignalStore::FuelLevelSignal); }
+double VehicleDataProxy::engineTemperature() const { return value(VehicleSignalStore::EngineTemperatureSignal); }
+bool VehicleDataProxy::leftTurnSignal() const { return value(VehicleSignalStore::LeftTurnSignalSignal) != 0.0; }
+bool VehicleDataProxy::rightTurnSignal() const { return value(VehicleSignalStore::RightTurnSignalSignal) != 0.0; }
+bool VehicleDataProxy::headlights() const { return value(VehicleSignalStore::HeadlightsSignal) != 0.0; }
+bool VehicleDataProxy::parkingBrake() const { return value(VehicleSignalStore::ParkingBrakeSignal) != 0.0; }
+QString VehicleDataProxy::gear() const { return VehicleDataController::gearName(static_cast<int>(value(VehicleSignalStore::GearSignal))); }
+double VehicleDataProxy::odometer() const { return value(VehicleSignalStore::OdometerSignal); }
+double VehicleDataProxy::batteryVoltage() const { return value(VehicleSignalStore::BatteryVoltageSignal); }
+bool VehicleDataProxy::engineRunning() const { return value(VehicleSignalStore::EngineRunningSignal) != 0.0; }
+bool VehicleDataProxy::seatbelt() const { return value(VehicleSignalStore::SeatbeltSignal) != 0.0; }
+bool VehicleDataProxy::doorOpen() const { return value(VehicleSignalStore::DoorOpenSignal) != 0.0; }
+bool VehicleDataProxy::acOn() const { return value(VehicleSignalStore::AcOnSignal) != 0.0; }
+int VehicleDataProxy::fanSpeed() const { return static_cast<int>(value(VehicleSignalStore::FanSpeedSignal)); }
+double VehicleDataProxy::cabinTemperature() const { return value(VehicleSignalStore::CabinTemperatureSignal); }
+
+QStringList VehicleDataProxy::activeWarnings() const
+{
+    return m_activeWarnings;
+}
+
+template<typename Call>
+void VehicleDataProxy::callController(Call call) const
+{
+    QMetaObject::invokeMethod(m_controller, call,
+                              m_controller->thread() == QThread::currentThread() ? Qt::DirectConnection
+                                                                                  : Qt::BlockingQueuedConnection);
+}
+
+void VehicleDataProxy::setWindow(QQuickWindow *window)
+{
+    disconnect(m_frameConnection);
+    m_window = window;
+    m_latencyTracer->setWindow(window);
+    if (window) {
+        m_frameConnection = connect(window, &QQuickWindow::afterAnimating, this, &VehicleDataProxy::startFrame);
+    }
+}
+
+QVariant VehicleDataProxy::signalValue(const QString &name) const
+{
+    return m_controller->signalValue(name);
+}
+
+QVariantList VehicleDataProxy::signalTrend(const QString &name, double spanSeconds, int columns) const
+{
+    return m_controller->signalTrend(name, spanSeconds, columns);
+}
+
+double VehicleDataProxy::signalEstimate(const QString &name) const
+{
+    const VehicleSignalStore::SignalId id = VehicleSignalStore::signalId(name.toLatin1().constData());
+    if (id == VehicleSignalStore::SignalCount) {
+        return 0.0;
+    }
+    if (m_presentationTimeUs == 0) {
+        return m_store.estimate(id, canMonotonicMicros());
+    }
+    return m_frameSnapshot.estimate(id, m_presentationTimeUs);
+}
+
+QVariantMap VehicleDataProxy::notificationStatistics() const
+{
+    QVariantMap statistics;
+    callController([&]() { statistics = m_controller->notificationStatistics(); });
+    return statistics;
+}
+
+QVariantMap VehicleDataProxy::decodeStatistics() const
+{
+    QVariantMap statistics;
+    callController([&]() { statistics = m_controller->decodeStatistics(); });
+    return statistics;
+}
+
+QVariantList VehicleDataProxy::warningLog() const
+{
+    QVariantList log;
+    callController([&]() { log = m_controller->warningLog(); });
+    return log;
+}
+
+int VehicleDataProxy::subscribe(const QStringList &names, double rate)
+{
+    int subscription = -1;
+    callController([&]() { subscription = m_controller->subscribe(names, rate); });
+    return subscription;
+}
+
+bool VehicleDataProxy::unsubscribe(int subscription)
+{
+    bool unsubscribed = false;
+    callController([&]() { unsubscribed = m_controller->unsubscribe(subscription); });
+    return unsubscribed;
+}
+
+bool VehicleDataProxy::setSignalDeadband(const QString &name, double deadband)
+{
+    if (VehicleSignalStore::signalId(name.toLatin1().constData()) == VehicleSignalStore::SignalCount) {
+        return false;
+    }
+    VehicleDataController *controller = m_controller;
+    QMetaObject::invokeMethod(controller, [controller, name, deadband]() {
+        controller->setSignalDeadband(name, deadband);
+    });
+    return true;
+}
+
+bool VehicleDataProxy::setSignalMaxRate(const QString &name, double maxRate)
+{
+    if (VehicleSignalStore::signalId(name.toLatin1().constData()) == VehicleSignalStore::SignalCount) {
+        return false;
+    }
+    VehicleDataController *controller = m_controller;
+    QMetaObject::invokeMethod(controller, [controller, name, maxRate]() {
+        controller->setSignalMaxRate(name, maxRate);
+    });
+    return true;
+}
+
+bool VehicleDataProxy::acknowledgeWarning(const QString &name)
+{
+    // Only an active warning can be latched
+    if (!m_activeWarnings.contains(name)) {
+        return false;
+    }
+    VehicleDataController *controller = m_controller;
+    QMetaObject::invokeMethod(controller, [controller, name]() { controller->acknowledgeWarning(name); });
+    return true;
+}
+
+void VehicleDataProxy::setPropertiesActive(bool active)
+{
+    VehicleDataController *controller = m_controller;
+    QMetaObject::invokeMethod(controller, [controller, active]() { controller->setPropertiesActive(active); });
+}
+
+void VehicleDataProxy::resetTripOdometer()
+{
+    QMetaObject::invokeMethod(m_controller, &VehicleDataController::resetTripOdometer);
+}
+
+void VehicleDataProxy::toggleEngineState()
+{
+    QMetaObject::invokeMethod(m_controller, &VehicleDataController::toggleEngineState);
+}
+
+QVariantMap VehicleDataProxy::proxyStatistics() const
+{
+    QVariantMap statistics;
+    statistics.insert(QStringLiteral("deltas"), static_cast<qulonglong>(m_deltas));
+    statistics.insert(QStringLiteral("notifications"), static_cast<qulonglong>(m_notifications));
+    statistics.insert(QStringLiteral("maxApplyUs"), m_maxApplyUs);
+    return statistics;
+}
+
+QVariantMap VehicleDataProxy::latencyStatistics() const
+{
+    return m_latencyTracer->statistics();
+}
+
+bool VehicleDataProxy::dumpLatency(const QString &path) const
+{
+    QString error;
+    if (!m_latencyTracer->dump(path, &error)) {
+        qWarning() << "Cannot write latency trace" << path << ":" << error;
+        return false;
+    }
+    return true;
+}
+
+void VehicleDataProxy::resetLatency()
+{
+    m_latencyTracer->reset();
+}
+
+void VehicleDataProxy::applyDelta(const VehicleStateDelta &delta)
+{
+    VEHICLESYS_TRACE_SCOPE("qml", "applyDelta");
+    static const SignalNotifiers notifiers(staticMetaObject);
+    if (delta.sequence <= m_sequence) {
+        return;
+    }
+    m_sequence = delta.sequence;
+    const qint64 startUs = canMonotonicMicros();
+    ++m_deltas;
+
+    // Every value first, so a binding reading several sees them together
+    for (VehicleSignalStore::SignalMask mask = delta.signalMask; mask; mask &= mask - 1) {
+        const int id = qCountTrailingZeroBits(mask);
+        m_values[id] = delta.values[id];
+    }
+
+    m_notifications += qPopulationCount(delta.signalMask);
+    notifiers.notify(this, delta.signalMask, "qml");
+
+    if (delta.warningsChanged) {
+        m_activeWarnings = delta.activeWarnings;
+        emit activeWarningsChanged();
+        for (const QString &name : delta.raisedWarnings) {
+            if (name == QLatin1String("lowFuel")) {
+                emit lowFuelWarning();
+            } else if (name == QLatin1String("engineOverheat")) {
+                emit engineOverheatWarning();
+            } else if (name == QLatin1String("batteryLow")) {
+                emit batteryLowWarning();
+            }
+        }
+    }
+
+    // Bindings have run with the NOTIFY signals above
+    const qint64 boundUs = canMonotonicMicros();
+    for (VehicleSignalStore::SignalMask mask = delta.signalMask; mask; mask &= mask - 1) {
+        const VehicleSignalStore::SignalId id = static_cast<VehicleSignalStore::SignalId>(qCountTrailingZeroBits(mask));
+        m_latencyTracer->recordBound(id, delta.receivedUs[id], delta.decodedUs[id], delta.sentUs, boundUs);
+    }
+
+    m_maxApplyUs = qMax(m_maxApplyUs, boundUs - startUs);
+}
+
+void VehicleDataProxy::startFrame()
+{
+    m_frameSnapshot = m_store.snapshot();
+    m_presentationTimeUs = canMonotonicMicros() + m_controller->presentationDelayUs();
+
+    bool moving = false;
+    for (int id = 0; id < VehicleSignalStore::SignalCount && !moving; ++id) {
+        const VehicleSignalStore::SignalId signal = static_cast<VehicleSignalStore::SignalId>(id);
+        moving = VehicleSignalStore::signalType(signal) == VehicleSignalStore::RealType
+                 && m_frameSnapshot.isExtrapolating(signal, m_presentationTimeUs);
+    }
+    // One more update once movement stops, so gauges settle on the held value
+    if (moving || m_estimatesMoving) {
+        emit estimatesChanged();
+    }
+    m_estimatesMoving = moving;
+    if (moving && m_window) {
+        m_window->update();
+    }
+}
@@ -0,0 +1,209 @@
+#include "vehiclesignalstore.h"
+
+#include <cstring>
+#include <thread>
+
+namespace {
+const struct {
+    const char *name;
+    VehicleSignalStore::SignalType type;
+} signalInfo[VehicleSignalStore::SignalCount] = {
+    { "speed", VehicleSignalStore::RealType },
+    { "rpm", VehicleSignalStore::RealType },
+    { "fuelLevel", VehicleSignalStore::RealType },
+    { "engineTemperature", VehicleSignalStore::RealType },
+    { "leftTurnSignal", VehicleSignalStore::BooleanType },
+    { "rightTurnSignal", VehicleSignalStore::BooleanType },
+    { "headlights", VehicleSignalStore::BooleanType },
+    { "parkingBrake", VehicleSignalStore::BooleanType },
+    { "gear", VehicleSignalStore::IntegerType },
+    { "odometer", VehicleSignalStore::RealType },
+    { "batteryVoltage", VehicleSignalStore::RealType },
+    { "engineRunning", VehicleSignalStore::BooleanType },
+    { "seatbelt", VehicleSignalStore::BooleanType },
+    { "doorOpen", VehicleSignalStore::BooleanType },
+    { "acOn", VehicleSignalStore::BooleanType },
+    { "fanSpeed", VehicleSignalStore::IntegerType },
+    { "cabinTemperature", VehicleSignalStore::RealType },
+    { "tripOdometer", VehicleSignalStore::RealType },
+    { "throttlePosition", VehicleSignalStore::RealType },
+    { "engineLoad", VehicleSignalStore::RealType },
+};
+}
+
+VehicleSignalStore::VehicleSignalStore()
+    : m_version(0)
+    , m_updateSequence(0)
+{
+    for (int id = 0; id < SignalCount; ++id) {
+        m_values[id].store(0.0, std::memory_order_relaxed);
+        m_timestampsUs[id].store(0, std::memory_order_relaxed);
+        m_sequences[id].store(0, std::memory_order_relaxed);
+        m_valid[id].store(false, std::memory_order_relaxed);
+        m_previousValues[id].store(0.0, std::memory_order_relaxed);
+        m_previousTimestampsUs[id].store(0, std::memory_order_relaxed);
+    }
+}
+
+const char *VehicleSignalStore::signalName(SignalId id)
+{
+    return id < SignalCount ? signalInfo[id].name : "";
+}
+
+VehicleSignalStore::SignalType VehicleSignalStore::signalType(SignalId id)
+{
+    return id < SignalCount ? signalInfo[id].type : RealType;
+}
+
+VehicleSignalStore::SignalId VehicleSignalStore::signalId(const char *name)
+{
+    for (int id = 0; id < SignalCount; ++id) {
+        if (std::strcmp(signalInfo[id].name, name) == 0) {
+            return static_cast<SignalId>(id);
+        }
+    }
+    return SignalCount;
+}
+
+void VehicleSignalStore::beginUpdate()
+{
+    const quint64 version = m_version.load(std::memory_order_relaxed);
+    m_version.store(version + 1, std::memory_order_relaxed);
+    // Readers that see any of the stores below also see the odd version.
+    std::atomic_thread_fence(std::memory_order_release);
+    m_updateSequence = version / 2 + 1;
+}
+
+bool VehicleSignalStore::set(SignalId id, double value, qint64 timestampUs)
+{
+    const double current = m_values[id].load(std::memory_order_relaxed);
+    const bool valid = m_valid[id].load(std::memory_order_relaxed);
+    // An invalid value is no sample to interpolate from.
+    m_previousValues[id].store(valid ? current : value, std::memory_order_relaxed);
+    m_previousTimestampsUs[id].store(valid ? m_timestampsUs[id].load(std::memory_order_relaxed) : 0,
+                                     std::memory_order_relaxed);
+    m_timestampsUs[id].store(timestampUs, std::memory_order_relaxed);
+    if (current == value && valid) {
+        return false;
+    }
+    m_values[id].store(value, std::memory_order_relaxed);
+    m_valid[id].store(true, std::memory_order_relaxed);
+    m_sequences[id].store(m_updateSequence, std::memory_order_relaxed);
+    return true;
+}
+
+bool VehicleSignalStore::invalidate(SignalId id, qint64 timestampUs)
+{
+    m_timestampsUs[id].store(timestampUs, std::memory_order_relaxed);
+    if (!m_valid[id].load(std::memory_order_relaxed)) {
+        return false;
+    }
+    m_valid[id].store(false, std::memory_order_relaxed);
+    m_sequences[id].store(m_updateSequence, std::memory_order_relaxed);
+    return true;
+}
+
+void VehicleSignalStore::endUpdate()
+{
+    m_version.store(m_updateSequence * 2, std::memory_order_release);
+}
+
+void VehicleSignalStore::reset(SignalId id, double value)
+{
+    m_values[id].store(value, std::memory_order_relaxed);
+    m_timestampsUs[id].store(0, std::memory_order_relaxed);
+    m_sequences[id].store(0, std::memory_order_relaxed);
+    m_valid[id].store(false, std::memory_order_relaxed);
+    m_previousValues[id].store(value, std::memory_order_relaxed);
+    m_previousTimestampsUs[id].store(0, std::memory_order_relaxed);
+}
+
+quint64 VehicleSignalStore::sequence() const
+{
+    return m_version.load(std::memory_order_acquire) / 2;
+}
+
+template<typename Read>
+void VehicleSignalStore::readConsistent(Read read) const
+{
+    for (;;) {
+        const quint64 version = m_version.load(std::memory_order_acquire);
+        if (version & 1) {
+            // The writer holds updates to one frame's worth of signals,
+            // so it is done long before a yield returns.
+            std::this_thread::yield();
+            continue;
+        }
+        read(version / 2);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_version.load(std::memory_order_relaxed) == version) {
+            return;
+        }
+    }
+}
+
+VehicleSignalStore::Sample VehicleSignalStore::sample(SignalId id) const
+{
+    Sample sample;
+    readConsistent([this, id, &sample](quint64) {
+        sample.value = m_values[id].load(std::memory_order_relaxed);
+        sample.timestampUs = m_timestampsUs[id].load(std::memory_order_relaxed);
+        sample.sequence = m_sequences[id].load(std::memory_order_relaxed);
+        sample.valid = m_valid[id].load(std::memory_order_relaxed);
+    });
+    return sample;
+}
+
+VehicleSignalStore::Snapshot VehicleSignalStore::snapshot() const
+{
+    Snapshot snapshot;
+    readConsistent([this, &snapshot](quint64 sequence) {
+        snapshot.sequence = sequence;
+        snapshot.validMask = 0;
+        for (int id = 0; id < SignalCount; ++id) {
+            snapshot.values[id] = m_values[id].load(std::memory_order_relaxed);
+            snapshot.timestampsUs[id] = m_timestampsUs[id].load(std::memory_order_relaxed);
+            snapshot.sequences[id] = m_sequences[id].load(std::memory_order_relaxed);
+            snapshot.previousValues[id] = m_previousValues[id].load(std::memory_order_relaxed);
+            snapshot.previousTimestampsUs[id] = m_previousTimestampsUs[id].load(std::memory_order_relaxed);
+            if (m_valid[id].load(std::memory_order_relaxed)) {
+                snapshot.validMask |= signalBit(static_cast<SignalId>(id));
+            }
+        }
+    });
+    return snapshot;
+}
+
+double VehicleSignalStore::estimate(SignalId id, qint64 timeUs) const
+{
+    double previousValue = 0;
+    qint64 previousTimestampUs = 0;
+    double value = 0;
+    qint64 timestampUs = 0;
+    readConsistent([&](quint64) {
+        previousValue = m_previousValues[id].load(std::memory_order_relaxed);
+        previousTimestampUs = m_previousTimestampsUs[id].load(std::memory_order_relaxed);
+        value = m_values[id].load(std::memory_order_relaxed);
+        timestampUs = m_timestampsUs[id].load(std::memory_order_relaxed);
+    });
+    return estimate(previousValue, previousTimestampUs, value, timestampUs, timeUs);
+}
+
+bool VehicleSignalStore::isExtrapolating(SignalId id, qint64 timeUs) const
+{
+    const qint64 timestampUs = m_timestampsUs[id].load(std::memory_order_relaxed);
+    const qint64 intervalUs = timestampUs - m_previousTimestampsUs[id].load(std::memory_order_relaxed);
+    return m_values[id].load(std::memory_order_relaxed) != m_previousValues[id].load(std::memory_order_relaxed)
+           && timeUs < timestampUs + qMin(intervalUs, MaxExtrapolationUs);
+}
+
+double VehicleSignalStore::estimate(double previousValue, qint64 previousTimestampUs, double value, qint64 timestampUs,
+                                    qint64 timeUs)
+{
+    if (previousTimestampUs <= 0 || timestampUs <= previousTimestampUs || timeUs <= previousTimestampUs) {
+        return timeUs <= previousTimestampUs ? previousValue : value;
+    }
+    const qint64 intervalUs = timestampUs - previousTimestampUs;
+    const qint64 offsetUs = qMin(timeUs - timestampUs, qMin(intervalUs, MaxExtrapolationUs));
+    return value + (value - previousValue) * static_cast<double>(offsetUs) / static_cast<double>(intervalUs);
+}
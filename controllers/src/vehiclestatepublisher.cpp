@@ -0,0 +1,159 @@
+#include "vehiclestatepublisher.h"
+#include "canframe.h"
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace VehicleStateFormat;
+
+VehicleStatePublisher::VehicleStatePublisher()
+    : m_header(nullptr)
+    , m_slots(nullptr)
+    , m_mappingSize(0)
+    , m_lastStoreSequence(0)
+    , m_publications(0)
+{
+}
+
+VehicleStatePublisher::~VehicleStatePublisher()
+{
+    close();
+}
+
+bool VehicleStatePublisher::open(const QString &name)
+{
+    close();
+#ifdef Q_OS_UNIX
+    const QByteArray objectName = name.toLocal8Bit();
+    const quint32 signalCount = VehicleSignalStore::SignalCount;
+    const quint32 size = segmentSize(signalCount);
+
+    // Readers still mapping an old segment keep it until they reopen
+    ::shm_unlink(objectName.constData());
+    const int fd = ::shm_open(objectName.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        m_errorString = QStringLiteral("Cannot open %1: %2").arg(name, QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+    if (::ftruncate(fd, size) != 0) {
+        m_errorString = QStringLiteral("Cannot size %1: %2").arg(name, QString::fromLocal8Bit(std::strerror(errno)));
+        ::close(fd);
+        ::shm_unlink(objectName.constData());
+        return false;
+    }
+    void *mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        m_errorString = QStringLiteral("Cannot map %1: %2").arg(name, QString::fromLocal8Bit(std::strerror(errno)));
+        ::shm_unlink(objectName.constData());
+        return false;
+    }
+
+    // The object is new and zero-filled: construct the atomics in place
+    // and fill in everything but magic, which goes last
+    char *base = static_cast<char *>(mapping);
+    m_header = new (base) Header();
+    SchemaEntry *schema = reinterpret_cast<SchemaEntry *>(base + schemaOffset());
+    for (quint32 index = 0; index < signalCount; ++index) {
+        const auto id = static_cast<VehicleSignalStore::SignalId>(index);
+        std::strncpy(schema[index].name, VehicleSignalStore::signalName(id), NameSize - 1);
+        schema[index].type = static_cast<quint8>(VehicleSignalStore::signalType(id));
+    }
+    m_slots = new (base + slotsOffset(signalCount)) SignalSlot[signalCount]();
+
+    m_header->layoutVersion = LayoutVersion;
+    m_header->headerSize = static_cast<quint16>(sizeof(Header));
+    m_header->signalCount = signalCount;
+    m_header->schemaOffset = schemaOffset();
+    m_header->slotsOffset = slotsOffset(signalCount);
+    m_header->totalSize = size;
+    m_header->schemaHash = schemaHash(schema, signalCount);
+    m_header->createdUs = canMonotonicMicros();
+    m_header->writerPid = static_cast<qint32>(::getpid());
+    m_header->writerRunning.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = Magic;
+
+    m_mappingSize = size;
+    m_lastStoreSequence = 0;
+    m_publications = 0;
+    m_name = name;
+    qDebug() << "Publishing vehicle state to shared memory" << name;
+    m_errorString.clear();
+    return true;
+#else
+    m_errorString = QStringLiteral("Cannot open %1: shared memory is not supported on this platform").arg(name);
+    return false;
+#endif
+}
+
+void VehicleStatePublisher::close()
+{
+#ifdef Q_OS_UNIX
+    if (m_header) {
+        m_header->writerRunning.store(0, std::memory_order_release);
+        ::munmap(m_header, m_mappingSize);
+        ::shm_unlink(m_name.toLocal8Bit().constData());
+    }
+#endif
+    m_header = nullptr;
+    m_slots = nullptr;
+    m_mappingSize = 0;
+}
+
+bool VehicleStatePublisher::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+QString VehicleStatePublisher::name() const
+{
+    return m_name;
+}
+
+QString VehicleStatePublisher::errorString() const
+{
+    return m_errorString;
+}
+
+quint64 VehicleStatePublisher::publicationCount() const
+{
+    return m_publications;
+}
+
+void VehicleStatePublisher::publish(const VehicleSignalStore::Snapshot &snapshot)
+{
+    if (!m_header || (m_publications > 0 && snapshot.sequence == m_lastStoreSequence)) {
+        return;
+    }
+
+    // Odd while writing; the release fence keeps the slot stores below
+    // from becoming visible before it
+    const quint64 sequence = m_header->sequence.load(std::memory_order_relaxed);
+    m_header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int id = 0; id < VehicleSignalStore::SignalCount; ++id) {
+        SignalSlot &slot = m_slots[id];
+        slot.value.store(snapshot.values[id], std::memory_order_relaxed);
+        slot.timestampUs.store(snapshot.timestampsUs[id], std::memory_order_relaxed);
+        slot.previousValue.store(snapshot.previousValues[id], std::memory_order_relaxed);
+        slot.previousTimestampUs.store(snapshot.previousTimestampsUs[id], std::memory_order_relaxed);
+    }
+    m_header->validMask.store(snapshot.validMask, std::memory_order_relaxed);
+    m_header->storeSequence.store(snapshot.sequence, std::memory_order_relaxed);
+    m_header->publishedUs.store(canMonotonicMicros(), std::memory_order_relaxed);
+
+    m_header->sequence.store(sequence + 2, std::memory_order_release);
+    m_lastStoreSequence = snapshot.sequence;
+    ++m_publications;
+}
@@ -0,0 +1,259 @@
+#include "vehiclestatereader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VEHICLESTATE_HAVE_SHM
+#endif
+
+using namespace VehicleStateFormat;
+
+namespace {
+// A publication takes microseconds; a read retrying this many times
+// checks that the writer still lives and lets it run. It gives up once the
+// writer has been preempted in the middle of one for MaxWaitUs.
+constexpr int AttemptsPerCheck = 1024;
+constexpr std::int64_t MaxWaitUs = 100000;
+
+std::int64_t monotonicMicros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool writerAlive(const Header *header)
+{
+    if (header->writerRunning.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+#ifdef VEHICLESTATE_HAVE_SHM
+    // A writer that crashed never cleared writerRunning
+    return ::kill(header->writerPid, 0) == 0 || errno != ESRCH;
+#else
+    return true;
+#endif
+}
+
+// Runs read() until it saw no publication in progress, or until the
+// writer turns out to be gone or never lets it finish.
+template<typename Read>
+VehicleStateReader::ReadError readConsistent(const Header *header, Read read)
+{
+    std::int64_t startUs = 0;
+    for (int attempt = 1;; ++attempt) {
+        const std::uint64_t before = header->sequence.load(std::memory_order_acquire);
+        if (!(before & 1u)) {
+            read();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header->sequence.load(std::memory_order_relaxed) == before) {
+                return VehicleStateReader::NoReadError;
+            }
+        }
+        if (attempt % AttemptsPerCheck == 0) {
+            if (!writerAlive(header)) {
+                return VehicleStateReader::WriterStopped;
+            }
+            const std::int64_t nowUs = monotonicMicros();
+            if (startUs == 0) {
+                startUs = nowUs;
+            } else if (nowUs - startUs >= MaxWaitUs) {
+                return VehicleStateReader::WriterBusy;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+VehicleStateReader::Signal loadSlot(const SignalSlot &slot, bool valid)
+{
+    VehicleStateReader::Signal signal;
+    signal.value = slot.value.load(std::memory_order_relaxed);
+    signal.timestampUs = slot.timestampUs.load(std::memory_order_relaxed);
+    signal.previousValue = slot.previousValue.load(std::memory_order_relaxed);
+    signal.previousTimestampUs = slot.previousTimestampUs.load(std::memory_order_relaxed);
+    signal.valid = valid;
+    return signal;
+}
+}
+
+VehicleStateReader::VehicleStateReader()
+    : m_header(nullptr)
+    , m_schema(nullptr)
+    , m_slots(nullptr)
+    , m_mappingSize(0)
+    , m_readError(NoReadError)
+{
+}
+
+VehicleStateReader::~VehicleStateReader()
+{
+    close();
+}
+
+bool VehicleStateReader::open(const char *name)
+{
+    close();
+#ifdef VEHICLESTATE_HAVE_SHM
+    const int fd = ::shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        m_errorString = std::string("Cannot open ") + name + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header))) {
+        m_errorString = std::string(name) + " is not a vehicle state segment";
+        ::close(fd);
+        return false;
+    }
+    const std::size_t size = static_cast<std::size_t>(status.st_size);
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        m_errorString = std::string("Cannot map ") + name + ": " + std::strerror(errno);
+        return false;
+    }
+
+    const Header *header = static_cast<const Header *>(mapping);
+    const char *error = nullptr;
+    const bool hasMagic = header->magic == Magic;
+    // Pairs with the writer's release fence before it stores magic, so the
+    // layout checked below is the one it wrote
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!hasMagic) {
+        error = " is not a vehicle state segment";
+    } else if (header->layoutVersion != LayoutVersion) {
+        error = " has an unsupported layout version";
+    } else if (header->headerSize < sizeof(Header) || header->signalCount > static_cast<std::uint32_t>(MaxSignals)
+               || header->totalSize > size || header->schemaOffset < header->headerSize
+               || header->schemaOffset + header->signalCount * sizeof(SchemaEntry) > header->slotsOffset
+               || header->slotsOffset + header->signalCount * sizeof(SignalSlot) > header->totalSize) {
+        error = " is truncated or corrupt";
+    }
+    if (error) {
+        m_errorString = std::string(name) + error;
+        ::munmap(mapping, size);
+        return false;
+    }
+
+    m_header = header;
+    m_schema = reinterpret_cast<const SchemaEntry *>(static_cast<const char *>(mapping) + header->schemaOffset);
+    m_slots = reinterpret_cast<const SignalSlot *>(static_cast<const char *>(mapping) + header->slotsOffset);
+    m_mappingSize = size;
+    m_readError = NoReadError;
+    m_errorString.clear();
+    return true;
+#else
+    m_errorString = std::string("Cannot open ") + name + ": shared memory is not supported on this platform";
+    return false;
+#endif
+}
+
+void VehicleStateReader::close()
+{
+#ifdef VEHICLESTATE_HAVE_SHM
+    if (m_header) {
+        ::munmap(const_cast<Header *>(m_header), m_mappingSize);
+    }
+#endif
+    m_header = nullptr;
+    m_schema = nullptr;
+    m_slots = nullptr;
+    m_mappingSize = 0;
+}
+
+bool VehicleStateReader::isWriterRunning() const
+{
+    return m_header && writerAlive(m_header);
+}
+
+int VehicleStateReader::signalCount() const
+{
+    return m_header ? static_cast<int>(m_header->signalCount) : 0;
+}
+
+int VehicleStateReader::signalIndex(const char *name) const
+{
+    for (int index = 0; index < signalCount(); ++index) {
+        if (std::strncmp(m_schema[index].name, name, NameSize) == 0) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+const char *VehicleStateReader::signalName(int index) const
+{
+    return index >= 0 && index < signalCount() ? m_schema[index].name : nullptr;
+}
+
+SignalType VehicleStateReader::signalType(int index) const
+{
+    return index >= 0 && index < signalCount() ? static_cast<SignalType>(m_schema[index].type) : RealType;
+}
+
+std::uint64_t VehicleStateReader::schemaHash() const
+{
+    return m_header ? m_header->schemaHash : 0;
+}
+
+std::uint64_t VehicleStateReader::sequence() const
+{
+    return m_header ? m_header->sequence.load(std::memory_order_acquire) : 0;
+}
+
+bool VehicleStateReader::read(int index, Signal *signal) const
+{
+    if (index < 0 || index >= signalCount()) {
+        m_readError = NoSuchSignal;
+        return false;
+    }
+    m_readError = readConsistent(m_header, [&]() {
+        const bool valid = (m_header->validMask.load(std::memory_order_relaxed) >> index & 1u) != 0;
+        *signal = loadSlot(m_slots[index], valid);
+    });
+    return m_readError == NoReadError;
+}
+
+int VehicleStateReader::readAll(Signal *signals, int count, std::int64_t *publishedUs,
+                                std::uint64_t *storeSequence) const
+{
+    count = std::max(0, std::min(count, signalCount()));
+    if (!m_header) {
+        m_readError = NoReadError;
+        return 0;
+    }
+    m_readError = readConsistent(m_header, [&]() {
+        const std::uint64_t validMask = m_header->validMask.load(std::memory_order_relaxed);
+        for (int index = 0; index < count; ++index) {
+            signals[index] = loadSlot(m_slots[index], (validMask >> index & 1u) != 0);
+        }
+        if (publishedUs) {
+            *publishedUs = m_header->publishedUs.load(std::memory_order_relaxed);
+        }
+        if (storeSequence) {
+            *storeSequence = m_header->storeSequence.load(std::memory_order_relaxed);
+        }
+    });
+    return m_readError == NoReadError ? count : -1;
+}
+
+double VehicleStateReader::estimate(const Signal &signal, std::int64_t timeUs)
+{
+    if (signal.previousTimestampUs <= 0 || signal.timestampUs <= signal.previousTimestampUs
+        || timeUs <= signal.previousTimestampUs) {
+        return timeUs <= signal.previousTimestampUs ? signal.previousValue : signal.value;
+    }
+    const std::int64_t intervalUs = signal.timestampUs - signal.previousTimestampUs;
+    const std::int64_t offsetUs = std::min(timeUs - signal.timestampUs, std::min(intervalUs, MaxExtrapolationUs));
+    return signal.value
+           + (signal.value - signal.previousValue) * static_cast<double>(offsetUs) / static_cast<double>(intervalUs);
+}
@@ -0,0 +1,753 @@
+#include "warningruleengine.h"
+#include "canframe.h"
+#include "tracerecorder.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QVariantMap>
+#include <QtAlgorithms>
+
+#include <cctype>
+#include <cstring>
+#include <limits>
+
+namespace {
+// Deepest evaluation stack a condition may need
+constexpr int MaxStackDepth = 32;
+// Deepest run of "(", "!" and unary "-" the parser recurses through
+constexpr int MaxNesting = 64;
+
+const char *levelName(WarningRuleEngine::Level level)
+{
+    switch (level) {
+    case WarningRuleEngine::InfoLevel:
+        return "info";
+    case WarningRuleEngine::CriticalLevel:
+        return "critical";
+    case WarningRuleEngine::WarningLevel:
+        break;
+    }
+    return "warning";
+}
+}
+
+// Recursive descent over one line of a rules file, emitting postfix code.
+class WarningRuleEngine::Parser
+{
+public:
+    Parser(const QByteArray &line, QVector<Instruction> &code)
+        : m_position(line.constData())
+        , m_end(line.constData() + line.size())
+        , m_code(code)
+        , m_depth(0)
+        , m_maxDepth(0)
+        , m_nesting(0)
+        , m_inputs(0)
+    {
+        next();
+    }
+
+    bool parseRule(Rule &rule)
+    {
+        if (!acceptKeyword("warning") || m_type != Identifier) {
+            return fail(QStringLiteral("expected \"warning <name>\""));
+        }
+        rule.name = QString::fromLatin1(m_text);
+        next();
+
+        bool hasWhen = false;
+        while (m_type != End) {
+            if (acceptKeyword("when")) {
+                if (!parseCondition(rule.whenCode, rule.whenLength)) {
+                    return false;
+                }
+                hasWhen = true;
+            } else if (acceptKeyword("clear")) {
+                if (!parseCondition(rule.clearCode, rule.clearLength)) {
+                    return false;
+                }
+            } else if (acceptKeyword("for")) {
+                if (m_type != Number) {
+                    return fail(QStringLiteral("expected a duration after \"for\""));
+                }
+                const double amount = m_number;
+                next();
+                double scaleUs = 1e6;
+                if (acceptKeyword("ms")) {
+                    scaleUs = 1e3;
+                } else if (!acceptKeyword("s")) {
+                    return fail(QStringLiteral("expected s or ms after the duration"));
+                }
+                rule.onDelayUs = rule.offDelayUs = static_cast<qint64>(amount * scaleUs);
+            } else if (acceptKeyword("level")) {
+                if (acceptKeyword("info")) {
+                    rule.level = InfoLevel;
+                } else if (acceptKeyword("warning")) {
+                    rule.level = WarningLevel;
+                } else if (acceptKeyword("critical")) {
+                    rule.level = CriticalLevel;
+                } else {
+                    return fail(QStringLiteral("expected info, warning or critical"));
+                }
+            } else if (acceptKeyword("latch")) {
+                rule.latch = true;
+            } else if (m_type == String) {
+                rule.message = QString::fromUtf8(m_text);
+                next();
+            } else {
+                return fail(QStringLiteral("unexpected \"%1\"").arg(QString::fromLatin1(m_text)));
+            }
+        }
+        if (!hasWhen) {
+            return fail(QStringLiteral("missing \"when\" condition"));
+        }
+        rule.inputs = m_inputs;
+        return true;
+    }
+
+    QString errorString() const { return m_errorString; }
+
+private:
+    enum TokenType { End, Identifier, Number, String, Operator, Invalid };
+
+    void next()
+    {
+        while (m_position < m_end && (*m_position == ' ' || *m_position == '\t' || *m_position == '\r')) {
+            ++m_position;
+        }
+        m_text.clear();
+        if (m_position >= m_end) {
+            m_type = End;
+            return;
+        }
+
+        const char c = *m_position;
+        if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            const char *start = m_position;
+            while (m_position < m_end
+                   && (std::isalnum(static_cast<unsigned char>(*m_position)) || *m_position == '_')) {
+                ++m_position;
+            }
+            m_type = Identifier;
+            m_text = QByteArray(start, static_cast<int>(m_position - start));
+        } else if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            const char *start = m_position;
+            while (m_position < m_end
+                   && (std::isdigit(static_cast<unsigned char>(*m_position)) || *m_position == '.')) {
+                ++m_position;
+            }
+            m_text = QByteArray(start, static_cast<int>(m_position - start));
+            bool ok = false;
+            m_number = m_text.toDouble(&ok);
+            m_type = ok ? Number : Invalid;
+        } else if (c == '"') {
+            const char *start = ++m_position;
+            while (m_position < m_end && *m_position != '"') {
+                ++m_position;
+            }
+            m_text = QByteArray(start, static_cast<int>(m_position - start));
+            m_type = m_position < m_end ? String : Invalid;
+            ++m_position;
+        } else {
+            static const char *const operators[] = {
+                "<=", ">=", "==", "!=", "&&", "||", "<", ">", "!", "+", "-", "*", "/", "(", ")"
+            };
+            m_type = Invalid;
+            m_text = QByteArray(1, c);
+            for (const char *op : operators) {
+                const std::size_t length = std::strlen(op);
+                if (static_cast<std::size_t>(m_end - m_position) >= length
+                    && std::strncmp(m_position, op, length) == 0) {
+                    m_type = Operator;
+                    m_text = QByteArray(op, static_cast<int>(length));
+                    break;
+                }
+            }
+            m_position += m_text.size();
+        }
+    }
+
+    bool acceptKeyword(const char *keyword)
+    {
+        if (m_type == Identifier && m_text == keyword) {
+            next();
+            return true;
+        }
+        return false;
+    }
+
+    bool acceptOperator(const char *op)
+    {
+        if (m_type == Operator && m_text == op) {
+            next();
+            return true;
+        }
+        return false;
+    }
+
+    bool fail(const QString &message)
+    {
+        if (m_errorString.isEmpty()) {
+            m_errorString = message;
+        }
+        return false;
+    }
+
+    bool parseCondition(int &code, int &length)
+    {
+        code = m_code.size();
+        m_depth = 0;
+        m_maxDepth = 0;
+        m_nesting = 0;
+        if (!parseOr()) {
+            return false;
+        }
+        if (m_maxDepth > MaxStackDepth) {
+            return fail(QStringLiteral("condition nested too deeply"));
+        }
+        length = m_code.size() - code;
+        return true;
+    }
+
+    void emitInstruction(Opcode opcode, int depthChange, quint8 signal = 0, double constant = 0.0)
+    {
+        m_code.append(Instruction{opcode, signal, constant});
+        m_depth += depthChange;
+        m_maxDepth = qMax(m_maxDepth, m_depth);
+    }
+
+    bool parseOr()
+    {
+        if (!parseAnd()) {
+            return false;
+        }
+        while (acceptOperator("||")) {
+            if (!parseAnd()) {
+                return false;
+            }
+            emitInstruction(Or, -1);
+        }
+        return true;
+    }
+
+    bool parseAnd()
+    {
+        if (!parseComparison()) {
+            return false;
+        }
+        while (acceptOperator("&&")) {
+            if (!parseComparison()) {
+                return false;
+            }
+            emitInstruction(And, -1);
+        }
+        return true;
+    }
+
+    bool parseComparison()
+    {
+        if (!parseSum()) {
+            return false;
+        }
+        static const struct {
+            const char *op;
+            Opcode opcode;
+        } comparisons[] = {
+            { "<=", LessEqual }, { ">=", GreaterEqual }, { "==", Equal },
+            { "!=", NotEqual }, { "<", Less }, { ">", Greater },
+        };
+        for (const auto &comparison : comparisons) {
+            if (acceptOperator(comparison.op)) {
+                if (!parseSum()) {
+                    return false;
+                }
+                emitInstruction(comparison.opcode, -1);
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool parseSum()
+    {
+        if (!parseProduct()) {
+            return false;
+        }
+        for (;;) {
+            Opcode opcode;
+            if (acceptOperator("+")) {
+                opcode = Add;
+            } else if (acceptOperator("-")) {
+                opcode = Subtract;
+            } else {
+                return true;
+            }
+            if (!parseProduct()) {
+                return false;
+            }
+            emitInstruction(opcode, -1);
+        }
+    }
+
+    bool parseProduct()
+    {
+        if (!parseUnary()) {
+            return false;
+        }
+        for (;;) {
+            Opcode opcode;
+            if (acceptOperator("*")) {
+                opcode = Multiply;
+            } else if (acceptOperator("/")) {
+                opcode = Divide;
+            } else {
+                return true;
+            }
+            if (!parseUnary()) {
+                return false;
+            }
+            emitInstruction(opcode, -1);
+        }
+    }
+
+    // Every nested operand, behind "!", "-" or "(", comes through here, so
+    // the bound holds before the recursion rather than after parsing.
+    bool parseUnary()
+    {
+        if (m_nesting >= MaxNesting) {
+            return fail(QStringLiteral("expression too deep"));
+        }
+        ++m_nesting;
+        const bool parsed = parseUnaryOperand();
+        --m_nesting;
+        return parsed;
+    }
+
+    bool parseUnaryOperand()
+    {
+        if (acceptOperator("!")) {
+            if (!parseUnary()) {
+                return false;
+            }
+            emitInstruction(Not, 0);
+            return true;
+        }
+        if (acceptOperator("-")) {
+            if (!parseUnary()) {
+                return false;
+            }
+            emitInstruction(Negate, 0);
+            return true;
+        }
+        return parsePrimary();
+    }
+
+    bool parsePrimary()
+    {
+        if (m_type == Number) {
+            emitInstruction(PushConstant, 1, 0, m_number);
+            next();
+            return true;
+        }
+        if (acceptKeyword("true")) {
+            emitInstruction(PushConstant, 1, 0, 1.0);
+            return true;
+        }
+        if (acceptKeyword("false")) {
+            emitInstruction(PushConstant, 1, 0, 0.0);
+            return true;
+        }
+        if (m_type == Identifier) {
+            const VehicleSignalStore::SignalId id = VehicleSignalStore::signalId(m_text.constData());
+            if (id == VehicleSignalStore::SignalCount) {
+                return fail(QStringLiteral("unknown signal \"%1\"").arg(QString::fromLatin1(m_text)));
+            }
+            emitInstruction(PushSignal, 1, id);
+            m_inputs |= VehicleSignalStore::signalBit(id);
+            next();
+            return true;
+        }
+        if (acceptOperator("(")) {
+            if (!parseOr()) {
+                return false;
+            }
+            if (!acceptOperator(")")) {
+                return fail(QStringLiteral("expected \")\""));
+            }
+            return true;
+        }
+        return fail(m_type == End ? QStringLiteral("condition ends early")
+                                  : QStringLiteral("unexpected \"%1\"").arg(QString::fromLatin1(m_text)));
+    }
+
+    const char *m_position;
+    const char *m_end;
+    TokenType m_type;
+    QByteArray m_text;
+    double m_number;
+
+    QVector<Instruction> &m_code;
+    int m_depth;
+    int m_maxDepth;
+    int m_nesting;
+    VehicleSignalStore::SignalMask m_inputs;
+    QString m_errorString;
+};
+
+WarningRuleEngine::WarningRuleEngine(const VehicleSignalStore &store, QObject *parent)
+    : QObject(parent)
+    , m_store(store)
+    , m_pass(0)
+    , m_dueTimer(new QTimer(this))
+    , m_logNext(0)
+{
+    m_signalRuleStart.fill(0, VehicleSignalStore::SignalCount + 1);
+    m_dueTimer->setSingleShot(true);
+    m_dueTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_dueTimer, &QTimer::timeout, this, &WarningRuleEngine::evaluateDue);
+}
+
+bool WarningRuleEngine::loadFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = QStringLiteral("Cannot open rules %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    return loadFromData(file.readAll());
+}
+
+bool WarningRuleEngine::loadFromData(const QByteArray &data)
+{
+    QVector<Rule> rules;
+    QVector<Instruction> code;
+
+    int lineNumber = 0;
+    const QList<QByteArray> lines = data.split('\n');
+    for (const QByteArray &rawLine : lines) {
+        ++lineNumber;
+        const QByteArray line = rawLine.trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        Rule rule = {};
+        rule.level = WarningLevel;
+        Parser parser(line, code);
+        if (!parser.parseRule(rule)) {
+            m_errorString = QStringLiteral("Rules line %1: %2").arg(lineNumber).arg(parser.errorString());
+            return false;
+        }
+        for (const Rule &existing : rules) {
+            if (existing.name == rule.name) {
+                m_errorString = QStringLiteral("Rules line %1: duplicate warning \"%2\"").arg(lineNumber).arg(rule.name);
+                return false;
+            }
+        }
+        rules.append(rule);
+    }
+
+    // Counting sort of (signal, rule) pairs into the per-signal lists
+    QVector<int> start(VehicleSignalStore::SignalCount + 1, 0);
+    for (const Rule &rule : rules) {
+        for (VehicleSignalStore::SignalMask inputs = rule.inputs; inputs; inputs &= inputs - 1) {
+            ++start[qCountTrailingZeroBits(inputs) + 1];
+        }
+    }
+    for (int id = 0; id < VehicleSignalStore::SignalCount; ++id) {
+        start[id + 1] += start[id];
+    }
+    QVector<int> signalRules(start.last());
+    QVector<int> fill = start;
+    for (int index = 0; index < rules.size(); ++index) {
+        for (VehicleSignalStore::SignalMask inputs = rules.at(index).inputs; inputs; inputs &= inputs - 1) {
+            signalRules[fill[qCountTrailingZeroBits(inputs)]++] = index;
+        }
+    }
+
+    // Warnings that were on go off with the rules they came from
+    for (int index = 0; index < m_rules.size(); ++index) {
+        if (m_rules.at(index).active) {
+            setActive(index, false);
+        }
+    }
+
+    m_rules = rules;
+    m_code = code;
+    m_signalRuleStart = start;
+    m_signalRules = signalRules;
+    m_pendingRules.clear();
+    m_dueTimer->stop();
+    m_errorString.clear();
+
+    // Rules over signals that already hold a value start from it.
+    evaluate(VehicleSignalStore::AllSignals);
+    return true;
+}
+
+QString WarningRuleEngine::errorString() const
+{
+    return m_errorString;
+}
+
+int WarningRuleEngine::ruleCount() const
+{
+    return m_rules.size();
+}
+
+VehicleSignalStore::SignalMask WarningRuleEngine::inputMask() const
+{
+    VehicleSignalStore::SignalMask mask = 0;
+    for (const Rule &rule : m_rules) {
+        mask |= rule.inputs;
+    }
+    return mask;
+}
+
+int WarningRuleEngine::ruleIndex(const QString &name) const
+{
+    for (int index = 0; index < m_rules.size(); ++index) {
+        if (m_rules.at(index).name == name) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+QString WarningRuleEngine::ruleName(int rule) const
+{
+    return m_rules.at(rule).name;
+}
+
+QString WarningRuleEngine::ruleMessage(int rule) const
+{
+    return m_rules.at(rule).message;
+}
+
+WarningRuleEngine::Level WarningRuleEngine::ruleLevel(int rule) const
+{
+    return m_rules.at(rule).level;
+}
+
+bool WarningRuleEngine::isActive(int rule) const
+{
+    return m_rules.at(rule).active;
+}
+
+QStringList WarningRuleEngine::activeRules() const
+{
+    QStringList names;
+    for (const Rule &rule : m_rules) {
+        if (rule.active) {
+            names.append(rule.name);
+        }
+    }
+    return names;
+}
+
+bool WarningRuleEngine::acknowledge(int rule)
+{
+    if (rule < 0 || rule >= m_rules.size() || !m_rules.at(rule).active) {
+        return false;
+    }
+    m_rules[rule].acknowledged = true;
+    evaluateRule(rule, readInputs(), canMonotonicMicros());
+    scheduleDue();
+    return true;
+}
+
+WarningRuleEngine::Inputs WarningRuleEngine::readInputs() const
+{
+    Inputs inputs;
+    inputs.validMask = 0;
+    for (int id = 0; id < VehicleSignalStore::SignalCount; ++id) {
+        const VehicleSignalStore::SignalId signal = static_cast<VehicleSignalStore::SignalId>(id);
+        inputs.values[id] = m_store.value(signal);
+        if (m_store.isValid(signal)) {
+            inputs.validMask |= VehicleSignalStore::signalBit(signal);
+        }
+    }
+    return inputs;
+}
+
+bool WarningRuleEngine::run(int code, int length, const Inputs &inputs) const
+{
+    double stack[MaxStackDepth];
+    int top = -1;
+    const Instruction *instruction = m_code.constData() + code;
+    const Instruction *end = instruction + length;
+    for (; instruction != end; ++instruction) {
+        switch (instruction->opcode) {
+        case PushConstant:
+            stack[++top] = instruction->constant;
+            continue;
+        case PushSignal:
+            stack[++top] = inputs.values[instruction->signal];
+            continue;
+        case Negate:
+            stack[top] = -stack[top];
+            continue;
+        case Not:
+            stack[top] = stack[top] == 0.0 ? 1.0 : 0.0;
+            continue;
+        default:
+            break;
+        }
+
+        const double right = stack[top--];
+        double &left = stack[top];
+        switch (instruction->opcode) {
+        case Add: left = left + right; break;
+        case Subtract: left = left - right; break;
+        case Multiply: left = left * right; break;
+        case Divide: left = left / right; break;
+        case Less: left = left < right; break;
+        case LessEqual: left = left <= right; break;
+        case Greater: left = left > right; break;
+        case GreaterEqual: left = left >= right; break;
+        case Equal: left = left == right; break;
+        case NotEqual: left = left != right; break;
+        case And: left = left != 0.0 && right != 0.0; break;
+        case Or: left = left != 0.0 || right != 0.0; break;
+        default: break;
+        }
+    }
+    return top >= 0 && stack[top] != 0.0;
+}
+
+void WarningRuleEngine::evaluate(VehicleSignalStore::SignalMask changedMask)
+{
+    changedMask &= VehicleSignalStore::AllSignals;
+    if (!changedMask || m_rules.isEmpty()) {
+        return;
+    }
+
+    const Inputs inputs = readInputs();
+    const qint64 nowUs = canMonotonicMicros();
+    // A rule reading several changed signals runs once per pass.
+    ++m_pass;
+    while (changedMask) {
+        const int id = qCountTrailingZeroBits(changedMask);
+        changedMask &= changedMask - 1;
+        for (int index = m_signalRuleStart.at(id); index < m_signalRuleStart.at(id + 1); ++index) {
+            const int rule = m_signalRules.at(index);
+            if (m_rules.at(rule).evaluatedPass != m_pass) {
+                m_rules[rule].evaluatedPass = m_pass;
+                evaluateRule(rule, inputs, nowUs);
+            }
+        }
+    }
+    scheduleDue();
+}
+
+void WarningRuleEngine::evaluateRule(int index, const Inputs &inputs, qint64 nowUs)
+{
+    Rule &rule = m_rules[index];
+    // A condition over a signal without a value yet never holds.
+    const bool inputsValid = (rule.inputs & ~inputs.validMask) == 0;
+
+    bool target;
+    if (!rule.active) {
+        target = inputsValid && run(rule.whenCode, rule.whenLength, inputs);
+    } else if (rule.clearLength > 0) {
+        target = !(inputsValid && run(rule.clearCode, rule.clearLength, inputs));
+    } else {
+        target = !inputsValid || run(rule.whenCode, rule.whenLength, inputs);
+    }
+
+    if (target == rule.active) {
+        if (rule.pendingSinceUs != 0) {
+            rule.pendingSinceUs = 0;
+            m_pendingRules.removeOne(index);
+        }
+        return;
+    }
+
+    if (rule.pendingSinceUs == 0) {
+        rule.pendingSinceUs = nowUs;
+    }
+    // A latched warning keeps timing its clear condition, so acknowledging
+    // it after that has held long enough turns it off at once.
+    if (rule.latch && !rule.acknowledged && !target) {
+        m_pendingRules.removeOne(index);
+        return;
+    }
+    const qint64 delayUs = target ? rule.onDelayUs : rule.offDelayUs;
+    if (nowUs - rule.pendingSinceUs >= delayUs) {
+        if (delayUs > 0) {
+            m_pendingRules.removeOne(index);
+        }
+        rule.pendingSinceUs = 0;
+        setActive(index, target);
+    } else if (!m_pendingRules.contains(index)) {
+        m_pendingRules.append(index);
+    }
+}
+
+void WarningRuleEngine::evaluateDue()
+{
+    VEHICLESYS_TRACE_SCOPE("timer", "evaluateWarnings");
+    if (m_pendingRules.isEmpty()) {
+        return;
+    }
+    const Inputs inputs = readInputs();
+    const qint64 nowUs = canMonotonicMicros();
+    // evaluateRule() edits the list
+    const QVector<int> pending = m_pendingRules;
+    for (int rule : pending) {
+        evaluateRule(rule, inputs, nowUs);
+    }
+    scheduleDue();
+}
+
+void WarningRuleEngine::scheduleDue()
+{
+    if (m_pendingRules.isEmpty()) {
+        m_dueTimer->stop();
+        return;
+    }
+    qint64 dueUs = std::numeric_limits<qint64>::max();
+    for (int index : m_pendingRules) {
+        const Rule &rule = m_rules.at(index);
+        dueUs = qMin(dueUs, rule.pendingSinceUs + (rule.active ? rule.offDelayUs : rule.onDelayUs));
+    }
+    const qint64 waitUs = qMax<qint64>(0, dueUs - canMonotonicMicros());
+    m_dueTimer->start(static_cast<int>((waitUs + 999) / 1000));
+}
+
+void WarningRuleEngine::setActive(int index, bool active)
+{
+    Rule &rule = m_rules[index];
+    rule.active = active;
+    rule.acknowledged = false;
+
+    const Event event = {QDateTime::currentMSecsSinceEpoch(), rule.name, rule.message, rule.level, active};
+    if (m_log.size() < LogCapacity) {
+        m_log.append(event);
+    } else {
+        m_log[m_logNext] = event;
+    }
+    m_logNext = (m_logNext + 1) % LogCapacity;
+
+    qDebug() << "Warning" << rule.name << (active ? "on" : "off");
+    emit warningChanged(index, active);
+}
+
+QVariantList WarningRuleEngine::log() const
+{
+    QVariantList entries;
+    entries.reserve(m_log.size());
+    // Once full, the oldest entry is the next one to be overwritten.
+    const int first = m_log.size() < LogCapacity ? 0 : m_logNext;
+    for (int i = 0; i < m_log.size(); ++i) {
+        const Event &event = m_log.at((first + i) % m_log.size());
+        QVariantMap entry;
+        entry["time"] = event.timeMs;
+        entry["name"] = event.name;
+        entry["message"] = event.message;
+        entry["level"] = QString::fromLatin1(levelName(event.level));
+        entry["active"] = event.active;
+        entries.append(entry);
+    }
+    return entries;
+}
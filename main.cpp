@@ -1,13 +1,22 @@
+#include <QDebug>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QQuickWindow>
+#include <QThread>
+#include <QTimer>
 
 #include "controllers/headers/system.h"
 #include "controllers/headers/hvachandler.h"
 #include "controllers/headers/audiocontroller.h"
 #include "controllers/headers/canbuscontroller.h"
 #include "controllers/headers/vehicledatacontroller.h"
+#include "controllers/headers/tripcomputer.h"
+#include "controllers/headers/diagnosticclient.h"
 #include "controllers/headers/mediacontroller.h"
+#include "controllers/headers/propertymirror.h"
+#include "controllers/headers/vehicledataproxy.h"
+#include "controllers/headers/tracecontroller.h"
 
 
 int main(int argc, char *argv[])
@@ -22,15 +31,32 @@ int main(int argc, char *argv[])
 	HvacHandler m_driverHvacHandler;
 	HvacHandler m_passengerHvacHandler;
 	AudioController m_audioController;
-	CanBusController m_canBusController;
-	VehicleDataController m_vehicleDataController;
 	MediaController m_mediaController;
 	
+	// CAN ingest, decoding and diagnostics get a thread of their own, away from
+	// the scene graph and animations; configured here, then moved over below
+	QThread vehicleThread;
+	vehicleThread.setObjectName(QStringLiteral("VehicleData"));
+	CanBusController *m_canBusController = new CanBusController;
+	VehicleDataController *m_vehicleDataController = new VehicleDataController;
+	DiagnosticClient *m_diagnosticClient = new DiagnosticClient;
+	
   QQmlApplicationEngine engine;
   
-	// Connect CAN bus to vehicle data controller
-	QObject::connect(&m_canBusController, &CanBusController::frameReceived,
-					 &m_vehicleDataController, &VehicleDataController::processCanFrame);
+	// Connect CAN bus to vehicle data controller (frames arrive in batches drained from the ingest thread)
+	QObject::connect(m_canBusController, &CanBusController::frameBatchReceived,
+					 m_vehicleDataController, &VehicleDataController::processCanFrames);
+	m_vehicleDataController->setTrafficStats(m_canBusController->trafficStats());
+	
+	// OBD-II / UDS polling rides on the same batches and backs off when the bus is busy
+	QObject::connect(m_canBusController, &CanBusController::frameBatchReceived,
+					 m_diagnosticClient, &DiagnosticClient::handleFrames);
+	QObject::connect(m_diagnosticClient, &DiagnosticClient::transmit,
+					 m_canBusController, &CanBusController::sendFrame);
+	QObject::connect(m_canBusController, &CanBusController::trafficStatisticsChanged, m_diagnosticClient,
+					 [m_canBusController, m_diagnosticClient]() {
+		m_diagnosticClient->setBusLoad(m_canBusController->busUtilization());
+	});
 	
 	// Connect audio controller to media controller for volume sync
 	QObject::connect(&m_audioController, &AudioController::volumeLevelChanged,
@@ -38,8 +64,220 @@ int main(int argc, char *argv[])
 	QObject::connect(&m_mediaController, &MediaController::volumeChanged,
 					 &m_audioController, &AudioController::setVolumeLevel);
 	
+	// Optional vehicle-specific DBC replacing the built-in decode table
+	const QString dbcPath = qEnvironmentVariable("VEHICLESYS_DBC");
+	if (!dbcPath.isEmpty())
+		m_vehicleDataController->loadDbc(dbcPath);
+	
+	// Per-bus DBCs, e.g. "1=/etc/vehiclesys/body.dbc,2=/etc/vehiclesys/infotainment.dbc";
+	// buses without one use the table above
+	const QStringList busDbcs = qEnvironmentVariable("VEHICLESYS_BUS_DBC").split(QLatin1Char(','), Qt::SkipEmptyParts);
+	for (const QString &entry : busDbcs) {
+		const int separator = entry.indexOf(QLatin1Char('='));
+		bool ok = false;
+		const int bus = entry.left(separator).trimmed().toInt(&ok);
+		if (separator > 0 && ok)
+			m_vehicleDataController->loadBusDbc(bus, entry.mid(separator + 1).trimmed());
+		else
+			qWarning() << "Ignoring VEHICLESYS_BUS_DBC entry:" << entry;
+	}
+	
+	// CAN interfaces to open, in bus order, e.g. "vcan0,vcan1,vcan2"
+	const QStringList canInterfaces = qEnvironmentVariable("VEHICLESYS_CAN_INTERFACES").split(QLatin1Char(','), Qt::SkipEmptyParts);
+	if (!canInterfaces.isEmpty())
+		m_canBusController->setInterfaces(canInterfaces);
+	
+	// Bit rates for bus utilization, e.g. "0=500000,1=500000/2000000" (nominal/data)
+	const QStringList busBitrates = qEnvironmentVariable("VEHICLESYS_CAN_BITRATES").split(QLatin1Char(','), Qt::SkipEmptyParts);
+	for (const QString &entry : busBitrates) {
+		const int separator = entry.indexOf(QLatin1Char('='));
+		const QStringList rates = entry.mid(separator + 1).split(QLatin1Char('/'));
+		bool busOk = false, bitrateOk = false, dataBitrateOk = true;
+		const int bus = entry.left(separator).trimmed().toInt(&busOk);
+		const double bitrate = rates.value(0).toDouble(&bitrateOk);
+		const double dataBitrate = rates.size() > 1 ? rates.value(1).toDouble(&dataBitrateOk) : CanTrafficStats::DefaultDataBitrate;
+		if (separator > 0 && busOk && bitrateOk && dataBitrateOk && rates.size() <= 2)
+			m_canBusController->setBusBitrate(bus, bitrate, dataBitrate);
+		else
+			qWarning() << "Ignoring VEHICLESYS_CAN_BITRATES entry:" << entry;
+	}
+	
+	// Select the CAN receive backend: "qtserialbus" (default) or "native" raw SocketCAN
+	const QString canBackend = qEnvironmentVariable("VEHICLESYS_CAN_BACKEND");
+	if (!canBackend.isEmpty())
+		m_canBusController->setBackend(canBackend);
+	
+	// Replay a candump/ASC capture, or generate synthetic load from a CanLoadProfile
+	// spec, instead of reading a live bus; speed is a factor or "max" for both
+	const QString replaySpeed = qEnvironmentVariable("VEHICLESYS_CAN_REPLAY_SPEED");
+	if (replaySpeed == QLatin1String("max"))
+		m_canBusController->setReplaySpeed(0);
+	else if (!replaySpeed.isEmpty())
+		m_canBusController->setReplaySpeed(replaySpeed.toDouble());
+	
+	const QString replayFile = qEnvironmentVariable("VEHICLESYS_CAN_REPLAY");
+	if (!replayFile.isEmpty()) {
+		m_canBusController->setReplayFile(replayFile);
+		m_canBusController->setBackend(CanBusController::ReplayBackend);
+	}
+	
+	if (qEnvironmentVariableIsSet("VEHICLESYS_CAN_GENERATOR")) {
+		const QString profile = qEnvironmentVariable("VEHICLESYS_CAN_GENERATOR");
+		m_canBusController->setGeneratorProfile(profile);
+		if (m_canBusController->generatorProfile() == profile)
+			m_canBusController->setBackend(CanBusController::GeneratorBackend);
+	}
+	
+	// Property notification thinning, e.g. VEHICLESYS_SIGNAL_DEADBANDS="rpm=25,speed=1"
+	// and VEHICLESYS_SIGNAL_RATES="odometer=1" (notifications per second)
+	const QStringList deadbands = qEnvironmentVariable("VEHICLESYS_SIGNAL_DEADBANDS").split(QLatin1Char(','), Qt::SkipEmptyParts);
+	for (const QString &entry : deadbands) {
+		bool ok = false;
+		const double deadband = entry.section(QLatin1Char('='), 1).toDouble(&ok);
+		if (!ok || !m_vehicleDataController->setSignalDeadband(entry.section(QLatin1Char('='), 0, 0).trimmed(), deadband))
+			qWarning() << "Ignoring VEHICLESYS_SIGNAL_DEADBANDS entry:" << entry;
+	}
+	const QStringList signalRates = qEnvironmentVariable("VEHICLESYS_SIGNAL_RATES").split(QLatin1Char(','), Qt::SkipEmptyParts);
+	for (const QString &entry : signalRates) {
+		bool ok = false;
+		const double rate = entry.section(QLatin1Char('='), 1).toDouble(&ok);
+		if (!ok || !m_vehicleDataController->setSignalMaxRate(entry.section(QLatin1Char('='), 0, 0).trimmed(), rate))
+			qWarning() << "Ignoring VEHICLESYS_SIGNAL_RATES entry:" << entry;
+	}
+	
+	// Site-specific warning rules replace the built-in ones
+	const QString warningRules = qEnvironmentVariable("VEHICLESYS_WARNING_RULES");
+	if (!warningRules.isEmpty())
+		m_vehicleDataController->loadWarningRules(warningRules);
+	
+	// Signal history for trend graphs, VEHICLESYS_HISTORY_MB of memory
+	// (about 7 MB by default)
+	const qint64 historyMb = qEnvironmentVariableIntValue("VEHICLESYS_HISTORY_MB");
+	if (historyMb > 0)
+		m_vehicleDataController->configureHistory(historyMb * 1024 * 1024);
+	// Samples per second it records of signals holding still (10 by default);
+	// 0 records only what the dashboard, rules and trip computer decode
+	const QString historyRate = qEnvironmentVariable("VEHICLESYS_HISTORY_RATE");
+	if (!historyRate.isEmpty())
+		m_vehicleDataController->setHistorySampleRate(historyRate.toDouble());
+	
+	// Odometer journal, on by default; VEHICLESYS_ODOMETER_JOURNAL=off disables it
+	const QString odometerJournalPath = qEnvironmentVariable("VEHICLESYS_ODOMETER_JOURNAL");
+	if (odometerJournalPath != QLatin1String("off"))
+		m_vehicleDataController->openOdometerJournal(odometerJournalPath.isEmpty()
+													? VehicleDataController::defaultOdometerJournalPath()
+													: odometerJournalPath);
+	
+	// Vehicle state for other processes in shared memory, on by default;
+	// VEHICLESYS_STATE_SHM names the segment, =off disables it
+	const QString stateShmName = qEnvironmentVariable("VEHICLESYS_STATE_SHM");
+	if (stateShmName != QLatin1String("off"))
+		m_vehicleDataController->openStatePublication(stateShmName.isEmpty()
+													 ? QLatin1String(VehicleStateFormat::DefaultName)
+													 : stateShmName);
+	
+	// Usable fuel tank volume for the trip computer's range, in litres
+	const double tankLitres = qEnvironmentVariable("VEHICLESYS_TANK_LITRES").toDouble();
+	if (tankLitres > 0)
+		m_vehicleDataController->tripComputer()->setTankCapacity(tankLitres);
+	
+	// ECUs, PIDs and data identifiers to poll, e.g. diagnostics/obd.conf; off unless set
+	const QString diagnosticsPath = qEnvironmentVariable("VEHICLESYS_DIAGNOSTICS");
+	if (!diagnosticsPath.isEmpty()) {
+		if (m_diagnosticClient->loadFile(diagnosticsPath))
+			m_diagnosticClient->start();
+		else
+			qWarning() << m_diagnosticClient->errorString();
+	}
+	
+	// Black-box recorder, on by default; VEHICLESYS_BLACKBOX=off disables it
+	const QString blackBoxPath = qEnvironmentVariable("VEHICLESYS_BLACKBOX");
+	if (blackBoxPath != QLatin1String("off")) {
+		const qint64 blackBoxMb = qEnvironmentVariableIntValue("VEHICLESYS_BLACKBOX_MB");
+		m_canBusController->startRecorder(blackBoxPath.isEmpty() ? CanBusController::defaultRecorderPath() : blackBoxPath,
+										 blackBoxMb > 0 ? blackBoxMb * 1024 * 1024 : CanBlackBox::DefaultFileSize);
+	}
+	
+	// Real-time profile of the CAN ingest, merge and decode threads, e.g.
+	// "priority=80,cpus=2-3,lock=1"; needs CAP_SYS_NICE, and a memlock limit for lock=1
+	const QString realtimeSpec = qEnvironmentVariable("VEHICLESYS_RT");
+	if (!realtimeSpec.isEmpty()) {
+		RealtimeProfile realtimeProfile;
+		std::string error;
+		if (!realtimeProfile.parse(realtimeSpec.toStdString(), &error)) {
+			qWarning() << "Ignoring VEHICLESYS_RT:" << QString::fromStdString(error);
+		} else {
+			if (!realtimeProfile.applyToProcess(&error))
+				qWarning() << "Memory not locked:" << QString::fromStdString(error);
+			else if (realtimeProfile.lockMemory)
+				qInfo() << "Memory locked";
+			m_canBusController->setRealtimeProfile(realtimeProfile);
+		}
+	}
+	
+	// Trace of the controller hot paths and frames: VEHICLESYS_TRACE records the
+	// whole run and saves it on exit (.json for chrome://tracing, .pftrace for
+	// Perfetto); VEHICLESYS_FLIGHT_RECORDER keeps recording and saves the last
+	// seconds around every stutter longer than VEHICLESYS_FLIGHT_RECORDER_STUTTER_MS
+	// into that directory
+	TraceController m_traceController;
+	const QString tracePath = qEnvironmentVariable("VEHICLESYS_TRACE");
+	const QString flightRecorderPath = qEnvironmentVariable("VEHICLESYS_FLIGHT_RECORDER");
+	if (!tracePath.isEmpty() || !flightRecorderPath.isEmpty()) {
+		if (!m_traceController.isAvailable()) {
+			qWarning() << "Tracing not compiled in, ignoring VEHICLESYS_TRACE and VEHICLESYS_FLIGHT_RECORDER";
+		} else {
+			if (!flightRecorderPath.isEmpty()) {
+				const int stutterMs = qEnvironmentVariableIntValue("VEHICLESYS_FLIGHT_RECORDER_STUTTER_MS");
+				m_traceController.setStutterCapture(flightRecorderPath,
+													stutterMs > 0 ? stutterMs : TraceController::DefaultStutterMs);
+			}
+			if (!tracePath.isEmpty())
+				QObject::connect(&app, &QCoreApplication::aboutToQuit, &m_traceController,
+								 [&m_traceController, tracePath]() {
+					m_traceController.save(tracePath);
+				});
+			m_traceController.setEnabled(true);
+		}
+	}
+	
+	// QML reads the CAN side through these, on this thread
+	VehicleDataProxy m_vehicleDataProxy(m_vehicleDataController);
+	PropertyMirror m_canBusMirror;
+	m_canBusMirror.watch(m_canBusController, &CanBusController::connectedChanged, {"connected"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::statusChanged, {"status"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::backendChanged, {"backend"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::interfacesChanged, {"interfaces"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::replayFileChanged, {"replayFile"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::replaySpeedChanged, {"replaySpeed"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::generatorProfileChanged, {"generatorProfile"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::ingestStatsChanged,
+						 {"ringHighWaterMark", "droppedFrames"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::recordingChanged, {"recording"});
+	m_canBusMirror.watch(m_canBusController, &CanBusController::trafficStatisticsChanged,
+						 {"trafficStatistics", "busUtilization", "errorFrames", "unknownFrames"});
+	PropertyMirror m_tripComputerMirror;
+	m_tripComputerMirror.watch(m_vehicleDataController->tripComputer(), &TripComputer::updated,
+							   {"tripA", "tripB", "sinceRefuel", "instantConsumption", "fuelRate", "range"});
+	PropertyMirror m_diagnosticsMirror;
+	m_diagnosticsMirror.watch(m_diagnosticClient, &DiagnosticClient::runningChanged, {"running"});
+	m_diagnosticsMirror.watch(m_diagnosticClient, &DiagnosticClient::valuesUpdated, {"values"});
+	
+	// From here on the CAN side is only reached through queued calls; it is
+	// torn down on its own thread when the application quits
+	const QList<QObject *> vehicleObjects = {m_canBusController, m_vehicleDataController, m_diagnosticClient};
+	for (QObject *object : vehicleObjects) {
+		object->moveToThread(&vehicleThread);
+		QObject::connect(&vehicleThread, &QThread::finished, object, &QObject::deleteLater);
+	}
+	QObject::connect(&app, &QCoreApplication::aboutToQuit, [&vehicleThread]() {
+		vehicleThread.quit();
+		vehicleThread.wait();
+	});
+	vehicleThread.start();
+	
 	// Start CAN bus simulation
-	m_canBusController.connectToSimulator();
+	QMetaObject::invokeMethod(m_canBusController, &CanBusController::connectToSimulator);
 	
   // Set context property BEFORE loading QML
 	QQmlContext * context( engine.rootContext() );
@@ -47,13 +285,44 @@ int main(int argc, char *argv[])
 	context->setContextProperty( "driverHVAC", &m_driverHvacHandler );
 	context->setContextProperty( "passengerHVAC", &m_passengerHvacHandler );
 	context->setContextProperty( "audioController", &m_audioController );
-	context->setContextProperty( "canBusController", &m_canBusController );
-	context->setContextProperty( "vehicleData", &m_vehicleDataController );
+	context->setContextProperty( "canBusController", &m_canBusMirror );
+	context->setContextProperty( "vehicleData", &m_vehicleDataProxy );
+	context->setContextProperty( "tripComputer", &m_tripComputerMirror );
 	context->setContextProperty( "mediaController", &m_mediaController );
+	context->setContextProperty( "diagnostics", &m_diagnosticsMirror );
+	context->setContextProperty( "tracing", &m_traceController );
 	
   engine.load(QUrl(QStringLiteral("qrc:/Main.qml")));
   if (engine.rootObjects().isEmpty())
     exit(-1);
 	
+	// Deliver vehicle property changes once per rendered frame, and stop
+	// decoding for the properties while nobody can see them
+	QQuickWindow *window = qobject_cast<QQuickWindow *>(engine.rootObjects().first());
+	QMetaObject::invokeMethod(m_vehicleDataController, [m_vehicleDataController, window]() {
+		m_vehicleDataController->setNotificationWindow(window);
+	});
+	m_vehicleDataProxy.setWindow(window);
+	m_traceController.setWindow(window);
+	if (window)
+		QObject::connect(window, &QWindow::visibilityChanged, &m_vehicleDataProxy,
+						 [&m_vehicleDataProxy](QWindow::Visibility visibility) {
+			m_vehicleDataProxy.setPropertiesActive(visibility != QWindow::Hidden
+												   && visibility != QWindow::Minimized);
+		});
+	
+	// Age of every delivered value when it first reaches the screen, written
+	// as JSON on exit. VEHICLESYS_RUN_S quits after that many seconds, for
+	// headless runs with QT_QPA_PLATFORM=offscreen.
+	const QString latencyTracePath = qEnvironmentVariable("VEHICLESYS_LATENCY_TRACE");
+	if (!latencyTracePath.isEmpty())
+		QObject::connect(&app, &QCoreApplication::aboutToQuit, &m_vehicleDataProxy,
+						 [&m_vehicleDataProxy, latencyTracePath]() {
+			m_vehicleDataProxy.dumpLatency(latencyTracePath);
+		});
+	const int runSeconds = qEnvironmentVariableIntValue("VEHICLESYS_RUN_S");
+	if (runSeconds > 0)
+		QTimer::singleShot(runSeconds * 1000, &app, &QCoreApplication::quit);
+	
   return app.exec();
 }
@@ -0,0 +1,151 @@
+// canbb2candump - exports a CAN black-box recording as a candump -l log.
+//
+// Usage: canbb2candump <recording.canbb> [--from <unix-s>] [--to <unix-s>]
+//                      [--last <seconds>] [--prefix <interface-prefix>]
+//
+// --from/--to select an absolute window in Unix seconds (fractions allowed),
+// --last selects the final N seconds of the recording. Frames are written to
+// stdout in recording order as "(<unix-s>) <prefix><bus> <id>#<data>", so
+// the output can be fed back to canplayer or to the VehicleSys replay
+// backend.
+//
+// The recording is read into memory rather than mapped, so exporting from a
+// recorder file that is still in use never modifies it.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "canblackboxring.h"
+
+namespace {
+
+// Mirrors CanFrame::Flag.
+constexpr std::uint8_t ExtendedIdFlag = 0x01;
+constexpr std::uint8_t FlexibleDataRateFlag = 0x02;
+constexpr std::uint8_t BitrateSwitchFlag = 0x04;
+
+bool parseSeconds(const char *text, std::int64_t &micros)
+{
+    char *end = nullptr;
+    const double seconds = std::strtod(text, &end);
+    if (end == text || *end != '\0') {
+        return false;
+    }
+    micros = static_cast<std::int64_t>(seconds * 1e6);
+    return true;
+}
+
+void printFrame(const CanBlackBoxFormat::RecordHeader &record, const std::uint8_t *payload,
+                const std::string &prefix)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    const std::int64_t seconds = record.unixTimeUs / 1000000;
+    const std::int64_t micros = record.unixTimeUs % 1000000;
+    std::printf("(%lld.%06lld) %s%u ", static_cast<long long>(seconds), static_cast<long long>(micros),
+                prefix.c_str(), static_cast<unsigned>(record.bus));
+
+    if (record.flags & ExtendedIdFlag) {
+        std::printf("%08X#", static_cast<unsigned>(record.frameId));
+    } else {
+        std::printf("%03X#", static_cast<unsigned>(record.frameId));
+    }
+    if (record.flags & FlexibleDataRateFlag) {
+        std::putchar('#');
+        std::putchar(hex[(record.flags & BitrateSwitchFlag) ? 1 : 0]);
+    }
+
+    char data[CanBlackBoxFormat::MaxPayloadSize * 2 + 1];
+    for (int i = 0; i < record.length; ++i) {
+        data[i * 2] = hex[payload[i] >> 4];
+        data[i * 2 + 1] = hex[payload[i] & 0xF];
+    }
+    data[record.length * 2] = '\0';
+    std::printf("%s\n", data);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        std::cerr << "usage: canbb2candump <recording.canbb> [--from <unix-s>] [--to <unix-s>]"
+                     " [--last <seconds>] [--prefix <name>]\n";
+        return 2;
+    }
+
+    std::int64_t fromUs = std::numeric_limits<std::int64_t>::min();
+    std::int64_t toUs = std::numeric_limits<std::int64_t>::max();
+    std::int64_t lastUs = -1;
+    std::string prefix = "can";
+
+    for (int i = 2; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "canbb2candump: " << option << " needs a value\n";
+            return 2;
+        }
+        const char *value = argv[++i];
+        bool ok = true;
+        if (option == "--from") {
+            ok = parseSeconds(value, fromUs);
+        } else if (option == "--to") {
+            ok = parseSeconds(value, toUs);
+        } else if (option == "--last") {
+            ok = parseSeconds(value, lastUs);
+        } else if (option == "--prefix") {
+            prefix = value;
+        } else {
+            std::cerr << "canbb2candump: unknown option " << option << "\n";
+            return 2;
+        }
+        if (!ok) {
+            std::cerr << "canbb2candump: bad value for " << option << ": " << value << "\n";
+            return 2;
+        }
+    }
+
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input) {
+        std::cerr << "canbb2candump: cannot open " << argv[1] << "\n";
+        return 1;
+    }
+    std::vector<char> contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    if (contents.size() <= CanBlackBoxFormat::HeaderSize) {
+        std::cerr << "canbb2candump: " << argv[1] << " is not a black-box recording\n";
+        return 1;
+    }
+
+    CanBlackBoxRing ring;
+    if (!ring.attach(contents.data(), contents.size())) {
+        std::cerr << "canbb2candump: " << argv[1] << " is not a black-box recording\n";
+        return 1;
+    }
+
+    if (lastUs >= 0) {
+        std::int64_t newestUs = std::numeric_limits<std::int64_t>::min();
+        ring.forEach([&newestUs](const CanBlackBoxFormat::RecordHeader &record, const std::uint8_t *) {
+            newestUs = record.unixTimeUs;
+        });
+        fromUs = newestUs - lastUs;
+    }
+
+    std::uint64_t exported = 0;
+    ring.forEach([&](const CanBlackBoxFormat::RecordHeader &record, const std::uint8_t *payload) {
+        if (record.unixTimeUs >= fromUs && record.unixTimeUs <= toUs) {
+            printFrame(record, payload, prefix);
+            ++exported;
+        }
+    });
+
+    std::cerr << "canbb2candump: exported " << exported << " of " << ring.recordCount() << " frames\n";
+    return 0;
+}
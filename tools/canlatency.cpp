@@ -0,0 +1,304 @@
+// canlatency - worst-case frame-to-decode latency of the CAN receive path
+// while the machine is busy.
+//
+// Usage: canlatency [--interface <name>] [--rt <spec>] [--stress <threads>]
+//                   [--rate <frames/s>] [--frames <count>] [--max-us <limit>]
+//
+// A sender thread writes frames carrying their send time; a receiver thread
+// blocks on its socket like an ingest thread, decodes each frame and records
+// how long after sending it got there. With --interface (e.g. vcan0) frames
+// go through a raw CAN socket, the way the native backend reads them;
+// without it through a local datagram socket pair. --rt takes the same
+// RealtimeProfile spec as VEHICLESYS_RT and is applied to both threads, so
+// runs with and without it show what the profile buys. --stress starts that
+// many threads (default: one per CPU) writing over a cache-sized buffer at
+// normal priority. Prints the latency distribution in microseconds and
+// exits with status 1 if the worst case exceeds --max-us.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include "realtimeprofile.h"
+
+#ifdef __linux__
+
+namespace {
+
+constexpr std::uint32_t LatencyFrameId = 0x7E0;
+constexpr std::size_t StressBufferSize = 8 * 1024 * 1024;
+
+std::int64_t monotonicMicros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int openCanSocket(const std::string &interface)
+{
+    const int fd = ::socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0) {
+        return -1;
+    }
+    ifreq request;
+    std::memset(&request, 0, sizeof(request));
+    std::strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    sockaddr_can address;
+    std::memset(&address, 0, sizeof(address));
+    address.can_family = AF_CAN;
+    if (::ioctl(fd, SIOCGIFINDEX, &request) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    address.can_ifindex = request.ifr_ifindex;
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void applyProfile(const RealtimeProfile &profile, const char *thread)
+{
+    if (!profile.isEnabled()) {
+        return;
+    }
+    std::string error;
+    if (profile.applyToCurrentThread(0, &error)) {
+        std::cerr << "canlatency: " << thread << ": " << RealtimeProfile::describeCurrentThread() << "\n";
+    } else {
+        std::cerr << "canlatency: " << thread << ": " << error << "\n";
+    }
+}
+
+void stress(const std::atomic<bool> &running)
+{
+    // Streams over more memory than most caches hold, so the receive path
+    // competes for caches and memory bandwidth as well as for the CPU
+    std::vector<unsigned char> buffer(StressBufferSize);
+    unsigned char value = 0;
+    while (running.load(std::memory_order_relaxed)) {
+        for (std::size_t offset = 0; offset < buffer.size(); offset += 64) {
+            buffer[offset] = value;
+        }
+        ++value;
+    }
+}
+
+void printDistribution(std::vector<std::int64_t> &latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&latencies](double fraction) {
+        const std::size_t index = static_cast<std::size_t>(fraction * (latencies.size() - 1));
+        return static_cast<long long>(latencies[index]);
+    };
+    long double sum = 0;
+    for (std::int64_t latency : latencies) {
+        sum += latency;
+    }
+    std::printf("frames %zu\n", latencies.size());
+    std::printf("min %lld us  avg %.1f us  p50 %lld us  p99 %lld us  p99.9 %lld us  max %lld us\n",
+                static_cast<long long>(latencies.front()), static_cast<double>(sum / latencies.size()),
+                percentile(0.5), percentile(0.99), percentile(0.999), static_cast<long long>(latencies.back()));
+
+    // Power-of-two buckets: the tail is what matters
+    std::int64_t bound = 1;
+    std::size_t counted = 0;
+    while (counted < latencies.size()) {
+        const std::size_t end = std::upper_bound(latencies.begin(), latencies.end(), bound - 1) - latencies.begin();
+        if (end > counted) {
+            std::printf("  < %8lld us  %zu\n", static_cast<long long>(bound), end - counted);
+        }
+        counted = end;
+        bound *= 2;
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string interface;
+    std::string profileSpec;
+    int stressThreads = static_cast<int>(std::thread::hardware_concurrency());
+    double rate = 2000;
+    std::size_t frameCount = 20000;
+    std::int64_t maxUs = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "usage: canlatency [--interface <name>] [--rt <spec>] [--stress <threads>]"
+                         " [--rate <frames/s>] [--frames <count>] [--max-us <limit>]\n";
+            return 2;
+        }
+        const std::string value = argv[++i];
+        if (option == "--interface") {
+            interface = value;
+        } else if (option == "--rt") {
+            profileSpec = value;
+        } else if (option == "--stress") {
+            stressThreads = std::atoi(value.c_str());
+        } else if (option == "--rate") {
+            rate = std::strtod(value.c_str(), nullptr);
+        } else if (option == "--frames") {
+            frameCount = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (option == "--max-us") {
+            maxUs = std::strtoll(value.c_str(), nullptr, 10);
+        } else {
+            std::cerr << "canlatency: unknown option " << option << "\n";
+            return 2;
+        }
+    }
+
+    RealtimeProfile profile;
+    std::string error;
+    if (!profile.parse(profileSpec, &error)) {
+        std::cerr << "canlatency: " << error << "\n";
+        return 2;
+    }
+    if (rate <= 0 || frameCount == 0 || stressThreads < 0) {
+        std::cerr << "canlatency: rate, frames and stress must be positive\n";
+        return 2;
+    }
+    if (!profile.applyToProcess(&error)) {
+        std::cerr << "canlatency: " << error << "\n";
+    }
+
+    int sendFd = -1;
+    int receiveFd = -1;
+    if (interface.empty()) {
+        int pair[2];
+        if (::socketpair(AF_UNIX, SOCK_DGRAM, 0, pair) != 0) {
+            std::cerr << "canlatency: socketpair: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+        sendFd = pair[0];
+        receiveFd = pair[1];
+    } else {
+        sendFd = openCanSocket(interface);
+        receiveFd = openCanSocket(interface);
+        if (sendFd < 0 || receiveFd < 0) {
+            std::cerr << "canlatency: cannot open " << interface << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+        can_filter filter;
+        filter.can_id = LatencyFrameId;
+        filter.can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        ::setsockopt(receiveFd, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter));
+    }
+
+    // Lets the receiver notice the sender is done when frames were lost
+    timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 200000;
+    ::setsockopt(receiveFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Allocated and touched up front, so recording never faults a page in
+    std::vector<std::int64_t> latencies(frameCount, 0);
+    std::size_t received = 0;
+    std::atomic<bool> sending(true);
+
+    std::atomic<bool> stressing(true);
+    std::vector<std::thread> stressors;
+    for (int i = 0; i < stressThreads; ++i) {
+        stressors.emplace_back(stress, std::cref(stressing));
+    }
+
+    std::thread receiver([&]() {
+        applyProfile(profile, "receiver");
+        can_frame frame;
+        while (received < frameCount) {
+            const ssize_t size = ::recv(receiveFd, &frame, sizeof(frame), 0);
+            const std::int64_t receivedUs = monotonicMicros();
+            if (size < 0 && (errno == EINTR || ((errno == EAGAIN || errno == EWOULDBLOCK) && sending))) {
+                continue;
+            }
+            if (size != static_cast<ssize_t>(sizeof(frame))) {
+                break;
+            }
+            // Decode: the payload is the send time, little-endian
+            std::int64_t sentUs = 0;
+            for (int i = 0; i < 8; ++i) {
+                sentUs |= static_cast<std::int64_t>(frame.data[i]) << (8 * i);
+            }
+            latencies[received++] = receivedUs - sentUs;
+        }
+    });
+
+    std::cerr << "canlatency: " << frameCount << " frames at " << rate << " frames/s through "
+              << (interface.empty() ? std::string("a socket pair") : interface) << ", "
+              << stressThreads << " stress threads\n";
+
+    std::thread sender([&]() {
+        applyProfile(profile, "sender");
+        using namespace std::chrono;
+        const auto start = steady_clock::now();
+        can_frame frame;
+        std::memset(&frame, 0, sizeof(frame));
+        frame.can_id = LatencyFrameId;
+        frame.can_dlc = 8;
+        for (std::size_t i = 0; i < frameCount; ++i) {
+            std::this_thread::sleep_until(start + microseconds(static_cast<std::int64_t>(i * 1000000.0 / rate)));
+            const std::int64_t sentUs = monotonicMicros();
+            for (int byte = 0; byte < 8; ++byte) {
+                frame.data[byte] = static_cast<std::uint8_t>(sentUs >> (8 * byte));
+            }
+            while (::write(sendFd, &frame, sizeof(frame)) != static_cast<ssize_t>(sizeof(frame))) {
+                if (errno != ENOBUFS && errno != EINTR) {
+                    return;
+                }
+                std::this_thread::sleep_for(microseconds(100));
+            }
+        }
+    });
+
+    sender.join();
+    sending = false;
+    receiver.join();
+    stressing = false;
+    for (std::thread &thread : stressors) {
+        thread.join();
+    }
+    ::close(sendFd);
+    ::close(receiveFd);
+
+    if (received == 0) {
+        std::cerr << "canlatency: no frames received\n";
+        return 1;
+    }
+    if (received < frameCount) {
+        std::cerr << "canlatency: " << frameCount - received << " frames lost\n";
+        latencies.resize(received);
+    }
+    printDistribution(latencies);
+    return maxUs > 0 && latencies.back() > maxUs ? 1 : 0;
+}
+
+#else
+
+int main()
+{
+    std::cerr << "canlatency: only available on Linux\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,218 @@
+// canloadgen - writes deterministic synthetic CAN load onto a SocketCAN
+// interface or as a candump -l log.
+//
+// Usage: canloadgen [--profile <spec>] [--interface <name>] [--speed <factor>|max]
+//                   [--frames <count>]
+//
+// --profile takes the same CanLoadProfile spec as VEHICLESYS_CAN_GENERATOR,
+// e.g. "messages=4000,fd=0.25,load=0.8,seed=7". With --interface (e.g. vcan0)
+// frames are sent through a raw CAN socket, so VehicleSys reads them through
+// its live receive path; without it they are printed to stdout as a candump
+// log for the replay backend or canplayer. --speed paces the schedule in
+// real time (1, the default, when sending) or N times faster; "max", the
+// default for logs, does not pace at all. Generation stops after --frames
+// frames or at the profile's duration-s, whichever comes first.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include "canloadgenerator.h"
+
+namespace {
+
+struct Frame
+{
+    std::uint32_t frameId;
+    std::uint8_t flags;
+    std::uint8_t length;
+    std::int64_t timestampUs;
+    std::uint8_t payload[64];
+};
+
+void printFrame(const Frame &frame, std::int64_t startUs)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    const std::int64_t timeUs = startUs + frame.timestampUs;
+    std::printf("(%lld.%06lld) can0 ", static_cast<long long>(timeUs / 1000000),
+                static_cast<long long>(timeUs % 1000000));
+    if (frame.flags & CanLoadGenerator::ExtendedIdFlag) {
+        std::printf("%08X#", static_cast<unsigned>(frame.frameId));
+    } else {
+        std::printf("%03X#", static_cast<unsigned>(frame.frameId));
+    }
+    if (frame.flags & CanLoadGenerator::FlexibleDataRateFlag) {
+        std::putchar('#');
+        std::putchar(hex[(frame.flags & CanLoadGenerator::BitrateSwitchFlag) ? 1 : 0]);
+    }
+
+    char data[64 * 2 + 1];
+    for (int i = 0; i < frame.length; ++i) {
+        data[i * 2] = hex[frame.payload[i] >> 4];
+        data[i * 2 + 1] = hex[frame.payload[i] & 0xF];
+    }
+    data[frame.length * 2] = '\0';
+    std::printf("%s\n", data);
+}
+
+#ifdef __linux__
+int openSocket(const std::string &interface)
+{
+    const int fd = ::socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0) {
+        return -1;
+    }
+    const int enable = 1;
+    ::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable));
+
+    ifreq request;
+    std::memset(&request, 0, sizeof(request));
+    std::strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    sockaddr_can address;
+    std::memset(&address, 0, sizeof(address));
+    address.can_family = AF_CAN;
+    if (::ioctl(fd, SIOCGIFINDEX, &request) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    address.can_ifindex = request.ifr_ifindex;
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendFrame(int fd, const Frame &frame)
+{
+    canfd_frame raw;
+    std::memset(&raw, 0, sizeof(raw));
+    raw.can_id = frame.frameId | ((frame.flags & CanLoadGenerator::ExtendedIdFlag) ? CAN_EFF_FLAG : 0);
+    raw.len = frame.length;
+    if (frame.flags & CanLoadGenerator::BitrateSwitchFlag) {
+        raw.flags |= CANFD_BRS;
+    }
+    std::memcpy(raw.data, frame.payload, frame.length);
+
+    const std::size_t mtu = (frame.flags & CanLoadGenerator::FlexibleDataRateFlag) ? CANFD_MTU : CAN_MTU;
+    for (;;) {
+        if (::write(fd, &raw, mtu) == static_cast<ssize_t>(mtu)) {
+            return true;
+        }
+        // vcan has no queue limit, real controllers do; back off briefly.
+        if (errno != ENOBUFS) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+#endif
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string profileSpec;
+    std::string interface;
+    double speed = -1;
+    std::uint64_t frameLimit = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "usage: canloadgen [--profile <spec>] [--interface <name>]"
+                         " [--speed <factor>|max] [--frames <count>]\n";
+            return 2;
+        }
+        const std::string value = argv[++i];
+        if (option == "--profile") {
+            profileSpec = value;
+        } else if (option == "--interface") {
+            interface = value;
+        } else if (option == "--speed") {
+            speed = value == "max" ? 0 : std::strtod(value.c_str(), nullptr);
+        } else if (option == "--frames") {
+            frameLimit = std::strtoull(value.c_str(), nullptr, 10);
+        } else {
+            std::cerr << "canloadgen: unknown option " << option << "\n";
+            return 2;
+        }
+    }
+
+    CanLoadProfile profile;
+    std::string error;
+    if (!profile.parse(profileSpec, &error)) {
+        std::cerr << "canloadgen: " << error << "\n";
+        return 2;
+    }
+    if (speed < 0) {
+        speed = interface.empty() ? 0 : 1;
+    }
+
+    int fd = -1;
+    if (!interface.empty()) {
+#ifdef __linux__
+        fd = openSocket(interface);
+        if (fd < 0) {
+            std::cerr << "canloadgen: cannot open " << interface << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+#else
+        std::cerr << "canloadgen: SocketCAN output is only available on Linux\n";
+        return 1;
+#endif
+    }
+
+    CanLoadGenerator generator(profile);
+    std::cerr << "canloadgen: " << profile.messageCount << " IDs, "
+              << static_cast<long long>(generator.framesPerSecond()) << " frames/s scheduled, "
+              << static_cast<int>(generator.estimatedBusLoad() * 100) << "% bus load, seed " << profile.seed << "\n";
+
+    using namespace std::chrono;
+    const auto clockStart = steady_clock::now();
+    const std::int64_t logStartUs = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+
+    Frame frame;
+    std::memset(&frame, 0, sizeof(frame));
+    while ((frameLimit == 0 || generator.generatedFrames() < frameLimit) && generator.next(frame)) {
+        if (speed > 0) {
+            std::this_thread::sleep_until(clockStart + microseconds(static_cast<std::int64_t>(frame.timestampUs / speed)));
+        }
+        if (fd < 0) {
+            printFrame(frame, logStartUs);
+            continue;
+        }
+#ifdef __linux__
+        if (!sendFrame(fd, frame)) {
+            std::cerr << "canloadgen: write to " << interface << " failed: " << std::strerror(errno) << "\n";
+            ::close(fd);
+            return 1;
+        }
+#endif
+    }
+
+#ifdef __linux__
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#endif
+    const double elapsedS = duration_cast<duration<double>>(steady_clock::now() - clockStart).count();
+    std::cerr << "canloadgen: " << generator.generatedFrames() << " frames in " << elapsedS << " s\n";
+    return 0;
+}
@@ -0,0 +1,370 @@
+// dbc2cpp - turns a DBC file into a header of compile-time CAN decoders.
+//
+// Usage: dbc2cpp <input.dbc> <output.h> [namespace]
+//
+// Each BO_ becomes a Message<FrameId> specialisation whose decode()
+// calls onSignal(index, value) for every signal present in the payload.
+// FrameId is the CAN ID with DbcDecoder::ExtendedIdFlag set for extended
+// IDs, as DBC files write them, so an 11-bit and a 29-bit message of the
+// same number stay apart.
+// Each SG_ becomes a type deriving from DbcBitField with its layout as
+// template arguments and factor/offset/range as constexpr members, so the
+// compiler folds the whole extraction.
+//
+// Signal indices follow the same rules as DbcDecoder (file order, muxed and
+// unsupported signals skipped), so a table built at runtime from the same
+// DBC and the generated decoder agree on every index. The generated
+// SourceChecksum lets the application check that at runtime.
+//
+// Deliberately dependency-free: it runs at build time before Qt code is
+// compiled.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Same as DbcDecoder::ExtendedIdFlag
+constexpr uint32_t ExtendedIdFlag = 0x80000000u;
+
+struct Signal
+{
+    std::string name;
+    int index = 0;
+    int firstByte = 0;
+    int byteCount = 0;
+    int shift = 0;
+    int length = 0;
+    bool bigEndian = false;
+    bool isSigned = false;
+    double factor = 1.0;
+    double offset = 0.0;
+    double minimum = 0.0;
+    double maximum = 0.0;
+    std::string unit;
+};
+
+struct Message
+{
+    uint32_t frameId = 0;       // with ExtendedIdFlag for extended IDs
+    std::string name;
+    int length = 0;
+    std::vector<Signal> signalList;
+};
+
+// Same checksum as DbcDecoder::checksum().
+uint32_t fnv1a(const std::string &data)
+{
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+std::string trim(const std::string &s)
+{
+    const auto begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    const auto end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+std::string identifier(const std::string &name)
+{
+    std::string id = name;
+    if (id.empty() || (id[0] >= '0' && id[0] <= '9')) {
+        id = "_" + id;
+    }
+    return id;
+}
+
+std::string number(double value)
+{
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    std::string text(buffer);
+    if (text.find_first_of(".eEn") == std::string::npos) {
+        text += ".0";
+    }
+    return text;
+}
+
+// Mirrors DbcDecoder::resolveLayout(), expressed as a byte span.
+bool resolveLayout(Signal &signal, int startBit, int length, bool bigEndian)
+{
+    constexpr int MaxBits = 64 * 8;
+    if (length < 1 || length > 64 || startBit < 0 || startBit >= MaxBits) {
+        return false;
+    }
+
+    signal.length = length;
+    signal.bigEndian = bigEndian;
+
+    if (!bigEndian) {
+        const int lastBit = startBit + length - 1;
+        if (lastBit >= MaxBits || (startBit % 8) + length > 64) {
+            return false;
+        }
+        signal.firstByte = startBit / 8;
+        signal.byteCount = lastBit / 8 - signal.firstByte + 1;
+        signal.shift = startBit % 8;
+        return true;
+    }
+
+    const int msbLinear = (startBit / 8) * 8 + (7 - startBit % 8);
+    const int lsbLinear = msbLinear + length - 1;
+    if (lsbLinear >= MaxBits || (msbLinear % 8) + length > 64) {
+        return false;
+    }
+    signal.firstByte = msbLinear / 8;
+    signal.byteCount = lsbLinear / 8 - signal.firstByte + 1;
+    signal.shift = signal.byteCount * 8 - 1 - (lsbLinear - signal.firstByte * 8);
+    return true;
+}
+
+bool parse(const std::string &text, std::vector<Message> &messages, std::string &error)
+{
+    static const std::regex messagePattern(R"re(^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+))re");
+    static const std::regex signalPattern(
+        R"re(^SG_\s+(\w+)\s*(M|m\d+)?\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*)re"
+        R"re(\(([^,]+),([^)]+)\)\s*\[([^|]+)\|([^\]]+)\]\s*"([^"]*)")re");
+
+    std::istringstream stream(text);
+    std::string rawLine;
+    Message *current = nullptr;
+    int lineNumber = 0;
+    int signalIndex = 0;
+
+    while (std::getline(stream, rawLine)) {
+        ++lineNumber;
+        const std::string line = trim(rawLine);
+        std::smatch match;
+
+        if (line.rfind("BO_ ", 0) == 0) {
+            if (!std::regex_search(line, match, messagePattern)) {
+                error = "Malformed BO_ at line " + std::to_string(lineNumber);
+                return false;
+            }
+            if (match[2] == "VECTOR__INDEPENDENT_SIG_MSG") {
+                current = nullptr;
+                continue;
+            }
+            Message message;
+            message.frameId = static_cast<uint32_t>(std::stoul(match[1]));
+            // An ID too long for 11 bits is extended even without the flag
+            if ((message.frameId & ~ExtendedIdFlag) > 0x7FFu) {
+                message.frameId |= ExtendedIdFlag;
+            }
+            for (const Message &other : messages) {
+                if (other.frameId == message.frameId) {
+                    error = "Duplicate message ID " + std::string(match[1]) + " at line " + std::to_string(lineNumber);
+                    return false;
+                }
+            }
+            message.name = match[2];
+            message.length = std::min(std::stoi(match[3]), 64);
+            messages.push_back(message);
+            current = &messages.back();
+            continue;
+        }
+
+        if (line.rfind("SG_ ", 0) == 0) {
+            if (!current) {
+                continue;
+            }
+            if (!std::regex_search(line, match, signalPattern)) {
+                error = "Malformed SG_ at line " + std::to_string(lineNumber);
+                return false;
+            }
+            const std::string multiplex = match[2];
+            if (!multiplex.empty() && multiplex[0] == 'm') {
+                std::cerr << "dbc2cpp: skipping multiplexed signal " << match[1] << "\n";
+                continue;
+            }
+
+            Signal signal;
+            signal.name = match[1];
+            if (!resolveLayout(signal, std::stoi(match[3]), std::stoi(match[4]), match[5] == "0")) {
+                std::cerr << "dbc2cpp: unsupported layout for signal " << signal.name << "\n";
+                continue;
+            }
+            signal.isSigned = match[6] == "-";
+            signal.factor = std::stod(trim(match[7]));
+            signal.offset = std::stod(trim(match[8]));
+            signal.minimum = std::stod(trim(match[9]));
+            signal.maximum = std::stod(trim(match[10]));
+            signal.unit = match[11];
+            // DbcDecoder rejects these too; signals are bound by name alone
+            for (const Message &other : messages) {
+                for (const Signal &existing : other.signalList) {
+                    if (existing.name == signal.name) {
+                        error = "Duplicate signal name " + signal.name + " in " + current->name + " at line "
+                                + std::to_string(lineNumber) + ", already in " + other.name;
+                        return false;
+                    }
+                }
+            }
+            signal.index = signalIndex++;
+            current->signalList.push_back(signal);
+            continue;
+        }
+
+        if (!line.empty()) {
+            current = nullptr;
+        }
+    }
+
+    if (messages.empty()) {
+        error = "DBC contains no messages";
+        return false;
+    }
+    return true;
+}
+
+void emitHeader(std::ostream &out, const std::vector<Message> &messages, const std::string &ns,
+                const std::string &source, uint32_t checksum, int signalCount)
+{
+    std::string guard = ns;
+    for (char &c : guard) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    guard += "_GENERATED_H";
+
+    char checksumText[16];
+    std::snprintf(checksumText, sizeof(checksumText), "0x%08xu", checksum);
+
+    out << "// Generated by dbc2cpp from " << source << ". Do not edit.\n"
+        << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+        << "#include \"dbcbitfield.h\"\n\n"
+        << "namespace " << ns << " {\n\n"
+        << "// FNV-1a of the source DBC, see DbcDecoder::checksum().\n"
+        << "constexpr quint32 SourceChecksum = " << checksumText << ";\n"
+        << "constexpr int SignalCount = " << signalCount << ";\n"
+        << "constexpr int MessageCount = " << messages.size() << ";\n\n"
+        << "template <quint32 FrameId>\nstruct Message;\n\n";
+
+    for (const Message &message : messages) {
+        const std::string messageId = identifier(message.name);
+        out << "namespace " << messageId << " {\n";
+        for (const Signal &signal : message.signalList) {
+            out << "struct " << identifier(signal.name) << " : DbcBitField<" << signal.firstByte << ", "
+                << signal.byteCount << ", " << signal.shift << ", " << signal.length << ", "
+                << (signal.bigEndian ? "true" : "false") << ", " << (signal.isSigned ? "true" : "false")
+                << ">\n{\n"
+                << "    static constexpr int index = " << signal.index << ";\n"
+                << "    static constexpr double factor = " << number(signal.factor) << ";\n"
+                << "    static constexpr double offset = " << number(signal.offset) << ";\n"
+                << "    static constexpr double minimum = " << number(signal.minimum) << ";\n"
+                << "    static constexpr double maximum = " << number(signal.maximum) << ";\n"
+                << "    static constexpr bool clamped = " << (signal.maximum > signal.minimum ? "true" : "false")
+                << ";\n};\n";
+        }
+        out << "}\n\n";
+
+        char idText[16];
+        std::snprintf(idText, sizeof(idText), "0x%xu", message.frameId);
+        out << "template <>\nstruct Message<" << idText << ">\n{\n"
+            << "    static constexpr quint32 frameId = " << idText << ";\n"
+            << "    static constexpr int length = " << message.length << ";\n\n"
+            << "    template <typename Callback>\n"
+            << "    static int decode(const quint8 *data, int size, Callback &&onSignal, const quint8 *wanted = nullptr)\n"
+            << "    {\n"
+            << "        int decoded = 0;\n";
+        for (const Signal &signal : message.signalList) {
+            const std::string type = messageId + "::" + identifier(signal.name);
+            out << "        if (size >= " << type << "::requiredBytes && (!wanted || wanted[" << type << "::index])) {\n"
+                << "            onSignal(" << type << "::index, dbcPhysicalValue<" << type << ">(data));\n"
+                << "            ++decoded;\n"
+                << "        }\n";
+        }
+        out << "        return decoded;\n    }\n};\n\n";
+    }
+
+    out << "// Decodes one frame; returns false when the ID is not in the DBC. frameId\n"
+        << "// carries DbcDecoder::ExtendedIdFlag for extended frames. With wanted (one\n"
+        << "// entry per signal index), signals whose entry is 0 are skipped.\n"
+        << "template <typename Callback>\n"
+        << "inline bool decode(quint32 frameId, const quint8 *data, int size, Callback &&onSignal,\n"
+        << "                   const quint8 *wanted = nullptr)\n{\n"
+        << "    switch (frameId) {\n";
+    for (const Message &message : messages) {
+        char idText[16];
+        std::snprintf(idText, sizeof(idText), "0x%xu", message.frameId);
+        out << "    case " << idText << ":\n"
+            << "        Message<" << idText << ">::decode(data, size, onSignal, wanted);\n"
+            << "        return true;\n";
+    }
+    out << "    default:\n        return false;\n    }\n}\n\n"
+        << "} // namespace " << ns << "\n\n"
+        << "#endif // " << guard << "\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        std::cerr << "usage: dbc2cpp <input.dbc> <output.h> [namespace]\n";
+        return 2;
+    }
+
+    const std::string inputPath = argv[1];
+    const std::string outputPath = argv[2];
+    const std::string ns = argc > 3 ? argv[3] : "VehicleDbc";
+
+    std::ifstream input(inputPath, std::ios::binary);
+    if (!input) {
+        std::cerr << "dbc2cpp: cannot open " << inputPath << "\n";
+        return 1;
+    }
+    std::ostringstream contents;
+    contents << input.rdbuf();
+    const std::string text = contents.str();
+
+    std::vector<Message> messages;
+    std::string error;
+    if (!parse(text, messages, error)) {
+        std::cerr << "dbc2cpp: " << inputPath << ": " << error << "\n";
+        return 1;
+    }
+
+    int signalCount = 0;
+    for (const Message &message : messages) {
+        signalCount += static_cast<int>(message.signalList.size());
+    }
+
+    std::ostringstream header;
+    const auto slash = inputPath.find_last_of("/\\");
+    emitHeader(header, messages, ns, slash == std::string::npos ? inputPath : inputPath.substr(slash + 1),
+               fnv1a(text), signalCount);
+
+    // Only touch the output when it changes, so dependants are not rebuilt.
+    std::ifstream existing(outputPath, std::ios::binary);
+    if (existing) {
+        std::ostringstream previous;
+        previous << existing.rdbuf();
+        if (previous.str() == header.str()) {
+            return 0;
+        }
+    }
+
+    std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        std::cerr << "dbc2cpp: cannot write " << outputPath << "\n";
+        return 1;
+    }
+    output << header.str();
+    return output ? 0 : 1;
+}
@@ -0,0 +1,354 @@
+// obdecusim - emulates an engine ECU answering OBD-II service 01 and UDS
+// ReadDataByIdentifier (0x22) requests over ISO-TP on a SocketCAN interface.
+//
+// Usage: obdecusim --interface <name> [--request-id <id>] [--response-id <id>]
+//                  [--extended] [--delay-ms <ms>] [--block-size <n>]
+//                  [--stmin <encoded>]
+//
+// Listens on the physical request ID (0x7E0 by default) and the functional
+// 0x7DF and answers on the response ID (0x7E8). Service 01 reports the
+// supported-PID bitmaps and slowly varying values for the PIDs listed below,
+// several per request like a real ECU. Service 0x22 serves the VIN (0xF190,
+// a multi-frame response) and the ISO 27145 mirror of every supported PID
+// (0xF400 + PID). --delay-ms holds each response back that long, to mimic a
+// busy ECU; --block-size and --stmin are the flow control it asks for when
+// receiving a multi-frame request. IDs above 0x7FF, or any ID with
+// --extended, are 29-bit: requests must arrive as extended frames and
+// responses go out as extended frames; the functional 0x7DF stays 11-bit.
+//
+// Typical use with a virtual bus:
+//
+//     sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+//     obdecusim --interface vcan0 &
+//     VEHICLESYS_DIAGNOSTICS=diagnostics/obd.conf VehicleSys
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include "isotp.h"
+#include "obdpid.h"
+
+namespace {
+
+constexpr std::uint32_t FunctionalRequestId = 0x7DF;
+constexpr std::uint8_t SupportedPids[] = {
+    0x04, 0x05, 0x0C, 0x0D, 0x0F, 0x10, 0x11, 0x1F, 0x2F, 0x33, 0x42, 0x46, 0x49, 0x5C, 0x5E
+};
+const char Vin[] = "VSYS0BDEMU0000001";
+
+std::int64_t nowMicros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool isSupported(std::uint8_t pid)
+{
+    for (std::uint8_t supported : SupportedPids) {
+        if (supported == pid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Physical value of pid at t seconds: a slow drive cycle
+double physicalValue(std::uint8_t pid, double t)
+{
+    const double drive = 0.5 - 0.5 * std::cos(t / 20.0);       // 0..1 over ~2 min
+    const double speed = 130.0 * drive;
+    const double rpm = 800.0 + 2600.0 * drive + 300.0 * std::sin(t * 1.3);
+    switch (pid) {
+    case 0x04: return 20.0 + 60.0 * drive;
+    case 0x05: return std::min(90.0, 20.0 + t * 0.5);
+    case 0x0C: return rpm;
+    case 0x0D: return speed;
+    case 0x0F: return 25.0 + 10.0 * drive;
+    case 0x10: return rpm * 0.01 + 2.0;
+    case 0x11: return 10.0 + 70.0 * drive;
+    case 0x1F: return t;
+    case 0x2F: return std::max(5.0, 80.0 - t * 0.01);
+    case 0x33: return 101.0;
+    case 0x42: return 13.8 + 0.2 * std::sin(t);
+    case 0x46: return 18.0;
+    case 0x49: return 10.0 + 70.0 * drive;
+    case 0x5C: return std::min(100.0, 20.0 + t * 0.4);
+    case 0x5E: return 0.8 + 12.0 * drive;
+    default: return 0;
+    }
+}
+
+// Appends the data bytes of pid to out; false if it is not supported
+bool appendPid(std::uint8_t pid, double t, std::vector<std::uint8_t> &out)
+{
+    if (pid % 0x20 == 0 && pid <= 0x40) {
+        // Bitmap of PIDs pid+1..pid+0x20, bit 0 announcing the next range
+        std::uint32_t bits = 0;
+        for (std::uint8_t supported : SupportedPids) {
+            if (supported > pid && supported <= pid + 0x20) {
+                bits |= 1u << (0x20 - (supported - pid));
+            }
+        }
+        if (pid < 0x40) {
+            bits |= 1u;
+        }
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<std::uint8_t>(bits >> shift));
+        }
+        return true;
+    }
+    if (!isSupported(pid)) {
+        return false;
+    }
+    const ObdPidScaling *scaling = obdPidScaling(pid);
+    const int length = obdPidLength(pid);
+    const double raw = scaling ? (physicalValue(pid, t) - scaling->offset) / scaling->scale : physicalValue(pid, t);
+    const double limit = std::pow(256.0, scaling ? scaling->bytes : length) - 1.0;
+    const std::uint32_t value = static_cast<std::uint32_t>(std::max(0.0, std::min(limit, std::round(raw))));
+    const int bytes = scaling ? scaling->bytes : length;
+    for (int i = bytes - 1; i >= 0; --i) {
+        out.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+    }
+    for (int i = bytes; i < length; ++i) {
+        out.push_back(0);
+    }
+    return true;
+}
+
+// The response to request, empty if the ECU stays silent
+std::vector<std::uint8_t> respond(const std::vector<std::uint8_t> &request, bool functional, double t)
+{
+    std::vector<std::uint8_t> response;
+    if (request.empty()) {
+        return response;
+    }
+    const std::uint8_t service = request[0];
+    response.push_back(static_cast<std::uint8_t>(service + 0x40));
+
+    if (service == 0x01 && request.size() >= 2 && request.size() <= 7) {
+        for (std::size_t i = 1; i < request.size(); ++i) {
+            response.push_back(request[i]);
+            if (!appendPid(request[i], t, response)) {
+                response.pop_back();
+            }
+        }
+        // J1979: an ECU supporting none of the PIDs does not answer
+        if (response.size() == 1) {
+            response.clear();
+        }
+        return response;
+    }
+    if (service == 0x22 && request.size() >= 3 && request.size() % 2 == 1) {
+        for (std::size_t i = 1; i + 1 < request.size(); i += 2) {
+            const std::uint16_t did = static_cast<std::uint16_t>((request[i] << 8) | request[i + 1]);
+            const std::size_t mark = response.size();
+            response.push_back(request[i]);
+            response.push_back(request[i + 1]);
+            if (did == 0xF190) {
+                response.insert(response.end(), Vin, Vin + sizeof(Vin) - 1);
+            } else if ((did & 0xFF00) != 0xF400 || !appendPid(static_cast<std::uint8_t>(did & 0xFF), t, response)) {
+                response.resize(mark);
+            }
+        }
+        if (response.size() == 1) {
+            response = { 0x7F, service, 0x31 };     // request out of range
+        }
+    } else {
+        response = { 0x7F, service, 0x11 };         // service not supported
+    }
+    if (functional) {
+        response.clear();   // only OBD services are answered to functional requests
+    }
+    return response;
+}
+
+#ifdef __linux__
+int openSocket(const std::string &interface)
+{
+    const int fd = ::socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0) {
+        return -1;
+    }
+    ifreq request;
+    std::memset(&request, 0, sizeof(request));
+    std::strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    sockaddr_can address;
+    std::memset(&address, 0, sizeof(address));
+    address.can_family = AF_CAN;
+    if (::ioctl(fd, SIOCGIFINDEX, &request) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    address.can_ifindex = request.ifr_ifindex;
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendFrame(int fd, std::uint32_t frameId, bool extended, const std::uint8_t *data)
+{
+    can_frame raw;
+    std::memset(&raw, 0, sizeof(raw));
+    raw.can_id = extended ? (frameId & CAN_EFF_MASK) | CAN_EFF_FLAG : frameId & CAN_SFF_MASK;
+    raw.can_dlc = IsoTpChannel::FrameLength;
+    std::memcpy(raw.data, data, IsoTpChannel::FrameLength);
+    return ::write(fd, &raw, sizeof(raw)) == static_cast<ssize_t>(sizeof(raw));
+}
+#endif
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string interface;
+    std::uint32_t requestId = 0x7E0;
+    std::uint32_t responseId = 0x7E8;
+    bool extendedIds = false;
+    std::int64_t delayUs = 0;
+    IsoTpConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--extended") {
+            extendedIds = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "usage: obdecusim --interface <name> [--request-id <id>] [--response-id <id>]"
+                         " [--extended] [--delay-ms <ms>] [--block-size <n>] [--stmin <encoded>]\n";
+            return 2;
+        }
+        const std::string value = argv[++i];
+        if (option == "--interface") {
+            interface = value;
+        } else if (option == "--request-id") {
+            requestId = static_cast<std::uint32_t>(std::strtoul(value.c_str(), nullptr, 0));
+        } else if (option == "--response-id") {
+            responseId = static_cast<std::uint32_t>(std::strtoul(value.c_str(), nullptr, 0));
+        } else if (option == "--delay-ms") {
+            delayUs = static_cast<std::int64_t>(std::strtod(value.c_str(), nullptr) * 1000.0);
+        } else if (option == "--block-size") {
+            config.blockSize = static_cast<std::uint8_t>(std::strtoul(value.c_str(), nullptr, 0));
+        } else if (option == "--stmin") {
+            config.separationTime = static_cast<std::uint8_t>(std::strtoul(value.c_str(), nullptr, 0));
+        } else {
+            std::cerr << "obdecusim: unknown option " << option << "\n";
+            return 2;
+        }
+    }
+    if (interface.empty()) {
+        std::cerr << "obdecusim: --interface is required\n";
+        return 2;
+    }
+    const bool requestExtended = extendedIds || requestId > 0x7FFu;
+    const bool responseExtended = extendedIds || responseId > 0x7FFu;
+
+#ifdef __linux__
+    const int fd = openSocket(interface);
+    if (fd < 0) {
+        std::cerr << "obdecusim: cannot open " << interface << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::cerr << "obdecusim: answering 0x" << std::hex << requestId << " and 0x" << FunctionalRequestId
+              << " on 0x" << responseId << std::dec << " on " << interface << "\n";
+
+    IsoTpChannel physical(config);
+    IsoTpChannel functional(config);
+    const std::int64_t startUs = nowMicros();
+    std::vector<std::uint8_t> pending;
+    std::int64_t pendingDueUs = IsoTpChannel::NoDeadline;
+    std::uint64_t requests = 0;
+
+    for (;;) {
+        std::int64_t now = nowMicros();
+
+        const IsoTpChannel::Event timeout = physical.poll(now);
+        if (timeout != IsoTpChannel::NoEvent) {
+            std::cerr << "obdecusim: " << (timeout == IsoTpChannel::TransmitFailed ? "no flow control" : "request incomplete")
+                      << "\n";
+        }
+        if (!pending.empty() && now >= pendingDueUs && !physical.isSending()) {
+            physical.send(pending.data(), pending.size());
+            pending.clear();
+            pendingDueUs = IsoTpChannel::NoDeadline;
+        }
+        std::uint8_t frame[IsoTpChannel::FrameLength];
+        while (physical.nextDeadlineUs() <= now && physical.nextFrame(now, frame)) {
+            if (!sendFrame(fd, responseId, responseExtended, frame)) {
+                std::cerr << "obdecusim: write to " << interface << " failed: " << std::strerror(errno) << "\n";
+            }
+        }
+
+        const std::int64_t wakeUs = std::min(physical.nextDeadlineUs(), pendingDueUs);
+        int timeoutMs = -1;
+        if (wakeUs != IsoTpChannel::NoDeadline) {
+            timeoutMs = static_cast<int>(std::max<std::int64_t>(0, (wakeUs - now + 999) / 1000));
+        }
+        pollfd descriptor = { fd, POLLIN, 0 };
+        const int ready = ::poll(&descriptor, 1, timeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "obdecusim: poll failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        can_frame raw;
+        if (::read(fd, &raw, sizeof(raw)) != static_cast<ssize_t>(sizeof(raw))) {
+            continue;
+        }
+        const std::uint32_t frameId = raw.can_id & CAN_EFF_MASK;
+        const bool frameExtended = (raw.can_id & CAN_EFF_FLAG) != 0;
+        const bool isPhysical = frameId == requestId && frameExtended == requestExtended;
+        const bool isFunctional = !isPhysical && frameId == FunctionalRequestId && !frameExtended;
+        if ((raw.can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG)) || (!isPhysical && !isFunctional)) {
+            continue;
+        }
+        now = nowMicros();
+        IsoTpChannel &channel = isFunctional ? functional : physical;
+        // Functional requests are single frames; there is nobody to send
+        // flow control to
+        if (isFunctional && (raw.data[0] >> 4) != 0) {
+            continue;
+        }
+        if (channel.receive(raw.data, raw.can_dlc, now) != IsoTpChannel::MessageReceived) {
+            continue;
+        }
+        ++requests;
+        const std::vector<std::uint8_t> response =
+            respond(channel.message(), isFunctional, static_cast<double>(now - startUs) / 1e6);
+        if (!response.empty()) {
+            pending = response;
+            pendingDueUs = now + delayUs;
+        }
+    }
+
+    ::close(fd);
+    std::cerr << "obdecusim: " << requests << " requests received\n";
+    return 1;
+#else
+    std::cerr << "obdecusim: SocketCAN is only available on Linux\n";
+    return 1;
+#endif
+}
@@ -0,0 +1,136 @@
+// vehiclestatedump - prints the vehicle state VehicleSys publishes in shared memory.
+//
+// Usage: vehiclestatedump [--name <shm-name>] [--watch <ms>] [signal...]
+//
+// Prints every signal, or only those named, as "<name> <value> <age-ms>"
+// with "-" for the value of a signal that is not valid. --watch repeats
+// every <ms> milliseconds while the publication advances and reopens the
+// segment when VehicleSys restarts. Doubles as an example of
+// VehicleStateReader.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vehiclestatereader.h"
+
+namespace {
+
+std::int64_t monotonicMicros()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// False if the state could not be read, see VehicleStateReader::readError()
+bool printState(const VehicleStateReader &reader, const std::vector<int> &indexes)
+{
+    VehicleStateReader::Signal state[VehicleStateFormat::MaxSignals];
+    std::int64_t publishedUs = 0;
+    std::uint64_t storeSequence = 0;
+    if (reader.readAll(state, VehicleStateFormat::MaxSignals, &publishedUs, &storeSequence) < 0) {
+        return false;
+    }
+
+    const std::int64_t nowUs = monotonicMicros();
+    std::printf("# update %llu, published %.1f ms ago\n", static_cast<unsigned long long>(storeSequence),
+                publishedUs > 0 ? static_cast<double>(nowUs - publishedUs) / 1000.0 : 0.0);
+    for (const int index : indexes) {
+        const VehicleStateReader::Signal &signal = state[index];
+        const double ageMs = signal.timestampUs > 0 ? static_cast<double>(nowUs - signal.timestampUs) / 1000.0 : -1.0;
+        if (!signal.valid) {
+            std::printf("%-20s %12s %10.1f\n", reader.signalName(index), "-", ageMs);
+        } else if (reader.signalType(index) == VehicleStateFormat::RealType) {
+            std::printf("%-20s %12.3f %10.1f\n", reader.signalName(index), signal.value, ageMs);
+        } else {
+            std::printf("%-20s %12.0f %10.1f\n", reader.signalName(index), signal.value, ageMs);
+        }
+    }
+    std::fflush(stdout);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::string name = VehicleStateFormat::DefaultName;
+    int watchMs = 0;
+    std::vector<std::string> wanted;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc) {
+            name = argv[++i];
+        } else if (arg == "--watch" && i + 1 < argc) {
+            watchMs = std::atoi(argv[++i]);
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "usage: vehiclestatedump [--name <shm-name>] [--watch <ms>] [signal...]" << std::endl;
+            return 2;
+        } else {
+            wanted.push_back(arg);
+        }
+    }
+
+    VehicleStateReader reader;
+    if (!reader.open(name.c_str())) {
+        std::cerr << reader.errorString() << std::endl;
+        return 1;
+    }
+
+    std::vector<int> indexes;
+    const auto resolve = [&]() {
+        indexes.clear();
+        for (int index = 0; index < reader.signalCount(); ++index) {
+            if (wanted.empty()) {
+                indexes.push_back(index);
+            }
+        }
+        for (const std::string &signal : wanted) {
+            const int index = reader.signalIndex(signal.c_str());
+            if (index < 0) {
+                std::cerr << "no signal named " << signal << std::endl;
+                return false;
+            }
+            indexes.push_back(index);
+        }
+        return true;
+    };
+    if (!resolve()) {
+        return 1;
+    }
+
+    if (!printState(reader, indexes) && watchMs <= 0) {
+        std::cerr << name << (reader.readError() == VehicleStateReader::WriterStopped
+                                  ? ": VehicleSys stopped while publishing"
+                                  : ": VehicleSys is too busy publishing to be read")
+                  << std::endl;
+        return 1;
+    }
+    std::uint64_t lastSequence = reader.sequence();
+    while (watchMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(watchMs));
+        if (!reader.isWriterRunning()) {
+            // VehicleSys stopped; wait for its next segment
+            if (!reader.open(name.c_str()) || !reader.isWriterRunning()) {
+                continue;
+            }
+            if (!resolve()) {
+                return 1;
+            }
+            lastSequence = 0;
+        }
+        const std::uint64_t sequence = reader.sequence();
+        // A failed read is tried again next time; a stopped writer is
+        // noticed above
+        if (sequence != lastSequence && printState(reader, indexes)) {
+            lastSequence = sequence;
+        }
+    }
+    return 0;
+}
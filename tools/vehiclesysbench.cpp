@@ -0,0 +1,590 @@
+// VehicleSysBench - QBENCHMARK suite for the decode, simulation, notification
+// and media hot paths.
+//
+// Usage: VehicleSysBench [--json <path>] [QtTest options] [function[:tag]...]
+//
+// Runs like any QtTest binary, so -callgrind, -perf, -tickcounter,
+// -iterations and friends pick the measurement. --json also writes every
+// result as {"function", "tag", "metric", "value", "iterations"} records, with
+// value per iteration, for tracking regressions between builds. Frames are
+// synthetic, varied per message so the controller's same-payload shortcut
+// does not hide the decoder; VEHICLESYS_BENCH_REPLAY names a candump or ASC
+// capture to use for processCanFrames instead. decodeAllocations fails if
+// decoding batches on two buses, and the notification flush and state
+// delta that follow, allocate once the controller has warmed up.
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QMetaMethod>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QTemporaryDir>
+#include <QTemporaryFile>
+#include <QVariantMap>
+#include <QXmlStreamReader>
+#include <QtTest>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include "canbuscontroller.h"
+#include "canframe.h"
+#include "canlogreader.h"
+#include "dbcdecoder.h"
+#include "mediacontroller.h"
+#include "vehicledatacontroller.h"
+#include "vehicledataproxy.h"
+#include "vehiclestatedelta.h"
+#ifdef HAVE_GENERATED_DBC
+#include "vehicledbc.h"
+#endif
+
+namespace {
+
+// Allocations made by the current thread while counting; glibc's malloc
+// family and aligned allocators are interposed, which operator new and
+// Qt's containers go through.
+thread_local bool t_countAllocations = false;
+thread_local qint64 t_allocations = 0;
+
+struct AllocationCounter
+{
+    AllocationCounter() { t_allocations = 0; t_countAllocations = true; }
+    ~AllocationCounter() { t_countAllocations = false; }
+    qint64 count() const { return t_allocations; }
+};
+
+struct MessageCase
+{
+    const char *name;
+    quint32 frameId;
+    quint8 payload[8];
+    // Byte stepped through its masked values from frame to frame; chosen
+    // so no warning rule changes state
+    int variedByte;
+    quint8 variedMask;
+};
+
+// Cruising at 60 km/h, 2000 rpm, engine warm, seatbelt on
+const MessageCase Messages[] = {
+    { "Engine_Data", 0x100, { 0x40, 0x1F, 40, 130, 20, 0x2C, 0x01, 153 }, 0, 0xFF },
+    { "Vehicle_Speed", 0x200, { 0x58, 0x02, 0x58, 0x02, 0x58, 0x02, 0x58, 0x02 }, 0, 0xFF },
+    { "HVAC_Status", 0x300, { 1, 3, 44, 44, 122, 0, 0, 0 }, 4, 0x07 },
+    { "Transmission_Data", 0x400, { 3, 0, 0, 0, 0, 0, 0, 0 }, 0, 0x03 },
+    { "Battery_Status", 0x500, { 0x78, 0x05, 0, 0, 0, 0, 0, 0 }, 0, 0x3F },
+    { "Warning_Lights", 0x600, { 0, 0x04, 0, 0, 0, 0, 0, 0 }, 1, 0x03 },
+    { "Door_Status", 0x700, { 0x10, 0, 0, 0, 0, 0, 0, 0 }, 1, 0xFF },
+};
+const int MessageCount = int(sizeof(Messages) / sizeof(Messages[0]));
+
+// Payload variants per message; a power of two for cheap wrapping
+const int VariantCount = 1024;
+const int BatchSize = 64;
+
+QByteArray variantPayload(const MessageCase &message, int variant)
+{
+    QByteArray payload(reinterpret_cast<const char *>(message.payload), 8);
+    payload[message.variedByte] = char((message.payload[message.variedByte] & ~message.variedMask)
+                                       | (variant & message.variedMask));
+    return payload;
+}
+
+// Counts what the proxy notifies, one connection per listener per signal
+class NotificationCounter : public QObject
+{
+    Q_OBJECT
+
+public:
+    qint64 notifications = 0;
+
+public slots:
+    void count() { ++notifications; }
+};
+
+} // namespace
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    if (t_countAllocations) {
+        ++t_allocations;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (t_countAllocations) {
+        ++t_allocations;
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    if (t_countAllocations) {
+        ++t_allocations;
+    }
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    if (t_countAllocations) {
+        ++t_allocations;
+    }
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (t_countAllocations) {
+        ++t_allocations;
+    }
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    if (t_countAllocations) {
+        ++t_allocations;
+    }
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *memory = __libc_memalign(alignment, size);
+    if (!memory) {
+        return ENOMEM;
+    }
+    *pointer = memory;
+    return 0;
+}
+}
+#endif
+
+class VehicleSysBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void processCanFrame_data();
+    void processCanFrame();
+    void processCanFrames();
+    void decodeAllocations();
+    void dbcDecoder_data();
+    void dbcDecoder();
+
+    void simulateVehicleData_data();
+    void simulateVehicleData();
+    void notificationFanOut_data();
+    void notificationFanOut();
+
+    void loadMusicDirectory_data();
+    void loadMusicDirectory();
+    void trackNameParsing_data();
+    void trackNameParsing();
+
+private:
+    // Message index to payload variants, built once
+    QVector<QVector<QByteArray>> m_payloads;
+    // Round-robin over every message, or the capture
+    QVector<CanFrame> m_replay;
+    // QTest may run a benchmark function more than once; libraries are
+    // only created the first time
+    QHash<int, QSharedPointer<QTemporaryDir>> m_libraries;
+    // Keeps decoded values alive past the optimizer
+    double m_sink = 0.0;
+};
+
+void VehicleSysBench::initTestCase()
+{
+    m_payloads.resize(MessageCount);
+    for (int message = 0; message < MessageCount; ++message) {
+        m_payloads[message].reserve(VariantCount);
+        for (int variant = 0; variant < VariantCount; ++variant) {
+            m_payloads[message].append(variantPayload(Messages[message], variant));
+        }
+    }
+
+    const QString capture = qEnvironmentVariable("VEHICLESYS_BENCH_REPLAY");
+    if (!capture.isEmpty()) {
+        CanLogReader reader;
+        QVERIFY2(reader.open(capture), qPrintable(reader.errorString()));
+        CanFrame frame;
+        while (reader.readFrame(frame)) {
+            m_replay.append(frame);
+        }
+        QVERIFY2(!m_replay.isEmpty(), "the capture has no frames");
+        return;
+    }
+
+    m_replay.reserve(VariantCount * MessageCount);
+    for (int variant = 0; variant < VariantCount; ++variant) {
+        for (int message = 0; message < MessageCount; ++message) {
+            CanFrame frame = CanFrame::make(Messages[message].frameId, 8, 0);
+            std::memcpy(frame.payload, m_payloads[message][variant].constData(), 8);
+            m_replay.append(frame);
+        }
+    }
+}
+
+void VehicleSysBench::processCanFrame_data()
+{
+    QTest::addColumn<int>("message");
+    for (int message = 0; message < MessageCount; ++message) {
+        QTest::newRow(Messages[message].name) << message;
+    }
+}
+
+void VehicleSysBench::processCanFrame()
+{
+    QFETCH(int, message);
+    VehicleDataController controller;
+    const quint32 frameId = Messages[message].frameId;
+    const QVector<QByteArray> &payloads = m_payloads[message];
+    int variant = 0;
+    QBENCHMARK {
+        controller.processCanFrame(frameId, payloads[variant]);
+        variant = (variant + 1) & (VariantCount - 1);
+    }
+}
+
+void VehicleSysBench::processCanFrames()
+{
+    VehicleDataController controller;
+    QVector<CanFrame> batch;
+    batch.reserve(BatchSize);
+    int next = 0;
+    qint64 timestampUs = 0;
+    QBENCHMARK {
+        batch.clear();
+        for (int i = 0; i < BatchSize; ++i) {
+            CanFrame frame = m_replay[next];
+            frame.timestampUs = timestampUs += 100;
+            batch.append(frame);
+            next = next + 1 < m_replay.size() ? next + 1 : 0;
+        }
+        controller.processCanFrames(batch);
+    }
+}
+
+void VehicleSysBench::decodeAllocations()
+{
+#ifndef __GLIBC__
+    QSKIP("Allocations are only counted with glibc");
+#endif
+    // Bus 1 gets its own table, so frames go through the per-bus lookup
+    VehicleDataController controller;
+    QVERIFY(controller.loadBusDbc(1, QStringLiteral(":/dbc/vehicle.dbc")));
+
+    // Takes the deltas the proxy would, without the queued call that
+    // carries them to the GUI thread
+    qint64 deltas = 0;
+    connect(&controller, &VehicleDataController::stateChanged, this,
+            [&deltas](const VehicleStateDelta &) { ++deltas; }, Qt::DirectConnection);
+
+    QVector<CanFrame> batch(BatchSize);
+    qint64 timestampUs = canMonotonicMicros();
+    int frames = 0;
+    qint64 allocations = 0;
+    // The first pass sizes whatever the controller keeps between batches
+    for (int pass = 0; pass < 2; ++pass) {
+        AllocationCounter counter;
+        for (int variant = 0; variant < VariantCount; ++variant) {
+            for (int message = 0; message < MessageCount; ++message) {
+                CanFrame &frame = batch[frames % BatchSize];
+                frame = CanFrame::make(Messages[message].frameId, 8, timestampUs += 100);
+                frame.bus = static_cast<quint8>(variant & 1);
+                std::memcpy(frame.payload, m_payloads[message][variant].constData(), 8);
+                if (++frames % BatchSize == 0) {
+                    controller.processCanFrames(batch);
+                    // There is no event loop to run the flush here
+                    controller.flushNotifications();
+                }
+            }
+        }
+        allocations = counter.count();
+    }
+
+    QTest::setBenchmarkResult(qreal(allocations) / (VariantCount * MessageCount), QTest::Events);
+    QVERIFY(deltas > 0);
+    QCOMPARE(allocations, qint64(0));
+}
+
+void VehicleSysBench::dbcDecoder_data()
+{
+    QTest::addColumn<bool>("generated");
+    QTest::newRow("runtime table") << false;
+    QTest::newRow("generated") << true;
+}
+
+void VehicleSysBench::dbcDecoder()
+{
+    QFETCH(bool, generated);
+    const auto onSignal = [this](int, double value) { m_sink += value; };
+    int next = 0;
+    if (!generated) {
+        DbcDecoder decoder;
+        QVERIFY2(decoder.loadFile(QStringLiteral(":/dbc/vehicle.dbc")), qPrintable(decoder.errorString()));
+        QBENCHMARK {
+            const CanFrame &frame = m_replay[next];
+            if (const DbcDecoder::MessageDescriptor *msg = decoder.findMessage(frame.frameId, frame.flags & CanFrame::ExtendedId)) {
+                decoder.decode(*msg, frame.payload, frame.length, onSignal);
+            }
+            next = next + 1 < m_replay.size() ? next + 1 : 0;
+        }
+        return;
+    }
+#ifdef HAVE_GENERATED_DBC
+    QBENCHMARK {
+        const CanFrame &frame = m_replay[next];
+        VehicleDbc::decode((frame.flags & CanFrame::ExtendedId) ? frame.frameId | DbcDecoder::ExtendedIdFlag : frame.frameId,
+                           frame.payload, frame.length, onSignal);
+        next = next + 1 < m_replay.size() ? next + 1 : 0;
+    }
+#else
+    QSKIP("Built without VEHICLESYS_GENERATED_DBC");
+#endif
+}
+
+void VehicleSysBench::simulateVehicleData_data()
+{
+    QTest::addColumn<bool>("decoded");
+    QTest::newRow("unconnected") << false;
+    QTest::newRow("decoded") << true;
+}
+
+void VehicleSysBench::simulateVehicleData()
+{
+    QFETCH(bool, decoded);
+    CanBusController bus;
+    VehicleDataController controller;
+    if (decoded) {
+        connect(&bus, &CanBusController::frameBatchReceived, &controller, &VehicleDataController::processCanFrames,
+                Qt::DirectConnection);
+    }
+    QBENCHMARK {
+        bus.simulateVehicleData();
+    }
+}
+
+void VehicleSysBench::notificationFanOut_data()
+{
+    QTest::addColumn<int>("listeners");
+    for (int listeners : { 0, 1, 10, 100 }) {
+        QTest::newRow(qPrintable(QStringLiteral("%1 listeners").arg(listeners))) << listeners;
+    }
+}
+
+void VehicleSysBench::notificationFanOut()
+{
+    QFETCH(int, listeners);
+    VehicleDataController controller;
+    VehicleDataProxy proxy(&controller);
+
+    NotificationCounter counter;
+    const QMetaMethod count = counter.metaObject()->method(counter.metaObject()->indexOfSlot("count()"));
+    const QMetaObject *meta = proxy.metaObject();
+    for (int i = meta->propertyOffset(); i < meta->propertyCount(); ++i) {
+        const QMetaProperty property = meta->property(i);
+        if (!property.hasNotifySignal()) {
+            continue;
+        }
+        for (int listener = 0; listener < listeners; ++listener) {
+            connect(&proxy, property.notifySignal(), &counter, count);
+        }
+    }
+
+    // Delivered through the proxy's own connection, direct on one thread
+    VehicleStateDelta delta = controller.fullState();
+    delta.signalMask = VehicleSignalStore::AllSignals;
+    delta.validMask = delta.signalMask;
+    QBENCHMARK {
+        ++delta.sequence;
+        emit controller.stateChanged(delta);
+    }
+    QVERIFY(listeners == 0 || counter.notifications > 0);
+}
+
+void VehicleSysBench::loadMusicDirectory_data()
+{
+    QTest::addColumn<int>("files");
+    for (int files : { 1000, 10000, 100000 }) {
+        QTest::newRow(qPrintable(QStringLiteral("%1 files").arg(files))) << files;
+    }
+}
+
+void VehicleSysBench::loadMusicDirectory()
+{
+    QFETCH(int, files);
+    QSharedPointer<QTemporaryDir> &library = m_libraries[files];
+    if (!library) {
+        library.reset(new QTemporaryDir);
+        QVERIFY(library->isValid());
+        const QDir dir(library->path());
+        for (int i = 0; i < files; ++i) {
+            QFile file(dir.filePath(QStringLiteral("Artist %1 - Title %2.mp3").arg(i % 97).arg(i)));
+            QVERIFY2(file.open(QIODevice::WriteOnly), qPrintable(file.errorString()));
+        }
+    }
+
+    MediaController media;
+    QBENCHMARK {
+        media.loadMusicDirectory(library->path());
+    }
+}
+
+void VehicleSysBench::trackNameParsing_data()
+{
+    QTest::addColumn<QString>("pattern");
+    QTest::newRow("artist - title") << QStringLiteral("/music/Artist %1 - Title %1.mp3");
+    QTest::newRow("plain name") << QStringLiteral("/music/Track %1.mp3");
+}
+
+// The title and artist a track change parses from the file name, without
+// the player behind it
+void VehicleSysBench::trackNameParsing()
+{
+    QFETCH(QString, pattern);
+    const int tracks = 1000;
+    QStringList paths;
+    paths.reserve(tracks);
+    for (int i = 0; i < tracks; ++i) {
+        paths.append(pattern.arg(i));
+    }
+
+    int next = 0;
+    qint64 characters = 0;
+    QBENCHMARK {
+        const QString &path = paths.at(next);
+        characters += MediaController::getFileTitle(path).size() + MediaController::getFileArtist(path).size();
+        next = next + 1 < tracks ? next + 1 : 0;
+    }
+    QVERIFY(characters > 0);
+}
+
+namespace {
+
+// Turns QtTest's XML log into the --json records
+bool writeJson(const QString &xmlPath, const QString &jsonPath, QString *error)
+{
+    QFile xml(xmlPath);
+    if (!xml.open(QIODevice::ReadOnly)) {
+        *error = xml.errorString();
+        return false;
+    }
+
+    QVariantList results;
+    QString function;
+    QXmlStreamReader reader(&xml);
+    while (!reader.atEnd()) {
+        if (reader.readNext() != QXmlStreamReader::StartElement) {
+            continue;
+        }
+        const QXmlStreamAttributes attributes = reader.attributes();
+        if (reader.name() == QLatin1String("TestFunction")) {
+            function = attributes.value(QLatin1String("name")).toString();
+        } else if (reader.name() == QLatin1String("BenchmarkResult")) {
+            // value is the total over all iterations
+            const qint64 iterations = qMax<qint64>(1, attributes.value(QLatin1String("iterations")).toLongLong());
+            QVariantMap result;
+            result.insert(QStringLiteral("function"), function);
+            result.insert(QStringLiteral("tag"), attributes.value(QLatin1String("tag")).toString());
+            result.insert(QStringLiteral("metric"), attributes.value(QLatin1String("metric")).toString());
+            result.insert(QStringLiteral("value"), attributes.value(QLatin1String("value")).toDouble() / iterations);
+            result.insert(QStringLiteral("iterations"), iterations);
+            results.append(result);
+        }
+    }
+    if (reader.hasError()) {
+        *error = reader.errorString();
+        return false;
+    }
+
+    QVariantMap document;
+    document.insert(QStringLiteral("suite"), QStringLiteral("VehicleSysBench"));
+    document.insert(QStringLiteral("qtVersion"), QString::fromLatin1(qVersion()));
+    document.insert(QStringLiteral("timestamp"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+#ifdef HAVE_GENERATED_DBC
+    document.insert(QStringLiteral("generatedDbc"), true);
+#else
+    document.insert(QStringLiteral("generatedDbc"), false);
+#endif
+#ifdef VEHICLESYS_TRACING
+    document.insert(QStringLiteral("tracing"), true);
+#else
+    document.insert(QStringLiteral("tracing"), false);
+#endif
+    document.insert(QStringLiteral("results"), results);
+
+    QSaveFile json(jsonPath);
+    if (!json.open(QIODevice::WriteOnly)) {
+        *error = json.errorString();
+        return false;
+    }
+    json.write(QJsonDocument::fromVariant(document).toJson());
+    if (!json.commit()) {
+        *error = json.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // The controllers log every library they load and every connection
+    QLoggingCategory::setFilterRules(QStringLiteral("default.debug=false"));
+
+    QStringList arguments = app.arguments();
+    const int jsonIndex = arguments.indexOf(QStringLiteral("--json"));
+    QString jsonPath;
+    if (jsonIndex > 0) {
+        if (jsonIndex + 1 >= arguments.size()) {
+            qWarning("usage: VehicleSysBench [--json <path>] [QtTest options] [function[:tag]...]");
+            return 2;
+        }
+        jsonPath = arguments.takeAt(jsonIndex + 1);
+        arguments.removeAt(jsonIndex);
+    }
+
+    VehicleSysBench bench;
+    if (jsonPath.isEmpty()) {
+        return QTest::qExec(&bench, arguments);
+    }
+
+    QTemporaryFile xml(QDir::temp().filePath(QStringLiteral("vehiclesysbench-XXXXXX.xml")));
+    if (!xml.open()) {
+        qWarning("Cannot create %s: %s", qPrintable(xml.fileTemplate()), qPrintable(xml.errorString()));
+        return 1;
+    }
+    xml.close();
+    arguments << QStringLiteral("-o") << xml.fileName() + QStringLiteral(",xml")
+              << QStringLiteral("-o") << QStringLiteral("-,txt");
+    const int status = QTest::qExec(&bench, arguments);
+
+    QString error;
+    if (!writeJson(xml.fileName(), jsonPath, &error)) {
+        qWarning("Cannot write %s: %s", qPrintable(jsonPath), qPrintable(error));
+        return status ? status : 1;
+    }
+    return status;
+}
+
+#include "vehiclesysbench.moc"
@@ -6,9 +6,18 @@ Rectangle {
     height: 200
     color: "transparent"
 
-    property int speed: vehicleData.speed
+    property real speed: vehicleData.speed
     property int maxSpeed: 160
-    property real needleAngle: (speed / maxSpeed) * 240 - 120 // -120 to +120 degrees
+    // Needle follows the estimate at presentation time, updated every frame
+    property real needleSpeed: speed
+    property real needleAngle: (needleSpeed / maxSpeed) * 240 - 120 // -120 to +120 degrees
+
+    Connections {
+        target: vehicleData
+        function onEstimatesChanged() {
+            speedometer.needleSpeed = vehicleData.signalEstimate("speed")
+        }
+    }
 
     Canvas {
         id: speedometerCanvas
@@ -84,10 +93,6 @@ Rectangle {
         anchors.bottom: parent.verticalCenter
         transformOrigin: Item.Bottom
         rotation: needleAngle
-        
-        Behavior on rotation {
-            SmoothedAnimation { duration: 300 }
-        }
     }
     
     // Digital speed display
@@ -104,7 +109,7 @@ Rectangle {
         
         Text {
             anchors.centerIn: parent
-            text: speed + " km/h"
+            text: Math.round(speed) + " km/h"
             color: "#00ff00"
             font.pixelSize: 12
             font.family: "monospace"
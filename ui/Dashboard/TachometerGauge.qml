@@ -6,9 +6,18 @@ Rectangle {
     height: 180
     color: "transparent"
 
-    property int rpm: vehicleData.rpm
+    property real rpm: vehicleData.rpm
     property int maxRpm: 7000
-    property real needleAngle: (rpm / maxRpm) * 240 - 120 // -120 to +120 degrees
+    // Needle follows the estimate at presentation time, updated every frame
+    property real needleRpm: rpm
+    property real needleAngle: (needleRpm / maxRpm) * 240 - 120 // -120 to +120 degrees
+
+    Connections {
+        target: vehicleData
+        function onEstimatesChanged() {
+            tachometer.needleRpm = vehicleData.signalEstimate("rpm")
+        }
+    }
 
     Canvas {
         id: tachometerCanvas
@@ -96,10 +105,6 @@ Rectangle {
         transformOrigin: Item.Bottom
         rotation: needleAngle
         
-        Behavior on rotation {
-            SmoothedAnimation { duration: 200 }
-        }
-        
         Behavior on color {
             ColorAnimation { duration: 150 }
         }
@@ -130,7 +135,7 @@ Rectangle {
         
         Text {
             anchors.centerIn: parent
-            text: rpm.toString()
+            text: Math.round(rpm).toString()
             color: rpm > 6000 ? "#ff4444" : "#00ff00"
             font.pixelSize: 11
             font.family: "monospace"
@@ -144,7 +144,7 @@ Rectangle {
 
                     // Engine warning
                     WarningLight {
-                        active: vehicleData.engineTemperature > 105
+                        warning: "engineOverheat"
                         lightColor: "#ff4444"
                         symbol: "🌡"
                         blinking: false
@@ -152,15 +152,15 @@ Rectangle {
 
                     // Low fuel warning
                     WarningLight {
-                        active: vehicleData.fuelLevel < 20
+                        warning: "fuelLow"
                         lightColor: "#ffaa00"
                         symbol: "⛽"
-                        blinking: vehicleData.fuelLevel < 10
+                        blinking: vehicleData.activeWarnings.indexOf("lowFuel") >= 0
                     }
 
                     // Battery warning
                     WarningLight {
-                        active: vehicleData.batteryVoltage < 12
+                        warning: "batteryLow"
                         lightColor: "#ff4444"
                         symbol: "🔋"
                         blinking: false
@@ -184,7 +184,7 @@ Rectangle {
 
                     // Seatbelt
                     WarningLight {
-                        active: !vehicleData.seatbelt && vehicleData.engineRunning
+                        warning: "seatbelt"
                         lightColor: "#ff4444"
                         symbol: "🔗"
                         blinking: true
@@ -195,7 +195,7 @@ Rectangle {
             // Vehicle status information
             Rectangle {
                 width: 280
-                height: 120
+                height: 140
                 color: "#1a1a1a"
                 radius: 8
                 border.color: "#333"
@@ -228,6 +228,22 @@ Rectangle {
                         }
                     }
 
+                    Row {
+                        spacing: 20
+                        Text {
+                            text: "Range:"
+                            color: "#aaa"
+                            font.pixelSize: 12
+                        }
+                        Text {
+                            text: tripComputer.range.toFixed(0) + " km  "
+                                  + tripComputer.tripA.averageConsumption.toFixed(1) + " L/100km"
+                            color: tripComputer.range < 50 ? "#ffaa00" : "#fff"
+                            font.pixelSize: 12
+                            font.family: "monospace"
+                        }
+                    }
+
                     Row {
                         spacing: 20
                         Text {
@@ -236,7 +252,7 @@ Rectangle {
                             font.pixelSize: 12
                         }
                         Text {
-                            text: vehicleData.batteryVoltage + "V"
+                            text: vehicleData.batteryVoltage.toFixed(1) + "V"
                             color: vehicleData.batteryVoltage < 12 ? "#ff4444" : "#00aa44"
                             font.pixelSize: 12
                             font.family: "monospace"
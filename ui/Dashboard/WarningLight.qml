@@ -9,7 +9,9 @@ Rectangle {
     border.color: active ? Qt.lighter(lightColor, 1.3) : "#444"
     border.width: 1
 
-    property bool active: false
+    // Name of a warning rule; the light is on while it is
+    property string warning: ""
+    property bool active: warning.length > 0 && vehicleData.activeWarnings.indexOf(warning) >= 0
     property color lightColor: "#ff4444"
     property string symbol: "⚠"
     property bool blinking: false
@@ -33,6 +35,13 @@ Rectangle {
         }
     }
 
+    // Tapping a latched warning acknowledges it
+    MouseArea {
+        anchors.fill: parent
+        enabled: warning.length > 0
+        onClicked: vehicleData.acknowledgeWarning(warning)
+    }
+
     // Blinking animation for critical warnings
     SequentialAnimation {
         id: blinkAnimation